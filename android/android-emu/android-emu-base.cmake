@@ -32,6 +32,7 @@ android_add_library(
       android/base/StringParse.cpp
       android/base/StringView.cpp
       android/base/SubAllocator.cpp
+      android/base/TraceRecorder.cpp
       android/base/Tracing.cpp
       android/base/Uri.cpp
       android/base/Uuid.cpp
@@ -183,6 +184,7 @@ android_target_compile_options(android-emu-base windows_msvc-x86_64
 android_add_executable(
   TARGET android-emu_benchmark NODISTRIBUTE
   SRC # cmake-format: sortable
+      android/base/ring_buffer_benchmark.cpp
       android/base/synchronization/Lock_benchmark.cpp)
 target_link_libraries(android-emu_benchmark PRIVATE android-emu-base
                                                     emulator-gbench)
@@ -210,14 +210,16 @@ set(android-emu-common
     android/shaper.c
     android/snaphost-android.c
     android/snapshot.c
+    android/snapshot/AccessTrace.cpp
+    android/snapshot/Codec.cpp
     android/snapshot/common.cpp
     android/snapshot/Compressor.cpp
-    android/snapshot/Decompressor.cpp
     android/snapshot/GapTracker.cpp
     android/snapshot/IncrementalStats.cpp
     android/snapshot/interface.cpp
     android/snapshot/Loader.cpp
     android/snapshot/MemoryWatch_common.cpp
+    android/snapshot/PageStore.cpp
     android/snapshot/PathUtils.cpp
     android/snapshot/Hierarchy.cpp
     android/snapshot/Quickboot.cpp
@@ -229,6 +231,7 @@ set(android-emu-common
     android/snapshot/Snapshotter.cpp
     android/snapshot/TextureLoader.cpp
     android/snapshot/TextureSaver.cpp
+    android/snapshot/ZeroCheck.cpp
     android/telephony/debug.c
     android/telephony/gsm.c
     android/telephony/modem.c
@@ -381,6 +384,7 @@ target_link_libraries(
          LibXml2::LibXml2
          png
          lz4
+         zstd
          zlib
          android-hw-config)
 
@@ -554,14 +558,16 @@ set(android-emu-min
     android/protobuf/LoadSave.cpp
     android/snaphost-android.c
     android/snapshot.c
+    android/snapshot/AccessTrace.cpp
+    android/snapshot/Codec.cpp
     android/snapshot/common.cpp
     android/snapshot/Compressor.cpp
-    android/snapshot/Decompressor.cpp
     android/snapshot/GapTracker.cpp
     android/snapshot/IncrementalStats.cpp
     android/snapshot/interface.cpp
     android/snapshot/Loader.cpp
     android/snapshot/MemoryWatch_common.cpp
+    android/snapshot/PageStore.cpp
     android/snapshot/PathUtils.cpp
     android/snapshot/Hierarchy.cpp
     android/snapshot/Quickboot.cpp
@@ -573,6 +579,7 @@ set(android-emu-min
     android/snapshot/Snapshotter.cpp
     android/snapshot/TextureLoader.cpp
     android/snapshot/TextureSaver.cpp
+    android/snapshot/ZeroCheck.cpp
     android/uncompress.cpp
     android/user-config.cpp
     android/utils/looper.cpp
@@ -618,6 +625,7 @@ target_link_libraries(
          # Prebuilt libraries
          png
          lz4
+         zstd
          zlib
          android-hw-config)
 # Here are the windows library and link dependencies. They are public and will
@@ -797,6 +805,8 @@ android_add_test(
       android/base/threads/ParallelTask_unittest.cpp
       android/base/threads/Thread_unittest.cpp
       android/base/threads/ThreadStore_unittest.cpp
+      android/base/threads/WorkStealingThreadPool_unittest.cpp
+      android/base/TraceRecorder_unittest.cpp
       android/base/TypeTraits_unittest.cpp
       android/base/Uri_unittest.cpp
       android/base/Uuid_unittest.cpp
@@ -818,6 +828,7 @@ android_add_test(
       android/emulation/android_pipe_pingpong_unittest.cpp
       android/emulation/android_pipe_zero_unittest.cpp
       android/emulation/AndroidAsyncMessagePipe_unittest.cpp
+      android/emulation/AndroidPipe_unittest.cpp
       android/emulation/bufprint_config_dirs_unittest.cpp
       android/emulation/ComponentVersion_unittest.cpp
       android/emulation/ConfigDirs_unittest.cpp
@@ -882,10 +893,15 @@ android_add_test(
       android/proxy/ProxyUtils_unittest.cpp
       android/qt/qt_path_unittest.cpp
       android/qt/qt_setup_unittest.cpp
+      android/snapshot/AccessTrace_unittest.cpp
+      android/snapshot/Codec_unittest.cpp
+      android/snapshot/GapTracker_unittest.cpp
       android/snapshot/RamLoader_unittest.cpp
       android/snapshot/RamSaver_unittest.cpp
       android/snapshot/RamSnapshot_unittest.cpp
       android/snapshot/Snapshot_unittest.cpp
+      android/snapshot/TextureLoader_unittest.cpp
+      android/snapshot/ZeroCheck_unittest.cpp
       android/telephony/gsm_unittest.cpp
       android/telephony/modem_unittest.cpp
       android/telephony/sms_unittest.cpp
@@ -946,6 +962,42 @@ target_link_libraries(
   android-emu_unittests PRIVATE android-emu android-mock-vm-operations gtest
                                 gmock gtest_main)
 
+# Snapshot codec and RAM scan benchmarks, see Codec_benchmark.cpp and
+# ZeroCheck_benchmark.cpp for the options.
+android_add_executable(
+  TARGET android-emu-snapshot_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/snapshot/Codec_benchmark.cpp
+      android/snapshot/ZeroCheck_benchmark.cpp)
+target_link_libraries(android-emu-snapshot_benchmark PRIVATE android-emu
+                                                             emulator-gbench)
+
+# ThreadPool against WorkStealingThreadPool on uniform and skewed work items.
+android_add_executable(
+  TARGET android-emu-threadpool_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/base/threads/ThreadPool_benchmark.cpp)
+target_link_libraries(android-emu-threadpool_benchmark PRIVATE android-emu
+                                                               emulator-gbench)
+
+# DefaultLooper with 10k timers and thousands of fd watches, for each
+# SocketWaiter backend.
+android_add_executable(
+  TARGET android-emu-looper_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/base/async/Looper_benchmark.cpp)
+target_link_libraries(android-emu-looper_benchmark PRIVATE android-emu
+                                                           emulator-gbench)
+
+# Pipe bandwidth through the 'zero' and 'pingpong' services, and guest write
+# latency with a slow service.
+android_add_executable(
+  TARGET android-emu-pipe_benchmark NODISTRIBUTE
+  SRC # cmake-format: sortable
+      android/emulation/AndroidPipe_benchmark.cpp
+      android/emulation/testing/TestAndroidPipeDevice.cpp)
+target_link_libraries(android-emu-pipe_benchmark PRIVATE android-emu
+                                                         emulator-gbench)
 
 android_add_executable(
   NODISTRIBUTE TARGET studio_discovery_tester
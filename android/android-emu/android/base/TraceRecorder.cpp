@@ -0,0 +1,482 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/base/TraceRecorder.h"
+
+#include "android/base/files/ScopedStdioFile.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/base/threads/Thread.h"
+#include "android/base/threads/ThreadStore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <inttypes.h>
+#include <memory>
+#include <stdio.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace android {
+namespace base {
+
+namespace internal {
+std::atomic<bool> gTraceRecording{false};
+}  // namespace internal
+
+namespace {
+
+enum class EventType : uint8_t { Begin, End, Counter };
+
+// Past this many distinct names, traceRecordBeginCopy() records a
+// placeholder instead, so a guest can't grow a buffer without bounds.
+constexpr size_t kMaxCopiedNames = 1024;
+constexpr char kTooManyNames[] = "(too many names)";
+
+struct Event {
+    uint64_t timeNs;
+    const char* name;
+    int64_t value;
+    EventType type;
+};
+
+// Written by its thread only; read by exportTrace() from any thread. The
+// writer publishes each event by bumping |writeIndex|, and the reader drops
+// whatever was overwritten while it copied the events out.
+struct ThreadBuffer {
+    ThreadBuffer(size_t size, uint64_t generation)
+        : events(size), mask(size - 1), generation(generation) {}
+
+    std::vector<Event> events;
+    const size_t mask;
+    const uint64_t generation;
+    std::atomic<uint64_t> writeIndex{0};
+    int64_t tid = 0;
+    std::string threadName;
+    // Names copied by traceRecordBeginCopy(), added to by the writer only.
+    // Events point into it, so they stay valid as long as the buffer.
+    std::unordered_set<std::string> copiedNames;
+};
+
+struct ThreadBufferHolder {
+    std::shared_ptr<ThreadBuffer> buffer;
+};
+
+struct TraceRecorderState {
+    Lock lock;
+    // Buffers of the current recording, guarded by |lock|.
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    size_t eventsPerThread = 0;
+    std::atomic<uint64_t> generation{0};
+    // Keeps a buffer alive while its thread writes to it, even after a new
+    // recording dropped it from |buffers|.
+    ThreadStore<ThreadBufferHolder> threadBuffers;
+};
+
+LazyInstance<TraceRecorderState> sState = LAZY_INSTANCE_INIT;
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+int64_t currentTid() {
+#ifdef __linux__
+    return static_cast<int64_t>(syscall(SYS_gettid));
+#else
+    return static_cast<int64_t>(getCurrentThreadId());
+#endif
+}
+
+std::string currentThreadName() {
+#ifdef _WIN32
+    return {};
+#else
+    char name[64] = {};
+    if (pthread_getname_np(pthread_self(), name, sizeof(name)) != 0) {
+        return {};
+    }
+    return name;
+#endif
+}
+
+ThreadBuffer* currentThreadBuffer() {
+    TraceRecorderState& state = sState.get();
+    auto holder = state.threadBuffers.get();
+    if (!holder) {
+        holder = new ThreadBufferHolder();
+        state.threadBuffers.set(holder);
+    }
+    if (!holder->buffer ||
+        holder->buffer->generation !=
+                state.generation.load(std::memory_order_acquire)) {
+        // First event of this thread in this recording.
+        AutoLock lock(state.lock);
+        auto buffer = std::make_shared<ThreadBuffer>(
+                state.eventsPerThread,
+                state.generation.load(std::memory_order_relaxed));
+        buffer->tid = currentTid();
+        buffer->threadName = currentThreadName();
+        state.buffers.push_back(buffer);
+        holder->buffer = std::move(buffer);
+    }
+    return holder->buffer.get();
+}
+
+void record(ThreadBuffer* buffer,
+            EventType type,
+            const char* name,
+            int64_t value) {
+    const uint64_t index = buffer->writeIndex.load(std::memory_order_relaxed);
+    buffer->events[index & buffer->mask] = {nowNs(), name, value, type};
+    buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+void record(EventType type, const char* name, int64_t value) {
+    if (!isTraceRecording()) {
+        return;
+    }
+    record(currentThreadBuffer(), type, name, value);
+}
+
+// The events still in |buffer|, oldest first, without the ends of slices
+// whose beginning got overwritten.
+std::vector<Event> snapshotEvents(const ThreadBuffer& buffer) {
+    const uint64_t size = buffer.events.size();
+    const uint64_t end = buffer.writeIndex.load(std::memory_order_acquire);
+    const uint64_t begin = end > size ? end - size : 0;
+    std::vector<Event> events;
+    events.reserve(end - begin);
+    for (uint64_t i = begin; i < end; ++i) {
+        events.push_back(buffer.events[i & buffer.mask]);
+    }
+
+    // Anything the writer lapped while we were copying may be torn, and so
+    // may event |newEnd|, which shares its slot with |newEnd - size| and can
+    // be half written.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t newEnd = buffer.writeIndex.load(std::memory_order_relaxed);
+    const uint64_t firstValid = newEnd + 1 > size ? newEnd + 1 - size : 0;
+    if (firstValid > begin) {
+        events.erase(events.begin(),
+                     events.begin() +
+                             std::min<uint64_t>(firstValid - begin,
+                                                events.size()));
+    }
+
+    std::vector<Event> result;
+    result.reserve(events.size());
+    int depth = 0;
+    for (const Event& event : events) {
+        if (event.type == EventType::Begin) {
+            ++depth;
+        } else if (event.type == EventType::End) {
+            if (depth == 0) {
+                continue;
+            }
+            --depth;
+        }
+        result.push_back(event);
+    }
+    return result;
+}
+
+std::string jsonString(const char* str) {
+    std::string result = "\"";
+    for (; str && *str; ++str) {
+        const char c = *str;
+        switch (c) {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    result += escaped;
+                } else {
+                    result += c;
+                }
+        }
+    }
+    result += '"';
+    return result;
+}
+
+std::string exportJson(
+        const std::vector<std::shared_ptr<ThreadBuffer>>& buffers,
+        int pid) {
+    std::string out = "{\"traceEvents\":[";
+    bool first = true;
+    char line[256];
+    auto append = [&out, &first](const std::string& event) {
+        if (!first) {
+            out += ",\n";
+        }
+        first = false;
+        out += event;
+    };
+
+    for (const auto& buffer : buffers) {
+        const long long tid = buffer->tid;
+        if (!buffer->threadName.empty()) {
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                     "\"tid\":%lld,\"args\":{\"name\":",
+                     pid, tid);
+            append(line + jsonString(buffer->threadName.c_str()) + "}}");
+        }
+        for (const Event& event : snapshotEvents(*buffer)) {
+            const unsigned long long us = event.timeNs / 1000;
+            const unsigned fraction = event.timeNs % 1000;
+            switch (event.type) {
+                case EventType::Begin:
+                    snprintf(line, sizeof(line),
+                             ",\"ph\":\"B\",\"ts\":%llu.%03u,\"pid\":%d,"
+                             "\"tid\":%lld}",
+                             us, fraction, pid, tid);
+                    append("{\"name\":" + jsonString(event.name) + line);
+                    break;
+                case EventType::End:
+                    snprintf(line, sizeof(line),
+                             "{\"ph\":\"E\",\"ts\":%llu.%03u,\"pid\":%d,"
+                             "\"tid\":%lld}",
+                             us, fraction, pid, tid);
+                    append(line);
+                    break;
+                case EventType::Counter:
+                    snprintf(line, sizeof(line),
+                             ",\"ph\":\"C\",\"ts\":%llu.%03u,\"pid\":%d,"
+                             "\"tid\":%lld,\"args\":{\"value\":%" PRId64 "}}",
+                             us, fraction, pid, tid, event.value);
+                    append("{\"name\":" + jsonString(event.name) + line);
+                    break;
+            }
+        }
+    }
+    out += "],\"displayTimeUnit\":\"ns\"}\n";
+    return out;
+}
+
+// Just enough of the protobuf wire format for the Perfetto trace messages.
+void putVarint(std::string* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+void putVarintField(std::string* out, int field, uint64_t value) {
+    putVarint(out, static_cast<uint64_t>(field) << 3);
+    putVarint(out, value);
+}
+
+void putBytesField(std::string* out, int field, StringView bytes) {
+    putVarint(out, (static_cast<uint64_t>(field) << 3) | 2);
+    putVarint(out, bytes.size());
+    out->append(bytes.data(), bytes.size());
+}
+
+// Field numbers from perfetto/trace/trace_packet.proto and friends.
+enum : int {
+    kTracePacket = 1,                 // Trace
+    kPacketTimestamp = 8,             // TracePacket
+    kPacketSequenceId = 10,           // TracePacket
+    kPacketTrackEvent = 11,           // TracePacket
+    kPacketSequenceFlags = 13,        // TracePacket
+    kPacketTrackDescriptor = 60,      // TracePacket
+    kEventType = 9,                   // TrackEvent
+    kEventTrackUuid = 11,             // TrackEvent
+    kEventName = 23,                  // TrackEvent
+    kEventCounterValue = 30,          // TrackEvent
+    kTrackUuid = 1,                   // TrackDescriptor
+    kTrackName = 2,                   // TrackDescriptor
+    kTrackThread = 4,                 // TrackDescriptor
+    kTrackCounter = 8,                // TrackDescriptor
+    kThreadPid = 1,                   // ThreadDescriptor
+    kThreadTid = 2,                   // ThreadDescriptor
+    kThreadName = 5,                  // ThreadDescriptor
+};
+
+enum : uint64_t {
+    kTypeSliceBegin = 1,
+    kTypeSliceEnd = 2,
+    kTypeCounter = 4,
+    kSeqIncrementalStateCleared = 1,
+};
+
+void putPacket(std::string* out, uint32_t sequenceId, StringView fields) {
+    std::string packet;
+    putVarintField(&packet, kPacketSequenceId, sequenceId);
+    packet.append(fields.data(), fields.size());
+    putBytesField(out, kTracePacket, packet);
+}
+
+std::string exportProtobuf(
+        const std::vector<std::shared_ptr<ThreadBuffer>>& buffers,
+        int pid) {
+    std::string out;
+    // Thread tracks are numbered from 1, counter tracks after them.
+    uint64_t nextCounterUuid = buffers.size() + 1;
+    std::unordered_map<std::string, uint64_t> counterUuids;
+
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        const ThreadBuffer& buffer = *buffers[i];
+        const uint32_t sequenceId = static_cast<uint32_t>(i + 1);
+        const uint64_t threadUuid = i + 1;
+
+        std::string thread;
+        putVarintField(&thread, kThreadPid, static_cast<uint64_t>(pid));
+        putVarintField(&thread, kThreadTid, static_cast<uint64_t>(buffer.tid));
+        if (!buffer.threadName.empty()) {
+            putBytesField(&thread, kThreadName, buffer.threadName);
+        }
+        std::string track;
+        putVarintField(&track, kTrackUuid, threadUuid);
+        putBytesField(&track, kTrackThread, thread);
+        std::string fields;
+        putVarintField(&fields, kPacketSequenceFlags,
+                       kSeqIncrementalStateCleared);
+        putBytesField(&fields, kPacketTrackDescriptor, track);
+        putPacket(&out, sequenceId, fields);
+
+        for (const Event& event : snapshotEvents(buffer)) {
+            std::string trackEvent;
+            switch (event.type) {
+                case EventType::Begin:
+                    putVarintField(&trackEvent, kEventType, kTypeSliceBegin);
+                    putVarintField(&trackEvent, kEventTrackUuid, threadUuid);
+                    putBytesField(&trackEvent, kEventName,
+                                  event.name ? event.name : "");
+                    break;
+                case EventType::End:
+                    putVarintField(&trackEvent, kEventType, kTypeSliceEnd);
+                    putVarintField(&trackEvent, kEventTrackUuid, threadUuid);
+                    break;
+                case EventType::Counter: {
+                    auto it = counterUuids.find(event.name);
+                    if (it == counterUuids.end()) {
+                        it = counterUuids
+                                     .emplace(event.name, nextCounterUuid++)
+                                     .first;
+                        std::string counterTrack;
+                        putVarintField(&counterTrack, kTrackUuid, it->second);
+                        putBytesField(&counterTrack, kTrackName, event.name);
+                        putBytesField(&counterTrack, kTrackCounter, {});
+                        std::string descriptor;
+                        putBytesField(&descriptor, kPacketTrackDescriptor,
+                                      counterTrack);
+                        putPacket(&out, sequenceId, descriptor);
+                    }
+                    putVarintField(&trackEvent, kEventType, kTypeCounter);
+                    putVarintField(&trackEvent, kEventTrackUuid, it->second);
+                    putVarintField(&trackEvent, kEventCounterValue,
+                                   static_cast<uint64_t>(event.value));
+                    break;
+                }
+            }
+            std::string packetFields;
+            putVarintField(&packetFields, kPacketTimestamp, event.timeNs);
+            putBytesField(&packetFields, kPacketTrackEvent, trackEvent);
+            putPacket(&out, sequenceId, packetFields);
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+void startTraceRecording(size_t eventsPerThread) {
+    eventsPerThread = std::min(eventsPerThread, kMaxTraceEventsPerThread);
+    size_t size = 1;
+    while (size < eventsPerThread) {
+        size <<= 1;
+    }
+    TraceRecorderState& state = sState.get();
+    AutoLock lock(state.lock);
+    state.buffers.clear();
+    state.eventsPerThread = size;
+    state.generation.fetch_add(1, std::memory_order_release);
+    internal::gTraceRecording.store(true, std::memory_order_release);
+}
+
+void stopTraceRecording() {
+    internal::gTraceRecording.store(false, std::memory_order_release);
+}
+
+void traceRecordBegin(const char* name) {
+    record(EventType::Begin, name, 0);
+}
+
+void traceRecordBeginCopy(const char* name) {
+    if (!isTraceRecording()) {
+        return;
+    }
+    ThreadBuffer* buffer = currentThreadBuffer();
+    auto& names = buffer->copiedNames;
+    auto it = names.find(name ? name : "");
+    if (it == names.end()) {
+        if (names.size() >= kMaxCopiedNames) {
+            record(buffer, EventType::Begin, kTooManyNames, 0);
+            return;
+        }
+        it = names.emplace(name ? name : "").first;
+    }
+    record(buffer, EventType::Begin, it->c_str(), 0);
+}
+
+void traceRecordEnd() {
+    record(EventType::End, nullptr, 0);
+}
+
+void traceRecordCounter(const char* name, int64_t value) {
+    record(EventType::Counter, name, value);
+}
+
+std::string exportTrace(TraceFormat format) {
+    TraceRecorderState& state = sState.get();
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        AutoLock lock(state.lock);
+        buffers = state.buffers;
+    }
+    const int pid = static_cast<int>(System::get()->getCurrentProcessId());
+    return format == TraceFormat::Json ? exportJson(buffers, pid)
+                                       : exportProtobuf(buffers, pid);
+}
+
+bool exportTraceToFile(StringView path, TraceFormat format) {
+    const std::string trace = exportTrace(format);
+    ScopedStdioFile file(fopen(std::string(path).c_str(), "wb"));
+    return file && fwrite(trace.data(), 1, trace.size(), file.get()) ==
+                           trace.size();
+}
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,80 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "android/base/StringView.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// In-process recorder for the AEMU_SCOPED_TRACE slices (see Tracing.h) and
+// for counters, to get a timeline of all the emulator threads at once.
+//
+// While recording, each thread appends its events to a ring buffer of its
+// own, without locks, so that the oldest events are overwritten once it's
+// full. The buffers can be exported at any time, as Chrome trace JSON or as
+// a Perfetto protobuf trace; both open in ui.perfetto.dev.
+//
+// The console 'trace' command drives it.
+
+namespace android {
+namespace base {
+
+enum class TraceFormat {
+    Json,      // Chrome trace event format.
+    Protobuf,  // Perfetto TracePacket stream.
+};
+
+namespace internal {
+extern std::atomic<bool> gTraceRecording;
+}  // namespace internal
+
+inline bool isTraceRecording() {
+    return internal::gTraceRecording.load(std::memory_order_relaxed);
+}
+
+// Each event takes 32 bytes, for every thread that records any.
+constexpr size_t kMaxTraceEventsPerThread = 4 * 1024 * 1024;
+
+// Starts recording, with room for |eventsPerThread| events in each thread
+// (rounded up to a power of two, at most kMaxTraceEventsPerThread). Drops
+// the events of the previous recording, if any.
+void startTraceRecording(size_t eventsPerThread = 64 * 1024);
+// Stops recording; the events recorded so far can still be exported.
+void stopTraceRecording();
+
+// |name| must outlive the recording, e.g. be a string literal.
+void traceRecordBegin(const char* name);
+// Same for a |name| that may not, e.g. one from the guest: it's copied
+// into the thread's buffer, up to a limit of distinct names per thread.
+void traceRecordBeginCopy(const char* name);
+void traceRecordEnd();
+void traceRecordCounter(const char* name, int64_t value);
+
+// Writes the recorded events out, oldest first.
+std::string exportTrace(TraceFormat format);
+bool exportTraceToFile(StringView path, TraceFormat format);
+
+}  // namespace base
+}  // namespace android
+
+// Records a counter value, e.g. a queue depth, if recording.
+#define AEMU_TRACE_COUNTER(name, value)                          \
+    do {                                                         \
+        if (android::base::isTraceRecording()) {                 \
+            android::base::traceRecordCounter((name), (value));  \
+        }                                                        \
+    } while (0)
@@ -0,0 +1,132 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/TraceRecorder.h"
+
+#include "android/base/Tracing.h"
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+namespace android {
+namespace base {
+
+static size_t countOf(const std::string& str, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = str.find(needle); pos != std::string::npos;
+         pos = str.find(needle, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+TEST(TraceRecorder, NotRecording) {
+    startTraceRecording();
+    stopTraceRecording();
+    EXPECT_FALSE(isTraceRecording());
+    {
+        AEMU_SCOPED_TRACE("notRecorded");
+    }
+    EXPECT_EQ(std::string::npos,
+              exportTrace(TraceFormat::Json).find("notRecorded"));
+}
+
+TEST(TraceRecorder, Json) {
+    startTraceRecording();
+    {
+        AEMU_SCOPED_TRACE("outer");
+        AEMU_TRACE_COUNTER("depth", 42);
+        {
+            AEMU_SCOPED_TRACE("in\"ner");
+        }
+    }
+    FunctorThread thread([] { AEMU_SCOPED_TRACE("otherThread"); });
+    thread.start();
+    thread.wait();
+    stopTraceRecording();
+
+    const std::string json = exportTrace(TraceFormat::Json);
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, json.find("{\"name\":\"outer\",\"ph\":\"B\""));
+    EXPECT_NE(std::string::npos,
+              json.find("{\"name\":\"in\\\"ner\",\"ph\":\"B\""));
+    EXPECT_NE(std::string::npos, json.find("{\"name\":\"otherThread\""));
+    EXPECT_NE(std::string::npos,
+              json.find("\"ph\":\"C\"", json.find("\"depth\"")));
+    EXPECT_NE(std::string::npos, json.find("\"args\":{\"value\":42}"));
+    EXPECT_EQ(3u, countOf(json, "\"ph\":\"B\""));
+    EXPECT_EQ(3u, countOf(json, "\"ph\":\"E\""));
+}
+
+// Once the ring buffer wraps, slice ends whose beginning got overwritten
+// are dropped.
+TEST(TraceRecorder, RingBufferWraps) {
+    startTraceRecording(4);
+    beginTrace("first");
+    for (int i = 0; i < 3; ++i) {
+        AEMU_SCOPED_TRACE("repeated");
+    }
+    endTrace();
+    stopTraceRecording();
+
+    // The oldest of the last four events is dropped, as a writer could be
+    // overwriting it; the other three are a whole "repeated" and the end of
+    // "first", and only the whole slice is left.
+    const std::string json = exportTrace(TraceFormat::Json);
+    EXPECT_EQ(std::string::npos, json.find("first"));
+    EXPECT_EQ(1u, countOf(json, "{\"name\":\"repeated\",\"ph\":\"B\""));
+    EXPECT_EQ(1u, countOf(json, "\"ph\":\"B\""));
+    EXPECT_EQ(1u, countOf(json, "\"ph\":\"E\""));
+}
+
+// beginTrace() names, as the guest's atrace ones, don't have to outlive
+// the call.
+TEST(TraceRecorder, CopiedNames) {
+    startTraceRecording();
+    for (int i = 0; i < 2000; ++i) {
+        std::string name = "guest" + std::to_string(i);
+        beginTrace(name.c_str());
+        name.assign(name.size(), 'x');
+        endTrace();
+    }
+    stopTraceRecording();
+
+    const std::string json = exportTrace(TraceFormat::Json);
+    EXPECT_EQ(std::string::npos, json.find("xxxx"));
+    EXPECT_EQ(1u, countOf(json, "{\"name\":\"guest0\",\"ph\":\"B\""));
+    EXPECT_EQ(1u, countOf(json, "{\"name\":\"guest1023\",\"ph\":\"B\""));
+    EXPECT_EQ(0u, countOf(json, "\"guest1024\""));
+    EXPECT_EQ(976u, countOf(json, "{\"name\":\"(too many names)\""));
+}
+
+TEST(TraceRecorder, Protobuf) {
+    startTraceRecording();
+    {
+        AEMU_SCOPED_TRACE("slice");
+        AEMU_TRACE_COUNTER("counter", 7);
+    }
+    stopTraceRecording();
+
+    const std::string proto = exportTrace(TraceFormat::Protobuf);
+    ASSERT_FALSE(proto.empty());
+    // A stream of Trace.packet fields, i.e. tag 1, length delimited.
+    EXPECT_EQ('\x0a', proto[0]);
+    EXPECT_NE(std::string::npos, proto.find("slice"));
+    EXPECT_NE(std::string::npos, proto.find("counter"));
+}
+
+}  // namespace base
+}  // namespace android
@@ -14,6 +14,7 @@
 // limitations under the License.
 #include "android/base/Tracing.h"
 
+#include "android/base/TraceRecorder.h"
 #include "android/base/system/System.h"
 #include "android/base/memory/LazyInstance.h"
 #include "android/base/threads/Thread.h"
@@ -248,48 +249,73 @@ bool shouldEnableTracing() {
 #endif
 
 void ScopedTrace::beginTraceImpl(const char* name) {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordBegin(name);
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_begin(name);
     }
 }
 
 void ScopedTrace::endTraceImpl(const char*) {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordEnd();
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_end();
     }
 }
 
 void beginTrace(const char* name) {
+    // Unlike the scoped traces, |name| may come from the guest.
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordBeginCopy(name);
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_begin(name);
     }
 }
 
 void endTrace() {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordEnd();
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         indentTrace_end();
     }
 }
 
 void ScopedThresholdTrace::beginTraceImpl(const char* name, uint64_t thresholdUs) {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordBegin(name);
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_begin(name, thresholdUs);
     }
 }
 
 void ScopedThresholdTrace::endTraceImpl(const char*) {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordEnd();
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_end();
     }
 }
 
 void beginThresholdTrace(const char* name, uint64_t thresholdUs) {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordBeginCopy(name);
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_begin(name, thresholdUs);
     }
 }
 
 void endThresholdTrace() {
+    if (CC_UNLIKELY(isTraceRecording())) {
+        traceRecordEnd();
+    }
     if (CC_UNLIKELY(shouldEnableTracing())) {
         thresholdTrace_end();
     }
@@ -17,7 +17,7 @@
 #include <inttypes.h>
 
 // Library to perform tracing. Talks to platform-specific
-// tracing libraries.
+// tracing libraries, and to the in-process recorder (TraceRecorder.h).
 namespace android {
 namespace base {
 
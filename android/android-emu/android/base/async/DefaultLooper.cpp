@@ -18,10 +18,39 @@
 #include <algorithm>
 #include <utility>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 namespace android {
 namespace base {
 
-DefaultLooper::DefaultLooper() : mWaiter(SocketWaiter::create()) {}
+namespace {
+
+int lowestSetBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+int highestSetBit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+}  // namespace
+
+DefaultLooper::DefaultLooper(SocketWaiter::Backend backend)
+    : mWaiter(SocketWaiter::create(backend)) {}
 
 DefaultLooper::~DefaultLooper() {
     // Both FdWatch and Timer delete themselves from pending/active lists and
@@ -31,7 +60,7 @@ DefaultLooper::~DefaultLooper() {
         delete mFdWatches.begin()->first;
     }
     while (!mTimers.empty()) {
-        delete mTimers.begin()->first;
+        delete *mTimers.begin();
     }
 }
 
@@ -56,10 +85,18 @@ void DefaultLooper::forceQuit() {
 
 void DefaultLooper::addFdWatch(DefaultLooper::FdWatch* watch) {
     mFdWatches.emplace(watch, mPendingFdWatches.end());
+    mFdWatchesByFd.emplace(watch->fd(), watch);
 }
 
 void DefaultLooper::delFdWatch(DefaultLooper::FdWatch* watch) {
     mFdWatches.erase(watch);
+    const auto range = mFdWatchesByFd.equal_range(watch->fd());
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == watch) {
+            mFdWatchesByFd.erase(it);
+            break;
+        }
+    }
 }
 
 void DefaultLooper::addPendingFdWatch(DefaultLooper::FdWatch* watch) {
@@ -82,7 +119,7 @@ Looper::FdWatch* DefaultLooper::createFdWatch(int fd,
 }
 
 void DefaultLooper::addTimer(DefaultLooper::Timer* timer) {
-    mTimers.emplace(timer, mPendingTimers.end());
+    mTimers.insert(timer);
 }
 
 void DefaultLooper::delTimer(DefaultLooper::Timer* timer) {
@@ -90,26 +127,145 @@ void DefaultLooper::delTimer(DefaultLooper::Timer* timer) {
 }
 
 void DefaultLooper::enableTimer(DefaultLooper::Timer* timer) {
-    // Find the first timer that expires after this one.
-    const auto deadline = timer->deadline();
-    const auto it = std::find_if(
-            mActiveTimers.begin(), mActiveTimers.end(),
-            [deadline](const Timer* t) { return t->deadline() > deadline; });
-    mTimers[timer] = mActiveTimers.insert(it, timer);
+    timer->mSequence = mNextTimerSequence++;
+    placeTimer(timer, nullptr);
+    ++mActiveTimerCount;
 }
 
 void DefaultLooper::disableTimer(DefaultLooper::Timer* timer) {
-    // Simply remove from the list.
-    mActiveTimers.erase(mTimers[timer]);
+    unlinkTimer(timer);
+    --mActiveTimerCount;
 }
 
 void DefaultLooper::addPendingTimer(DefaultLooper::Timer* timer) {
-    mPendingTimers.push_back(timer);
-    mTimers[timer] = std::prev(mPendingTimers.end());
+    // Active timers become pending when they expire.
+    mPendingTimers.splice(mPendingTimers.end(), *timer->mList,
+                          timer->mListIt);
+    timer->mList = &mPendingTimers;
+    timer->mWheelLevel = -1;
+    --mActiveTimerCount;
 }
 
 void DefaultLooper::delPendingTimer(DefaultLooper::Timer* timer) {
-    mPendingTimers.erase(mTimers[timer]);
+    unlinkTimer(timer);
+}
+
+void DefaultLooper::placeTimer(DefaultLooper::Timer* timer, TimerList* from) {
+    TimerList* list;
+    const Duration deadline = timer->deadline();
+    if (deadline <= static_cast<Duration>(mTimerWheelTime)) {
+        list = &mExpiredTimers;
+        timer->mWheelLevel = -1;
+    } else {
+        const uint64_t time = static_cast<uint64_t>(deadline);
+        const int level =
+                highestSetBit(time ^ mTimerWheelTime) / kTimerWheelBits;
+        const int slot = static_cast<int>(
+                (time >> (level * kTimerWheelBits)) & (kTimerWheelSlots - 1));
+        TimerWheelLevel& wheelLevel = mTimerWheel[level];
+        list = &wheelLevel.slots[slot];
+        wheelLevel.occupied |= uint64_t(1) << slot;
+        timer->mWheelLevel = level;
+        timer->mWheelSlot = slot;
+    }
+
+    if (from) {
+        list->splice(list->end(), *from, timer->mListIt);
+    } else {
+        timer->mListIt = list->insert(list->end(), timer);
+    }
+    timer->mList = list;
+}
+
+void DefaultLooper::unlinkTimer(DefaultLooper::Timer* timer) {
+    timer->mList->erase(timer->mListIt);
+    if (timer->mWheelLevel >= 0 && timer->mList->empty()) {
+        mTimerWheel[timer->mWheelLevel].occupied &=
+                ~(uint64_t(1) << timer->mWheelSlot);
+    }
+    timer->mList = nullptr;
+    timer->mWheelLevel = -1;
+}
+
+void DefaultLooper::advanceTimerWheel(Looper::Duration nowMs) {
+    const uint64_t to = static_cast<uint64_t>(nowMs);
+    const uint64_t from = mTimerWheelTime;
+    if (nowMs < 0 || to == from) {
+        return;
+    }
+    TimerList cascading;
+    if (to < from) {
+        // The host clock went back; start over from the new time.
+        for (auto& level : mTimerWheel) {
+            for (auto& slot : level.slots) {
+                cascading.splice(cascading.end(), slot);
+            }
+            level.occupied = 0;
+        }
+        cascading.splice(cascading.end(), mExpiredTimers);
+    } else {
+        for (int level = 0; level < kTimerWheelLevels; ++level) {
+            const int shift = level * kTimerWheelBits;
+            const uint64_t first = from >> shift;
+            const uint64_t last = to >> shift;
+            if (first == last) {
+                break;
+            }
+            TimerWheelLevel& wheelLevel = mTimerWheel[level];
+            // The slots the wheel time went through at this level.
+            uint64_t crossed = ~uint64_t(0);
+            if (last - first < kTimerWheelSlots) {
+                crossed = 0;
+                for (uint64_t index = first + 1; index <= last; ++index) {
+                    crossed |= uint64_t(1) << (index & (kTimerWheelSlots - 1));
+                }
+            }
+            crossed &= wheelLevel.occupied;
+            wheelLevel.occupied &= ~crossed;
+            while (crossed) {
+                const int slot = lowestSetBit(crossed);
+                crossed &= crossed - 1;
+                cascading.splice(cascading.end(), wheelLevel.slots[slot]);
+            }
+        }
+    }
+
+    mTimerWheelTime = to;
+    while (!cascading.empty()) {
+        placeTimer(cascading.front(), &cascading);
+    }
+}
+
+Looper::Duration DefaultLooper::nextTimerDeadline() const {
+    if (!mExpiredTimers.empty()) {
+        return static_cast<Duration>(mTimerWheelTime);
+    }
+    for (int level = 0; level < kTimerWheelLevels; ++level) {
+        const uint64_t occupied = mTimerWheel[level].occupied;
+        if (!occupied) {
+            continue;
+        }
+        // Timers in a level share the digits above it with the wheel time.
+        const int shift = level * kTimerWheelBits;
+        const int prefixShift = shift + kTimerWheelBits;
+        const uint64_t prefix =
+                prefixShift >= 64
+                        ? 0
+                        : (mTimerWheelTime >> prefixShift) << prefixShift;
+        return static_cast<Duration>(
+                prefix | (uint64_t(lowestSetBit(occupied)) << shift));
+    }
+    return kDurationInfinite;
+}
+
+DefaultLooper::TimerList DefaultLooper::activeTimers() const {
+    TimerList timers(mExpiredTimers);
+    for (const auto& level : mTimerWheel) {
+        for (const auto& slot : level.slots) {
+            timers.insert(timers.end(), slot.begin(), slot.end());
+        }
+    }
+    return timers;
 }
 
 Looper::Timer* DefaultLooper::createTimer(Looper::Timer::Callback callback,
@@ -140,7 +296,7 @@ int DefaultLooper::runWithDeadlineMs(Looper::Duration deadlineMs) {
     while (!mForcedExit) {
         // Return immediately with EWOULDBLOCK if there are no
         // more timers or watches registered.
-        if (mFdWatches.empty() && mActiveTimers.empty() &&
+        if (mFdWatches.empty() && mActiveTimerCount == 0 &&
             mScheduledTasks.empty()) {
             return EWOULDBLOCK;
         }
@@ -164,12 +320,7 @@ int DefaultLooper::runWithDeadlineMs(Looper::Duration deadlineMs) {
 
 bool DefaultLooper::runOneIterationWithDeadlineMs(Looper::Duration deadlineMs) {
     // Compute next deadline from timers.
-    Duration nextDeadline = kDurationInfinite;
-
-    auto firstTimerIt = mActiveTimers.begin();
-    if (firstTimerIt != mActiveTimers.end()) {
-        nextDeadline = (*firstTimerIt)->deadline();
-    }
+    Duration nextDeadline = nextTimerDeadline();
 
     if (nextDeadline > deadlineMs) {
         nextDeadline = deadlineMs;
@@ -220,14 +371,10 @@ bool DefaultLooper::runOneIterationWithDeadlineMs(Looper::Duration deadlineMs) {
                 }
 
                 // Find the FdWatch for this file descriptor.
-                // TODO(digit): Improve efficiency with a map?
-                const auto fdIt =
-                        std::find_if(mFdWatches.begin(), mFdWatches.end(),
-                                     [fd](const FdWatchSet::value_type& pair) {
-                                         return pair.first->fd() == fd;
-                                     });
-                if (fdIt != mFdWatches.end()) {
-                    fdIt->first->setPending(events);
+                const auto fdIt = mFdWatchesByFd.find(fd);
+                if (fdIt != mFdWatchesByFd.end() &&
+                    !fdIt->second->isPending()) {
+                    fdIt->second->setPending(events);
                 }
             }
         }
@@ -236,12 +383,15 @@ bool DefaultLooper::runOneIterationWithDeadlineMs(Looper::Duration deadlineMs) {
     // Queue pending expired timers.
     DCHECK(mPendingTimers.empty());
 
-    const Duration kNow = nowMs();
-    auto timerIt = mActiveTimers.begin();
-    while (timerIt != mActiveTimers.end() && (*timerIt)->deadline() <= kNow) {
-        // Remove from active list, add to pending list.
-        (*timerIt)->setPending();
-        timerIt = mActiveTimers.erase(timerIt);
+    advanceTimerWheel(nowMs());
+    // Expire in deadline order, and in start order for equal deadlines.
+    mExpiredTimers.sort([](const Timer* a, const Timer* b) {
+        return a->deadline() != b->deadline() ? a->deadline() < b->deadline()
+                                              : a->mSequence < b->mSequence;
+    });
+    while (!mExpiredTimers.empty()) {
+        // Moves from the expired list to the pending list.
+        mExpiredTimers.front()->setPending();
     }
 
     // Fire the pending timers, this is done in a separate step
@@ -355,6 +505,9 @@ DefaultLooper* DefaultLooper::Timer::defaultLooper() const {
 
 DefaultLooper::Timer::~Timer() {
     clearPending();
+    if (mDeadline != kDurationInfinite) {
+        defaultLooper()->disableTimer(this);
+    }
     defaultLooper()->delTimer(this);
 }
 
@@ -370,6 +523,8 @@ void DefaultLooper::Timer::startRelative(Looper::Duration deadlineMs) {
 }
 
 void DefaultLooper::Timer::startAbsolute(Looper::Duration deadlineMs) {
+    // Restarting a timer that expired but didn't fire yet cancels that.
+    clearPending();
     if (mDeadline != kDurationInfinite) {
         defaultLooper()->disableTimer(this);
     }
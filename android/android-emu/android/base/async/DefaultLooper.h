@@ -14,6 +14,8 @@
 #include "android/base/async/Looper.h"
 #include "android/base/sockets/SocketWaiter.h"
 
+#include <array>
+#include <cstdint>
 #include <list>
 #include <memory>
 #include <unordered_map>
@@ -23,11 +25,16 @@
 namespace android {
 namespace base {
 
-// Default looper implementation based on select(). To make sure all timers and
-// FD watches execute, run its runWithDeadlineMs() explicitly.
+// Default looper implementation based on a SocketWaiter, i.e. epoll() or
+// kqueue() where available and select() elsewhere. To make sure all timers
+// and FD watches execute, run its runWithDeadlineMs() explicitly.
+//
+// Active timers are kept in a hierarchical timer wheel, so starting and
+// stopping one is O(1) regardless of how many there are.
 class DefaultLooper : public Looper {
 public:
-    DefaultLooper();
+    explicit DefaultLooper(
+            SocketWaiter::Backend backend = SocketWaiter::Backend::kDefault);
 
     ~DefaultLooper() override;
 
@@ -93,6 +100,9 @@ public:
     //  T I M E R S
     //
 
+    class Timer;
+    typedef std::list<Timer*> TimerList;
+
     class Timer : public Looper::Timer {
     public:
         Timer(DefaultLooper* looper,
@@ -125,8 +135,18 @@ public:
         void load(Stream* stream) override;
 
     private:
+        friend class DefaultLooper;
+
         Duration mDeadline;
         bool mPending;
+
+        // Orders timers with the same deadline by the time they started.
+        uint64_t mSequence = 0;
+        // The wheel slot, expired or pending list the timer is in, if any.
+        TimerList* mList = nullptr;
+        TimerList::iterator mListIt;
+        int mWheelLevel = -1;
+        int mWheelSlot = -1;
     };
 
     void addTimer(Timer* timer);
@@ -174,8 +194,7 @@ public:
     //
     int runWithDeadlineMs(Duration deadlineMs) override;
 
-    typedef std::list<Timer*> TimerList;
-    typedef std::unordered_map<Timer*, TimerList::iterator> TimerSet;
+    typedef std::unordered_set<Timer*> TimerSet;
 
     typedef std::list<FdWatch*> FdWatchList;
     typedef std::unordered_map<FdWatch*, FdWatchList::iterator> FdWatchSet;
@@ -183,14 +202,46 @@ public:
 protected:
     bool runOneIterationWithDeadlineMs(Duration deadlineMs);
 
+    // Timer wheel: level N has 64 slots of 64^N ms each. A timer goes to the
+    // level of the highest digit where its deadline differs from the wheel
+    // time, and moves down the levels as the wheel time gets closer to it.
+    static constexpr int kTimerWheelBits = 6;
+    static constexpr int kTimerWheelSlots = 1 << kTimerWheelBits;
+    static constexpr int kTimerWheelLevels =
+            (64 + kTimerWheelBits - 1) / kTimerWheelBits;
+
+    struct TimerWheelLevel {
+        std::array<TimerList, kTimerWheelSlots> slots;
+        uint64_t occupied = 0;  // Bit N set iff slots[N] isn't empty.
+    };
+
+    // Puts |timer| in the wheel, or in the expired list if its deadline is
+    // past the wheel time. Moves it from |from| if it's there already.
+    void placeTimer(Timer* timer, TimerList* from);
+    void unlinkTimer(Timer* timer);
+    // Moves the wheel time forward to |nowMs|, cascading the timers of the
+    // slots crossed to the lower levels or the expired list.
+    void advanceTimerWheel(Duration nowMs);
+    // Lower bound of the earliest active timer deadline; exact when the
+    // timer is in the lowest level.
+    Duration nextTimerDeadline() const;
+    // Collects the active timers, in no particular order.
+    TimerList activeTimers() const;
+
     std::unique_ptr<SocketWaiter> mWaiter;
     FdWatchSet mFdWatches;          // Set of all fd watches.
     FdWatchList mPendingFdWatches;  // Queue of pending fd watches.
+    std::unordered_multimap<int, FdWatch*> mFdWatchesByFd;
 
     TimerSet mTimers;          // Set of all timers.
-    TimerList mActiveTimers;   // Sorted list of active timers.
     TimerList mPendingTimers;  // Sorted list of pending timers.
 
+    std::array<TimerWheelLevel, kTimerWheelLevels> mTimerWheel;
+    TimerList mExpiredTimers;  // Active timers past the wheel time.
+    uint64_t mTimerWheelTime = 0;
+    size_t mActiveTimerCount = 0;
+    uint64_t mNextTimerSequence = 0;
+
     using TaskSet = std::unordered_set<Task*>;
     TaskSet mScheduledTasks;
 
@@ -0,0 +1,230 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// How DefaultLooper scales with 10k timers and up to 5000 watched socket
+// pairs. The argument is the SocketWaiter backend (1 for select(), 2 for
+// epoll, 3 for kqueue), and only the ones the host has are registered.
+// select() stops at FD_SETSIZE, so it gets fewer fds than the others; the
+// label says how many.
+//
+// BM_Looper_TimerStartStop: start and stop all the timers.
+// BM_Looper_ExpiredTimers: one looper iteration firing all the timers.
+// BM_Looper_IdleRun: one iteration with everything registered but nothing
+// to do.
+// BM_Looper_ReadyFds: one iteration with one fd in twenty readable.
+
+#include "android/base/Log.h"
+#include "android/base/async/DefaultLooper.h"
+#include "android/base/sockets/ScopedSocket.h"
+#include "android/base/sockets/SocketUtils.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/select.h>
+#endif
+
+using android::base::DefaultLooper;
+using android::base::Looper;
+using android::base::ScopedSocket;
+using android::base::SocketWaiter;
+
+namespace {
+
+constexpr int kTimerCount = 10000;
+constexpr int kMaxPairs = 5000;
+constexpr int kReadyStride = 20;
+
+// Room for |kMaxPairs| socket pairs, as far as the hard limit allows.
+int maxSocketPairs() {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        const rlim_t wanted = 2 * kMaxPairs + 64;
+        if (limit.rlim_cur < wanted) {
+            limit.rlim_cur = std::min(wanted, limit.rlim_max);
+            setrlimit(RLIMIT_NOFILE, &limit);
+            getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        return std::min<int>(kMaxPairs, (limit.rlim_cur - 64) / 2);
+    }
+#endif
+    return kMaxPairs;
+}
+
+void onTimer(void* opaque, Looper::Timer* timer) {
+    ++*static_cast<int*>(opaque);
+}
+
+void onQuitTimer(void* opaque, Looper::Timer* timer) {
+    static_cast<Looper*>(opaque)->forceQuit();
+}
+
+void onFdWatch(void* opaque, int fd, unsigned events) {
+    char buffer[16];
+    android::base::socketRecv(fd, buffer, sizeof(buffer));
+    ++*static_cast<int*>(opaque);
+}
+
+// A looper with |kTimerCount| stopped timers and, if |withFds|, as many
+// socket pairs as the backend and the fd limit allow, each with a read watch
+// on one end.
+class LooperSetup {
+public:
+    LooperSetup(benchmark::State& state, bool withFds)
+        : mLooper(new DefaultLooper(
+                  static_cast<SocketWaiter::Backend>(state.range_x()))),
+          mQuitTimer(mLooper->createTimer(onQuitTimer, mLooper.get())) {
+        for (int i = 0; i < kTimerCount; ++i) {
+            mTimers.emplace_back(mLooper->createTimer(onTimer, &mFired));
+        }
+        const int maxPairs = withFds ? maxSocketPairs() : 0;
+        for (int i = 0; i < maxPairs; ++i) {
+            int fd0 = -1, fd1 = -1;
+            if (android::base::socketCreatePair(&fd0, &fd1) < 0) {
+                break;
+            }
+            ScopedSocket s0(fd0), s1(fd1);
+#ifndef _WIN32
+            if (state.range_x() ==
+                        static_cast<int>(SocketWaiter::Backend::kSelect) &&
+                std::max(fd0, fd1) >= FD_SETSIZE) {
+                break;
+            }
+#endif
+            mWatches.emplace_back(mLooper->createFdWatch(fd1, onFdWatch,
+                                                         &mReads));
+            mWatches.back()->wantRead();
+            mWriters.push_back(std::move(s0));
+            mReaders.push_back(std::move(s1));
+        }
+        if (withFds) {
+            state.SetLabel(std::to_string(mWatches.size()) + " fds");
+        }
+    }
+
+    // Starts the timers, half of them expired and the others spread over the
+    // next hour if |expired| is false.
+    void startTimers(bool expired) {
+        const Looper::Duration now = mLooper->nowMs();
+        for (int i = 0; i < kTimerCount; ++i) {
+            mTimers[i]->startAbsolute(expired || i % 2 ? now - i % 100
+                                                       : now + 1000 + i * 360);
+        }
+    }
+
+    void stopTimers() {
+        for (auto& timer : mTimers) {
+            timer->stop();
+        }
+    }
+
+    // Runs a single looper iteration.
+    void runOnce() {
+        mQuitTimer->startAbsolute(mLooper->nowMs() - 1000);
+        mLooper->run();
+    }
+
+    // Makes one fd in |kReadyStride| readable, returns how many.
+    int writeToSome() {
+        int count = 0;
+        for (size_t i = 0; i < mWriters.size(); i += kReadyStride) {
+            CHECK(android::base::socketSend(mWriters[i].get(), "x", 1) == 1);
+            ++count;
+        }
+        return count;
+    }
+
+    int fired() const { return mFired; }
+    int reads() const { return mReads; }
+
+private:
+    int mFired = 0;
+    int mReads = 0;
+    std::unique_ptr<Looper> mLooper;
+    std::unique_ptr<Looper::Timer> mQuitTimer;
+    std::vector<std::unique_ptr<Looper::Timer>> mTimers;
+    std::vector<ScopedSocket> mWriters;
+    std::vector<ScopedSocket> mReaders;
+    std::vector<std::unique_ptr<Looper::FdWatch>> mWatches;
+};
+
+void LooperBackends(benchmark::internal::Benchmark* b) {
+    for (auto backend :
+         {SocketWaiter::Backend::kSelect, SocketWaiter::Backend::kEpoll,
+          SocketWaiter::Backend::kKqueue}) {
+        if (SocketWaiter::hasBackend(backend)) {
+            b->Arg(static_cast<int>(backend));
+        }
+    }
+}
+
+}  // namespace
+
+static void BM_Looper_TimerStartStop(benchmark::State& state) {
+    LooperSetup setup(state, false);
+    while (state.KeepRunning()) {
+        setup.startTimers(false);
+        setup.stopTimers();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * kTimerCount);
+}
+
+static void BM_Looper_ExpiredTimers(benchmark::State& state) {
+    LooperSetup setup(state, true);
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        setup.startTimers(true);
+        state.ResumeTiming();
+        setup.runOnce();
+    }
+    CHECK(setup.fired() == int(state.iterations()) * kTimerCount);
+    state.SetItemsProcessed(int64_t(state.iterations()) * kTimerCount);
+}
+
+static void BM_Looper_IdleRun(benchmark::State& state) {
+    LooperSetup setup(state, true);
+    setup.startTimers(false);
+    setup.runOnce();  // Fires the expired half.
+    while (state.KeepRunning()) {
+        setup.runOnce();
+    }
+    CHECK(setup.fired() == kTimerCount / 2);
+}
+
+static void BM_Looper_ReadyFds(benchmark::State& state) {
+    LooperSetup setup(state, true);
+    setup.startTimers(false);
+    setup.runOnce();
+    int64_t ready = 0;
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        ready += setup.writeToSome();
+        state.ResumeTiming();
+        setup.runOnce();
+    }
+    CHECK(setup.reads() == ready);
+    state.SetItemsProcessed(ready);
+}
+
+BENCHMARK(BM_Looper_TimerStartStop)->Apply(LooperBackends);
+BENCHMARK(BM_Looper_ExpiredTimers)->Apply(LooperBackends);
+BENCHMARK(BM_Looper_IdleRun)->Apply(LooperBackends);
+BENCHMARK(BM_Looper_ReadyFds)->Apply(LooperBackends);
@@ -12,14 +12,23 @@
 #include "android/base/async/Looper.h"
 
 #include "android/base/Log.h"
+#include "android/base/async/DefaultLooper.h"
 #include "android/base/sockets/SocketUtils.h"
 #include "android/base/sockets/ScopedSocket.h"
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include <errno.h>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#endif
+
 #ifdef _MSC_VER
 #ifdef ERROR
 #undef ERROR
@@ -397,5 +406,120 @@ TEST(GenericLooper, ScheduleCallback) {
     EXPECT_FALSE(taskRan);
 }
 
+namespace {
+
+struct FiredTimers {
+    std::vector<Looper::Timer*> timers;
+};
+
+}  // namespace
+
+static void myTimerCallbackRecord(void* opaque, Looper::Timer* timer) {
+    auto fired = static_cast<FiredTimers*>(opaque);
+    fired->timers.push_back(timer);
+}
+
+// Timers spread over several timer wheel levels fire in deadline order, and
+// in start order for equal deadlines.
+TEST(GenericLooper, TimersFireInDeadlineOrder) {
+    std::unique_ptr<Looper> looper(Looper::create());
+    FiredTimers fired;
+
+    const Duration now = looper->nowMs();
+    std::vector<std::unique_ptr<Looper::Timer>> timers;
+    std::vector<Duration> deadlines;
+    for (int i = 0; i < 200; ++i) {
+        timers.emplace_back(
+                looper->createTimer(myTimerCallbackRecord, &fired));
+        // Some already expired, most within the next 80ms.
+        deadlines.push_back(now - 5 + (i * 37) % 85);
+        timers.back()->startAbsolute(deadlines.back());
+    }
+    // Restarting moves a timer behind the ones with the same deadline.
+    timers[0]->startAbsolute(deadlines[0]);
+    // Far enough to be on a high level, and never fire.
+    std::unique_ptr<Looper::Timer> farTimer(
+            looper->createTimer(myTimerCallbackShouldNeverBeCalled, nullptr));
+    farTimer->startAbsolute(now + 24 * 3600 * 1000);
+
+    std::vector<size_t> order;
+    for (size_t i = 1; i < timers.size(); ++i) {
+        order.push_back(i);
+    }
+    order.push_back(0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&deadlines](size_t a, size_t b) {
+                         return deadlines[a] < deadlines[b];
+                     });
+    std::vector<Looper::Timer*> expected;
+    for (size_t i : order) {
+        expected.push_back(timers[i].get());
+    }
+
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(now + 100));
+    EXPECT_EQ(expected, fired.timers);
+    for (const auto& timer : timers) {
+        EXPECT_FALSE(timer->isActive());
+    }
+    EXPECT_TRUE(farTimer->isActive());
+}
+
+namespace {
+
+struct FdWatchCounter {
+    int reads = 0;
+};
+
+}  // namespace
+
+static void myFdWatchCallbackCount(void* opaque, int fd, unsigned events) {
+    char buffer[16];
+    socketRecv(fd, buffer, sizeof(buffer));
+    ++static_cast<FdWatchCounter*>(opaque)->reads;
+}
+
+#ifdef __linux__
+// The epoll backend takes fds that select() can't, see Looper_benchmark.cpp
+// for how it scales.
+TEST(GenericLooper, EpollFdWatchBeyondFdSetSize) {
+    if (!SocketWaiter::hasBackend(SocketWaiter::Backend::kEpoll)) {
+        return;
+    }
+    // Only for this test, the default soft limit is often FD_SETSIZE.
+    struct rlimit oldLimit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &oldLimit));
+    if (oldLimit.rlim_max < FD_SETSIZE + 2) {
+        return;
+    }
+    struct rlimit limit = oldLimit;
+    if (limit.rlim_cur < FD_SETSIZE + 2) {
+        limit.rlim_cur = FD_SETSIZE + 2;
+        ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+    }
+
+    ScopedSocket s0, s1;
+    ASSERT_TRUE(createScopedSocketPair(&s0, &s1));
+    ScopedSocket high(fcntl(s1.get(), F_DUPFD_CLOEXEC, FD_SETSIZE));
+    setrlimit(RLIMIT_NOFILE, &oldLimit);
+    ASSERT_LE(FD_SETSIZE, high.get());
+
+    std::unique_ptr<Looper> looper(
+            new DefaultLooper(SocketWaiter::Backend::kEpoll));
+    FdWatchCounter low, beyond;
+    std::unique_ptr<Looper::FdWatch> lowWatch(
+            looper->createFdWatch(s0.get(), myFdWatchCallbackCount, &low));
+    std::unique_ptr<Looper::FdWatch> highWatch(looper->createFdWatch(
+            high.get(), myFdWatchCallbackCount, &beyond));
+    lowWatch->wantRead();
+    highWatch->wantRead();
+
+    EXPECT_EQ(1, socketSend(s0.get(), "x", 1));
+    EXPECT_EQ(1, socketSend(s1.get(), "y", 1));
+    EXPECT_EQ(ETIMEDOUT, looper->runWithDeadlineMs(looper->nowMs() + 100));
+    EXPECT_EQ(1, low.reads);
+    EXPECT_EQ(1, beyond.reads);
+}
+#endif  // __linux__
+
 }  // namespace base
 }  // namespace android
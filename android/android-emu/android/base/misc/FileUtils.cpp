@@ -26,6 +26,10 @@
 #include <io.h>
 #endif
 
+#ifdef __linux__
+#include <linux/falloc.h>
+#endif
+
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -95,4 +99,19 @@ bool setFileSize(int fd, int64_t size) {
 #endif
 }
 
+bool punchHole(int fd, int64_t start, int64_t length) {
+#if defined(__linux__)
+    return HANDLE_EINTR(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                  start, length)) == 0;
+#elif defined(__APPLE__) && defined(F_PUNCHHOLE)
+    fpunchhole_t hole = {};
+    hole.fp_offset = start;
+    hole.fp_length = length;
+    return HANDLE_EINTR(fcntl(fd, F_PUNCHHOLE, &hole)) == 0;
+#else
+    // Windows can only do it for files marked as sparse.
+    return false;
+#endif
+}
+
 }  // namespace android
@@ -32,4 +32,9 @@ bool writeStringToFile(int fd, const std::string& file_contents);
 // Sets the file size to |size|, could either extend or truncate it.
 bool setFileSize(int fd, int64_t size);
 
+// Gives the disk space of [start, start + length) in |fd| back to the file
+// system; the range reads back as zeroes, and the file size doesn't change.
+// Returns false if the file system can't do that.
+bool punchHole(int fd, int64_t start, int64_t length);
+
 }  // namespace android
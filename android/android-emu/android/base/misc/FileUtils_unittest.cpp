@@ -86,4 +86,29 @@ TEST(FileUtils, fileToString) {
     }
 }
 
+TEST(FileUtils, punchHole) {
+    const int fileSize = 16 * 4096;
+    TempFile* tf = tempfile_create();
+
+    ScopedFd fd(HANDLE_EINTR(open(tempfile_path(tf), O_RDWR, 0600)));
+    EXPECT_NE(-1, fd.get());
+    EXPECT_TRUE(writeStringToFile(fd.get(), std::string(fileSize, 'x')));
+
+    if (!punchHole(fd.get(), 4096, 3 * 4096)) {
+        // Not every file system supports it.
+        tempfile_close(tf);
+        return;
+    }
+
+    std::string contents;
+    EXPECT_TRUE(readFileIntoString(fd.get(), &contents));
+    ASSERT_EQ(size_t(fileSize), contents.size());
+    EXPECT_EQ(std::string(4096, 'x'), contents.substr(0, 4096));
+    EXPECT_EQ(std::string(3 * 4096, '\0'), contents.substr(4096, 3 * 4096));
+    EXPECT_EQ(std::string(fileSize - 4 * 4096, 'x'),
+              contents.substr(4 * 4096));
+
+    tempfile_close(tf);
+}
+
 }  // namespace android
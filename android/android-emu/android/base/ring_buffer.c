@@ -30,6 +30,13 @@
 #include <unistd.h>
 #endif
 
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
 #define RING_BUFFER_MASK (RING_BUFFER_SIZE - 1)
 
 #define RING_BUFFER_VERSION 1
@@ -37,7 +44,9 @@
 void ring_buffer_init(struct ring_buffer* r) {
     r->host_version = 1;
     r->write_pos = 0;
+    r->write_pos_waiters = 0;
     r->read_pos = 0;
+    r->read_pos_waiters = 0;
 
     r->read_live_count = 0;
     r->read_yield_count = 0;
@@ -46,6 +55,20 @@ void ring_buffer_init(struct ring_buffer* r) {
     r->state = 0;
 }
 
+// Wakes the threads parked in ring_buffer_park() on |pos|. Costs a single
+// load when nobody is parked, so it is fine to call after every update.
+static void ring_buffer_wake(uint32_t* pos, const uint32_t* waiters) {
+    if (!__atomic_load_n(waiters, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+#ifdef __linux__
+    // Not FUTEX_PRIVATE: the ring may live in memory shared across processes.
+    syscall(SYS_futex, pos, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)pos;
+#endif
+}
+
 static uint32_t get_ring_pos(uint32_t index) {
     return index & RING_BUFFER_MASK;
 }
@@ -95,6 +118,7 @@ long ring_buffer_write(
         }
 
         __atomic_add_fetch(&r->write_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->write_pos, &r->write_pos_waiters);
     }
 
     errno = 0;
@@ -134,6 +158,7 @@ long ring_buffer_read(
         }
 
         __atomic_add_fetch(&r->read_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->read_pos, &r->read_pos_waiters);
     }
 
     errno = 0;
@@ -151,6 +176,7 @@ long ring_buffer_advance_write(
         }
 
         __atomic_add_fetch(&r->write_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->write_pos, &r->write_pos_waiters);
     }
 
     errno = 0;
@@ -168,6 +194,7 @@ long ring_buffer_advance_read(
         }
 
         __atomic_add_fetch(&r->read_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->read_pos, &r->read_pos_waiters);
     }
 
     errno = 0;
@@ -356,6 +383,7 @@ long ring_buffer_view_write(
         }
 
         __atomic_add_fetch(&r->write_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->write_pos, &r->write_pos_waiters);
     }
 
     errno = 0;
@@ -396,6 +424,7 @@ long ring_buffer_view_read(
                    step_size);
         }
         __atomic_add_fetch(&r->read_pos, step_size, __ATOMIC_SEQ_CST);
+        ring_buffer_wake(&r->read_pos, &r->read_pos_waiters);
     }
 
     errno = 0;
@@ -410,14 +439,6 @@ void ring_buffer_yield() {
 #endif
 }
 
-static void ring_buffer_sleep() {
-#ifdef _WIN32
-    Sleep(2);
-#else
-    usleep(2000);
-#endif
-}
-
 static uint64_t ring_buffer_curr_us() {
     uint64_t res;
     struct timeval tv;
@@ -426,8 +447,54 @@ static uint64_t ring_buffer_curr_us() {
     return res;
 }
 
-static const uint32_t yield_backoff_us = 1000;
-static const uint32_t sleep_backoff_us = 2000;
+// Waiting goes through three phases: spinning, for peers that are about to
+// catch up; yielding; and parking, with a timeout that doubles from
+// min_park_us up to max_park_us so a long idle period costs a few wakeups
+// per frame instead of a busy core.
+static const uint32_t spin_backoff_us = 50;
+static const uint32_t yield_backoff_us = 200;
+static const uint32_t min_park_us = 50;
+static const uint32_t max_park_us = 2000;
+
+// Parks the calling thread until |*pos| moves away from |observed|, a
+// same-process peer calls ring_buffer_wake() on it, or |timeout_us| passes.
+static void ring_buffer_park(
+    const uint32_t* pos,
+    const uint32_t* waiters,
+    uint32_t observed,
+    uint32_t timeout_us) {
+    // Registering before re-checking |pos| pairs with the peer updating |pos|
+    // before checking |waiters|: one of the two sees the other.
+    __atomic_add_fetch((uint32_t*)waiters, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(pos, __ATOMIC_SEQ_CST) == observed) {
+#ifdef __linux__
+        struct timespec ts;
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        syscall(SYS_futex, pos, FUTEX_WAIT, observed, &ts, NULL, 0);
+#elif defined(_WIN32)
+        Sleep(timeout_us < 1000 ? 1 : timeout_us / 1000);
+#else
+        usleep(timeout_us);
+#endif
+    }
+    __atomic_sub_fetch((uint32_t*)waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+// Returns how long the wait may park next, or 0 to keep spinning.
+static uint32_t ring_buffer_backoff(uint64_t curr_wait_us, uint32_t* park_us) {
+    if (curr_wait_us <= spin_backoff_us) {
+        _mm_pause();
+        return 0;
+    }
+    if (curr_wait_us <= yield_backoff_us) {
+        ring_buffer_yield();
+        return 0;
+    }
+    uint32_t res = *park_us;
+    *park_us = res * 2 > max_park_us ? max_park_us : res * 2;
+    return res;
+}
 
 bool ring_buffer_wait_write(
     const struct ring_buffer* r,
@@ -437,27 +504,36 @@ bool ring_buffer_wait_write(
 
     uint64_t start_us = ring_buffer_curr_us();
     uint64_t curr_wait_us;
+    uint32_t park_us = min_park_us;
+    uint32_t read_view;
 
     bool can_write =
         v ? ring_buffer_view_can_write(r, v, bytes) :
             ring_buffer_can_write(r, bytes);
 
     while (!can_write) {
-        _mm_pause();
         curr_wait_us = ring_buffer_curr_us() - start_us;
 
-        if (curr_wait_us > yield_backoff_us) {
-            ring_buffer_yield();
-        }
-
-        if (curr_wait_us > sleep_backoff_us) {
-            ring_buffer_sleep();
-        }
-
         if (curr_wait_us > timeout_us) {
             return false;
         }
 
+        uint32_t wait_us = ring_buffer_backoff(curr_wait_us, &park_us);
+        if (wait_us) {
+            if (wait_us > timeout_us - curr_wait_us) {
+                wait_us = (uint32_t)(timeout_us - curr_wait_us) + 1;
+            }
+            __atomic_load(&r->read_pos, &read_view, __ATOMIC_SEQ_CST);
+            can_write =
+                v ? ring_buffer_view_can_write(r, v, bytes) :
+                    ring_buffer_can_write(r, bytes);
+            if (can_write) {
+                break;
+            }
+            ring_buffer_park(&r->read_pos, &r->read_pos_waiters, read_view,
+                             wait_us);
+        }
+
         can_write =
             v ? ring_buffer_view_can_write(r, v, bytes) :
                 ring_buffer_can_write(r, bytes);
@@ -474,27 +550,38 @@ bool ring_buffer_wait_read(
 
     uint64_t start_us = ring_buffer_curr_us();
     uint64_t curr_wait_us;
+    uint32_t park_us = min_park_us;
+    uint32_t write_view;
 
     bool can_read =
         v ? ring_buffer_view_can_read(r, v, bytes) :
             ring_buffer_can_read(r, bytes);
 
     while (!can_read) {
-        _mm_pause();
         curr_wait_us = ring_buffer_curr_us() - start_us;
 
-        if (curr_wait_us > yield_backoff_us) {
-            ring_buffer_yield();
-            ((struct ring_buffer*)r)->read_yield_count++;
+        if (curr_wait_us > timeout_us) {
+            return false;
         }
 
-        if (curr_wait_us > sleep_backoff_us) {
-            ring_buffer_sleep();
-            ((struct ring_buffer*)r)->read_sleep_us_count += 2000;
+        uint32_t wait_us = ring_buffer_backoff(curr_wait_us, &park_us);
+        if (curr_wait_us > spin_backoff_us && !wait_us) {
+            ((struct ring_buffer*)r)->read_yield_count++;
         }
-
-        if (curr_wait_us > timeout_us) {
-            return false;
+        if (wait_us) {
+            if (wait_us > timeout_us - curr_wait_us) {
+                wait_us = (uint32_t)(timeout_us - curr_wait_us) + 1;
+            }
+            __atomic_load(&r->write_pos, &write_view, __ATOMIC_SEQ_CST);
+            can_read =
+                v ? ring_buffer_view_can_read(r, v, bytes) :
+                    ring_buffer_can_read(r, bytes);
+            if (can_read) {
+                break;
+            }
+            ring_buffer_park(&r->write_pos, &r->write_pos_waiters, write_view,
+                             wait_us);
+            ((struct ring_buffer*)r)->read_sleep_us_count += wait_us;
         }
 
         can_read =
@@ -30,12 +30,14 @@ struct ring_buffer {
     uint32_t host_version;
     uint32_t guest_version;
     uint32_t write_pos; // Atomically updated for the consumer
-    uint32_t unused0[13]; // Separate cache line
+    uint32_t write_pos_waiters; // Host consumers parked on write_pos
+    uint32_t unused0[12]; // Separate cache line
     uint32_t read_pos; // Atomically updated for the producer
     uint32_t read_live_count;
     uint32_t read_yield_count;
     uint32_t read_sleep_us_count;
-    uint32_t unused1[12]; // Separate cache line
+    uint32_t read_pos_waiters; // Host producers parked on read_pos
+    uint32_t unused1[11]; // Separate cache line
     uint8_t buf[RING_BUFFER_SIZE];
     uint32_t state; // An atomically updated variable from both
                     // producer and consumer for other forms of
@@ -106,7 +108,11 @@ long ring_buffer_view_read(
     void* data, uint32_t step_size, uint32_t steps);
 
 // Usage of ring_buffer as a waitable object.
-// These functions will back off if spinning too long.
+// These functions spin briefly, then yield, then park the thread with
+// growing timeouts until the ring becomes available. On Linux, parking is a
+// futex wait on the peer's position that same-process writes and reads wake
+// right away; a peer in the guest can't wake it, so the timeout (at most
+// 2ms, the old sleep interval) bounds the latency there.
 //
 // if |v| is null, it is assumed that the statically allocated ring buffer is
 // used.
@@ -0,0 +1,115 @@
+// Copyright 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how fast a ring_buffer consumer notices new data and what it
+// costs to wait for it: round-trip latency between two busy threads, and
+// wakeup latency plus CPU use of a consumer that is mostly idle.
+
+#include "android/base/ring_buffer.h"
+
+#include "android/base/system/System.h"
+#include "android/base/threads/FunctorThread.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <cstdio>
+#include <vector>
+
+using android::base::FunctorThread;
+using android::base::System;
+
+// Sends |range_x| bytes to an echo thread and waits for them to come back.
+void BM_RingRoundTrip(benchmark::State& state) {
+    const auto size = uint32_t(state.range_x());
+    ring_buffer request;
+    ring_buffer response;
+    ring_buffer_init(&request);
+    ring_buffer_init(&response);
+
+    std::vector<uint8_t> buf(size);
+    FunctorThread echo([&request, &response, size] {
+        std::vector<uint8_t> echoBuf(size);
+        for (;;) {
+            ring_buffer_read_fully(&request, nullptr, echoBuf.data(), size);
+            ring_buffer_write_fully(&response, nullptr, echoBuf.data(), size);
+            if (echoBuf[0]) {
+                break;
+            }
+        }
+    });
+    echo.start();
+
+    while (state.KeepRunning()) {
+        ring_buffer_write_fully(&request, nullptr, buf.data(), size);
+        ring_buffer_read_fully(&response, nullptr, buf.data(), size);
+    }
+
+    buf[0] = 1;
+    ring_buffer_write_fully(&request, nullptr, buf.data(), size);
+    ring_buffer_read_fully(&response, nullptr, buf.data(), size);
+    echo.wait();
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * size * 2);
+}
+
+BENCHMARK(BM_RingRoundTrip)->Arg(4)->Arg(256)->Arg(1024);
+
+// Sends a timestamp every |range_x| milliseconds, the way a guest renders
+// frames. The label has the average time the consumer took to see each one
+// and the share of a core the process used in total, which is almost all
+// the consumer's waiting.
+void BM_RingIdleWakeup(benchmark::State& state) {
+    const auto intervalMs = unsigned(state.range_x());
+    ring_buffer r;
+    ring_buffer_init(&r);
+
+    uint64_t totalLatencyUs = 0;
+    uint64_t received = 0;
+    FunctorThread consumer([&r, &totalLatencyUs, &received] {
+        for (;;) {
+            System::WallDuration sentUs;
+            ring_buffer_read_fully(&r, nullptr, &sentUs, sizeof(sentUs));
+            if (!sentUs) {
+                break;
+            }
+            totalLatencyUs += System::get()->getHighResTimeUs() - sentUs;
+            ++received;
+        }
+    });
+    consumer.start();
+
+    const auto startTimes = System::get()->getProcessTimes();
+    const auto startUs = System::get()->getHighResTimeUs();
+    while (state.KeepRunning()) {
+        System::get()->sleepMs(intervalMs);
+        const System::WallDuration nowUs = System::get()->getHighResTimeUs();
+        ring_buffer_write_fully(&r, nullptr, &nowUs, sizeof(nowUs));
+    }
+    const System::WallDuration stop = 0;
+    ring_buffer_write_fully(&r, nullptr, &stop, sizeof(stop));
+    consumer.wait();
+
+    const auto endTimes = System::get()->getProcessTimes();
+    const auto wallMs = (System::get()->getHighResTimeUs() - startUs) / 1000;
+    const auto cpuMs = (endTimes.userMs - startTimes.userMs) +
+                       (endTimes.systemMs - startTimes.systemMs);
+
+    char label[64];
+    snprintf(label, sizeof(label), "wakeup %.1fus cpu %.1f%%",
+             received ? double(totalLatencyUs) / received : 0.0,
+             wallMs ? 100.0 * cpuMs / wallMs : 0.0);
+    state.SetLabel(label);
+}
+
+BENCHMARK(BM_RingIdleWakeup)->Arg(1)->Arg(16);
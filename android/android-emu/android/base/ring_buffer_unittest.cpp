@@ -364,6 +364,45 @@ TEST(ring_buffer, Wait) {
     EXPECT_FALSE(ring_buffer_wait_read(&r, nullptr, 1, 100));
 }
 
+// Tests that a parked reader and writer wake up as soon as the other side
+// makes progress, rather than running out their timeouts.
+TEST(ring_buffer, WaitWakesUp) {
+    ring_buffer r;
+    ring_buffer_init(&r);
+
+    const uint64_t kTimeoutUs = 10 * 1000 * 1000;
+    uint64_t waitedUs = 0;
+
+    FunctorThread consumer([&r, &waitedUs, kTimeoutUs]() {
+        const auto start = System::get()->getHighResTimeUs();
+        EXPECT_TRUE(ring_buffer_wait_read(&r, nullptr, 1, kTimeoutUs));
+        waitedUs = System::get()->getHighResTimeUs() - start;
+    });
+    consumer.start();
+    // Long enough for the consumer to get to the parking phase.
+    System::get()->sleepMs(50);
+    uint8_t byte = 1;
+    EXPECT_EQ(1, ring_buffer_write(&r, &byte, 1, 1));
+    consumer.wait();
+    EXPECT_LT(waitedUs, kTimeoutUs);
+
+    // Fill the ring up and wait for a reader to make room.
+    std::vector<uint8_t> buf(RING_BUFFER_SIZE);
+    ring_buffer_write(&r, buf.data(), 1, RING_BUFFER_SIZE);
+    EXPECT_FALSE(ring_buffer_can_write(&r, 1));
+
+    FunctorThread producer([&r, &waitedUs, kTimeoutUs]() {
+        const auto start = System::get()->getHighResTimeUs();
+        EXPECT_TRUE(ring_buffer_wait_write(&r, nullptr, 1, kTimeoutUs));
+        waitedUs = System::get()->getHighResTimeUs() - start;
+    });
+    producer.start();
+    System::get()->sleepMs(50);
+    EXPECT_EQ(1, ring_buffer_read(&r, &byte, 1, 1));
+    producer.wait();
+    EXPECT_LT(waitedUs, kTimeoutUs);
+}
+
 // Tests the read/write fully operations
 TEST(ring_buffer, FullReadWrite) {
     ring_buffer r;
@@ -13,16 +13,35 @@
 
 #include "android/base/Log.h"
 #include "android/base/sockets/SocketErrors.h"
+#include "android/base/system/System.h"
 
 #ifdef _WIN32
 #include "android/base/sockets/Winsock.h"
 #else
 #  include <sys/types.h>
 #  include <sys/select.h>
+#  include <unistd.h>
 #endif
 
+#ifdef __linux__
+#  include <sys/epoll.h>
+#endif
+
+#ifdef __APPLE__
+#  include <sys/event.h>
+#  include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 
 namespace android {
@@ -247,10 +266,404 @@ private:
     int mPendingFd;
 };
 
+// Bookkeeping shared by the waiters that keep the wanted events themselves,
+// as the kernel object they wait on can't be queried.
+class PollingSocketWaiter : public SocketWaiter {
+public:
+    virtual unsigned wantedEventsFor(int fd) const {
+        const auto it = mWanted.find(fd);
+        return it == mWanted.end() ? 0U : it->second;
+    }
+
+    virtual unsigned pendingEventsFor(int fd) const {
+        for (const auto& ready : mReady) {
+            if (ready.first == fd) {
+                return ready.second;
+            }
+        }
+        return 0U;
+    }
+
+    virtual bool hasFds() const {
+        return !mWanted.empty();
+    }
+
+    virtual int nextPendingFd(unsigned* fdEvents) {
+        if (mNextReady >= mReady.size()) {
+            *fdEvents = 0;
+            return -1;
+        }
+        *fdEvents = mReady[mNextReady].second;
+        return mReady[mNextReady++].first;
+    }
+
+protected:
+    // Most events returned by one wait(); level-triggered waits report the
+    // others the next time.
+    static constexpr int kMaxEventsPerWait = 1024;
+
+    // Converts the SocketWaiter timeout to the poll()-style one, in ms,
+    // with -1 for infinite.
+    static int pollTimeoutMs(int64_t timeout_ms) {
+        if (timeout_ms < 0 || timeout_ms == INT64_MAX) {
+            return -1;
+        }
+        return static_cast<int>(std::min<int64_t>(timeout_ms, INT_MAX));
+    }
+
+    // Starts a wait(): clears the previous results.
+    void clearReady() {
+        mReady.clear();
+        mNextReady = 0;
+    }
+
+    // Descriptors the kernel refuses to poll, i.e. regular files, are
+    // always ready, as they are with select().
+    void addUnpollableReady() {
+        for (int fd : mUnpollable) {
+            mReady.emplace_back(fd, mWanted[fd]);
+        }
+    }
+
+    int readyCount() {
+        if (mReady.empty()) {
+            errno = ETIMEDOUT;
+        }
+        return static_cast<int>(mReady.size());
+    }
+
+    std::unordered_map<int, unsigned> mWanted;
+    std::unordered_set<int> mUnpollable;
+    std::vector<std::pair<int, unsigned>> mReady;
+    size_t mNextReady = 0;
+};
+
+#ifdef __linux__
+
+class EpollSocketWaiter : public PollingSocketWaiter {
+public:
+    EpollSocketWaiter() : mEpollFd(::epoll_create1(EPOLL_CLOEXEC)) {
+        if (mEpollFd < 0) {
+            PLOG(ERROR) << "epoll_create1() failed";
+        }
+    }
+
+    virtual ~EpollSocketWaiter() {
+        if (mEpollFd >= 0) {
+            ::close(mEpollFd);
+        }
+    }
+
+    bool isValid() const {
+        return mEpollFd >= 0;
+    }
+
+    virtual void reset() {
+        for (const auto& wanted : mWanted) {
+            if (!mUnpollable.count(wanted.first)) {
+                control(EPOLL_CTL_DEL, wanted.first, 0);
+            }
+        }
+        mWanted.clear();
+        mUnpollable.clear();
+        clearReady();
+    }
+
+    virtual void update(int fd, unsigned events) {
+        events &= kEventRead | kEventWrite;
+        const unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents) {
+            return;
+        }
+
+        if (!events) {
+            mWanted.erase(fd);
+            if (!mUnpollable.erase(fd)) {
+                // Fails if |fd| was closed already, which removed it.
+                control(EPOLL_CTL_DEL, fd, 0);
+            }
+            return;
+        }
+
+        mWanted[fd] = events;
+        if (mUnpollable.count(fd)) {
+            return;
+        }
+        // A descriptor that was closed without update(fd, 0) is gone from
+        // the epoll set, and one reusing its number isn't there yet; try
+        // the other operation when the expected one fails.
+        const int op = oldEvents ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (control(op, fd, events) == 0) {
+            return;
+        }
+        if (errno == ENOENT) {
+            control(EPOLL_CTL_ADD, fd, events);
+        } else if (errno == EEXIST) {
+            control(EPOLL_CTL_MOD, fd, events);
+        } else if (errno == EPERM) {
+            mUnpollable.insert(fd);
+        }
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearReady();
+
+        // Nothing to wait on.
+        if (mWanted.empty()) {
+            return 0;
+        }
+
+        const int timeout = mUnpollable.empty() ? pollTimeoutMs(timeout_ms) : 0;
+        mEvents.resize(std::min<size_t>(mWanted.size(), kMaxEventsPerWait));
+        int ret;
+        do {
+            ret = ::epoll_wait(mEpollFd, mEvents.data(),
+                               static_cast<int>(mEvents.size()), timeout);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+            return ret;
+        }
+
+        for (int i = 0; i < ret; ++i) {
+            const int fd = mEvents[i].data.fd;
+            const uint32_t ready = mEvents[i].events;
+            // Like select(), report errors and hangups as readable and
+            // writable, so the owner finds out with its next read or write.
+            unsigned events = 0;
+            if (ready & (EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP)) {
+                events |= kEventRead;
+            }
+            if (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                events |= kEventWrite;
+            }
+            events &= wantedEventsFor(fd);
+            if (events) {
+                mReady.emplace_back(fd, events);
+            }
+        }
+        addUnpollableReady();
+        return readyCount();
+    }
+
+private:
+    int control(int op, int fd, unsigned events) {
+        struct epoll_event event = {};
+        if (events & kEventRead) {
+            event.events |= EPOLLIN;
+        }
+        if (events & kEventWrite) {
+            event.events |= EPOLLOUT;
+        }
+        event.data.fd = fd;
+        return ::epoll_ctl(mEpollFd, op, fd, &event);
+    }
+
+    const int mEpollFd;
+    std::vector<struct epoll_event> mEvents;
+};
+
+#endif  // __linux__
+
+#ifdef __APPLE__
+
+class KqueueSocketWaiter : public PollingSocketWaiter {
+public:
+    KqueueSocketWaiter() : mKqueueFd(::kqueue()) {
+        if (mKqueueFd < 0) {
+            PLOG(ERROR) << "kqueue() failed";
+        }
+    }
+
+    virtual ~KqueueSocketWaiter() {
+        if (mKqueueFd >= 0) {
+            ::close(mKqueueFd);
+        }
+    }
+
+    bool isValid() const {
+        return mKqueueFd >= 0;
+    }
+
+    virtual void reset() {
+        for (const auto& wanted : mWanted) {
+            if (!mUnpollable.count(wanted.first)) {
+                change(wanted.first, wanted.second, 0);
+            }
+        }
+        mWanted.clear();
+        mUnpollable.clear();
+        clearReady();
+    }
+
+    virtual void update(int fd, unsigned events) {
+        events &= kEventRead | kEventWrite;
+        const unsigned oldEvents = wantedEventsFor(fd);
+        if (events == oldEvents) {
+            return;
+        }
+
+        if (events) {
+            mWanted[fd] = events;
+        } else {
+            mWanted.erase(fd);
+        }
+        if (mUnpollable.count(fd)) {
+            if (!events) {
+                mUnpollable.erase(fd);
+            }
+            return;
+        }
+        if (change(fd, oldEvents, events) < 0 && events) {
+            // kqueue() doesn't take the descriptors it can't poll.
+            mUnpollable.insert(fd);
+        }
+    }
+
+    virtual int wait(int64_t timeout_ms) {
+        clearReady();
+
+        // Nothing to wait on.
+        if (mWanted.empty()) {
+            return 0;
+        }
+
+        const int timeout = mUnpollable.empty() ? pollTimeoutMs(timeout_ms) : 0;
+        struct timespec ts;
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        mEvents.resize(std::min<size_t>(2 * mWanted.size(), kMaxEventsPerWait));
+        int ret;
+        do {
+            ret = ::kevent(mKqueueFd, nullptr, 0, mEvents.data(),
+                           static_cast<int>(mEvents.size()),
+                           timeout < 0 ? nullptr : &ts);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret < 0) {
+            LOG(ERROR) << LogString("Error: %s\n", strerror(errno));
+            return ret;
+        }
+
+        // Reads and writes come as separate events; report each descriptor
+        // once.
+        std::unordered_map<int, size_t> readyIndex;
+        for (int i = 0; i < ret; ++i) {
+            const int fd = static_cast<int>(mEvents[i].ident);
+            unsigned events = 0;
+            if (mEvents[i].flags & EV_ERROR) {
+                events = kEventRead | kEventWrite;
+            } else if (mEvents[i].filter == EVFILT_READ) {
+                events = kEventRead;
+            } else if (mEvents[i].filter == EVFILT_WRITE) {
+                events = kEventWrite;
+            }
+            events &= wantedEventsFor(fd);
+            if (!events) {
+                continue;
+            }
+            const auto it = readyIndex.find(fd);
+            if (it == readyIndex.end()) {
+                readyIndex.emplace(fd, mReady.size());
+                mReady.emplace_back(fd, events);
+            } else {
+                mReady[it->second].second |= events;
+            }
+        }
+        addUnpollableReady();
+        return readyCount();
+    }
+
+private:
+    // Adds and deletes the filters to go from |oldEvents| to |events|.
+    int change(int fd, unsigned oldEvents, unsigned events) {
+        struct kevent changes[2];
+        int count = 0;
+        const unsigned changed = oldEvents ^ events;
+        if (changed & kEventRead) {
+            EV_SET(&changes[count++], fd, EVFILT_READ,
+                   (events & kEventRead) ? EV_ADD : EV_DELETE, 0, 0, nullptr);
+        }
+        if (changed & kEventWrite) {
+            EV_SET(&changes[count++], fd, EVFILT_WRITE,
+                   (events & kEventWrite) ? EV_ADD : EV_DELETE, 0, 0,
+                   nullptr);
+        }
+        // Deleting the filters of a closed descriptor fails, harmlessly.
+        return ::kevent(mKqueueFd, changes, count, nullptr, 0, nullptr);
+    }
+
+    const int mKqueueFd;
+    std::vector<struct kevent> mEvents;
+};
+
+#endif  // __APPLE__
+
+SocketWaiter::Backend backendFromEnvironment() {
+    const std::string name =
+            System::get()->envGet("ANDROID_EMU_SOCKET_WAITER");
+    if (name == "select") {
+        return SocketWaiter::Backend::kSelect;
+    } else if (name == "epoll") {
+        return SocketWaiter::Backend::kEpoll;
+    } else if (name == "kqueue") {
+        return SocketWaiter::Backend::kKqueue;
+    }
+#if defined(__linux__)
+    return SocketWaiter::Backend::kEpoll;
+#elif defined(__APPLE__)
+    return SocketWaiter::Backend::kKqueue;
+#else
+    return SocketWaiter::Backend::kSelect;
+#endif
+}
+
 }  // namespace
 
 // static
-SocketWaiter* SocketWaiter::create() {
+bool SocketWaiter::hasBackend(SocketWaiter::Backend backend) {
+    switch (backend) {
+        case Backend::kDefault:
+        case Backend::kSelect:
+            return true;
+        case Backend::kEpoll:
+#ifdef __linux__
+            return true;
+#else
+            return false;
+#endif
+        case Backend::kKqueue:
+#ifdef __APPLE__
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+// static
+SocketWaiter* SocketWaiter::create(SocketWaiter::Backend backend) {
+    if (backend == Backend::kDefault) {
+        backend = backendFromEnvironment();
+    }
+#ifdef __linux__
+    if (backend == Backend::kEpoll) {
+        std::unique_ptr<EpollSocketWaiter> waiter(new EpollSocketWaiter());
+        if (waiter->isValid()) {
+            return waiter.release();
+        }
+    }
+#endif
+#ifdef __APPLE__
+    if (backend == Backend::kKqueue) {
+        std::unique_ptr<KqueueSocketWaiter> waiter(new KqueueSocketWaiter());
+        if (waiter->isValid()) {
+            return waiter.release();
+        }
+    }
+#endif
     return new SelectSocketWaiter();
 }
 
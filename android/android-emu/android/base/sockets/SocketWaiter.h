@@ -65,8 +65,25 @@ public:
         kEventWrite = (1U << 1),
     };
 
-    // Create new SocketWaiter instance.
-    static SocketWaiter* create();
+    // How the waiter waits. select() works everywhere, but only for
+    // descriptors below FD_SETSIZE, and each wait() costs as much as the
+    // largest one. epoll (Linux) and kqueue (macOS) have neither limit.
+    enum class Backend {
+        // epoll or kqueue where there is one, select() otherwise. The
+        // ANDROID_EMU_SOCKET_WAITER environment variable can force one of
+        // "select", "epoll" or "kqueue".
+        kDefault,
+        kSelect,
+        kEpoll,
+        kKqueue,
+    };
+
+    // Return true iff |backend| can be used on this host.
+    static bool hasBackend(Backend backend);
+
+    // Create new SocketWaiter instance. Falls back to select() if
+    // |backend| isn't available.
+    static SocketWaiter* create(Backend backend = Backend::kDefault);
 
     // Destroy the instance.
     virtual ~SocketWaiter() {}
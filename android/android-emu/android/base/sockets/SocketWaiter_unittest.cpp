@@ -15,6 +15,14 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
 namespace android {
 namespace base {
 
@@ -121,6 +129,101 @@ TEST(SocketWaiter, waitOnWriteEvent) {
     socketClose(s1);
 }
 
+static std::vector<SocketWaiter::Backend> availableBackends() {
+    std::vector<SocketWaiter::Backend> backends;
+    for (auto backend :
+         {SocketWaiter::Backend::kSelect, SocketWaiter::Backend::kEpoll,
+          SocketWaiter::Backend::kKqueue}) {
+        if (SocketWaiter::hasBackend(backend)) {
+            backends.push_back(backend);
+        }
+    }
+    return backends;
+}
+
+TEST(SocketWaiter, allBackends) {
+    for (auto backend : availableBackends()) {
+        SCOPED_TRACE(static_cast<int>(backend));
+        ScopedPtr<SocketWaiter> waiter(SocketWaiter::create(backend));
+
+        int s1, s2;
+        ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+
+        // Nothing to read yet.
+        waiter->update(s1, SocketWaiter::kEventRead);
+        EXPECT_EQ(0, waiter->wait(0));
+
+        // Read and write events on the same fd come together.
+        EXPECT_EQ(1, socketSend(s2, "!", 1));
+        waiter->update(s1, SocketWaiter::kEventRead | SocketWaiter::kEventWrite);
+        EXPECT_LT(0, waiter->wait(1000));
+        unsigned events = 0;
+        EXPECT_EQ(s1, waiter->nextPendingFd(&events));
+        EXPECT_EQ((unsigned)(SocketWaiter::kEventRead |
+                             SocketWaiter::kEventWrite),
+                  events);
+        EXPECT_EQ(events, waiter->pendingEventsFor(s1));
+        EXPECT_EQ(-1, waiter->nextPendingFd(&events));
+
+        // Removed fds aren't reported anymore.
+        waiter->update(s1, 0);
+        EXPECT_FALSE(waiter->hasFds());
+        EXPECT_EQ(0, waiter->wait(0));
+
+        // An fd closed without being removed first doesn't confuse the
+        // waiter when its number is reused.
+        waiter->update(s2, SocketWaiter::kEventWrite);
+        socketClose(s2);
+        int s3, s4;
+        ASSERT_EQ(0, socketCreatePair(&s3, &s4));
+        waiter->update(s2, 0);
+        waiter->update(s3, SocketWaiter::kEventWrite);
+        EXPECT_EQ(1, waiter->wait(1000));
+        EXPECT_EQ(s3, waiter->nextPendingFd(&events));
+        EXPECT_EQ(SocketWaiter::kEventWrite, events);
+
+        socketClose(s1);
+        socketClose(s3);
+        socketClose(s4);
+    }
+}
+
+#ifdef __linux__
+// select() can't wait on fds past FD_SETSIZE, but epoll() can.
+TEST(SocketWaiter, epollBeyondFdSetSize) {
+    // Raised only for the fcntl() below, the rest of the tests don't need it.
+    struct rlimit oldLimit;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &oldLimit));
+    if (oldLimit.rlim_max < FD_SETSIZE + 2) {
+        return;
+    }
+    struct rlimit limit = oldLimit;
+    if (limit.rlim_cur < FD_SETSIZE + 2) {
+        limit.rlim_cur = FD_SETSIZE + 2;
+        ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &limit));
+    }
+
+    ScopedPtr<SocketWaiter> waiter(
+            SocketWaiter::create(SocketWaiter::Backend::kEpoll));
+    int s1, s2;
+    ASSERT_EQ(0, socketCreatePair(&s1, &s2));
+    const int high = fcntl(s1, F_DUPFD_CLOEXEC, FD_SETSIZE);
+    setrlimit(RLIMIT_NOFILE, &oldLimit);
+    ASSERT_GE(high, FD_SETSIZE);
+
+    waiter->update(high, SocketWaiter::kEventRead);
+    EXPECT_EQ(1, socketSend(s2, "!", 1));
+    EXPECT_EQ(1, waiter->wait(1000));
+    unsigned events = 0;
+    EXPECT_EQ(high, waiter->nextPendingFd(&events));
+    EXPECT_EQ(SocketWaiter::kEventRead, events);
+
+    waiter->update(high, 0);
+    close(high);
+    socketClose(s2);
+    socketClose(s1);
+}
+#endif  // __linux__
 
 }  // namespace base
 }  // namespace android
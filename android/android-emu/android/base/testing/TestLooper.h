@@ -31,7 +31,8 @@ public:
 
     // Add some functions to uncover the internal state
     const TimerSet& timers() const;
-    const TimerList& activeTimers() const;
+    // A snapshot, as active timers are spread over the timer wheel.
+    TimerList activeTimers() const;
     const TimerList& pendingTimers() const;
 
     const FdWatchSet& fdWatches() const;
@@ -69,8 +70,8 @@ inline const DefaultLooper::TimerSet& TestLooper::timers() const {
     return mTimers;
 }
 
-inline const DefaultLooper::TimerList& TestLooper::activeTimers() const {
-    return mActiveTimers;
+inline DefaultLooper::TimerList TestLooper::activeTimers() const {
+    return DefaultLooper::activeTimers();
 }
 
 inline const DefaultLooper::TimerList& TestLooper::pendingTimers() const {
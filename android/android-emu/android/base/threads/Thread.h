@@ -133,6 +133,10 @@ private:
 // Helper function to obtain a printable id for the current thread.
 unsigned long getCurrentThreadId();
 
+// Pin the current thread to the CPU core |cpu|. Return false if that failed,
+// or isn't supported on this host (e.g. on Mac).
+bool setCurrentThreadCpuAffinity(int cpu);
+
 // Subclass of Thread covering interruptible threads.
 class InterruptibleThread : public Thread {
     DISALLOW_COPY_ASSIGN_AND_MOVE(InterruptibleThread);
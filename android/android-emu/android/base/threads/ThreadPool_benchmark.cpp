@@ -0,0 +1,90 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares ThreadPool's round robin with WorkStealingThreadPool on items of
+// equal cost, and on skewed ones where one item in 16 costs 32 times more
+// (like the pages that compress badly in a RAM save).
+//
+// The argument is the number of worker threads.
+
+#include "android/base/threads/ThreadPool.h"
+#include "android/base/threads/WorkStealingThreadPool.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <atomic>
+#include <cstdint>
+
+using android::base::ThreadPool;
+using android::base::WorkStealingThreadPool;
+
+namespace {
+
+constexpr int kItemCount = 4096;
+constexpr int kUnitCost = 2000;
+
+struct WorkItem {
+    int cost;
+};
+
+std::atomic<uint64_t> sSink{0};
+
+void process(WorkItem&& item) {
+    uint64_t x = item.cost;
+    for (int i = 0; i < item.cost; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    sSink.fetch_add(x, std::memory_order_relaxed);
+}
+
+int itemCost(int index, bool skewed) {
+    return skewed && index % 16 == 0 ? 32 * kUnitCost : kUnitCost;
+}
+
+template <class Pool>
+void runPool(benchmark::State& state, bool skewed) {
+    while (state.KeepRunning()) {
+        Pool pool(state.range_x(), process);
+        pool.start();
+        for (int i = 0; i < kItemCount; ++i) {
+            pool.enqueue({itemCost(i, skewed)});
+        }
+        pool.done();
+        pool.join();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * kItemCount);
+}
+
+}  // namespace
+
+static void BM_RoundRobin_Uniform(benchmark::State& state) {
+    runPool<ThreadPool<WorkItem>>(state, false);
+}
+
+static void BM_WorkStealing_Uniform(benchmark::State& state) {
+    runPool<WorkStealingThreadPool<WorkItem>>(state, false);
+}
+
+static void BM_RoundRobin_Skewed(benchmark::State& state) {
+    runPool<ThreadPool<WorkItem>>(state, true);
+}
+
+static void BM_WorkStealing_Skewed(benchmark::State& state) {
+    runPool<WorkStealingThreadPool<WorkItem>>(state, true);
+}
+
+BENCHMARK(BM_RoundRobin_Uniform)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_WorkStealing_Uniform)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_RoundRobin_Skewed)->Arg(2)->Arg(4)->Arg(8);
+BENCHMARK(BM_WorkStealing_Skewed)->Arg(2)->Arg(4)->Arg(8);
@@ -18,6 +18,9 @@
 #include "android/base/threads/ThreadStore.h"
 
 #include <assert.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 #include <signal.h>
 #include <stdio.h>
 #ifndef _MSC_VER
@@ -186,5 +189,20 @@ unsigned long getCurrentThreadId() {
     return *reinterpret_cast<unsigned long*>(&tid);
 }
 
+bool setCurrentThreadCpuAffinity(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+    // Mac only has affinity hints, which don't pin anything.
+    return false;
+#endif
+}
+
 }  // namespace base
 }  // namespace android
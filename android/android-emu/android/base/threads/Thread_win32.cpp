@@ -137,5 +137,12 @@ unsigned long getCurrentThreadId() {
     return static_cast<unsigned long>(GetCurrentThreadId());
 }
 
+bool setCurrentThreadCpuAffinity(int cpu) {
+    if (cpu < 0 || cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
 }  // namespace base
 }  // namespace android
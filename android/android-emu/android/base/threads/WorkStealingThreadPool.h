@@ -0,0 +1,315 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/Optional.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/base/threads/FunctorThread.h"
+#include "android/base/threads/Thread.h"
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+//
+// WorkStealingThreadPool<Item> - a drop-in replacement for ThreadPool<Item>
+// for items that take very different time to process.
+//
+// ThreadPool hands the items out round robin, so a slow item holds up all the
+// ones queued behind it on the same worker while the others go idle. Here
+// each worker also takes items from the front of its own queue, but once it
+// runs out it steals them from the other workers' queues.
+//
+// The queues are bounded: enqueue() blocks once all of them are full, which
+// keeps a fast producer from queuing up unbounded memory in front of slower
+// workers. Workers can optionally be pinned to a CPU core each.
+//
+//      WorkStealingThreadPool<WorkItem> tp(
+//              [](WorkItem&& item) { std::cout << item.num; });
+//      CHECK(tp.start()) << "Failed to start the thread pool";
+//      tp.enqueue({1});
+//      tp.enqueue({2});
+//      tp.done();
+//      tp.join();
+//
+// Items enqueued before done() are all processed before the workers exit;
+// nothing may be enqueued after it.
+//
+
+namespace android {
+namespace base {
+
+template <class ItemT>
+class WorkStealingThreadPool {
+    DISALLOW_COPY_AND_ASSIGN(WorkStealingThreadPool);
+
+public:
+    using Item = ItemT;
+    using Processor = std::function<void(Item&&)>;
+
+    struct Options {
+        // Number of workers, 0 for one per CPU core.
+        int threads = 0;
+        // Most items queued per worker before enqueue() blocks.
+        size_t queueCapacity = 256;
+        // Pin worker N to CPU core N modulo the core count.
+        bool pinThreads = false;
+    };
+
+    struct WorkerStats {
+        uint64_t processed = 0;
+        // Items this worker took from the other workers' queues.
+        uint64_t stolen = 0;
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+    };
+
+    struct Stats {
+        std::vector<WorkerStats> workers;
+        // enqueue() calls that had to wait for room in the queues.
+        uint64_t blockedEnqueues = 0;
+    };
+
+    WorkStealingThreadPool(const Options& options, Processor&& processor)
+        : mProcessor(std::move(processor)),
+          mQueueCapacity(std::max<size_t>(1, options.queueCapacity)),
+          mPinThreads(options.pinThreads) {
+        int threads = options.threads;
+        if (threads < 1) {
+            threads = System::get()->getCpuCoreCount();
+        }
+        for (int i = 0; i < threads; ++i) {
+            mWorkers.emplace_back(new Worker());
+        }
+    }
+    WorkStealingThreadPool(int threads, Processor&& processor)
+        : WorkStealingThreadPool(optionsWithThreads(threads),
+                                 std::move(processor)) {}
+    explicit WorkStealingThreadPool(Processor&& processor)
+        : WorkStealingThreadPool(0, std::move(processor)) {}
+    ~WorkStealingThreadPool() {
+        done();
+        join();
+    }
+
+    bool start() {
+        const int cores = std::max(1, System::get()->getCpuCoreCount());
+        for (size_t i = 0; i < mWorkers.size(); ++i) {
+            const int cpu = mPinThreads ? static_cast<int>(i) % cores : -1;
+            auto& worker = *mWorkers[i];
+            worker.thread.reset(new FunctorThread(
+                    [this, i, cpu]() { workerLoop(i, cpu); }));
+            if (worker.thread->start()) {
+                ++mValidWorkersCount;
+            } else {
+                // The others steal whatever lands in its queue.
+                worker.thread.reset();
+            }
+        }
+        return mValidWorkersCount > 0;
+    }
+
+    void done() {
+        AutoLock lock(mLock);
+        mDone = true;
+        mSpaceAvailable.broadcast();
+        mWorkAvailable.broadcastAndUnlock(&lock);
+    }
+
+    void join() {
+        for (auto& worker : mWorkers) {
+            if (worker->thread) {
+                worker->thread->wait();
+                worker->thread.reset();
+            }
+        }
+        mValidWorkersCount = 0;
+    }
+
+    // Blocks while all the queues are full.
+    void enqueue(Item&& item) {
+        if (tryEnqueue(std::move(item))) {
+            return;
+        }
+        mBlockedEnqueues.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            {
+                AutoLock lock(mLock);
+                ++mBlockedProducers;
+                mSpaceAvailable.wait(&lock, [this] {
+                    return mDone || mQueuedCount < queueLimit();
+                });
+                --mBlockedProducers;
+            }
+            if (tryEnqueue(std::move(item))) {
+                return;
+            }
+        }
+    }
+
+    // Returns false, leaving |item| alone, if all the queues are full.
+    bool tryEnqueue(Item&& item) {
+        const size_t count = mWorkers.size();
+        const size_t first =
+                mNextWorkerIndex.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < count; ++i) {
+            Worker& worker = *mWorkers[(first + i) % count];
+            AutoLock lock(worker.lock);
+            if (worker.queue.size() >= mQueueCapacity) {
+                continue;
+            }
+            worker.queue.push_back(std::move(item));
+            worker.maxQueueDepth =
+                    std::max(worker.maxQueueDepth, worker.queue.size());
+            lock.unlock();
+
+            ++mQueuedCount;
+            if (mIdleWorkers > 0) {
+                AutoLock poolLock(mLock);
+                mWorkAvailable.signalAndUnlock(&poolLock);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    int numWorkers() const { return mValidWorkersCount; }
+
+    Stats stats() const {
+        Stats stats;
+        for (const auto& worker : mWorkers) {
+            WorkerStats workerStats;
+            workerStats.processed =
+                    worker->processed.load(std::memory_order_relaxed);
+            workerStats.stolen = worker->stolen.load(std::memory_order_relaxed);
+            AutoLock lock(worker->lock);
+            workerStats.queueDepth = worker->queue.size();
+            workerStats.maxQueueDepth = worker->maxQueueDepth;
+            stats.workers.push_back(workerStats);
+        }
+        stats.blockedEnqueues =
+                mBlockedEnqueues.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Worker {
+        Lock lock;
+        std::deque<Item> queue;
+        size_t maxQueueDepth = 0;
+        std::atomic<uint64_t> processed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::unique_ptr<FunctorThread> thread;
+    };
+
+    static Options optionsWithThreads(int threads) {
+        Options options;
+        options.threads = threads;
+        return options;
+    }
+
+    int64_t queueLimit() const {
+        return static_cast<int64_t>(mQueueCapacity * mWorkers.size());
+    }
+
+    Optional<Item> popFront(Worker* worker) {
+        AutoLock lock(worker->lock);
+        if (worker->queue.empty()) {
+            return {};
+        }
+        Optional<Item> item(std::move(worker->queue.front()));
+        worker->queue.pop_front();
+        return item;
+    }
+
+    // Own queue first, then the others' starting from the next worker.
+    Optional<Item> takeItem(size_t index) {
+        Worker& self = *mWorkers[index];
+        Optional<Item> item = popFront(&self);
+        if (item) {
+            return item;
+        }
+        for (size_t i = 1; i < mWorkers.size(); ++i) {
+            item = popFront(mWorkers[(index + i) % mWorkers.size()].get());
+            if (item) {
+                self.stolen.fetch_add(1, std::memory_order_relaxed);
+                return item;
+            }
+        }
+        return {};
+    }
+
+    void workerLoop(size_t index, int cpu) {
+        if (cpu >= 0) {
+            setCurrentThreadCpuAffinity(cpu);
+        }
+        Worker& self = *mWorkers[index];
+        for (;;) {
+            Optional<Item> item = takeItem(index);
+            if (item) {
+                // The count may dip below zero until the producer that
+                // queued the item increments it.
+                --mQueuedCount;
+                if (mBlockedProducers > 0) {
+                    AutoLock lock(mLock);
+                    mSpaceAvailable.signalAndUnlock(&lock);
+                }
+                mProcessor(std::move(*item));
+                self.processed.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            // Counting this worker as idle before checking for work, and
+            // producers incrementing the count before checking for idle
+            // workers, means one of them always sees the other.
+            AutoLock lock(mLock);
+            ++mIdleWorkers;
+            mWorkAvailable.wait(&lock,
+                                [this] { return mDone || mQueuedCount > 0; });
+            --mIdleWorkers;
+            if (mDone && mQueuedCount <= 0) {
+                return;
+            }
+        }
+    }
+
+    Processor mProcessor;
+    const size_t mQueueCapacity;
+    const bool mPinThreads;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<size_t> mNextWorkerIndex{0};
+    int mValidWorkersCount{0};
+
+    // Items in the queues, across all workers.
+    std::atomic<int64_t> mQueuedCount{0};
+    std::atomic<int> mIdleWorkers{0};
+    std::atomic<int> mBlockedProducers{0};
+    std::atomic<uint64_t> mBlockedEnqueues{0};
+
+    Lock mLock;
+    ConditionVariable mWorkAvailable;
+    ConditionVariable mSpaceAvailable;
+    bool mDone = false;  // Guarded by |mLock|.
+};
+
+}  // namespace base
+}  // namespace android
@@ -0,0 +1,160 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/base/threads/WorkStealingThreadPool.h"
+
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+namespace android {
+namespace base {
+
+namespace {
+
+// A flag the processing function can block on.
+class Gate {
+public:
+    void open() {
+        AutoLock lock(mLock);
+        mOpen = true;
+        mCv.broadcastAndUnlock(&lock);
+    }
+
+    void pass() {
+        AutoLock lock(mLock);
+        mCv.wait(&lock, [this] { return mOpen; });
+    }
+
+private:
+    Lock mLock;
+    ConditionVariable mCv;
+    bool mOpen = false;
+};
+
+using Pool = WorkStealingThreadPool<int>;
+
+}  // namespace
+
+TEST(WorkStealingThreadPool, ProcessesAllItems) {
+    std::atomic<int> sum{0};
+    std::atomic<int> count{0};
+    Pool::Options options;
+    options.threads = 4;
+    options.queueCapacity = 8;
+    options.pinThreads = true;
+    Pool pool(options, [&](int&& item) {
+        sum += item;
+        ++count;
+    });
+    ASSERT_TRUE(pool.start());
+    EXPECT_EQ(4, pool.numWorkers());
+
+    // Several producers, more items than fit in the queues.
+    std::vector<std::unique_ptr<FunctorThread>> producers;
+    for (int p = 0; p < 3; ++p) {
+        producers.emplace_back(new FunctorThread([&pool] {
+            for (int i = 1; i <= 1000; ++i) {
+                pool.enqueue(int(i));
+            }
+        }));
+        producers.back()->start();
+    }
+    for (auto& producer : producers) {
+        producer->wait();
+    }
+    pool.done();
+    pool.join();
+
+    EXPECT_EQ(3000, count);
+    EXPECT_EQ(3 * 500500, sum);
+
+    uint64_t processed = 0;
+    for (const auto& worker : pool.stats().workers) {
+        processed += worker.processed;
+        EXPECT_EQ(0u, worker.queueDepth);
+        EXPECT_LE(worker.maxQueueDepth, 8u);
+    }
+    EXPECT_EQ(3000u, processed);
+}
+
+// Items queued behind a stuck one get processed by the other worker.
+TEST(WorkStealingThreadPool, StealsFromBusyWorker) {
+    Gate gate;
+    std::atomic<int> processed{0};
+    Pool pool(2, [&](int&& item) {
+        if (item == 0) {
+            gate.pass();
+        }
+        ++processed;
+    });
+    ASSERT_TRUE(pool.start());
+
+    for (int i = 0; i < 100; ++i) {
+        pool.enqueue(int(i));
+    }
+    // Everything but the stuck item, half of it queued on the stuck worker.
+    while (processed < 99) {
+        Thread::sleepMs(1);
+    }
+    gate.open();
+    pool.done();
+    pool.join();
+
+    EXPECT_EQ(100, processed);
+    const auto stats = pool.stats();
+    EXPECT_GT(stats.workers[0].stolen + stats.workers[1].stolen, 0u);
+}
+
+TEST(WorkStealingThreadPool, BoundedQueues) {
+    Gate gate;
+    Pool::Options options;
+    options.threads = 1;
+    options.queueCapacity = 2;
+    Pool pool(options, [&](int&& item) { gate.pass(); });
+    ASSERT_TRUE(pool.start());
+
+    // The worker takes the first item and gets stuck, two more fill the
+    // queue.
+    pool.enqueue(0);
+    while (pool.stats().workers[0].queueDepth > 0) {
+        Thread::sleepMs(1);
+    }
+    EXPECT_TRUE(pool.tryEnqueue(1));
+    EXPECT_TRUE(pool.tryEnqueue(2));
+    EXPECT_FALSE(pool.tryEnqueue(3));
+
+    FunctorThread producer([&pool] { pool.enqueue(3); });
+    producer.start();
+    while (pool.stats().blockedEnqueues == 0) {
+        Thread::sleepMs(1);
+    }
+    gate.open();
+    producer.wait();
+    pool.done();
+    pool.join();
+
+    const auto stats = pool.stats();
+    EXPECT_EQ(4u, stats.workers[0].processed);
+    EXPECT_EQ(2u, stats.workers[0].maxQueueDepth);
+    EXPECT_EQ(1u, stats.blockedEnqueues);
+}
+
+}  // namespace base
+}  // namespace android
@@ -28,6 +28,7 @@
 #include "android/automation/AutomationController.h"
 #include "android/avd/BugreportInfo.h"
 #include "android/base/StringView.h"
+#include "android/base/TraceRecorder.h"
 #include "android/base/misc/StringUtils.h"
 #include "android/cmdline-option.h"
 #include "android/console_auth.h"
@@ -3497,6 +3498,95 @@ static const CommandDefRec screenrecord_commands[] = {
 
         {NULL, NULL, NULL, NULL, NULL, NULL}};
 
+/********************************************************************************************/
+/********************************************************************************************/
+/*****                                                                                 ******/
+/*****                          T R A C E   C O M M A N D S                            ******/
+/*****                                                                                 ******/
+/********************************************************************************************/
+/********************************************************************************************/
+
+static int do_trace_start(ControlClient client, char* args) {
+    size_t eventsPerThread = 64 * 1024;
+    if (args && *args) {
+        char* end = nullptr;
+        const long long value = strtoll(args, &end, 10);
+        if (end == args || value <= 0) {
+            control_write(client, "KO: invalid event count '%s'\r\n", args);
+            return -1;
+        }
+        if (static_cast<unsigned long long>(value) >
+            android::base::kMaxTraceEventsPerThread) {
+            control_write(client, "KO: at most %d events per thread\r\n",
+                          static_cast<int>(
+                                  android::base::kMaxTraceEventsPerThread));
+            return -1;
+        }
+        eventsPerThread = static_cast<size_t>(value);
+    }
+    android::base::startTraceRecording(eventsPerThread);
+    return 0;
+}
+
+static int do_trace_stop(ControlClient client, char* args) {
+    android::base::stopTraceRecording();
+    return 0;
+}
+
+static int do_trace_export(ControlClient client, char* args) {
+    std::vector<std::string> splitArgs;
+    android::base::split(args ? args : "", " ",
+                         [&splitArgs](android::base::StringView s) {
+                             if (!s.empty()) {
+                                 splitArgs.push_back(s);
+                             }
+                         });
+    if (splitArgs.empty() || splitArgs.size() > 2) {
+        control_write(client, "KO: expected '<filename> [json|proto]'\r\n");
+        return -1;
+    }
+    auto format = android::base::TraceFormat::Json;
+    if (splitArgs.size() == 2) {
+        if (splitArgs[1] == "proto") {
+            format = android::base::TraceFormat::Protobuf;
+        } else if (splitArgs[1] != "json") {
+            control_write(client, "KO: unknown format '%s'\r\n",
+                          splitArgs[1].c_str());
+            return -1;
+        }
+    }
+    if (!android::base::exportTraceToFile(splitArgs[0], format)) {
+        control_write(client, "KO: could not write '%s'\r\n",
+                      splitArgs[0].c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static const CommandDefRec trace_commands[] = {
+        {"start", "start recording traces",
+         "'trace start [events]' starts recording the traced scopes and "
+         "counters\r\n"
+         "of all the emulator threads, keeping the last [events] of each "
+         "thread\r\n"
+         "(default 65536, at most 4194304). Drops any previous "
+         "recording.\r\n",
+         NULL, do_trace_start, NULL},
+
+        {"stop", "stop recording traces",
+         "'trace stop' stops recording; the recording can still be "
+         "exported.\r\n",
+         NULL, do_trace_stop, NULL},
+
+        {"export", "export the recorded traces",
+         "'trace export <filename> [json|proto]' writes the recording as "
+         "Chrome\r\n"
+         "trace JSON (the default) or as a Perfetto protobuf trace, for\r\n"
+         "ui.perfetto.dev.\r\n",
+         NULL, do_trace_export, NULL},
+
+        {NULL, NULL, NULL, NULL, NULL, NULL}};
+
 /********************************************************************************************/
 /********************************************************************************************/
 /*****                                                                                 ******/
@@ -3988,6 +4078,9 @@ extern const CommandDefRec main_commands[] = {
         {"screenrecord", "Records the emulator's display", NULL, NULL, NULL,
          screenrecord_commands},
 
+        {"trace", "record a timeline of the emulator threads", NULL, NULL,
+         NULL, trace_commands},
+
         {"fold", "fold the device", NULL, NULL, do_fold, NULL},
 
         {"unfold", "unfold the device", NULL, NULL, do_unfold, NULL},
@@ -18,7 +18,10 @@
 #include "android/base/Optional.h"
 #include "android/base/StringFormat.h"
 #include "android/base/files/MemStream.h"
+#include "android/base/synchronization/ConditionVariable.h"
 #include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/base/threads/FunctorThread.h"
 #include "android/base/threads/ThreadStore.h"
 #include "android/crashreport/CrashReporter.h"
 #include "android/emulation/android_pipe_device.h"
@@ -27,6 +30,7 @@
 #include "android/emulation/VmLock.h"
 
 #include <algorithm>
+#include <deque>
 #include <memory>
 #include <string>
 #include <vector>
@@ -467,6 +471,199 @@ AndroidPipe* loadPipeFromStreamCommon(BaseStream* stream,
 
 }  // namespace
 
+// The queue and the worker thread behind enableAsyncGuestSend().
+class AndroidPipe::AsyncSender {
+public:
+    AsyncSender(AndroidPipe* pipe, size_t maxQueuedBytes)
+        : mPipe(pipe),
+          mMaxQueuedBytes(std::max<size_t>(1, maxQueuedBytes)),
+          mThread([this]() { workerLoop(); }) {}
+
+    ~AsyncSender() { stop(); }
+
+    // Called from the device thread.
+    int send(const AndroidPipeBuffer* buffers, int numBuffers) {
+        AutoLock lock(mLock);
+        if (mError) {
+            return mError;
+        }
+        if (mStopping) {
+            return PIPE_ERROR_IO;
+        }
+        if (mQueuedBytes >= mMaxQueuedBytes) {
+            return PIPE_ERROR_AGAIN;
+        }
+        if (!mThreadStarted) {
+            if (!mThread.start()) {
+                return PIPE_ERROR_IO;
+            }
+            mThreadStarted = true;
+        }
+
+        // Small writes are appended to the last chunk, so that the worker
+        // hands them to the service together.
+        size_t room = mMaxQueuedBytes - mQueuedBytes;
+        int result = 0;
+        for (; numBuffers > 0 && room > 0; ++buffers, --numBuffers) {
+            const size_t size = std::min(room, buffers->size);
+            if (mQueue.empty() || mQueue.back().size() >= kChunkSize) {
+                mQueue.emplace_back();
+                mQueue.back().reserve(room < kChunkSize ? room : kChunkSize);
+            }
+            mQueue.back().insert(mQueue.back().end(), buffers->data,
+                                 buffers->data + size);
+            mQueuedBytes += size;
+            room -= size;
+            result += static_cast<int>(size);
+        }
+        if (result > 0) {
+            mWorkAvailable.signal();
+        }
+        return result;
+    }
+
+    unsigned poll(unsigned pipeFlags) const {
+        AutoLock lock(mLock);
+        pipeFlags &= ~PIPE_POLL_OUT;
+        if (mError) {
+            return pipeFlags | PIPE_POLL_HUP;
+        }
+        return mQueuedBytes < mMaxQueuedBytes ? pipeFlags | PIPE_POLL_OUT
+                                              : pipeFlags;
+    }
+
+    // Returns the flags left for the pipe itself.
+    int wantWakeOn(int flags) {
+        if (flags & PIPE_WAKE_WRITE) {
+            AutoLock lock(mLock);
+            if (mError || mQueuedBytes < mMaxQueuedBytes) {
+                lock.unlock();
+                mPipe->signalWakeToGuest(PIPE_WAKE_WRITE);
+            } else {
+                mGuestWantsWrite = true;
+            }
+        }
+        return flags & ~PIPE_WAKE_WRITE;
+    }
+
+    // Returns the flags left for the guest: PIPE_WAKE_WRITE from the pipe
+    // is for the worker.
+    int onPipeWake(int flags) {
+        if (flags & PIPE_WAKE_WRITE) {
+            AutoLock lock(mLock);
+            mPipeWritable = true;
+            mPipeWritableCv.signal();
+        }
+        return flags & ~PIPE_WAKE_WRITE;
+    }
+
+    // Waits until the worker has handed all the queued data to the pipe.
+    void flush() {
+        AutoLock lock(mLock);
+        mDrained.wait(&lock, [this] { return mQueuedBytes == 0; });
+    }
+
+    void stop() {
+        AutoLock lock(mLock);
+        if (!mThreadStarted) {
+            return;
+        }
+        mStopping = true;
+        mWorkAvailable.signal();
+        mPipeWritableCv.signal();
+        lock.unlock();
+        mThread.wait();
+        mThreadStarted = false;
+    }
+
+private:
+    static constexpr size_t kChunkSize = 64 * 1024;
+    static constexpr System::Duration kRetryTimeoutUs = 10 * 1000;
+
+    void workerLoop() {
+        for (;;) {
+            std::vector<uint8_t> chunk;
+            {
+                AutoLock lock(mLock);
+                mWorkAvailable.wait(&lock, [this] {
+                    return mStopping || !mQueue.empty();
+                });
+                if (mQueue.empty()) {
+                    return;
+                }
+                // The chunk stays counted in |mQueuedBytes| until it's sent.
+                chunk = std::move(mQueue.front());
+                mQueue.pop_front();
+            }
+
+            int error = 0;
+            size_t pos = 0;
+            while (pos < chunk.size()) {
+                AndroidPipeBuffer buffer = {chunk.data() + pos,
+                                            chunk.size() - pos};
+                const int ret = mPipe->onGuestSend(&buffer, 1);
+                if (ret > 0) {
+                    pos += ret;
+                } else if (ret == PIPE_ERROR_AGAIN) {
+                    AutoLock lock(mLock);
+                    if (mStopping) {
+                        error = PIPE_ERROR_IO;
+                        break;
+                    }
+                    const auto waitUntilUs =
+                            System::get()->getUnixTimeUs() + kRetryTimeoutUs;
+                    while (!mPipeWritable && !mStopping &&
+                           mPipeWritableCv.timedWait(&mLock, waitUntilUs)) {
+                    }
+                    mPipeWritable = false;
+                } else {
+                    error = ret ? ret : PIPE_ERROR_IO;
+                    break;
+                }
+            }
+
+            AutoLock lock(mLock);
+            mQueuedBytes -= chunk.size();
+            if (error) {
+                DD("%s: pipe [%s] failed with %d, dropping %zu queued bytes",
+                   __func__, mPipe->name(), error, mQueuedBytes);
+                mError = error;
+                mQueue.clear();
+                mQueuedBytes = 0;
+            }
+            const bool wakeGuest = mGuestWantsWrite &&
+                                   (mError || mQueuedBytes < mMaxQueuedBytes);
+            if (wakeGuest) {
+                mGuestWantsWrite = false;
+            }
+            if (mQueuedBytes == 0) {
+                mDrained.broadcast();
+            }
+            lock.unlock();
+
+            if (wakeGuest) {
+                mPipe->signalWakeToGuest(PIPE_WAKE_WRITE);
+            }
+        }
+    }
+
+    AndroidPipe* const mPipe;
+    const size_t mMaxQueuedBytes;
+
+    mutable Lock mLock;
+    ConditionVariable mWorkAvailable;
+    ConditionVariable mDrained;
+    ConditionVariable mPipeWritableCv;
+    std::deque<std::vector<uint8_t>> mQueue;
+    size_t mQueuedBytes = 0;
+    int mError = 0;
+    bool mGuestWantsWrite = false;
+    bool mPipeWritable = false;
+    bool mStopping = false;
+    bool mThreadStarted = false;
+    FunctorThread mThread;
+};
+
 // static
 void AndroidPipe::initThreading(VmLock* vmLock) {
     sGlobals->pipeWaker.init(vmLock);
@@ -477,11 +674,18 @@ void AndroidPipe::initThreadingForTest(VmLock* vmLock, base::Looper* looper) {
     sGlobals->pipeWaker.init(vmLock, looper);
 }
 
+AndroidPipe::AndroidPipe(void* hwPipe, Service* service)
+    : mHwPipe(hwPipe), mService(service) {}
+
 AndroidPipe::~AndroidPipe() {
     DD("%s: for hwpipe=%p (host %p '%s')", __FUNCTION__, mHwPipe, this,
        mService->name().c_str());
 }
 
+void AndroidPipe::enableAsyncGuestSend(size_t maxQueuedBytes) {
+    mAsyncSender.reset(new AsyncSender(this, maxQueuedBytes));
+}
+
 // static
 void AndroidPipe::Service::add(Service* service) {
     DD("Adding new pipe service '%s' this=%p", service->name().c_str(),
@@ -497,6 +701,16 @@ void AndroidPipe::Service::resetAll() {
 }
 
 void AndroidPipe::signalWake(int wakeFlags) {
+    if (mAsyncSender) {
+        wakeFlags = mAsyncSender->onPipeWake(wakeFlags);
+        if (!wakeFlags) {
+            return;
+        }
+    }
+    signalWakeToGuest(wakeFlags);
+}
+
+void AndroidPipe::signalWakeToGuest(int wakeFlags) {
     // i.e., pipe not using normal pipe device
     if (mFlags) return;
     if (!mHwPipe) {
@@ -553,6 +767,9 @@ void AndroidPipe::saveToStream(BaseStream* stream) {
 
     // Save pipe-specific state now.
     if (mService->canLoad()) {
+        if (mAsyncSender) {
+            mAsyncSender->flush();
+        }
         mService->savePipe(this, &pipeStream);
     }
 
@@ -563,6 +780,38 @@ void AndroidPipe::saveToStream(BaseStream* stream) {
     pipeStream.save(stream);
 }
 
+int AndroidPipe::guestSend(const AndroidPipeBuffer* buffers, int numBuffers) {
+    if (mAsyncSender) {
+        return mAsyncSender->send(buffers, numBuffers);
+    }
+    return onGuestSend(buffers, numBuffers);
+}
+
+unsigned AndroidPipe::guestPoll() const {
+    const unsigned flags = onGuestPoll();
+    return mAsyncSender ? mAsyncSender->poll(flags) : flags;
+}
+
+void AndroidPipe::guestWantWakeOn(int flags) {
+    if (mAsyncSender) {
+        flags = mAsyncSender->wantWakeOn(flags);
+        if (!flags) {
+            return;
+        }
+    }
+    onGuestWantWakeOn(flags);
+}
+
+void AndroidPipe::guestClose(PipeCloseReason reason) {
+    abortPendingOperation();
+    if (mAsyncSender) {
+        // Deliver what the guest already wrote, and make sure the worker is
+        // done with the pipe before it goes away.
+        mAsyncSender->stop();
+    }
+    onGuestClose(reason);
+}
+
 // static
 AndroidPipe* AndroidPipe::loadFromStream(BaseStream* stream,
                                          void* hwPipe,
@@ -642,8 +891,7 @@ void android_pipe_guest_close(void* internalPipe, PipeCloseReason reason) {
     if (pipe) {
         D("%s: host=%p [%s] reason=%d", __FUNCTION__, pipe, pipe->name(),
             (int)reason);
-        pipe->abortPendingOperation();
-        pipe->onGuestClose(reason);
+        pipe->guestClose(reason);
     }
 }
 
@@ -780,7 +1028,7 @@ unsigned android_pipe_guest_poll(void* internalPipe) {
     CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
     DD("%s: host=%p [%s]", __FUNCTION__, pipe, pipe->name());
-    return pipe->onGuestPoll();
+    return pipe->guestPoll();
 }
 
 int android_pipe_guest_recv(void* internalPipe,
@@ -800,13 +1048,13 @@ int android_pipe_guest_send(void* internalPipe,
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
     // Note that pipe may be deleted during this call, so it's not safe to
     // access pipe after this point.
-    return pipe->onGuestSend(buffers, numBuffers);
+    return pipe->guestSend(buffers, numBuffers);
 }
 
 void android_pipe_guest_wake_on(void* internalPipe, unsigned wakes) {
     CHECK_VM_STATE_LOCK();
     auto pipe = static_cast<AndroidPipe*>(internalPipe);
-    pipe->onGuestWantWakeOn(wakes);
+    pipe->guestWantWakeOn(wakes);
 }
 
 // API implemented by the virtual device.
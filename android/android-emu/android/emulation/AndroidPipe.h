@@ -15,6 +15,8 @@
 #include "android/emulation/android_pipe_common.h"
 #include "android/emulation/VmLock.h"
 
+#include <memory>
+
 namespace android {
 
 namespace base {
@@ -44,6 +46,9 @@ class Looper;
 // A few methods can be called from any thread though, see signalWake() and
 // closeFromHost().
 //
+// A pipe whose onGuestSend() is slow can move it off the device thread with
+// enableAsyncGuestSend(), see below.
+//
 // Usage is the following:
 //
 // 1) At emulation setup time (i.e. before the VM runs), call
@@ -206,6 +211,13 @@ public:
     // Save an AndroidPipe instance state to a file |stream|.
     void saveToStream(android::base::Stream* stream);
 
+    // Forward the guest operations to the onGuestXXX methods, through the
+    // asynchronous send queue if the pipe enabled it.
+    int guestSend(const AndroidPipeBuffer* buffers, int numBuffers);
+    unsigned guestPoll() const;
+    void guestWantWakeOn(int flags);
+    void guestClose(PipeCloseReason reason);
+
     // Load an AndroidPipe instance from its saved state from |stream|.
     // |hwPipe| is the hardware-side view of the pipe. On success, return
     // a new instance pointer and sets |*pForceClose| to 0 or 1. A value
@@ -236,13 +248,35 @@ protected:
     AndroidPipe() = delete;
 
     // Constructor used by derived classes only.
-    AndroidPipe(void* hwPipe, Service* service)
-        : mHwPipe(hwPipe), mService(service) {}
+    AndroidPipe(void* hwPipe, Service* service);
+
+    // Makes guest writes asynchronous. Call it from the constructor.
+    //
+    // The data of each guest write is copied into a queue, and the write
+    // completes right away; a worker thread of the pipe's own then hands it
+    // to onGuestSend(), without the VM lock, so that a slow service doesn't
+    // stall the vCPU. Once |maxQueuedBytes| are queued, guest writes get
+    // PIPE_ERROR_AGAIN, and PIPE_WAKE_WRITE when there's room again;
+    // onGuestPoll() only decides the other flags than PIPE_POLL_OUT.
+    //
+    // onGuestSend() may thus run concurrently with the other callbacks.
+    // PIPE_ERROR_AGAIN from it makes the worker retry after the pipe calls
+    // signalWake(PIPE_WAKE_WRITE), or after a short while. Other errors, or
+    // EOF, drop the queue and fail the following guest writes. The queue
+    // is flushed before onSave() and onGuestClose().
+    void enableAsyncGuestSend(size_t maxQueuedBytes = 1024 * 1024);
 
     void* const mHwPipe = nullptr;
     Service* mService = nullptr;
     std::string mArgs;
     AndroidPipeFlags mFlags = ANDROID_PIPE_DEFAULT;
+
+private:
+    class AsyncSender;
+
+    void signalWakeToGuest(int flags);
+
+    std::unique_ptr<AsyncSender> mAsyncSender;
 };
 
 }  // namespace android
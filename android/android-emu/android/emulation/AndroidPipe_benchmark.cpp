@@ -0,0 +1,169 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Pipe bandwidth through the 'zero' service, which discards writes and reads
+// back zeroes, and the 'pingpong' one, which echoes back whatever it gets.
+// Both do next to no work of their own, so these measure the cost of a
+// transfer through AndroidPipe. The argument is the size of each transfer in
+// bytes.
+//
+// This is the AndroidPipe service overhead only: TestAndroidPipeDevice hands
+// host buffers straight to the service ops, so none of the virtual device in
+// hw/misc/goldfish_pipe.c (guest address translation, buffer merging) is
+// part of the measurement.
+//
+// BM_SlowPipe_Write measures how long a guest write keeps the vCPU busy when
+// the service takes a while to consume the data, with the argument set to 0
+// for the default synchronous pipe, or 1 for an asynchronous one (see
+// AndroidPipe::enableAsyncGuestSend()).
+
+#include "android/base/Log.h"
+#include "android/base/system/System.h"
+#include "android/emulation/AndroidPipe.h"
+#include "android/emulation/testing/TestAndroidPipeDevice.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <memory>
+#include <string>
+
+extern "C" void android_pipe_add_type_pingpong(void);
+extern "C" void android_pipe_add_type_zero(void);
+
+using android::AndroidPipe;
+using android::base::System;
+using android::TestAndroidPipeDevice;
+using Guest = android::TestAndroidPipeDevice::Guest;
+
+namespace {
+
+constexpr System::WallDuration kSlowSendUs = 50;
+constexpr size_t kSlowWriteSize = 4096;
+
+// Spends |kSlowSendUs| on each send, like a service that writes to a file.
+class SlowPipe : public AndroidPipe {
+public:
+    SlowPipe(void* hwPipe, Service* service, bool async)
+        : AndroidPipe(hwPipe, service) {
+        if (async) {
+            enableAsyncGuestSend();
+        }
+    }
+
+    void onGuestClose(PipeCloseReason reason) override { delete this; }
+    unsigned onGuestPoll() const override { return PIPE_POLL_OUT; }
+    int onGuestRecv(AndroidPipeBuffer* buffers, int numBuffers) override {
+        return PIPE_ERROR_IO;
+    }
+    int onGuestSend(const AndroidPipeBuffer* buffers,
+                    int numBuffers) override {
+        const auto start = System::get()->getHighResTimeUs();
+        while (System::get()->getHighResTimeUs() - start < kSlowSendUs) {
+        }
+        int count = 0;
+        for (int i = 0; i < numBuffers; ++i) {
+            count += static_cast<int>(buffers[i].size);
+        }
+        return count;
+    }
+    void onGuestWantWakeOn(int flags) override {}
+};
+
+class SlowService : public AndroidPipe::Service {
+public:
+    explicit SlowService(bool async) : Service("slow"), mAsync(async) {}
+
+    AndroidPipe* create(void* hwPipe, const char* args) override {
+        return new SlowPipe(hwPipe, this, mAsync);
+    }
+
+private:
+    const bool mAsync;
+};
+
+class BenchmarkPipeDevice : public TestAndroidPipeDevice {
+public:
+    BenchmarkPipeDevice() {
+        android_pipe_add_type_pingpong();
+        android_pipe_add_type_zero();
+    }
+};
+
+class SlowPipeDevice : public TestAndroidPipeDevice {
+public:
+    explicit SlowPipeDevice(bool async) {
+        AndroidPipe::Service::add(new SlowService(async));
+    }
+};
+
+std::unique_ptr<Guest> connectGuest(const char* service) {
+    std::unique_ptr<Guest> guest(Guest::create());
+    CHECK(guest->connect(service) == 0) << "Can't connect to " << service;
+    return guest;
+}
+
+}  // namespace
+
+static void BM_ZeroPipe_Write(benchmark::State& state) {
+    BenchmarkPipeDevice dev;
+    auto guest = connectGuest("zero");
+    const std::string buffer(state.range_x(), 'x');
+    while (state.KeepRunning()) {
+        guest->write(buffer.data(), buffer.size());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range_x());
+}
+
+static void BM_ZeroPipe_Read(benchmark::State& state) {
+    BenchmarkPipeDevice dev;
+    auto guest = connectGuest("zero");
+    std::string buffer(state.range_x(), 'x');
+    while (state.KeepRunning()) {
+        guest->read(&buffer[0], buffer.size());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range_x());
+}
+
+static void BM_PingPongPipe_RoundTrip(benchmark::State& state) {
+    BenchmarkPipeDevice dev;
+    auto guest = connectGuest("pingpong");
+    std::string buffer(state.range_x(), 'x');
+    while (state.KeepRunning()) {
+        guest->write(buffer.data(), buffer.size());
+        guest->read(&buffer[0], buffer.size());
+    }
+    // Each byte goes both ways.
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range_x() * 2);
+}
+
+static void BM_SlowPipe_Write(benchmark::State& state) {
+    SlowPipeDevice dev(state.range_x() != 0);
+    auto guest = connectGuest("slow");
+    const std::string buffer(kSlowWriteSize, 'x');
+    int64_t retries = 0;
+    while (state.KeepRunning()) {
+        // A full queue sends the guest back to wait for PIPE_WAKE_WRITE,
+        // which doesn't take the vCPU either.
+        if (guest->write(buffer.data(), buffer.size()) == PIPE_ERROR_AGAIN) {
+            ++retries;
+        }
+    }
+    state.SetLabel(std::to_string(retries) + " full queue");
+    state.SetBytesProcessed(int64_t(state.iterations()) * kSlowWriteSize);
+}
+
+BENCHMARK(BM_ZeroPipe_Write)->Range(64, 1 << 20);
+BENCHMARK(BM_ZeroPipe_Read)->Range(64, 1 << 20);
+BENCHMARK(BM_PingPongPipe_RoundTrip)->Range(64, 1 << 20);
+BENCHMARK(BM_SlowPipe_Write)->Arg(0)->Arg(1);
@@ -0,0 +1,185 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/emulation/AndroidPipe.h"
+
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/base/threads/FunctorThread.h"
+#include "android/emulation/testing/TestAndroidPipeDevice.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+namespace android {
+
+using base::AutoLock;
+using base::ConditionVariable;
+using base::Lock;
+using Guest = TestAndroidPipeDevice::Guest;
+
+namespace {
+
+constexpr size_t kMaxQueuedBytes = 16;
+
+// What the pipes of the 'async' service got, and a gate to hold them in
+// onGuestSend().
+struct AsyncSink {
+    Lock lock;
+    ConditionVariable cv;
+    std::string received;
+    bool open = true;
+    int result = 0;  // If non-zero, returned from onGuestSend().
+    bool closed = false;
+
+    void setOpen(bool value) {
+        AutoLock l(lock);
+        open = value;
+        cv.broadcast();
+    }
+
+    std::string waitFor(size_t size) {
+        AutoLock l(lock);
+        cv.wait(&l, [this, size] { return received.size() >= size; });
+        return received;
+    }
+};
+
+class AsyncPipe : public AndroidPipe {
+public:
+    AsyncPipe(void* hwPipe, Service* service, AsyncSink* sink)
+        : AndroidPipe(hwPipe, service), mSink(sink) {
+        enableAsyncGuestSend(kMaxQueuedBytes);
+    }
+
+    void onGuestClose(PipeCloseReason reason) override {
+        AutoLock l(mSink->lock);
+        mSink->closed = true;
+        l.unlock();
+        delete this;
+    }
+    unsigned onGuestPoll() const override { return PIPE_POLL_OUT; }
+    int onGuestRecv(AndroidPipeBuffer* buffers, int numBuffers) override {
+        return PIPE_ERROR_IO;
+    }
+    int onGuestSend(const AndroidPipeBuffer* buffers,
+                    int numBuffers) override {
+        AutoLock l(mSink->lock);
+        mSink->cv.wait(&l, [this] { return mSink->open; });
+        if (mSink->result) {
+            return mSink->result;
+        }
+        int count = 0;
+        for (int i = 0; i < numBuffers; ++i) {
+            mSink->received.append(reinterpret_cast<char*>(buffers[i].data),
+                                   buffers[i].size);
+            count += static_cast<int>(buffers[i].size);
+        }
+        mSink->cv.broadcast();
+        return count;
+    }
+    void onGuestWantWakeOn(int flags) override {}
+
+private:
+    AsyncSink* const mSink;
+};
+
+class AsyncService : public AndroidPipe::Service {
+public:
+    explicit AsyncService(AsyncSink* sink) : Service("async"), mSink(sink) {}
+
+    AndroidPipe* create(void* hwPipe, const char* args) override {
+        return new AsyncPipe(hwPipe, this, mSink);
+    }
+
+private:
+    AsyncSink* const mSink;
+};
+
+class AndroidPipeAsyncTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        AndroidPipe::Service::add(new AsyncService(&mSink));
+        mGuest.reset(Guest::create());
+        ASSERT_EQ(0, mGuest->connect("async"));
+    }
+
+    TestAndroidPipeDevice mDevice;
+    AsyncSink mSink;
+    std::unique_ptr<Guest> mGuest;
+};
+
+}  // namespace
+
+TEST_F(AndroidPipeAsyncTest, WritesDontWaitForThePipe) {
+    mSink.setOpen(false);
+    EXPECT_EQ(3, mGuest->write("abc", 3));
+    EXPECT_EQ(3, mGuest->write("def", 3));
+    EXPECT_EQ(unsigned(PIPE_POLL_OUT), mGuest->poll());
+
+    mSink.setOpen(true);
+    EXPECT_EQ("abcdef", mSink.waitFor(6));
+}
+
+TEST_F(AndroidPipeAsyncTest, FullQueue) {
+    mSink.setOpen(false);
+    const std::string data(kMaxQueuedBytes + 4, 'x');
+    // Only what fits is taken.
+    EXPECT_EQ(int(kMaxQueuedBytes), mGuest->write(data.data(), data.size()));
+    EXPECT_EQ(0u, mGuest->poll() & PIPE_POLL_OUT);
+    EXPECT_EQ(PIPE_ERROR_AGAIN, mGuest->write("y", 1));
+
+    mSink.setOpen(true);
+    EXPECT_EQ(data.substr(0, kMaxQueuedBytes), mSink.waitFor(kMaxQueuedBytes));
+}
+
+TEST_F(AndroidPipeAsyncTest, CloseDeliversQueuedData) {
+    mSink.setOpen(false);
+    EXPECT_EQ(5, mGuest->write("hello", 5));
+
+    base::FunctorThread opener([this] {
+        mSink.setOpen(true);
+    });
+    opener.start();
+    mGuest->close();
+    opener.wait();
+
+    AutoLock l(mSink.lock);
+    EXPECT_EQ("hello", mSink.received);
+    EXPECT_TRUE(mSink.closed);
+}
+
+TEST_F(AndroidPipeAsyncTest, PipeErrorFailsNextWrite) {
+    {
+        AutoLock l(mSink.lock);
+        mSink.result = PIPE_ERROR_IO;
+    }
+    EXPECT_EQ(3, mGuest->write("abc", 3));
+
+    // The error shows up once the worker got to it.
+    int result = 0;
+    for (int i = 0; i < 1000 && result >= 0; ++i) {
+        result = mGuest->write("d", 1);
+        if (result >= 0) {
+            base::System::get()->sleepMs(1);
+        }
+    }
+    EXPECT_EQ(PIPE_ERROR_IO, result);
+    EXPECT_NE(0u, mGuest->poll() & PIPE_POLL_HUP);
+}
+
+}  // namespace android
@@ -25,7 +25,11 @@ namespace emulation {
 static base::Lock sLogcatStreamLock;
 static std::vector<std::unique_ptr<std::ostream>> sLogcatOutputStreams;
 
-LogcatPipe::LogcatPipe(void* hwPipe, Service* svc) : AndroidPipe(hwPipe, svc) {}
+LogcatPipe::LogcatPipe(void* hwPipe, Service* svc) : AndroidPipe(hwPipe, svc) {
+    // Writing and flushing the output files can take a while; don't make
+    // the guest wait for it.
+    enableAsyncGuestSend();
+}
 
 void LogcatPipe::registerStream(std::ostream* stream) {
     base::AutoLock lock(sLogcatStreamLock);
@@ -21,9 +21,11 @@
 #include "android/base/memory/LazyInstance.h"
 #include "android/base/SubAllocator.h"
 #include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
 #include "android/crashreport/crash-handler.h"
 #include "android/globals.h"
 
+#include <algorithm>
 #include <memory>
 
 #define ASGFX_DEBUG 0
@@ -38,6 +40,7 @@ using android::base::AutoLock;
 using android::base::Lock;
 using android::base::LazyInstance;
 using android::base::SubAllocator;
+using android::base::System;
 
 namespace android {
 namespace emulation {
@@ -364,44 +367,68 @@ void AddressSpaceGraphicsContext::perform(AddressSpaceDevicePingInfo* info) {
     }
 }
 
-int AddressSpaceGraphicsContext::onUnavailableRead() {
-    static const uint32_t kMaxUnavailableReads = 8;
-
-    ++mUnavailableReadCount;
-    ring_buffer_yield();
-
-    ConsumerCommand cmd;
+bool AddressSpaceGraphicsContext::hasPendingData() const {
+    return ring_buffer_available_read(mHostContext.to_host, 0) ||
+           ring_buffer_available_read(mHostContext.to_host_large_xfer.ring,
+                                      &mHostContext.to_host_large_xfer.view);
+}
 
-    if (mExiting) {
-        mUnavailableReadCount = kMaxUnavailableReads;
+int AddressSpaceGraphicsContext::onUnavailableRead() {
+    // How long to spin before parking adapts to the guest: waits that end
+    // while spinning raise the budget to twice their length, and each park
+    // halves it. A guest streaming commands keeps the consumer spinning, an
+    // idle one costs next to no CPU.
+    static constexpr System::WallDuration kMinSpinUs = 10;
+    static constexpr System::WallDuration kMaxSpinUs = 1000;
+
+    const auto startUs = System::get()->getHighResTimeUs();
+    while (!mExiting) {
+        if (hasPendingData()) {
+            const auto waitedUs = System::get()->getHighResTimeUs() - startUs;
+            mSpinBudgetUs = std::min(kMaxSpinUs,
+                                     std::max(mSpinBudgetUs, 2 * waitedUs));
+            return 0;
+        }
+        if (System::get()->getHighResTimeUs() - startUs >= mSpinBudgetUs) {
+            break;
+        }
+        ring_buffer_yield();
     }
+    mSpinBudgetUs = std::max(kMinSpinUs, mSpinBudgetUs / 2);
 
-    if (mUnavailableReadCount >= kMaxUnavailableReads) {
-        mUnavailableReadCount = 0;
+    ConsumerCommand cmd;
 
 sleep:
-        *(mHostContext.host_state) = ASG_HOST_STATE_NEED_NOTIFY;
-        mConsumerMessages.receive(&cmd);
-
-        switch (cmd) {
-            case ConsumerCommand::Wakeup:
-                *(mHostContext.host_state) = ASG_HOST_STATE_CAN_CONSUME;
-                break;
-            case ConsumerCommand::Exit:
-                *(mHostContext.host_state) = ASG_HOST_STATE_EXIT;
-                return -1;
-            case ConsumerCommand::Sleep:
-                goto sleep;
-            default:
-                crashhandler_die(
-                    "AddressSpaceGraphicsContext::onUnavailableRead: "
-                    "Unknown command: 0x%x\n",
-                    (uint32_t)cmd);
-        }
+    __atomic_store_n(mHostContext.host_state, ASG_HOST_STATE_NEED_NOTIFY,
+                     __ATOMIC_SEQ_CST);
+
+    // The guest checks the host state after writing, so anything it wrote
+    // before seeing NEED_NOTIFY came without a ping and must be consumed
+    // now.
+    if (!mExiting && hasPendingData()) {
+        *(mHostContext.host_state) = ASG_HOST_STATE_CAN_CONSUME;
+        return 0;
+    }
 
-        return 1;
+    mConsumerMessages.receive(&cmd);
+
+    switch (cmd) {
+        case ConsumerCommand::Wakeup:
+            *(mHostContext.host_state) = ASG_HOST_STATE_CAN_CONSUME;
+            break;
+        case ConsumerCommand::Exit:
+            *(mHostContext.host_state) = ASG_HOST_STATE_EXIT;
+            return -1;
+        case ConsumerCommand::Sleep:
+            goto sleep;
+        default:
+            crashhandler_die(
+                "AddressSpaceGraphicsContext::onUnavailableRead: "
+                "Unknown command: 0x%x\n",
+                (uint32_t)cmd);
     }
-    return 0;
+
+    return 1;
 }
 
 AddressSpaceDeviceType AddressSpaceGraphicsContext::getDeviceType() const {
@@ -60,6 +60,7 @@ private:
 
     // For ConsumerCallbacks
     int onUnavailableRead();
+    bool hasPendingData() const;
 
     // Data layout
     uint32_t mVersion = 1;
@@ -76,7 +77,7 @@ private:
     base::MessageChannel<ConsumerCommand, 4> mConsumerMessages;
     uint32_t mExiting = 0;
     // For onUnavailableRead
-    uint32_t mUnavailableReadCount = 0;
+    uint64_t mSpinBudgetUs = 200;
 };
 
 }  // namespace asg
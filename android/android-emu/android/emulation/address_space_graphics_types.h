@@ -282,8 +282,10 @@ namespace asg {
 // Called by the consumer, implemented in AddressSpaceGraphicsContext:
 //
 // Called when the consumer doesn't find anything to
-// read in to_host. Will make the consumer sleep
-// until another Ping(NotifyAvailable).
+// read in to_host. Spins for a while in case the guest
+// is about to write more, then makes the consumer sleep
+// until another Ping(NotifyAvailable). Returns -1 if the
+// consumer should exit.
 using OnUnavailableReadCallback =
     std::function<int()>;
 
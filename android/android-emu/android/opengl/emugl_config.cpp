@@ -13,6 +13,7 @@
 #include "android/opengl/gpuinfo.h"
 
 #include "android/base/StringFormat.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/system/System.h"
 #include "android/crashreport/crash-handler.h"
 #include "android/globals.h"
@@ -35,6 +36,7 @@
 #define D(...)  crashhandler_append_message_format(__VA_ARGS__)
 #endif
 
+using android::base::PathUtils;
 using android::base::RunOptions;
 using android::base::StringFormat;
 using android::base::System;
@@ -174,6 +176,18 @@ void free_emugl_host_gpu_props(emugl_host_gpu_prop_list proplist) {
     delete [] proplist.props;
 }
 
+char* emuglConfig_get_shader_cache_dir(const char* avd_content_path) {
+    System* system = System::get();
+    if (system->envTest("ANDROID_EMU_SHADER_CACHE_DIR")) {
+        return strdup(
+                system->envGet("ANDROID_EMU_SHADER_CACHE_DIR").c_str());
+    }
+    if (!avd_content_path) {
+        return strdup("");
+    }
+    return strdup(PathUtils::join(avd_content_path, "shader-cache").c_str());
+}
+
 static void setCurrentRenderer(const char* gpuMode) {
     sCurrentRenderer = emuglConfig_get_renderer(gpuMode);
 }
@@ -111,6 +111,13 @@ bool emuglConfig_current_renderer_supports_snapshot();
 
 void free_emugl_host_gpu_props(emugl_host_gpu_prop_list props);
 
+// Returns the directory the GLES translator keeps its on-disk shader cache
+// in: ANDROID_EMU_SHADER_CACHE_DIR if it is set, "shader-cache" under
+// |avd_content_path| otherwise. An empty result disables the cache, and so
+// does a NULL |avd_content_path| without the override. The caller must
+// free() the result.
+char* emuglConfig_get_shader_cache_dir(const char* avd_content_path);
+
 // Initialize an EmuglConfig instance based on the AVD's hardware properties
 // and the command-line -gpu option, if any.
 //
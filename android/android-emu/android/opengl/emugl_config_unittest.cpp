@@ -13,11 +13,14 @@
 #include "android/opengl/EmuglBackendList.h"
 #include "android/opengl/gpuinfo.h"
 
+#include "android/base/files/PathUtils.h"
 #include "android/base/testing/TestSystem.h"
 #include "android/base/testing/TestTempDir.h"
 
 #include <gtest/gtest.h>
 
+#include <stdlib.h>
+
 namespace android {
 namespace base {
 
@@ -578,5 +581,26 @@ TEST(EmuglConfig, hostGpuProps_empty) {
     free_emugl_host_gpu_props(gpu_props);
 }
 
+TEST(EmuglConfig, shaderCacheDir) {
+    TestSystem testSys("/usr", 32);
+
+    // By default, the cache lives in the AVD directory.
+    char* dir = emuglConfig_get_shader_cache_dir("/avd/foo.avd");
+    EXPECT_STREQ(PathUtils::join("/avd/foo.avd", "shader-cache").c_str(),
+                 dir);
+    free(dir);
+
+    // Without an AVD, there is no cache.
+    dir = emuglConfig_get_shader_cache_dir(nullptr);
+    EXPECT_STREQ("", dir);
+    free(dir);
+
+    // The environment overrides the AVD directory.
+    testSys.envSet("ANDROID_EMU_SHADER_CACHE_DIR", "/tmp/shaders");
+    dir = emuglConfig_get_shader_cache_dir("/avd/foo.avd");
+    EXPECT_STREQ("/tmp/shaders", dir);
+    free(dir);
+}
+
 }  // namespace base
 }  // namespace android
@@ -12,6 +12,7 @@
 
 #include "android/opengles.h"
 
+#include "android/avd/info.h"
 #include "android/base/CpuUsage.h"
 #include "android/base/GLObjectCounter.h"
 #include "android/base/files/PathUtils.h"
@@ -238,6 +239,11 @@ android_startOpenglesRenderer(int width, int height, bool guestPhoneApi, int gue
     logfuncs.fine = android_opengl_cxt_logger_write;
     sRenderLib->setLogger(logfuncs);
     sRenderLib->setGLObjectCounter(android::base::GLObjectCounter::get());
+    char* shaderCacheDir = emuglConfig_get_shader_cache_dir(
+            android_avdInfo ? avdInfo_getContentPath(android_avdInfo)
+                            : nullptr);
+    sRenderLib->setShaderCacheDir(shaderCacheDir);
+    free(shaderCacheDir);
     emugl_dma_ops dma_ops;
     dma_ops.get_host_addr = android_goldfish_dma_ops.get_host_addr;
     dma_ops.unlock = android_goldfish_dma_ops.unlock;
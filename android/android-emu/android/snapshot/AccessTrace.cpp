@@ -0,0 +1,91 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/AccessTrace.h"
+
+#include "android/base/files/FileShareOpen.h"
+#include "android/base/files/StdioStream.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using android::base::c_str;
+using android::base::StdioStream;
+
+namespace android {
+namespace snapshot {
+
+constexpr int AccessTrace::kRecordingTimeMs;
+constexpr int AccessTrace::kMaxPages;
+
+// static
+bool AccessTrace::read(base::StringView fileName, Pages* pages) {
+    pages->clear();
+    StdioStream stream(
+            base::fsopen(c_str(fileName), "rb", base::FileShare::Read),
+            StdioStream::kOwner);
+    if (!stream.get()) {
+        return false;
+    }
+    const auto count = stream.getBe32();
+    if (count > uint32_t(kMaxPages)) {
+        return false;
+    }
+    std::vector<uint8_t> data(count * sizeof(PageIndex));
+    if (stream.read(data.data(), data.size()) != ssize_t(data.size())) {
+        return false;
+    }
+    pages->reserve(count);
+    for (size_t i = 0; i < data.size(); i += sizeof(PageIndex)) {
+        pages->push_back(PageIndex(data[i]) << 24 |
+                         PageIndex(data[i + 1]) << 16 |
+                         PageIndex(data[i + 2]) << 8 | PageIndex(data[i + 3]));
+    }
+    return true;
+}
+
+// static
+bool AccessTrace::write(base::StringView fileName, const Pages& pages) {
+    StdioStream stream(
+            base::fsopen(c_str(fileName), "wb", base::FileShare::Write),
+            StdioStream::kOwner);
+    if (!stream.get()) {
+        return false;
+    }
+    stream.putBe32(uint32_t(pages.size()));
+    for (const PageIndex page : pages) {
+        stream.putBe32(page);
+    }
+    return ferror(stream.get()) == 0;
+}
+
+// static
+AccessTrace::Pages AccessTrace::merge(const Pages& recent,
+                                      const Pages& previous,
+                                      size_t maxPages) {
+    Pages res;
+    res.reserve(std::min(recent.size() + previous.size(), maxPages));
+    std::unordered_set<PageIndex> seen;
+    for (const Pages* pages : {&recent, &previous}) {
+        for (const PageIndex page : *pages) {
+            if (res.size() == maxPages) {
+                return res;
+            }
+            if (seen.insert(page).second) {
+                res.push_back(page);
+            }
+        }
+    }
+    return res;
+}
+
+}  // namespace snapshot
+}  // namespace android
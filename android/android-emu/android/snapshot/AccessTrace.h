@@ -0,0 +1,59 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/StringView.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+//
+//   AccessTrace - the order in which the guest touched its RAM pages in the
+// first seconds after a quickboot load.
+//
+// RamLoader records it into a kRamAccessFileName file next to ram.bin, and
+// the next on-demand load prefetches the pages in that order before falling
+// back to the index order, so the pages the guest needs to become responsive
+// are already there by the time it faults on them.
+//
+// Pages are identified by their index in the RAM index (RamLoader::Pages),
+// which only depends on the RAM block layout and is stable across saves of
+// the same AVD; loaders ignore entries out of range for their index.
+//
+class AccessTrace {
+public:
+    using PageIndex = uint32_t;
+    using Pages = std::vector<PageIndex>;
+
+    // How long after start() faults are recorded, and how many of them.
+    static constexpr int kRecordingTimeMs = 5000;
+    static constexpr int kMaxPages = 64 * 1024;
+
+    static bool read(base::StringView fileName, Pages* pages);
+    static bool write(base::StringView fileName, const Pages& pages);
+
+    // Builds the next trace out of the pages that faulted during this load,
+    // |recent|, and the trace the load prefetched from, |previous|.
+    // Prefetched pages don't fault, so a trace recorded from faults alone
+    // would lose them; instead, |recent| goes first and the |previous| pages
+    // follow in their old order, with duplicates removed and the result
+    // capped to |maxPages| so pages the guest stopped touching age out.
+    static Pages merge(const Pages& recent,
+                       const Pages& previous,
+                       size_t maxPages = kMaxPages);
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,75 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/AccessTrace.h"
+
+#include "android/base/misc/FileUtils.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+using android::base::TestTempDir;
+
+namespace android {
+namespace snapshot {
+
+using Pages = AccessTrace::Pages;
+
+TEST(AccessTrace, ReadWrite) {
+    TestTempDir tempDir("accesstracetest");
+    const auto path = tempDir.makeSubPath("ram.access");
+
+    const Pages pages = {7, 0, 0x12345678, 3};
+    ASSERT_TRUE(AccessTrace::write(path, pages));
+    Pages read;
+    ASSERT_TRUE(AccessTrace::read(path, &read));
+    EXPECT_EQ(pages, read);
+
+    ASSERT_TRUE(AccessTrace::write(path, {}));
+    ASSERT_TRUE(AccessTrace::read(path, &read));
+    EXPECT_TRUE(read.empty());
+}
+
+TEST(AccessTrace, ReadBroken) {
+    TestTempDir tempDir("accesstracetest");
+    const auto path = tempDir.makeSubPath("ram.access");
+
+    Pages read = {1};
+    EXPECT_FALSE(AccessTrace::read(path, &read));
+    EXPECT_TRUE(read.empty());
+
+    // Says it has two pages, but only has one.
+    ASSERT_TRUE(AccessTrace::write(path, {1, 2}));
+    auto contents = readFileIntoString(path);
+    ASSERT_TRUE(contents);
+    contents->resize(contents->size() - sizeof(AccessTrace::PageIndex));
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    fwrite(contents->data(), 1, contents->size(), file);
+    fclose(file);
+    EXPECT_FALSE(AccessTrace::read(path, &read));
+    EXPECT_TRUE(read.empty());
+}
+
+TEST(AccessTrace, Merge) {
+    EXPECT_EQ(Pages({5, 1, 2, 3}), AccessTrace::merge({5, 1}, {1, 2, 3}));
+    EXPECT_EQ(Pages({1, 2, 3}), AccessTrace::merge({}, {1, 2, 3}));
+    EXPECT_EQ(Pages({4, 2}), AccessTrace::merge({4, 4, 2}, {}));
+    // Pages that didn't fault again are the first to go.
+    EXPECT_EQ(Pages({9, 8, 1}), AccessTrace::merge({9, 8}, {1, 2, 3}, 3));
+    EXPECT_EQ(Pages({9, 8}), AccessTrace::merge({9, 8, 7}, {1}, 2));
+}
+
+}  // namespace snapshot
+}  // namespace android
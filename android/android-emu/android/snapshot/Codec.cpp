@@ -0,0 +1,269 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/Codec.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/threads/ThreadStore.h"
+#include "android/utils/debug.h"
+
+#include "lz4.h"
+#include "lz4hc.h"
+#include "zdict.h"
+#include "zstd.h"
+
+#include <cassert>
+#include <cstring>
+
+using android::base::LazyInstance;
+using android::base::ThreadStore;
+
+namespace android {
+namespace snapshot {
+
+// Snapshot pages are small, so higher levels buy little extra ratio for a
+// lot of CPU.
+static constexpr int kLz4HcLevel = 9;
+static constexpr int kZstdLevel = 3;
+
+// zstd recommends dictionaries of ~100KB, trained on ~100x as much data.
+static constexpr size_t kZstdDictionarySize = 112 * 1024;
+
+namespace {
+
+class Lz4Codec final : public Codec {
+public:
+    explicit Lz4Codec(CodecType type) : Codec(type) {}
+
+    int32_t maxCompressedSize(int32_t dataSize) const override {
+        return LZ4_compressBound(dataSize);
+    }
+
+    int32_t compress(const uint8_t* data,
+                     int32_t size,
+                     uint8_t* out,
+                     int32_t outSize) const override {
+        assert(outSize >= maxCompressedSize(size));
+        if (type() == CodecType::Lz4Hc) {
+            return LZ4_compress_HC(reinterpret_cast<const char*>(data),
+                                   reinterpret_cast<char*>(out), size, outSize,
+                                   kLz4HcLevel);
+        }
+        return LZ4_compress_fast(reinterpret_cast<const char*>(data),
+                                 reinterpret_cast<char*>(out), size, outSize,
+                                 1);
+    }
+
+    // LZ4-HC produces regular LZ4 blocks, the decompression is the same.
+    bool decompress(const uint8_t* data,
+                    int32_t size,
+                    uint8_t* outData,
+                    int32_t outSize) const override {
+        const int res = LZ4_decompress_safe(
+                reinterpret_cast<const char*>(data),
+                reinterpret_cast<char*>(outData), size, outSize);
+        if (res != outSize) {
+            derror("LZ4 decompression failed: %d", res);
+        }
+        return res == outSize;
+    }
+};
+
+// zstd contexts are expensive to create and can't be shared between
+// threads, so keep one pair per thread.
+struct ZstdContexts {
+    ZstdContexts() : cctx(ZSTD_createCCtx()), dctx(ZSTD_createDCtx()) {}
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+
+    ZSTD_CCtx* const cctx;
+    ZSTD_DCtx* const dctx;
+};
+
+static LazyInstance<ThreadStore<ZstdContexts>> sZstdContexts =
+        LAZY_INSTANCE_INIT;
+
+static ZstdContexts* zstdContexts() {
+    auto contexts = sZstdContexts->get();
+    if (!contexts) {
+        contexts = new ZstdContexts();
+        sZstdContexts->set(contexts);
+    }
+    return contexts;
+}
+
+class ZstdCodec final : public Codec {
+public:
+    ZstdCodec() : Codec(CodecType::Zstd) {}
+
+    explicit ZstdCodec(Dictionary&& dictionary)
+        : Codec(CodecType::ZstdDict),
+          mDictionary(std::move(dictionary)),
+          mCDict(ZSTD_createCDict(mDictionary.data(), mDictionary.size(),
+                                  kZstdLevel)),
+          mDDict(ZSTD_createDDict(mDictionary.data(), mDictionary.size())) {}
+
+    ~ZstdCodec() {
+        ZSTD_freeCDict(mCDict);
+        ZSTD_freeDDict(mDDict);
+    }
+
+    int32_t maxCompressedSize(int32_t dataSize) const override {
+        return int32_t(ZSTD_compressBound(size_t(dataSize)));
+    }
+
+    int32_t compress(const uint8_t* data,
+                     int32_t size,
+                     uint8_t* out,
+                     int32_t outSize) const override {
+        assert(outSize >= maxCompressedSize(size));
+        const auto cctx = zstdContexts()->cctx;
+        const size_t res =
+                mCDict ? ZSTD_compress_usingCDict(cctx, out, size_t(outSize),
+                                                  data, size_t(size), mCDict)
+                       : ZSTD_compressCCtx(cctx, out, size_t(outSize), data,
+                                           size_t(size), kZstdLevel);
+        if (ZSTD_isError(res)) {
+            return 0;
+        }
+        return int32_t(res);
+    }
+
+    bool decompress(const uint8_t* data,
+                    int32_t size,
+                    uint8_t* outData,
+                    int32_t outSize) const override {
+        const auto dctx = zstdContexts()->dctx;
+        const size_t res =
+                mDDict ? ZSTD_decompress_usingDDict(dctx, outData,
+                                                    size_t(outSize), data,
+                                                    size_t(size), mDDict)
+                       : ZSTD_decompressDCtx(dctx, outData, size_t(outSize),
+                                             data, size_t(size));
+        if (ZSTD_isError(res) || res != size_t(outSize)) {
+            derror("zstd decompression failed: %s",
+                   ZSTD_isError(res) ? ZSTD_getErrorName(res) : "short");
+            return false;
+        }
+        return true;
+    }
+
+    const Dictionary& dictionary() const override { return mDictionary; }
+
+private:
+    const Dictionary mDictionary;
+    ZSTD_CDict* const mCDict = nullptr;
+    ZSTD_DDict* const mDDict = nullptr;
+};
+
+struct StaticCodecs {
+    Codec::Ptr lz4 = std::make_shared<Lz4Codec>(CodecType::Lz4);
+    Codec::Ptr lz4hc = std::make_shared<Lz4Codec>(CodecType::Lz4Hc);
+    Codec::Ptr zstd = std::make_shared<ZstdCodec>();
+};
+
+static LazyInstance<StaticCodecs> sStaticCodecs = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+const Codec::Dictionary& Codec::dictionary() const {
+    static const Dictionary* const kEmpty = new Dictionary();
+    return *kEmpty;
+}
+
+// static
+Codec::Ptr Codec::get(CodecType type) {
+    switch (type) {
+        case CodecType::Lz4:
+            return sStaticCodecs->lz4;
+        case CodecType::Lz4Hc:
+            return sStaticCodecs->lz4hc;
+        case CodecType::Zstd:
+            return sStaticCodecs->zstd;
+        case CodecType::ZstdDict:
+            break;
+    }
+    return nullptr;
+}
+
+// static
+Codec::Ptr Codec::createWithDictionary(Dictionary&& dictionary) {
+    if (dictionary.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<ZstdCodec>(std::move(dictionary));
+}
+
+// static
+Codec::Ptr Codec::trainDictionary(const std::vector<const uint8_t*>& samples,
+                                  int32_t sampleSize) {
+    if (samples.empty()) {
+        return nullptr;
+    }
+
+    std::vector<char> sampleBuffer(samples.size() * size_t(sampleSize));
+    std::vector<size_t> sampleSizes(samples.size(), size_t(sampleSize));
+    for (size_t i = 0; i < samples.size(); ++i) {
+        memcpy(sampleBuffer.data() + i * size_t(sampleSize), samples[i],
+               size_t(sampleSize));
+    }
+
+    Dictionary dictionary(kZstdDictionarySize);
+    const size_t res = ZDICT_trainFromBuffer(
+            dictionary.data(), dictionary.size(), sampleBuffer.data(),
+            sampleSizes.data(), unsigned(sampleSizes.size()));
+    if (ZDICT_isError(res)) {
+        VERBOSE_PRINT(snapshot, "zstd dictionary training failed: %s",
+                      ZDICT_getErrorName(res));
+        return nullptr;
+    }
+    dictionary.resize(res);
+    VERBOSE_PRINT(snapshot, "Trained a %d byte zstd dictionary on %d samples",
+                  int(res), int(samples.size()));
+    return createWithDictionary(std::move(dictionary));
+}
+
+// static
+base::Optional<CodecType> Codec::fromString(base::StringView name) {
+    if (name == "lz4") {
+        return CodecType::Lz4;
+    }
+    if (name == "lz4hc") {
+        return CodecType::Lz4Hc;
+    }
+    if (name == "zstd") {
+        return CodecType::Zstd;
+    }
+    if (name == "zstd-dict") {
+        return CodecType::ZstdDict;
+    }
+    return {};
+}
+
+// static
+const char* Codec::toString(CodecType type) {
+    switch (type) {
+        case CodecType::Lz4:
+            return "lz4";
+        case CodecType::Lz4Hc:
+            return "lz4hc";
+        case CodecType::Zstd:
+            return "zstd";
+        case CodecType::ZstdDict:
+            return "zstd-dict";
+    }
+    return "unknown";
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,111 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/Optional.h"
+#include "android/base/StringView.h"
+#include "android/snapshot/common.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//
+// Codec - a compression algorithm for snapshot RAM pages and textures.
+//
+// All codecs are stateless (or keep their state per thread), so a single
+// instance can be shared by all compressing and decompressing threads.
+//
+
+namespace android {
+namespace snapshot {
+
+// The values are stored in the snapshot files, don't reorder them.
+enum class CodecType : uint8_t {
+    Lz4 = 0,
+    Lz4Hc = 1,
+    Zstd = 2,
+    // zstd with a dictionary trained on a sample of the data; the dictionary
+    // has to be stored next to the compressed data.
+    ZstdDict = 3,
+};
+
+class Codec {
+    DISALLOW_COPY_AND_ASSIGN(Codec);
+
+public:
+    using Ptr = std::shared_ptr<const Codec>;
+    using Dictionary = std::vector<char>;
+
+    virtual ~Codec() = default;
+
+    CodecType type() const { return mType; }
+
+    virtual int32_t maxCompressedSize(int32_t dataSize) const = 0;
+
+    // Compresses |size| bytes of |data| into |out|. Returns the compressed
+    // size, or 0 on failure.
+    virtual int32_t compress(const uint8_t* data,
+                             int32_t size,
+                             uint8_t* out,
+                             int32_t outSize) const = 0;
+
+    // Decompresses |size| bytes of |data| into exactly |outSize| bytes of
+    // |outData|.
+    virtual bool decompress(const uint8_t* data,
+                            int32_t size,
+                            uint8_t* outData,
+                            int32_t outSize) const = 0;
+
+    // Empty for all codecs except CodecType::ZstdDict.
+    virtual const Dictionary& dictionary() const;
+
+    // Returns a shared codec instance of |type|; CodecType::ZstdDict needs
+    // createWithDictionary() instead.
+    static Ptr get(CodecType type);
+    static Ptr createWithDictionary(Dictionary&& dictionary);
+
+    // Trains a zstd dictionary on |samples|, each |sampleSize| bytes long.
+    // Returns a CodecType::ZstdDict codec, or null if the samples don't make
+    // a useful dictionary.
+    static Ptr trainDictionary(const std::vector<const uint8_t*>& samples,
+                               int32_t sampleSize);
+
+    // Conversion for environment variables, command line and logs:
+    // "lz4", "lz4hc", "zstd", "zstd-dict".
+    static base::Optional<CodecType> fromString(base::StringView name);
+    static const char* toString(CodecType type);
+
+protected:
+    explicit Codec(CodecType type) : mType(type) {}
+
+private:
+    const CodecType mType;
+};
+
+// The codec is kept in the IndexFlags::CodecMask bits of the RAM index flags;
+// 0 is LZ4, so all older snapshots are read correctly.
+constexpr int kIndexFlagsCodecShift = 4;
+
+inline CodecType codecFromIndexFlags(int32_t flags) {
+    return CodecType((flags & int32_t(IndexFlags::CodecMask)) >>
+                     kIndexFlagsCodecShift);
+}
+
+inline int32_t codecToIndexFlags(CodecType type) {
+    return (int32_t(type) << kIndexFlagsCodecShift) &
+           int32_t(IndexFlags::CodecMask);
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,211 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Compares the snapshot codecs on 4K pages: compression and decompression
+// throughput, with the resulting ratio in the label.
+//
+// By default it runs on generated pages that mix zeroes, repeated records
+// and noise; set ANDROID_SNAPSHOT_BENCHMARK_RAM to a raw RAM dump (e.g.
+// QEMU's 'pmemsave' output) to measure on real guest memory.
+
+#include "android/base/misc/FileUtils.h"
+#include "android/base/system/System.h"
+#include "android/snapshot/Codec.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using android::base::System;
+using android::snapshot::Codec;
+using android::snapshot::CodecType;
+
+static constexpr int kPageSize = 4096;
+static constexpr int kGeneratedPages = 4096;  // 16MB
+
+static std::string generateRam() {
+    std::default_random_engine generator;
+    generator.seed(0);
+    std::uniform_int_distribution<int> distribution(0, 99999);
+
+    std::string ram(size_t(kGeneratedPages) * kPageSize, '\0');
+    for (int i = 0; i < kGeneratedPages; ++i) {
+        auto page = &ram[size_t(i) * kPageSize];
+        switch (i % 4) {
+            case 0:
+                // Sparse, page table-like data.
+                for (int j = 0; j < kPageSize; j += 64) {
+                    const uint64_t entry = uint64_t(i) << 12 | 0x67;
+                    memcpy(page + j, &entry, sizeof(entry));
+                }
+                break;
+            case 1:
+            case 2: {
+                int offset = 0;
+                while (offset < kPageSize) {
+                    const int id = distribution(generator) % 1024;
+                    char line[64];
+                    const int len =
+                            snprintf(line, sizeof(line),
+                                     "obj %04d: refs=%d next=%08x\n", id,
+                                     id % 7, id * 2654435761u);
+                    const int size = std::min(len, kPageSize - offset);
+                    memcpy(page + offset, line, size_t(size));
+                    offset += size;
+                }
+                break;
+            }
+            case 3:
+                for (int j = 0; j < kPageSize; ++j) {
+                    page[j] = char(distribution(generator));
+                }
+                break;
+        }
+    }
+    return ram;
+}
+
+static const std::string& testRam() {
+    static const std::string* const ram = [] {
+        const auto path =
+                System::get()->envGet("ANDROID_SNAPSHOT_BENCHMARK_RAM");
+        if (!path.empty()) {
+            if (auto contents = android::readFileIntoString(path)) {
+                contents->resize(contents->size() / kPageSize * kPageSize);
+                if (!contents->empty()) {
+                    return new std::string(std::move(*contents));
+                }
+            }
+            fprintf(stderr, "Can't read '%s', using generated pages\n",
+                    path.c_str());
+        }
+        return new std::string(generateRam());
+    }();
+    return *ram;
+}
+
+static std::vector<const uint8_t*> pages(const std::string& ram) {
+    std::vector<const uint8_t*> res;
+    static const std::string zeroPage(kPageSize, '\0');
+    for (size_t i = 0; i < ram.size(); i += kPageSize) {
+        if (memcmp(&ram[i], zeroPage.data(), kPageSize) != 0) {
+            res.push_back(reinterpret_cast<const uint8_t*>(&ram[i]));
+        }
+    }
+    return res;
+}
+
+static Codec::Ptr makeCodec(CodecType type,
+                            const std::vector<const uint8_t*>& pages) {
+    if (type != CodecType::ZstdDict) {
+        return Codec::get(type);
+    }
+    // Same sampling as RamSaver: ~2048 evenly spaced pages.
+    std::vector<const uint8_t*> samples;
+    const size_t step = std::max<size_t>(1, pages.size() / 2048);
+    for (size_t i = 0; i < pages.size(); i += step) {
+        samples.push_back(pages[i]);
+    }
+    return Codec::trainDictionary(samples, kPageSize);
+}
+
+static void setLabel(benchmark::State& state,
+                     int64_t rawSize,
+                     int64_t compressedSize) {
+    char label[64];
+    snprintf(label, sizeof(label), "ratio %.3f",
+             compressedSize ? double(rawSize) / compressedSize : 0.0);
+    state.SetLabel(label);
+}
+
+// Older benchmark library versions have no SkipWithError().
+static void skip(benchmark::State& state, const char* reason) {
+    state.SetLabel(reason);
+    while (state.KeepRunning()) {
+    }
+}
+
+static void BM_Compress(benchmark::State& state) {
+    const auto type = CodecType(state.range_x());
+    const auto ramPages = pages(testRam());
+    const auto codec = makeCodec(type, ramPages);
+    if (!codec || ramPages.empty()) {
+        skip(state, "no codec or no data");
+        return;
+    }
+
+    std::vector<uint8_t> out(size_t(codec->maxCompressedSize(kPageSize)));
+    int64_t rawSize = 0;
+    int64_t compressedSize = 0;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const auto size = codec->compress(ramPages[i], kPageSize, out.data(),
+                                          int32_t(out.size()));
+        rawSize += kPageSize;
+        // Incompressible pages are stored as is.
+        compressedSize += size > 0 && size < kPageSize ? size : kPageSize;
+        i = (i + 1) % ramPages.size();
+    }
+    state.SetBytesProcessed(rawSize);
+    setLabel(state, rawSize, compressedSize);
+}
+
+static void BM_Decompress(benchmark::State& state) {
+    const auto type = CodecType(state.range_x());
+    const auto ramPages = pages(testRam());
+    const auto codec = makeCodec(type, ramPages);
+    if (!codec || ramPages.empty()) {
+        skip(state, "no codec or no data");
+        return;
+    }
+
+    // Only compressed pages go through the codec when loading.
+    std::vector<std::vector<uint8_t>> compressed;
+    std::vector<uint8_t> out(size_t(codec->maxCompressedSize(kPageSize)));
+    for (auto page : ramPages) {
+        const auto size = codec->compress(page, kPageSize, out.data(),
+                                          int32_t(out.size()));
+        if (size > 0 && size < kPageSize) {
+            compressed.emplace_back(out.begin(), out.begin() + size);
+        }
+    }
+    if (compressed.empty()) {
+        skip(state, "data doesn't compress");
+        return;
+    }
+
+    uint8_t page[kPageSize];
+    int64_t rawSize = 0;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        const auto& data = compressed[i];
+        codec->decompress(data.data(), int32_t(data.size()), page, kPageSize);
+        rawSize += kPageSize;
+        i = (i + 1) % compressed.size();
+    }
+    state.SetBytesProcessed(rawSize);
+}
+
+#define CODEC_BENCHMARK(x)                  \
+    BENCHMARK(x)                            \
+            ->Arg(int(CodecType::Lz4))      \
+            ->Arg(int(CodecType::Lz4Hc))    \
+            ->Arg(int(CodecType::Zstd))     \
+            ->Arg(int(CodecType::ZstdDict))
+
+CODEC_BENCHMARK(BM_Compress);
+CODEC_BENCHMARK(BM_Decompress);
+
+BENCHMARK_MAIN()
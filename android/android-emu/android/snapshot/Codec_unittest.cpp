@@ -0,0 +1,169 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/Codec.h"
+
+#include "android/snapshot/RamSnapshotTesting.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+static void checkRoundTrip(const Codec& codec,
+                           const uint8_t* data,
+                           int32_t size) {
+    std::vector<uint8_t> compressed(size_t(codec.maxCompressedSize(size)));
+    const auto compressedSize = codec.compress(
+            data, size, compressed.data(), int32_t(compressed.size()));
+    ASSERT_GT(compressedSize, 0);
+
+    std::vector<uint8_t> decompressed(static_cast<size_t>(size));
+    ASSERT_TRUE(codec.decompress(compressed.data(), compressedSize,
+                                 decompressed.data(), size));
+    EXPECT_EQ(0, memcmp(data, decompressed.data(), size_t(size)));
+}
+
+// Pages of text-like records: unlike generateRandomRam()'s single-byte
+// patterns, they have enough shared structure to train a dictionary on.
+static TestRamBuffer generateRecordRam(int numPages) {
+    std::default_random_engine generator;
+    generator.seed(0);
+    std::uniform_int_distribution<int> distribution(0, 99999);
+
+    TestRamBuffer res(numPages * kTestingPageSize);
+    for (int i = 0; i < numPages; ++i) {
+        auto page = res.data() + i * kTestingPageSize;
+        int offset = 0;
+        while (offset < kTestingPageSize) {
+            // Records come from a limited set, the way structures in real
+            // memory do.
+            const int id = distribution(generator) % 512;
+            char line[64];
+            const int len = snprintf(line, sizeof(line),
+                                     "entry %05d: flags=%02x value=%d\n", id,
+                                     (id * 37) % 256, id * 7919);
+            const int size = std::min(len, kTestingPageSize - offset);
+            memcpy(page + offset, line, size_t(size));
+            offset += size;
+        }
+    }
+    return res;
+}
+
+TEST(Codec, RoundTrip) {
+    auto ram = generateRandomRam(16, 0.25);
+    for (auto type : {CodecType::Lz4, CodecType::Lz4Hc, CodecType::Zstd}) {
+        SCOPED_TRACE(Codec::toString(type));
+        const auto codec = Codec::get(type);
+        ASSERT_TRUE(codec);
+        EXPECT_EQ(type, codec->type());
+        EXPECT_TRUE(codec->dictionary().empty());
+        for (size_t i = 0; i < 16; ++i) {
+            checkRoundTrip(*codec, ram.data() + i * kTestingPageSize,
+                           kTestingPageSize);
+        }
+    }
+}
+
+TEST(Codec, NoSharedDictionaryCodec) {
+    EXPECT_FALSE(Codec::get(CodecType::ZstdDict));
+    EXPECT_FALSE(Codec::createWithDictionary({}));
+}
+
+TEST(Codec, DecompressWrongSize) {
+    auto ram = generateRandomRam(1, 0);
+    for (auto type : {CodecType::Lz4, CodecType::Zstd}) {
+        SCOPED_TRACE(Codec::toString(type));
+        const auto codec = Codec::get(type);
+        std::vector<uint8_t> compressed(
+                size_t(codec->maxCompressedSize(kTestingPageSize)));
+        const auto compressedSize =
+                codec->compress(ram.data(), kTestingPageSize,
+                                compressed.data(), int32_t(compressed.size()));
+        ASSERT_GT(compressedSize, 0);
+        std::vector<uint8_t> decompressed(kTestingPageSize * 2);
+        EXPECT_FALSE(codec->decompress(compressed.data(), compressedSize,
+                                       decompressed.data(),
+                                       int32_t(decompressed.size())));
+    }
+}
+
+TEST(Codec, TrainDictionary) {
+    const int numPages = 2048;
+    auto ram = generateRecordRam(numPages);
+    std::vector<const uint8_t*> samples;
+    for (int i = 0; i < numPages; ++i) {
+        samples.push_back(ram.data() + i * kTestingPageSize);
+    }
+    const auto codec = Codec::trainDictionary(samples, kTestingPageSize);
+    ASSERT_TRUE(codec);
+    EXPECT_EQ(CodecType::ZstdDict, codec->type());
+    ASSERT_FALSE(codec->dictionary().empty());
+
+    // A codec recreated from the stored dictionary reads the same data.
+    auto dictionary = codec->dictionary();
+    const auto loaded = Codec::createWithDictionary(std::move(dictionary));
+    ASSERT_TRUE(loaded);
+
+    std::vector<uint8_t> compressed(
+            size_t(codec->maxCompressedSize(kTestingPageSize)));
+    const auto compressedSize =
+            codec->compress(ram.data(), kTestingPageSize, compressed.data(),
+                            int32_t(compressed.size()));
+    ASSERT_GT(compressedSize, 0);
+    std::vector<uint8_t> decompressed(kTestingPageSize);
+    ASSERT_TRUE(loaded->decompress(compressed.data(), compressedSize,
+                                   decompressed.data(), kTestingPageSize));
+    EXPECT_EQ(0, memcmp(ram.data(), decompressed.data(), kTestingPageSize));
+
+    // The whole point: the dictionary beats plain zstd on small pages.
+    const auto plainSize = Codec::get(CodecType::Zstd)
+                                   ->compress(ram.data(), kTestingPageSize,
+                                              compressed.data(),
+                                              int32_t(compressed.size()));
+    EXPECT_LT(compressedSize, plainSize);
+}
+
+TEST(Codec, TrainDictionaryNoSamples) {
+    EXPECT_FALSE(Codec::trainDictionary({}, kTestingPageSize));
+}
+
+TEST(Codec, Names) {
+    for (auto type : {CodecType::Lz4, CodecType::Lz4Hc, CodecType::Zstd,
+                      CodecType::ZstdDict}) {
+        const auto parsed = Codec::fromString(Codec::toString(type));
+        ASSERT_TRUE(parsed);
+        EXPECT_EQ(type, *parsed);
+    }
+    EXPECT_FALSE(Codec::fromString(""));
+    EXPECT_FALSE(Codec::fromString("gzip"));
+}
+
+TEST(Codec, IndexFlags) {
+    const int32_t otherFlags = int32_t(IndexFlags::CompressedPages) |
+                               int32_t(IndexFlags::PageStore);
+    for (auto type : {CodecType::Lz4, CodecType::Lz4Hc, CodecType::Zstd,
+                      CodecType::ZstdDict}) {
+        const auto flags = otherFlags | codecToIndexFlags(type);
+        EXPECT_EQ(type, codecFromIndexFlags(flags));
+        EXPECT_EQ(otherFlags, flags & ~int32_t(IndexFlags::CodecMask));
+    }
+    // Snapshots from before codec support.
+    EXPECT_EQ(CodecType::Lz4, codecFromIndexFlags(otherFlags));
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -13,11 +13,7 @@
 
 #include "android/base/system/System.h"
 
-#include "lz4.h"
-
 #include <algorithm>
-#include <cassert>
-#include <utility>
 
 namespace android {
 namespace snapshot {
@@ -28,18 +24,6 @@ int workerCount() {
     return std::max(2, std::min(4, base::System::get()->getCpuCoreCount() - 1));
 }
 
-int32_t compress(const uint8_t* data,
-                 int32_t size,
-                 uint8_t* out,
-                 int32_t outSize) {
-    assert(out);
-    assert(outSize >= maxCompressedSize(size));
-    int32_t compressedSize =
-            LZ4_compress_fast(reinterpret_cast<const char*>(data),
-                              reinterpret_cast<char*>(out), size, outSize, 1);
-    return compressedSize;
-}
-
 }  // namespace compress
 
 }  // namespace snapshot
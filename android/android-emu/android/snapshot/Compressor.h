@@ -13,19 +13,19 @@
 
 #include <cstdint>
 #include "lz4.h"
+#include "zstd.h"
 
 namespace android {
 namespace snapshot {
 namespace compress {
 
 int workerCount();
-int32_t compress(const uint8_t* data,
-                 int32_t size,
-                 uint8_t* out,
-                 int32_t outSize);
 
+// The largest compressed size any Codec may produce, for static buffers.
 constexpr int32_t maxCompressedSize(int32_t dataSize) {
-    return LZ4_COMPRESSBOUND(dataSize);
+    return LZ4_COMPRESSBOUND(dataSize) > int32_t(ZSTD_COMPRESSBOUND(dataSize))
+                   ? LZ4_COMPRESSBOUND(dataSize)
+                   : int32_t(ZSTD_COMPRESSBOUND(dataSize));
 }
 
 }  // namespace compress
@@ -11,9 +11,12 @@
 
 #include "android/snapshot/GapTracker.h"
 
+#include "android/base/misc/FileUtils.h"
+
 #include <algorithm>
 #include <cassert>
 #include <iterator>
+#include <limits>
 #include <numeric>
 
 namespace android {
@@ -272,6 +275,162 @@ int64_t OneSizeGapTracker::wastedSpaceImpl() const {
     return mSize * (mGapStarts.size() - mCurrentPos);
 }
 
+// The granularity of hole punching: file systems allocate disk space in
+// blocks of this size or its divisors.
+static constexpr int64_t kFileBlockSize = 4096;
+
+static int64_t alignDownToBlock(int64_t pos) {
+    return pos & ~(kFileBlockSize - 1);
+}
+
+static int64_t alignUpToBlock(int64_t pos) {
+    return alignDownToBlock(pos + kFileBlockSize - 1);
+}
+
+void ExtentGapTracker::load(base::Stream& in) {
+    base::AutoLock lock(mLock);
+    mByStart.clear();
+    mBySize.clear();
+    mTotalSize = 0;
+    const auto sizesCount = in.getBe32();
+    for (uint32_t i = 0; i < sizesCount; ++i) {
+        const auto size = int64_t(in.getPackedNum());
+        assert(size != 0);
+        const auto posCount = in.getPackedNum();
+        assert(posCount != 0);
+        auto pos = int64_t(in.getBe64());
+        addLocked(pos, size);
+        for (uint64_t j = 1; j < posCount; ++j) {
+            pos += in.getPackedSignedNum();
+            addLocked(pos, size);
+        }
+    }
+    mEmpty.store(mByStart.empty(), std::memory_order_relaxed);
+}
+
+void ExtentGapTracker::save(base::Stream& out) {
+    base::AutoLock lock(mLock);
+    // Same format as GenericGapTracker: positions grouped by the gap size.
+    uint32_t sizesCount = 0;
+    int64_t prevSize = 0;
+    for (const auto& gap : mBySize) {
+        if (gap.first != prevSize) {
+            ++sizesCount;
+            prevSize = gap.first;
+        }
+    }
+    out.putBe32(sizesCount);
+    for (auto it = mBySize.begin(); it != mBySize.end();) {
+        const auto size = it->first;
+        const auto groupEnd = mBySize.lower_bound(
+                {size, std::numeric_limits<int64_t>::max()});
+        out.putPackedNum(uint64_t(size));
+        out.putPackedNum(uint64_t(std::distance(it, groupEnd)));
+        int64_t pos = it->second;
+        out.putBe64(uint64_t(pos));
+        for (++it; it != groupEnd; ++it) {
+            out.putPackedSignedNum(it->second - pos);
+            pos = it->second;
+        }
+    }
+}
+
+base::Optional<int64_t> ExtentGapTracker::allocate(int size) {
+    if (empty()) {
+        return {};
+    }
+    base::AutoLock lock(mLock);
+
+    auto sizeIt = mBySize.lower_bound(
+            {size, std::numeric_limits<int64_t>::min()});
+    if (sizeIt == mBySize.end()) {
+        return {};
+    }
+    const auto gapSize = sizeIt->first;
+    const auto pos = sizeIt->second;
+    mBySize.erase(sizeIt);
+    auto startIt = mByStart.erase(mByStart.find(pos));
+    mTotalSize -= size;
+    if (gapSize > size) {
+        // The rest of the gap still has no neighbors to merge with.
+        mByStart.emplace_hint(startIt, pos + size, gapSize - size);
+        mBySize.emplace(gapSize - size, pos + size);
+    } else if (mByStart.empty()) {
+        mEmpty.store(true, std::memory_order_relaxed);
+    }
+    return pos;
+}
+
+void ExtentGapTracker::add(int64_t start, int size) {
+    if (size <= 0) {
+        return;
+    }
+    base::AutoLock lock(mLock);
+    addLocked(start, size);
+}
+
+void ExtentGapTracker::setHolePunchFd(int fd) {
+    base::AutoLock lock(mLock);
+    mHolePunchFd = fd;
+    // Catch up on the gaps that were there before.
+    for (auto it = mByStart.begin();
+         mHolePunchFd >= 0 && it != mByStart.end(); ++it) {
+        punchHoleLocked(it->first, it->second);
+    }
+}
+
+int64_t ExtentGapTracker::wastedSpaceImpl() const {
+    base::AutoLock lock(mLock);
+    return mTotalSize;
+}
+
+void ExtentGapTracker::addLocked(int64_t start, int64_t size) {
+    const auto addedStart = start;
+    const auto addedEnd = start + size;
+
+    auto nextIt = mByStart.lower_bound(start);
+    if (nextIt != mByStart.begin()) {
+        const auto prevIt = std::prev(nextIt);
+        if (prevIt->first + prevIt->second == start) {
+            start = prevIt->first;
+            size += prevIt->second;
+            mBySize.erase({prevIt->second, prevIt->first});
+            mByStart.erase(prevIt);
+        }
+    }
+    if (nextIt != mByStart.end() && nextIt->first == addedEnd) {
+        size += nextIt->second;
+        mBySize.erase({nextIt->second, nextIt->first});
+        nextIt = mByStart.erase(nextIt);
+    }
+    mByStart.emplace_hint(nextIt, start, size);
+    mBySize.emplace(size, start);
+    mTotalSize += addedEnd - addedStart;
+    mEmpty.store(false, std::memory_order_relaxed);
+
+    if (mHolePunchFd >= 0) {
+        // The blocks of the merged gap outside of the added one were
+        // punched when their own gaps got added.
+        const auto holeStart = std::max(alignUpToBlock(start),
+                                        alignDownToBlock(addedStart));
+        const auto holeEnd = std::min(alignDownToBlock(start + size),
+                                      alignUpToBlock(addedEnd));
+        punchHoleLocked(holeStart, holeEnd - holeStart);
+    }
+}
+
+void ExtentGapTracker::punchHoleLocked(int64_t start, int64_t size) {
+    const auto holeStart = alignUpToBlock(start);
+    const auto holeEnd = alignDownToBlock(start + size);
+    if (holeStart >= holeEnd) {
+        return;
+    }
+    if (!punchHole(mHolePunchFd, holeStart, holeEnd - holeStart)) {
+        // The file system can't do it, don't keep trying.
+        mHolePunchFd = -1;
+    }
+}
+
 void NullGapTracker::load(base::Stream& in) {
     GenericGapTracker().load(in);
 }
@@ -42,6 +42,10 @@ public:
     virtual base::Optional<int64_t> allocate(int size) = 0;
     virtual void add(int64_t start, int size) = 0;
 
+    // Lets the tracker give the disk space under its gaps in |fd| back to
+    // the file system; -1 stops it. Only some trackers can do that.
+    virtual void setHolePunchFd(int fd) {}
+
     int64_t wastedSpace() const {
         if (empty()) {
             return 0;
@@ -127,5 +131,33 @@ private:
     RangesBySize mBySize;
 };
 
+// Keeps the gaps as extents, merging the adjacent ones, and allocates from
+// the smallest one that fits. With a file to punch holes in, the file system
+// blocks that end up fully inside of a gap get deallocated, so the wasted
+// space doesn't take up any disk space. Saves in GenericGapTracker's format.
+class ExtentGapTracker final : public GapTracker {
+public:
+    ExtentGapTracker() = default;
+
+    void load(base::Stream& in) override;
+    void save(base::Stream& out) override;
+
+    base::Optional<int64_t> allocate(int size) override;
+    void add(int64_t start, int size) override;
+    void setHolePunchFd(int fd) override;
+
+    int64_t wastedSpaceImpl() const override;
+
+private:
+    void addLocked(int64_t start, int64_t size);
+    void punchHoleLocked(int64_t start, int64_t size);
+
+    // start -> size, and {size, start} for the best fit lookup.
+    std::map<int64_t, int64_t> mByStart;
+    std::set<std::pair<int64_t, int64_t>> mBySize;
+    int64_t mTotalSize = 0;
+    int mHolePunchFd = -1;
+};
+
 }  // namespace snapshot
 }  // namespace android
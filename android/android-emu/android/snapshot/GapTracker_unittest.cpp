@@ -0,0 +1,95 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/GapTracker.h"
+
+#include "android/base/files/MemStream.h"
+
+#include <gtest/gtest.h>
+
+using android::base::MemStream;
+
+namespace android {
+namespace snapshot {
+
+TEST(ExtentGapTracker, MergesAdjacentGaps) {
+    ExtentGapTracker gaps;
+    EXPECT_EQ(0, gaps.wastedSpace());
+    EXPECT_FALSE(gaps.allocate(1));
+
+    gaps.add(100, 10);
+    gaps.add(120, 10);
+    EXPECT_FALSE(gaps.allocate(20));
+    gaps.add(110, 10);
+    EXPECT_EQ(30, gaps.wastedSpace());
+
+    EXPECT_EQ(100, gaps.allocate(30).valueOr(-1));
+    EXPECT_EQ(0, gaps.wastedSpace());
+    EXPECT_FALSE(gaps.allocate(1));
+}
+
+TEST(ExtentGapTracker, AllocatesBestFit) {
+    ExtentGapTracker gaps;
+    gaps.add(0, 100);
+    gaps.add(200, 20);
+    gaps.add(300, 50);
+
+    EXPECT_EQ(300, gaps.allocate(30).valueOr(-1));
+    EXPECT_EQ(200, gaps.allocate(20).valueOr(-1));
+    // What's left of the 50 bytes gap fits better than the 100 bytes one.
+    EXPECT_EQ(330, gaps.allocate(20).valueOr(-1));
+    EXPECT_EQ(0, gaps.allocate(20).valueOr(-1));
+    EXPECT_EQ(80, gaps.wastedSpace());
+}
+
+TEST(ExtentGapTracker, SaveLoad) {
+    ExtentGapTracker gaps;
+    gaps.add(8, 100);
+    gaps.add(1000, 100);
+    gaps.add(500, 30);
+    gaps.add(2000, 100);
+
+    MemStream stream;
+    gaps.save(stream);
+
+    ExtentGapTracker loaded;
+    loaded.load(stream);
+    EXPECT_EQ(330, loaded.wastedSpace());
+    EXPECT_EQ(500, loaded.allocate(30).valueOr(-1));
+    EXPECT_EQ(8, loaded.allocate(100).valueOr(-1));
+    EXPECT_EQ(1000, loaded.allocate(100).valueOr(-1));
+    EXPECT_EQ(2000, loaded.allocate(100).valueOr(-1));
+    EXPECT_FALSE(loaded.allocate(1));
+}
+
+TEST(ExtentGapTracker, GenericGapTrackerFormat) {
+    GenericGapTracker generic;
+    generic.add(100, 10);
+    generic.add(300, 20);
+    generic.add(200, 10);
+
+    MemStream stream;
+    generic.save(stream);
+    ExtentGapTracker extent;
+    extent.load(stream);
+    EXPECT_EQ(40, extent.wastedSpace());
+
+    extent.add(110, 5);
+    extent.save(stream);
+    generic.load(stream);
+    EXPECT_EQ(45, generic.wastedSpace());
+    EXPECT_EQ(300, generic.allocate(20).valueOr(-1));
+    EXPECT_EQ(100, generic.allocate(15).valueOr(-1));
+    EXPECT_EQ(200, generic.allocate(10).valueOr(-1));
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -62,6 +62,8 @@ Loader::Loader(const Snapshot& snapshot, int error)
         mRamLoader.emplace(StdioStream(ram, StdioStream::kOwner),
                            RamLoader::Flags::OnDemandAllowed,
                            emptyRamBlockStructure);
+        mRamLoader->setAccessTraceFile(
+                PathUtils::join(mSnapshot.dataDir(), kRamAccessFileName));
     }
     {
         const auto textures = android::base::fsopen(
@@ -77,5 +77,27 @@ private:
     std::unique_ptr<Impl> mImpl;
 };
 
+// Write-protects memory ranges: the first write to each of their pages calls
+// |writeCallback| with the page address on the watch's own thread, and only
+// goes through once it returns. The page stays writable after that, and all
+// of the ranges become writable again when the watch is destroyed.
+class MemoryWriteWatch {
+public:
+    static bool isSupported();
+
+    using WriteCallback = std::function<void(void*)>;
+
+    explicit MemoryWriteWatch(WriteCallback&& writeCallback);
+
+    ~MemoryWriteWatch();
+
+    bool valid() const;
+    bool protectRange(void* start, size_t length);
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> mImpl;
+};
+
 }  // namespace snapshot
 }  // namespace android
@@ -230,5 +230,30 @@ void MemoryAccessWatch::join() {
     if (mImpl) { mImpl->join(); }
 }
 
+// Copy-on-write saving isn't supported on macOS. It needs the host to be told
+// about the first guest write to each page while the VM keeps running, and
+// the only hook here is the fault handler used for on-demand loading, which
+// makes a page fully accessible on first touch; it can't keep pages readable
+// but write-protected from under Hypervisor.framework.
+
+// static
+bool MemoryWriteWatch::isSupported() {
+    return false;
+}
+
+class MemoryWriteWatch::Impl {};
+
+MemoryWriteWatch::MemoryWriteWatch(WriteCallback&& writeCallback) {}
+
+MemoryWriteWatch::~MemoryWriteWatch() {}
+
+bool MemoryWriteWatch::valid() const {
+    return false;
+}
+
+bool MemoryWriteWatch::protectRange(void* start, size_t length) {
+    return false;
+}
+
 }  // namespace snapshot
 }  // namespace android
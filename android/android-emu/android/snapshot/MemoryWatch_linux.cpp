@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <cassert>
 #include <utility>
@@ -43,6 +44,30 @@
 #endif
 #endif
 
+// Write protection needs newer kernel headers than the toolchain has too.
+#ifndef UFFDIO_WRITEPROTECT
+#define _UFFDIO_WRITEPROTECT (0x06)
+#define UFFDIO_WRITEPROTECT_MODE_WP ((__u64)1 << 0)
+struct uffdio_writeprotect {
+    struct uffdio_range range;
+    __u64 mode;
+};
+#define UFFDIO_WRITEPROTECT \
+    _IOWR(UFFDIO, _UFFDIO_WRITEPROTECT, struct uffdio_writeprotect)
+#endif
+#ifndef UFFD_FEATURE_PAGEFAULT_FLAG_WP
+#define UFFD_FEATURE_PAGEFAULT_FLAG_WP (1 << 0)
+#endif
+#ifndef UFFD_PAGEFAULT_FLAG_WP
+#define UFFD_PAGEFAULT_FLAG_WP (1 << 1)
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+
 namespace fc = android::featurecontrol;
 using fc::Feature;
 
@@ -299,5 +324,173 @@ void MemoryAccessWatch::join() {
     }
 }
 
+// Returns the userfaultfd features to ask for write protection with, or 0 if
+// the kernel can't do it. The features have to be known before the UFFDIO_API
+// call, as asking for an unknown one fails it, so check on a separate fd.
+static uint64_t writeProtectFeatures() {
+    base::ScopedFd ufd(int(syscall(__NR_userfaultfd, O_CLOEXEC)));
+    if (!ufd.valid()) {
+        return 0;
+    }
+    uffdio_api apiStruct = {UFFD_API, 0, 0};
+    if (ioctl(ufd.get(), UFFDIO_API, &apiStruct)) {
+        return 0;
+    }
+    if (!(apiStruct.features & UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+        return 0;
+    }
+    // Without this one, pages that were never touched can't be protected
+    // and have to be populated first.
+    return UFFD_FEATURE_PAGEFAULT_FLAG_WP |
+           (apiStruct.features & UFFD_FEATURE_WP_UNPOPULATED);
+}
+
+class MemoryWriteWatch::Impl {
+public:
+    Impl(MemoryWriteWatch::WriteCallback&& writeCallback)
+        : mWriteCallback(std::move(writeCallback)),
+          mPageSize(size_t(getpagesize())),
+          mPagefaultThread([this]() { pagefaultWorker(); }) {
+        mFeatures = writeProtectFeatures();
+        if (!mFeatures) {
+            return;
+        }
+        mUserfaultFd = base::ScopedFd(
+                int(syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK)));
+        uffdio_api apiStruct = {UFFD_API, mFeatures, 0};
+        if (!mUserfaultFd.valid() ||
+            ioctl(mUserfaultFd.get(), UFFDIO_API, &apiStruct)) {
+            dwarning("UFFDIO_API failed: %s", strerror(errno));
+            mUserfaultFd.close();
+            return;
+        }
+        mExitFd = base::ScopedFd(eventfd(0, EFD_CLOEXEC));
+        assert(mExitFd.get() >= 0);
+        mPagefaultThread.start();
+    }
+
+    ~Impl() {
+        if (!mUserfaultFd.valid()) {
+            return;
+        }
+        // Unprotecting wakes up all pending writers as well, so the thread
+        // has nothing left to wait for after this.
+        for (auto&& range : mRanges) {
+            writeProtect(range.first, range.second, false);
+        }
+        HANDLE_EINTR(eventfd_write(mExitFd.get(), 1));
+        mPagefaultThread.wait();
+        for (auto&& range : mRanges) {
+            uffdio_range rangeStruct{(uintptr_t)range.first, range.second};
+            if (ioctl(mUserfaultFd.get(), UFFDIO_UNREGISTER, &rangeStruct)) {
+                derror("%s: userfault unregister %p - %s", __func__,
+                       range.first, strerror(errno));
+            }
+        }
+    }
+
+    bool protectRange(void* start, size_t length) {
+        uffdio_register regStruct = {{(uintptr_t)start, length},
+                                     UFFDIO_REGISTER_MODE_WP};
+        if (ioctl(mUserfaultFd.get(), UFFDIO_REGISTER, &regStruct)) {
+            VERBOSE_PRINT(snapshot, "%s userfault register(%p, %llu): %s",
+                          __func__, start, (unsigned long long)length,
+                          strerror(errno));
+            return false;
+        }
+        if (!(regStruct.ioctls & (1ull << _UFFDIO_WRITEPROTECT))) {
+            unregister(start, length);
+            return false;
+        }
+        if (!(mFeatures & UFFD_FEATURE_WP_UNPOPULATED) &&
+            madvise(start, length, MADV_POPULATE_READ)) {
+            // Reading maps the shared zero page, so this costs no memory.
+            for (size_t pos = 0; pos < length; pos += mPageSize) {
+                static_cast<void>(
+                        static_cast<volatile char*>(start)[pos]);
+            }
+        }
+        if (!writeProtect(start, length, true)) {
+            unregister(start, length);
+            return false;
+        }
+        mRanges.emplace_back(start, length);
+        return true;
+    }
+
+    bool writeProtect(void* start, size_t length, bool protect) {
+        uffdio_writeprotect wpStruct = {
+                {(uintptr_t)start, length},
+                protect ? UFFDIO_WRITEPROTECT_MODE_WP : 0};
+        if (ioctl(mUserfaultFd.get(), UFFDIO_WRITEPROTECT, &wpStruct)) {
+            derror("%s: userfault writeprotect(%p, %d): %s", __func__, start,
+                   int(protect), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void unregister(void* start, size_t length) {
+        uffdio_range rangeStruct{(uintptr_t)start, length};
+        ioctl(mUserfaultFd.get(), UFFDIO_UNREGISTER, &rangeStruct);
+    }
+
+    void pagefaultWorker() {
+        for (;;) {
+            pollfd pfd[] = {{mExitFd.get(), POLLIN},
+                            {mUserfaultFd.get(), POLLIN}};
+            if (HANDLE_EINTR(ppoll(pfd, ARRAY_SIZE(pfd), nullptr, nullptr)) ==
+                -1) {
+                derror("%s: userfault ppoll: %s", __func__, strerror(errno));
+                break;
+            }
+            if (pfd[0].revents) {
+                break;
+            }
+            uffd_msg msg;
+            while (HANDLE_EINTR(read(mUserfaultFd.get(), &msg,
+                                     sizeof(msg))) == sizeof(msg)) {
+                if (msg.event != UFFD_EVENT_PAGEFAULT ||
+                    !(msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP)) {
+                    continue;
+                }
+                const auto page = reinterpret_cast<void*>(
+                        uintptr_t(msg.arg.pagefault.address) &
+                        ~uintptr_t(mPageSize - 1));
+                mWriteCallback(page);
+                writeProtect(page, mPageSize, false);
+            }
+        }
+    }
+
+    MemoryWriteWatch::WriteCallback mWriteCallback;
+    const size_t mPageSize;
+    uint64_t mFeatures = 0;
+
+    base::ScopedFd mUserfaultFd;
+    base::ScopedFd mExitFd;
+
+    std::vector<std::pair<void*, uint64_t>> mRanges;
+
+    base::FunctorThread mPagefaultThread;
+};
+
+bool MemoryWriteWatch::isSupported() {
+    return writeProtectFeatures() != 0;
+}
+
+MemoryWriteWatch::MemoryWriteWatch(WriteCallback&& writeCallback)
+    : mImpl(new Impl(std::move(writeCallback))) {}
+
+MemoryWriteWatch::~MemoryWriteWatch() = default;
+
+bool MemoryWriteWatch::valid() const {
+    return mImpl->mUserfaultFd.valid();
+}
+
+bool MemoryWriteWatch::protectRange(void* start, size_t length) {
+    return valid() && mImpl->protectRange(start, length);
+}
+
 }  // namespace snapshot
 }  // namespace android
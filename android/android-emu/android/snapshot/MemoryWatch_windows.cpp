@@ -284,5 +284,29 @@ void MemoryAccessWatch::join() {
     if (mImpl) { mImpl->join(); }
 }
 
+// Copy-on-write saving isn't supported on Windows. It needs the host to be
+// told about the first guest write to each page while the VM keeps running;
+// the HAXM protection used for on-demand loading traps any access until the
+// page is filled in, rather than writes only, and WHPX has no such hook.
+
+// static
+bool MemoryWriteWatch::isSupported() {
+    return false;
+}
+
+class MemoryWriteWatch::Impl {};
+
+MemoryWriteWatch::MemoryWriteWatch(WriteCallback&& writeCallback) {}
+
+MemoryWriteWatch::~MemoryWriteWatch() {}
+
+bool MemoryWriteWatch::valid() const {
+    return false;
+}
+
+bool MemoryWriteWatch::protectRange(void* start, size_t length) {
+    return false;
+}
+
 }  // namespace snapshot
 }  // namespace android
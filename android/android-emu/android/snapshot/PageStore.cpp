@@ -0,0 +1,355 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/PageStore.h"
+
+#include "android/base/EintrWrapper.h"
+#include "android/base/files/FileShareOpen.h"
+#include "android/base/files/MemStream.h"
+#include "android/base/files/PathUtils.h"
+#include "android/base/files/preadwrite.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/misc/FileUtils.h"
+#include "android/base/system/System.h"
+#include "android/snapshot/PathUtils.h"
+#include "android/snapshot/common.h"
+#include "android/utils/debug.h"
+#include "android/utils/path.h"
+
+#include <cassert>
+
+using android::base::AutoLock;
+using android::base::c_str;
+using android::base::LazyInstance;
+using android::base::MemStream;
+using android::base::PathUtils;
+using android::base::StdioStream;
+
+namespace android {
+namespace snapshot {
+
+// Version 2 added the codec of the stored pages; version 1 stores are LZ4.
+static constexpr int32_t kPageStoreVersion = 2;
+
+namespace {
+
+struct AvdPageStore {
+    AvdPageStore()
+        : store(PathUtils::join(getSnapshotBaseDir(), kPageStoreFileName)) {}
+    PageStore store;
+};
+
+}  // namespace
+
+static LazyInstance<AvdPageStore> sAvdPageStore = LAZY_INSTANCE_INIT;
+
+PageStore* PageStore::get() {
+    return &sAvdPageStore->store;
+}
+
+PageStore::PageStore(base::StringView fileName) {
+    const bool exists = path_is_regular(c_str(fileName));
+    mStream = StdioStream(base::fsopen(c_str(fileName), exists ? "rb+" : "wb+",
+                                       base::FileShare::Write),
+                          StdioStream::kOwner);
+    if (!mStream.get()) {
+        return;
+    }
+    mFd = fileno(mStream.get());
+
+    // Shorter than the header, it can't have any pages anyone uses.
+    base::System::FileSize size = 0;
+    const bool empty = !exists ||
+                       (base::System::get()->fileSize(mFd, &size) && size < 8);
+    if (!empty && !readIndex()) {
+        // Snapshots may still have their pages in there, so leave the file
+        // alone and save without deduplication for this session.
+        derror("Snapshot page store %s can't be read, not using it",
+               c_str(fileName).get());
+        mPages.clear();
+        mStream.close();
+        mFd = -1;
+        return;
+    }
+    if (empty) {
+        setFileSize(mFd, 0);
+        HANDLE_EINTR(fseeko64(mStream.get(), 0, SEEK_SET));
+        mStream.putBe64(0);
+        fflush(mStream.get());
+    }
+}
+
+PageStore::~PageStore() = default;
+
+bool PageStore::readIndex() {
+    base::System::FileSize size;
+    if (!base::System::get()->fileSize(mFd, &size) || size < 8) {
+        return false;
+    }
+    mIndexPos = int64_t(mStream.getBe64());
+    if (mIndexPos == 0) {
+        // Store was created but never flushed.
+        mAppendPos = 8;
+        return true;
+    }
+    if (mIndexPos < 8 || mIndexPos > int64_t(size)) {
+        return false;
+    }
+
+    mIndexSize = int64_t(size) - mIndexPos;
+    MemStream::Buffer buffer(static_cast<size_t>(mIndexSize));
+    if (base::pread(mFd, buffer.data(), buffer.size(), mIndexPos) !=
+        int64_t(buffer.size())) {
+        return false;
+    }
+    MemStream stream(std::move(buffer));
+
+    const auto version = int32_t(stream.getBe32());
+    if (version < 1 || version > kPageStoreVersion) {
+        return false;
+    }
+    mCodec = version > 1 ? CodecType(stream.getByte()) : CodecType::Lz4;
+    if (!Codec::get(mCodec)) {
+        return false;
+    }
+    const auto count = stream.getBe32();
+    mPages.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        Hash hash;
+        stream.read(hash.data(), hash.size());
+        StoredPage page;
+        page.entry.filePos = int64_t(stream.getPackedNum());
+        page.entry.sizeOnDisk = int32_t(stream.getPackedNum());
+        page.refCount = uint32_t(stream.getPackedNum());
+        mPages.emplace(hash, page);
+    }
+    mGaps.load(stream);
+
+    // Keep the current index intact until a new one is written, so a crash
+    // in the middle of a save doesn't lose the whole store.
+    mAppendPos = int64_t(size);
+    return true;
+}
+
+base::Optional<PageStore::Entry> PageStore::put(const Hash& hash,
+                                                const uint8_t* data,
+                                                int32_t size,
+                                                bool* inserted) {
+    int64_t pos;
+    {
+        AutoLock lock(mLock);
+        auto it = mPages.find(hash);
+        if (it != mPages.end()) {
+            if (inserted) {
+                *inserted = false;
+            }
+            return it->second.entry;
+        }
+        if (auto gapPos = mGaps.allocate(size)) {
+            pos = *gapPos;
+        } else {
+            pos = mAppendPos;
+            mAppendPos += size;
+        }
+        mPages.emplace(hash, StoredPage{{pos, size}, 0});
+    }
+    if (base::pwrite(mFd, data, size_t(size), pos) != int64_t(size)) {
+        // The entry has no references yet, so at most a put() of the same
+        // page racing with this one can have returned it.
+        AutoLock lock(mLock);
+        mPages.erase(hash);
+        mGaps.add(pos, size);
+        return {};
+    }
+    if (inserted) {
+        *inserted = true;
+    }
+    return Entry{pos, size};
+}
+
+base::Optional<PageStore::Entry> PageStore::find(const Hash& hash) const {
+    AutoLock lock(mLock);
+    auto it = mPages.find(hash);
+    if (it == mPages.end()) {
+        return {};
+    }
+    return it->second.entry;
+}
+
+void PageStore::addRefs(const Hashes& hashes) {
+    AutoLock lock(mLock);
+    for (const Hash& hash : hashes) {
+        auto it = mPages.find(hash);
+        if (it != mPages.end()) {
+            ++it->second.refCount;
+        }
+    }
+}
+
+void PageStore::releaseRefs(const Hashes& hashes) {
+    AutoLock lock(mLock);
+    for (const Hash& hash : hashes) {
+        auto it = mPages.find(hash);
+        if (it == mPages.end() || it->second.refCount == 0) {
+            continue;
+        }
+        if (--it->second.refCount == 0) {
+            mReleasedGaps.emplace_back(it->second.entry.filePos,
+                                       it->second.entry.sizeOnDisk);
+            mPages.erase(it);
+        }
+    }
+}
+
+bool PageStore::flush() {
+    if (!valid()) {
+        return false;
+    }
+
+    AutoLock lock(mLock);
+    for (auto it = mPages.begin(); it != mPages.end();) {
+        if (it->second.refCount == 0) {
+            mGaps.add(it->second.entry.filePos, it->second.entry.sizeOnDisk);
+            it = mPages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    MemStream stream(512 + 32 * mPages.size());
+    stream.putBe32(uint32_t(kPageStoreVersion));
+    stream.putByte(uint8_t(mCodec));
+    stream.putBe32(uint32_t(mPages.size()));
+    for (const auto& pair : mPages) {
+        stream.write(pair.first.data(), pair.first.size());
+        stream.putPackedNum(uint64_t(pair.second.entry.filePos));
+        stream.putPackedNum(uint64_t(pair.second.entry.sizeOnDisk));
+        stream.putPackedNum(pair.second.refCount);
+    }
+    // The previous index and the released pages are still in use by the
+    // committed index, so they only become free space once the new one is
+    // committed; account for them in the saved gaps already.
+    if (mIndexPos) {
+        mReleasedGaps.emplace_back(mIndexPos, int(mIndexSize));
+    }
+    {
+        MemStream gapsStream;
+        mGaps.save(gapsStream);
+        GenericGapTracker savedGaps;
+        savedGaps.load(gapsStream);
+        for (const auto& gap : mReleasedGaps) {
+            savedGaps.add(gap.first, gap.second);
+        }
+        savedGaps.save(stream);
+    }
+
+    const auto newIndexPos = mAppendPos;
+    if (base::pwrite(mFd, stream.buffer().data(), stream.buffer().size(),
+                     newIndexPos) != int64_t(stream.buffer().size())) {
+        if (mIndexPos) {
+            mReleasedGaps.pop_back();
+        }
+        return false;
+    }
+    setFileSize(mFd, newIndexPos + int64_t(stream.buffer().size()));
+    HANDLE_EINTR(fseeko64(mStream.get(), 0, SEEK_SET));
+    mStream.putBe64(uint64_t(newIndexPos));
+    fflush(mStream.get());
+
+    for (const auto& gap : mReleasedGaps) {
+        mGaps.add(gap.first, gap.second);
+    }
+    mReleasedGaps.clear();
+    mIndexPos = newIndexPos;
+    mIndexSize = int64_t(stream.buffer().size());
+    // New pages go right after the index; the next flush() will release it.
+    mAppendPos = mIndexPos + mIndexSize;
+
+    VERBOSE_PRINT(snapshot,
+                  "Page store: %d unique pages, %lld bytes wasted",
+                  int(mPages.size()), (long long)mGaps.wastedSpace());
+    return ferror(mStream.get()) == 0;
+}
+
+CodecType PageStore::codec() const {
+    AutoLock lock(mLock);
+    return mCodec;
+}
+
+CodecType PageStore::setCodec(CodecType codec) {
+    AutoLock lock(mLock);
+    if (mPages.empty() && Codec::get(codec)) {
+        mCodec = codec;
+    }
+    return mCodec;
+}
+
+int64_t PageStore::entryCount() const {
+    AutoLock lock(mLock);
+    return int64_t(mPages.size());
+}
+
+// static
+bool PageStore::readRefs(base::StringView fileName, Hashes* hashes) {
+    hashes->clear();
+    StdioStream stream(base::fsopen(c_str(fileName), "rb",
+                                    base::FileShare::Read),
+                       StdioStream::kOwner);
+    if (!stream.get()) {
+        return false;
+    }
+    const auto count = stream.getBe32();
+    hashes->resize(count);
+    for (Hash& hash : *hashes) {
+        if (stream.read(hash.data(), hash.size()) != ssize_t(hash.size())) {
+            hashes->clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// static
+bool PageStore::writeRefs(base::StringView fileName, const Hashes& hashes) {
+    StdioStream stream(base::fsopen(c_str(fileName), "wb",
+                                    base::FileShare::Write),
+                       StdioStream::kOwner);
+    if (!stream.get()) {
+        return false;
+    }
+    stream.putBe32(uint32_t(hashes.size()));
+    for (const Hash& hash : hashes) {
+        stream.write(hash.data(), hash.size());
+    }
+    return ferror(stream.get()) == 0;
+}
+
+bool usesPageStore(base::StringView snapshotDir) {
+    return path_is_regular(
+            PathUtils::join(snapshotDir, kRamRefsFileName).c_str());
+}
+
+void releasePageStoreRefs(base::StringView snapshotDir) {
+    const auto refsFile = PathUtils::join(snapshotDir, kRamRefsFileName);
+    if (!path_is_regular(refsFile.c_str())) {
+        return;
+    }
+    PageStore::Hashes hashes;
+    if (PageStore::readRefs(refsFile, &hashes)) {
+        auto store = PageStore::get();
+        store->releaseRefs(hashes);
+        store->flush();
+    }
+    path_delete_file(refsFile.c_str());
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,160 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/Optional.h"
+#include "android/base/StringView.h"
+#include "android/base/files/StdioStream.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/snapshot/Codec.h"
+#include "android/snapshot/GapTracker.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+// PageStore - a content-addressed store of RAM pages, shared by all snapshots
+// of an AVD.
+//
+// Pages are keyed by the same MurmurHash3 that RamSaver computes for its
+// incremental save logic, so every unique page is written to disk once no
+// matter how many snapshots (or how many places in one snapshot) contain it.
+// A ram.bin saved with IndexFlags::PageStore keeps only its index, with
+// all page positions pointing into the store file.
+//
+// Each snapshot that references the store keeps a list of the unique hashes
+// it uses in a kRamRefsFileName file next to its ram.bin; the store keeps a
+// per-page reference count of those snapshots, and returns pages nobody
+// references anymore to a GapTracker for reuse.
+//
+// The store lives in the snapshot base directory, not in any snapshot's own
+// one, so a deduplicated snapshot can't leave its AVD: copying or exporting
+// its directory takes the index without the pages. Such snapshots are
+// refused by the export and import paths (see usesPageStore()); save them
+// again without RamSaver::Flags::Dedup to move them elsewhere.
+//
+// The file structure is as follows:
+//
+// 0: 8 bytes, index offset in the file (indexOffset)
+// 8: pages, in any order, with gaps left by released pages
+// indexOffset: version, codec, entry count, then for each entry its hash,
+//              position, size on disk and reference count; finally the gaps.
+// EOF
+class PageStore {
+    DISALLOW_COPY_AND_ASSIGN(PageStore);
+
+public:
+    using Hash = std::array<char, 16>;
+    using Hashes = std::vector<Hash>;
+
+    struct Entry {
+        int64_t filePos;
+        int32_t sizeOnDisk;
+    };
+
+    // Returns the store for the current AVD, creating it if needed. If the
+    // file exists but can't be read, the store isn't valid() for the session
+    // and the file is left alone.
+    static PageStore* get();
+
+    explicit PageStore(base::StringView fileName);
+    ~PageStore();
+
+    bool valid() const { return mStream.get() != nullptr; }
+
+    // An FD to pread() page data at Entry::filePos from.
+    int fd() const { return mFd; }
+
+    // Returns the entry for |hash|, writing |size| bytes of |data| as a new
+    // page if the store doesn't have it yet, or nothing if that write
+    // failed. |sizeOnDisk| of the returned entry may differ from |size| if
+    // the page was stored by a snapshot with different compression
+    // settings. |inserted|, if not null, is set to whether the page had to
+    // be written.
+    base::Optional<Entry> put(const Hash& hash,
+                              const uint8_t* data,
+                              int32_t size,
+                              bool* inserted = nullptr);
+    base::Optional<Entry> find(const Hash& hash) const;
+
+    // Reference counting: a snapshot adds a reference to every unique page
+    // it uses once its index is written, and releases them when it is
+    // overwritten or deleted. Released pages are reused only after the next
+    // flush(), as the index on disk still has them until then.
+    void addRefs(const Hashes& hashes);
+    void releaseRefs(const Hashes& hashes);
+
+    // Drops the pages that ended up unreferenced (e.g. written by a canceled
+    // save) and writes the index out.
+    bool flush();
+
+    // All pages in the store are compressed with the same codec, as the
+    // snapshots sharing them have to be able to decompress any of them.
+    // setCodec() changes it only while the store is empty, and returns the
+    // codec new pages have to use. CodecType::ZstdDict isn't supported.
+    CodecType codec() const;
+    CodecType setCodec(CodecType codec);
+
+    int64_t entryCount() const;
+    int64_t wastedSpace() const { return mGaps.wastedSpace(); }
+
+    static bool readRefs(base::StringView fileName, Hashes* hashes);
+    static bool writeRefs(base::StringView fileName, const Hashes& hashes);
+
+private:
+    struct HashHasher {
+        size_t operator()(const Hash& hash) const {
+            size_t res;
+            memcpy(&res, hash.data(), sizeof(res));
+            return res;
+        }
+    };
+
+    struct StoredPage {
+        Entry entry;
+        uint32_t refCount;
+    };
+
+    bool readIndex();
+
+    base::StdioStream mStream;
+    int mFd = -1;
+    int64_t mAppendPos = 8;
+    int64_t mIndexPos = 0;
+    int64_t mIndexSize = 0;
+    CodecType mCodec = CodecType::Lz4;
+
+    mutable base::Lock mLock;
+    std::unordered_map<Hash, StoredPage, HashHasher> mPages;
+    GenericGapTracker mGaps;
+    // Space freed since the index on disk was written, as (position, size).
+    std::vector<std::pair<int64_t, int>> mReleasedGaps;
+};
+
+// Returns true if the snapshot in |snapshotDir| keeps its RAM pages in the
+// AVD's page store instead of its own ram.bin.
+bool usesPageStore(base::StringView snapshotDir);
+
+// Releases the store references of the snapshot in |snapshotDir|, if it has
+// any. Needs to be called before the snapshot's files are deleted.
+void releasePageStoreRefs(base::StringView snapshotDir);
+
+}  // namespace snapshot
+}  // namespace android
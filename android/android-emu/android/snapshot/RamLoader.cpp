@@ -22,8 +22,9 @@
 #include "android/base/files/preadwrite.h"
 #include "android/base/memory/MemoryHints.h"
 #include "android/base/misc/StringUtils.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/snapshot/Codec.h"
 #include "android/snapshot/Compressor.h"
-#include "android/snapshot/Decompressor.h"
 #include "android/snapshot/PathUtils.h"
 #include "android/snapshot/interface.h"
 #include "android/utils/debug.h"
@@ -35,6 +36,7 @@
 #include <cassert>
 #include <memory>
 
+using android::base::AutoLock;
 using android::base::ContiguousRangeMapper;
 using android::base::MemoryHint;
 using android::base::MemStream;
@@ -45,6 +47,14 @@ using android::base::Stopwatch;
 namespace android {
 namespace snapshot {
 
+// Loading and decompressing pages takes longer than filling them in, so
+// there are several readers feeding the access watch thread.
+static constexpr int kMaxReaderThreads = 4;
+
+// How many of the pages the readers have ready to fill in at once, before
+// checking for page faults again.
+static constexpr int kFillBatchSize = 16;
+
 void RamLoader::FileIndex::clear() {
     decltype(pages)().swap(pages);
     decltype(blocks)().swap(blocks);
@@ -55,7 +65,7 @@ RamLoader::RamBlockStructure::~RamBlockStructure() {}
 RamLoader::RamLoader(base::StdioStream&& stream,
                      Flags flags,
                      const RamLoader::RamBlockStructure& blockStructure)
-    : mStream(std::move(stream)), mReaderThread([this]() { readerWorker(); }) {
+    : mStream(std::move(stream)) {
     if (nonzero(flags & Flags::LoadIndexOnly)) {
         mIndexOnly = true;
         applyRamBlockStructure(blockStructure);
@@ -81,7 +91,7 @@ RamLoader::RamLoader(base::StdioStream&& stream,
 RamLoader::~RamLoader() {
     if (mWasStarted) {
         interruptReading();
-        mReaderThread.wait();
+        waitForReaders();
         if (mAccessWatch) {
             mAccessWatch->join();
             mAccessWatch.clear();
@@ -159,8 +169,9 @@ bool RamLoader::start(bool isQuickboot) {
         return false;
     }
     mBackgroundPageIt = mIndex.pages.begin();
+    readAccessTrace();
     mAccessWatch->doneRegistering();
-    mReaderThread.start();
+    startReaders();
     return true;
 }
 
@@ -190,12 +201,13 @@ void RamLoader::join() {
     // get race conditions in fillPageData.
     mJoining = true;
 
-    mReaderThread.wait();
+    waitForReaders();
     if (mAccessWatch) {
         mAccessWatch->join();
         mAccessWatch.clear();
     }
     mStream.close();
+    writeAccessTrace();
 
 #if SNAPSHOT_PROFILE > 1
     printf("Finished remaining RAM load in %f ms\n", sw.elapsedUs() / 1000.0f);
@@ -205,7 +217,7 @@ void RamLoader::join() {
 void RamLoader::interrupt() {
     mReadDataQueue.stop();
     mReadingQueue.stop();
-    mReaderThread.wait();
+    waitForReaders();
     if (mAccessWatch) {
         mAccessWatch->join();
         mAccessWatch.clear();
@@ -262,6 +274,7 @@ bool RamLoader::readIndex() {
     auto start = base::System::get()->getHighResTimeUs();
 #endif
     mStreamFd = fileno(mStream.get());
+    mPageFd = mStreamFd;
     base::System::FileSize size;
     if (!base::System::get()->fileSize(mStreamFd, &size)) {
         return false;
@@ -282,9 +295,36 @@ bool RamLoader::readIndex() {
         return false;
     }
     mIndex.flags = IndexFlags(stream.getBe32());
-    const bool compressed = nonzero(mIndex.flags & IndexFlags::CompressedPages);
+    // Page store indices always keep exact page sizes, the same way as
+    // compressed ones do.
+    const bool compressed =
+            nonzero(mIndex.flags & IndexFlags::CompressedPages) ||
+            nonzero(mIndex.flags & IndexFlags::PageStore);
+    if (nonzero(mIndex.flags & IndexFlags::PageStore)) {
+        if (!mPageStore) {
+            mPageStore = PageStore::get();
+        }
+        if (!mPageStore->valid()) {
+            derror("Snapshot RAM is in the page store, but it can't be opened");
+            return false;
+        }
+        mPageFd = mPageStore->fd();
+    }
     auto pageCount = stream.getBe32();
 
+    const auto codecType = codecFromIndexFlags(int32_t(mIndex.flags));
+    if (codecType == CodecType::ZstdDict) {
+        Codec::Dictionary dictionary(stream.getBe32());
+        stream.read(dictionary.data(), dictionary.size());
+        mCodec = Codec::createWithDictionary(std::move(dictionary));
+    } else {
+        mCodec = Codec::get(codecType);
+    }
+    if (!mCodec) {
+        derror("Snapshot RAM uses an unknown codec %d", int(codecType));
+        return false;
+    }
+
     mIndex.pages.reserve(pageCount);
     int64_t runningFilePos = 8;
     int32_t prevPageSizeOnDisk = 0;
@@ -306,8 +346,9 @@ bool RamLoader::readIndex() {
     }
 
     if (mVersion > 1) {
-        mGaps = compressed ? GapTracker::Ptr(new GenericGapTracker())
-                           : GapTracker::Ptr(new OneSizeGapTracker());
+        mGaps = nonzero(mIndex.flags & IndexFlags::CompressedPages)
+                        ? GapTracker::Ptr(new ExtentGapTracker())
+                        : GapTracker::Ptr(new OneSizeGapTracker());
         mGaps->load(stream);
     }
 
@@ -526,10 +567,87 @@ RamLoader::Page& RamLoader::page(void* ptr) {
     return *pageIt;
 }
 
+void RamLoader::readAccessTrace() {
+    if (!mIsQuickboot || mAccessTraceFile.empty()) {
+        return;
+    }
+    // A missing or broken trace only means there's nothing to prefetch.
+    AccessTrace::read(mAccessTraceFile, &mPreviousAccessTrace);
+    mPrefetchPages.reserve(mPreviousAccessTrace.size());
+    for (const auto index : mPreviousAccessTrace) {
+        if (index < mIndex.pages.size()) {
+            mPrefetchPages.push_back(&mIndex.pages[index]);
+        }
+    }
+    mAccessTraceEndTime = mStartTime + AccessTrace::kRecordingTimeMs * 1000;
+    mRecordingAccessTrace = true;
+
+    VERBOSE_PRINT(snapshot, "Prefetching %d traced RAM pages",
+                  int(mPrefetchPages.size()));
+}
+
+void RamLoader::recordAccess(const Page& page) {
+    // loadRam() may come for pages that are already there.
+    if (!mRecordingAccessTrace.load(std::memory_order_relaxed) ||
+        page.state.load(std::memory_order_relaxed) == uint8_t(State::Filled)) {
+        return;
+    }
+    const auto now = base::System::get()->getHighResTimeUs();
+    AutoLock lock(mAccessTraceLock);
+    if (now > mAccessTraceEndTime ||
+        mAccessTrace.size() >= size_t(AccessTrace::kMaxPages)) {
+        mRecordingAccessTrace = false;
+        return;
+    }
+    mAccessTrace.push_back(
+            AccessTrace::PageIndex(&page - mIndex.pages.data()));
+}
+
+void RamLoader::writeAccessTrace() {
+    // Only on-demand loads record anything.
+    if (mAccessTraceFile.empty() || !mAccessTraceEndTime || mHasError) {
+        return;
+    }
+    mRecordingAccessTrace = false;
+    AutoLock lock(mAccessTraceLock);
+    if (!AccessTrace::write(
+                mAccessTraceFile,
+                AccessTrace::merge(mAccessTrace, mPreviousAccessTrace))) {
+        VERBOSE_PRINT(snapshot, "Failed to write the RAM access trace to %s",
+                      mAccessTraceFile.c_str());
+    }
+    mAccessTraceFile.clear();
+}
+
+void RamLoader::startReaders() {
+    const int count = std::max(
+            1, std::min(kMaxReaderThreads,
+                        base::System::get()->getCpuCoreCount() - 1));
+    mRunningReaders = count;
+    for (int i = 0; i < count; ++i) {
+        mReaderThreads.emplace_back(
+                new base::FunctorThread([this]() { readerWorker(); }));
+        mReaderThreads.back()->start();
+    }
+}
+
+void RamLoader::waitForReaders() {
+    for (auto& thread : mReaderThreads) {
+        thread->wait();
+    }
+}
+
 void RamLoader::readerWorker() {
     while (auto pagePtr = mReadingQueue.receive()) {
         Page* page = *pagePtr;
         if (!page) {
+            // The end marker is the last item in the queue: pass it on to
+            // the next reader, and let the last one report the end once
+            // all the others are done with their pages.
+            if (--mRunningReaders > 0) {
+                mReadingQueue.send(nullptr);
+                return;
+            }
             mReadDataQueue.send(nullptr);
             mReadingQueue.stop();
             break;
@@ -547,6 +665,33 @@ void RamLoader::readerWorker() {
 #endif
 }
 
+static bool needsBackgroundLoad(const RamLoader::Page& page) {
+    auto state = page.state.load(std::memory_order_acquire);
+    return state == uint8_t(RamLoader::State::Empty) ||
+           (state == uint8_t(RamLoader::State::Read) && !page.data);
+}
+
+// Traced pages go first, then the rest in the index order.
+RamLoader::Page* RamLoader::nextBackgroundPage() {
+    for (; mPrefetchPos < mPrefetchPages.size(); ++mPrefetchPos) {
+        if (needsBackgroundLoad(*mPrefetchPages[mPrefetchPos])) {
+            return mPrefetchPages[mPrefetchPos];
+        }
+    }
+    mBackgroundPageIt = std::find_if(mBackgroundPageIt, mIndex.pages.end(),
+                                     needsBackgroundLoad);
+    return mBackgroundPageIt == mIndex.pages.end() ? nullptr
+                                                   : &*mBackgroundPageIt;
+}
+
+void RamLoader::advanceBackgroundPage() {
+    if (mPrefetchPos < mPrefetchPages.size()) {
+        ++mPrefetchPos;
+    } else {
+        ++mBackgroundPageIt;
+    }
+}
+
 MemoryAccessWatch::IdleCallbackResult RamLoader::backgroundPageLoad() {
     if (mReadingQueue.isStopped() && mReadDataQueue.isStopped()) {
         return MemoryAccessWatch::IdleCallbackResult::AllDone;
@@ -555,18 +700,22 @@ MemoryAccessWatch::IdleCallbackResult RamLoader::backgroundPageLoad() {
     {
         Page* page = nullptr;
         if (mReadDataQueue.tryReceive(&page)) {
+            // Fill in a batch of what the readers have ready before
+            // checking for page faults again.
+            Page* next = nullptr;
+            for (int i = 1; page && i < kFillBatchSize &&
+                            mReadDataQueue.tryReceive(&next);
+                 ++i) {
+                fillPageData(page);
+                page = next;
+            }
             return fillPageInBackground(page);
         }
     }
 
     for (int i = 0; i < int(mReadingQueue.capacity()); ++i) {
         // Find next page to queue.
-        mBackgroundPageIt = std::find_if(
-                mBackgroundPageIt, mIndex.pages.end(), [](const Page& page) {
-                    auto state = page.state.load(std::memory_order_acquire);
-                    return state == uint8_t(State::Empty) ||
-                           (state == uint8_t(State::Read) && !page.data);
-                });
+        Page* const page = nextBackgroundPage();
 #if SNAPSHOT_PROFILE > 2
         const auto count = int(mBackgroundPageIt - mIndex.pages.begin());
         if ((count % 10000) == 0 || count == int(mIndex.pages.size())) {
@@ -575,7 +724,7 @@ MemoryAccessWatch::IdleCallbackResult RamLoader::backgroundPageLoad() {
         }
 #endif
 
-        if (mBackgroundPageIt == mIndex.pages.end()) {
+        if (!page) {
             if (!mSentEndOfPagesMarker) {
                 mSentEndOfPagesMarker = mReadingQueue.trySend(nullptr);
             }
@@ -583,14 +732,14 @@ MemoryAccessWatch::IdleCallbackResult RamLoader::backgroundPageLoad() {
                             : MemoryAccessWatch::IdleCallbackResult::Wait;
         }
 
-        if (mBackgroundPageIt->state.load(std::memory_order_relaxed) ==
+        if (page->state.load(std::memory_order_relaxed) ==
             uint8_t(State::Read)) {
-            Page* const page = &*mBackgroundPageIt++;
+            advanceBackgroundPage();
             return fillPageInBackground(page);
         }
 
-        if (mReadingQueue.trySend(&*mBackgroundPageIt)) {
-            ++mBackgroundPageIt;
+        if (mReadingQueue.trySend(page)) {
+            advanceBackgroundPage();
         } else {
             // The queue is full - let's wait for a while to give the reader
             // time to empty it.
@@ -608,9 +757,11 @@ MemoryAccessWatch::IdleCallbackResult RamLoader::fillPageInBackground(
         fillPageData(page);
         // If we've loaded a page then this function took quite a while
         // and it's better to check for a pagefault before proceeding to
-        // queuing pages into the reader thread.
-        return mJoining ? MemoryAccessWatch::IdleCallbackResult::RunAgain
-                        : MemoryAccessWatch::IdleCallbackResult::Wait;
+        // queuing pages into the reader thread. Traced pages are about to
+        // be needed though, so don't wait between them.
+        return mJoining || mPrefetchPos < mPrefetchPages.size()
+                       ? MemoryAccessWatch::IdleCallbackResult::RunAgain
+                       : MemoryAccessWatch::IdleCallbackResult::Wait;
     } else {
         // null page == all pages were loaded, stop.
         interruptReading();
@@ -641,6 +792,7 @@ void RamLoader::loadRamPage(void* ptr) {
     }
 
     Page& page = this->page(ptr);
+    recordAccess(page);
     readDataFromDisk(&page, nullptr);
     fillPageData(&page);
 }
@@ -668,7 +820,8 @@ bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
     uint8_t compressedBuf[compress::maxCompressedSize(kDefaultPageSize)];
     auto size = page.sizeOnDisk;
     const bool compressed =
-            nonzero(mIndex.flags & IndexFlags::CompressedPages) &&
+            (nonzero(mIndex.flags & IndexFlags::CompressedPages) ||
+             nonzero(mIndex.flags & IndexFlags::PageStore)) &&
             (mVersion == 1 || page.sizeOnDisk < kDefaultPageSize);
 
     // We need to allocate a dynamic buffer if:
@@ -681,7 +834,7 @@ bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
     auto buf = allocateBuffer ? new uint8_t[size]
                               : compressed ? compressedBuf : preallocatedBuffer;
     auto read = HANDLE_EINTR(
-            base::pread(mStreamFd, buf, size, int64_t(page.filePos)));
+            base::pread(mPageFd, buf, size, int64_t(page.filePos)));
     if (read != int64_t(size)) {
         VERBOSE_PRINT(snapshot,
                       "Error: (%d) Reading page %p from disk returned less "
@@ -707,8 +860,8 @@ bool RamLoader::readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer) {
             auto decompressed = preallocatedBuffer
                                         ? preallocatedBuffer
                                         : new uint8_t[pageSize(page)];
-            if (!Decompressor::decompress(buf, int32_t(size), decompressed,
-                                          int32_t(pageSize(page)))) {
+            if (!mCodec->decompress(buf, int32_t(size), decompressed,
+                                    int32_t(pageSize(page)))) {
                 VERBOSE_PRINT(snapshot,
                               "Error: Decompressing page %p @%llu (%d -> %d) "
                               "failed",
@@ -782,7 +935,9 @@ bool RamLoader::readAllPages() {
     auto startTime = base::System::get()->getHighResTimeUs();
 #endif
 
-    if (nonzero(mIndex.flags & IndexFlags::CompressedPages) && !mAccessWatch) {
+    if ((nonzero(mIndex.flags & IndexFlags::CompressedPages) ||
+         nonzero(mIndex.flags & IndexFlags::PageStore)) &&
+        !mAccessWatch) {
         startDecompressor();
     }
 
@@ -834,7 +989,7 @@ bool RamLoader::readAllPages() {
 
 void RamLoader::startDecompressor() {
     mDecompressor.emplace([this](Page* page) {
-        const bool res = Decompressor::decompress(
+        const bool res = mCodec->decompress(
                 page->data, int32_t(page->sizeOnDisk), pagePtr(*page),
                 int32_t(pageSize(*page)));
         delete[] page->data;
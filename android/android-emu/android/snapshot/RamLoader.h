@@ -15,17 +15,22 @@
 #include "android/base/EnumFlags.h"
 #include "android/base/Optional.h"
 #include "android/base/files/StdioStream.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/base/synchronization/MessageChannel.h"
 #include "android/base/system/System.h"
 #include "android/base/threads/FunctorThread.h"
 #include "android/base/threads/ThreadPool.h"
+#include "android/snapshot/AccessTrace.h"
+#include "android/snapshot/Codec.h"
 #include "android/snapshot/GapTracker.h"
 #include "android/snapshot/MemoryWatch.h"
+#include "android/snapshot/PageStore.h"
 #include "android/snapshot/common.h"
 
 #include <array>
 #include <atomic>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -101,6 +106,21 @@ public:
     bool compressed() const {
         return (mIndex.flags & IndexFlags::CompressedPages) != 0;
     }
+    bool deduped() const {
+        return (mIndex.flags & IndexFlags::PageStore) != 0;
+    }
+    // The codec the pages were compressed with; has the dictionary for
+    // CodecType::ZstdDict, so incremental saves can keep using it.
+    const Codec::Ptr& codec() const { return mCodec; }
+    // Overrides the AVD's PageStore::get() for indices saved with
+    // IndexFlags::PageStore; needs to be called before start().
+    void setPageStore(PageStore* pageStore) { mPageStore = pageStore; }
+    // Makes quickboot on-demand loads prefetch the pages listed in the
+    // AccessTrace at |fileName| first, and record a new trace there; needs
+    // to be called before start().
+    void setAccessTraceFile(std::string fileName) {
+        mAccessTraceFile = std::move(fileName);
+    }
     uint64_t diskSize() const { return mDiskSize; }
     int version() const { return mVersion; }
     uint64_t indexOffset() const { return mIndexPos; }
@@ -144,7 +164,15 @@ private:
     bool readDataFromDisk(Page* pagePtr, uint8_t* preallocatedBuffer = nullptr);
     void fillPageData(Page* pagePtr);
 
+    void readAccessTrace();
+    void recordAccess(const Page& page);
+    void writeAccessTrace();
+
+    void startReaders();
+    void waitForReaders();
     void readerWorker();
+    Page* nextBackgroundPage();
+    void advanceBackgroundPage();
     MemoryAccessWatch::IdleCallbackResult backgroundPageLoad();
     MemoryAccessWatch::IdleCallbackResult fillPageInBackground(Page* page);
     void interruptReading();
@@ -154,12 +182,23 @@ private:
 
     base::StdioStream mStream;
     int mStreamFd;  // An FD for the |mStream|'s underlying open file.
+    int mPageFd;    // An FD to read the page data from: |mStreamFd|, or the
+                    // page store's one.
+    PageStore* mPageStore = nullptr;
+    Codec::Ptr mCodec;
     bool mWasStarted = false;
     std::atomic<bool> mHasError{false};
 
     base::Optional<MemoryAccessWatch> mAccessWatch;
-    base::FunctorThread mReaderThread;
+    // Readers load and decompress the pages queued by backgroundPageLoad(),
+    // so the access watch thread only needs to fill them in.
+    std::vector<std::unique_ptr<base::FunctorThread>> mReaderThreads;
+    std::atomic<int> mRunningReaders{0};
     Pages::iterator mBackgroundPageIt;
+    // Pages to load before the ones at |mBackgroundPageIt|, from the
+    // AccessTrace file.
+    std::vector<Page*> mPrefetchPages;
+    size_t mPrefetchPos = 0;
     bool mSentEndOfPagesMarker = false;
     bool mJoining = false;
     bool mOnDemandEnabled = false;
@@ -188,6 +227,15 @@ private:
     // quickboot load.
     bool mIsQuickboot = false;
 
+    // The AccessTrace file, the trace read from it and the faults recorded
+    // during this load.
+    std::string mAccessTraceFile;
+    AccessTrace::Pages mPreviousAccessTrace;
+    AccessTrace::Pages mAccessTrace;
+    base::Lock mAccessTraceLock;
+    base::System::Duration mAccessTraceEndTime = 0;
+    std::atomic<bool> mRecordingAccessTrace{false};
+
     // Whether or not we just want to reload the index.
     bool mIndexOnly = false;
 
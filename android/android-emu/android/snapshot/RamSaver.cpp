@@ -11,12 +11,14 @@
 
 #include "android/snapshot/RamSaver.h"
 
+#include "android/base/AlignedBuf.h"
 #include "android/base/ContiguousRangeMapper.h"
 #include "android/base/Profiler.h"
 #include "android/base/Stopwatch.h"
 #include "android/base/EintrWrapper.h"
 #include "android/base/files/FileShareOpen.h"
 #include "android/base/files/MemStream.h"
+#include "android/base/files/PathUtils.h"
 #include "android/base/files/preadwrite.h"
 #include "android/base/memory/MemoryHints.h"
 #include "android/base/memory/OnDemand.h"
@@ -47,12 +49,22 @@ namespace snapshot {
 using android::base::ContiguousRangeMapper;
 using android::base::MemStream;
 using android::base::MemoryHint;
+using android::base::PathUtils;
 using android::base::ScopedMemoryProfiler;
 using android::base::System;
 
 using StatAction = IncrementalStats::Action;
 using StatTime = IncrementalStats::Time;
 
+// 2048 pages make an 8MB training set, ~100x the dictionary size.
+static constexpr int64_t kDictionarySamplePages = 2048;
+
+// Incremental saves give up on the loaded file past this much wasted space,
+// and compacting ones close the gaps past the second one.
+static constexpr double kMaxWastedSpaceRatio = 0.30;
+static constexpr double kCompactionWastedSpaceRatio = 0.10;
+static constexpr int64_t kCompactionBufferSize = 1024 * 1024;
+
 void RamSaver::FileIndex::clear() {
     decltype(blocks)().swap(blocks);
 }
@@ -60,15 +72,24 @@ void RamSaver::FileIndex::clear() {
 RamSaver::RamSaver(const std::string& fileName,
                    Flags preferredFlags,
                    RamLoader* loader,
-                   bool isOnExit)
+                   bool isOnExit,
+                   CodecType codec,
+                   PageStore* pageStore)
     : mStream(nullptr) {
     bool incremental = false;
+    bool canCompact = false;
     if (loader) {
         // check if we're ok to proceed with incremental saving
         auto currentGaps = loader->releaseGapTracker();
         assert(currentGaps);
         const auto wastedSpace = currentGaps->wastedSpace();
-        if (wastedSpace <= loader->diskSize() * 0.30) {
+        // Pages can only be moved once the loader is done with the file, and
+        // the page store has gaps of its own.
+        canCompact = nonzero(preferredFlags & RamSaver::Flags::Compact) &&
+                     (isOnExit || !loader->onDemandEnabled()) &&
+                     !loader->deduped();
+        if (wastedSpace <= loader->diskSize() * kMaxWastedSpaceRatio ||
+            canCompact) {
             incremental = true;
             if (isOnExit) {
                 loader->interrupt();
@@ -92,6 +113,20 @@ RamSaver::RamSaver(const std::string& fileName,
         if (nonzero(preferredFlags & RamSaver::Flags::Async)) {
             mFlags |= RamSaver::Flags::Async;
         }
+        if (nonzero(preferredFlags & RamSaver::Flags::CopyOnWrite)) {
+            mFlags |= RamSaver::Flags::CopyOnWrite;
+        }
+        // Page positions in the loaded index only make sense for the same
+        // backing storage, so stick to the loaded one.
+        if (loader->deduped()) {
+            mFlags |= RamSaver::Flags::Dedup;
+        }
+        if (canCompact) {
+            mFlags |= RamSaver::Flags::Compact;
+        }
+        // Same for the codec: unchanged pages stay compressed with it.
+        mCodec = loader->codec();
+        mCodecType = mCodec ? mCodec->type() : CodecType::Lz4;
 
         mLoader = loader;
         mLoaderOnDemand = loader->onDemandEnabled();
@@ -106,6 +141,7 @@ RamSaver::RamSaver(const std::string& fileName,
         }
     } else {
         mFlags = preferredFlags;
+        mCodecType = codec;
         mStream = base::StdioStream(
                 android::base::fsopen(fileName.c_str(), "wb",
                                       android::base::FileShare::Write),
@@ -122,11 +158,24 @@ RamSaver::RamSaver(const std::string& fileName,
     }
 
     mStreamFd = fileno(mStream.get());
+    mSnapshotDir = PathUtils::pathToDir(fileName).valueOr(std::string());
+
+    if (incremental && !loader->deduped()) {
+        mGaps->setHolePunchFd(mStreamFd);
+    }
 
     if (nonzero(mFlags & Flags::Async)) {
         mIndex.flags |= int32_t(FileIndex::Flags::SeparateBackingStore);
     }
 
+    if (nonzero(mFlags & Flags::CopyOnWrite) &&
+        !MemoryWriteWatch::isSupported()) {
+        VERBOSE_PRINT(snapshot,
+                      "Guest RAM can't be write-protected, saving it with "
+                      "the VM stopped");
+        mFlags &= ~Flags::CopyOnWrite;
+    }
+
     if (nonzero(mFlags & Flags::Compress)) {
         mIndex.flags |= int32_t(FileIndex::Flags::CompressedPages);
 
@@ -136,6 +185,42 @@ RamSaver::RamSaver(const std::string& fileName,
                                  compressBuffers + kCompressBufferCount);
     }
 
+    if (nonzero(mFlags & Flags::Dedup)) {
+        mPageStore = pageStore ? pageStore : PageStore::get();
+        if (mPageStore->valid()) {
+            mIndex.flags |= int32_t(FileIndex::Flags::PageStore);
+        } else if (incremental) {
+            derror("Snapshot page store is unavailable, can't save RAM");
+            mHasError = true;
+            return;
+        } else {
+            VERBOSE_PRINT(snapshot,
+                          "Snapshot page store is unavailable, saving RAM "
+                          "without deduplication");
+            mPageStore = nullptr;
+            mFlags &= ~Flags::Dedup;
+        }
+    }
+
+    if (mPageStore && !incremental) {
+        // The store can't keep a dictionary per snapshot.
+        if (mCodecType == CodecType::ZstdDict) {
+            mCodecType = CodecType::Zstd;
+        }
+        const auto storeCodec = mPageStore->setCodec(mCodecType);
+        if (storeCodec != mCodecType) {
+            VERBOSE_PRINT(snapshot,
+                          "Snapshot page store uses %s, saving RAM with it "
+                          "instead of %s",
+                          Codec::toString(storeCodec),
+                          Codec::toString(mCodecType));
+            mCodecType = storeCodec;
+        }
+    }
+    if (!mCodec && mCodecType != CodecType::ZstdDict) {
+        mCodec = Codec::get(mCodecType);
+    }
+
     mWriteCombineBuffer.resize(kCompressBufferBatchSize * kDefaultPageSize);
 
     mWorkers.emplace(
@@ -153,7 +238,11 @@ RamSaver::RamSaver(const std::string& fileName,
         if (wi.blockIndex == -1) {
             return base::WorkerProcessingResult::Stop;
         }
-        writePage(std::move(wi));
+        if (mPageStore) {
+            writePageToStore(std::move(wi));
+        } else {
+            writePage(std::move(wi));
+        }
         return base::WorkerProcessingResult::Continue;
     });
     if (!mWriter->start()) {
@@ -181,6 +270,9 @@ void RamSaver::savePage(int64_t blockOffset,
         printf("From ctor to first savePage: %.03f\n",
                 (mSystem->getHighResTimeUs() - mStartTime) / 1000.0);
 #endif
+        if (!mCodec && compressed()) {
+            trainDictionary();
+        }
     }
 
     assert(!mIndex.blocks.empty());
@@ -233,72 +325,20 @@ void RamSaver::savePage(int64_t blockOffset,
         // Short-circuit the fastest cases right here.
 
         // Stats counting vars (for speed, avoid atomic ops)
-        int totalZero = 0;
-        int changedTotal = 0;
         int samePage = 0;
         int notLoadedPage = 0;
-        int stillZero = 0;
-        int sameHash = 0;
 
         mIncStats.countMultiple(StatAction::TotalPages, numPages);
 
         mIncStats.measure(StatTime::ZeroCheck, [&] {
-
-            // Hint that we will access sequentially.
-            android::base::memoryHint(
-                block.ramBlock.hostPtr,
-                numPages * block.ramBlock.pageSize,
-                MemoryHint::Sequential);
-
-            // Initialize Pages and check for all-zero pages.
-            uint8_t* zeroCheckPtr = block.ramBlock.hostPtr;
-
-            {
-
-                // RAM decommit: when checking for zero pages or hashing, we need to make sure
-                // that the memory does not become resident, or useful memory might
-                // get paged out and the save itself will have to compete with
-                // paging out, which can slow things down.
-                //
-                // Track continguous 16mb ranges to decommit.  This is so that zero
-                // check causes extra RAM to be resident only up to 16 mb, while
-                // avoiding issuing frequent system calls.
-
-                // Zero pages can actually be zeroed out and MADV_FREE'ed.
-                ContiguousRangeMapper zeroPageDeleter([](uintptr_t start, uintptr_t size) {
-                    android::base::memoryHint((void*)start, size, MemoryHint::DontNeed);
-                }, kDecommitChunkSize);
-
-#if SNAPSHOT_PROFILE > 1
-                ScopedMemoryProfiler mem("zeroCheck");
-#endif
-
-                for (int32_t i = 0; i < numPages;
-                     ++i,
-                     zeroCheckPtr += (uintptr_t)block.ramBlock.pageSize) {
-
-                    bool isZero = isBufferZeroed(zeroCheckPtr,
-                                                 block.ramBlock.pageSize);
-
-                    auto& page = block.pages[size_t(i)];
-                    page.same = false;
-                    page.hashFilled = false;
-                    page.filePos = 0;
-                    page.loaderPage = nullptr;
-
-                    // Don't branch for the isZero decision
-                    page.sizeOnDisk = kDefaultPageSize * !isZero;
-                    totalZero += isZero;
-
-                    // Decommit or free in chunks of 16 mb.
-                    if (page.sizeOnDisk == 0) {
-                        zeroPageDeleter.add((uintptr_t)zeroCheckPtr, block.ramBlock.pageSize);
-                    }
-                }
+            for (int32_t i = 0; i < numPages; ++i) {
+                auto& page = block.pages[size_t(i)];
+                page.same = false;
+                page.hashFilled = false;
+                page.filePos = 0;
+                page.loaderPage = nullptr;
             }
 
-            changedTotal = totalZero;
-
             // Initialize the incremental save case
             if (mLoader) {
 
@@ -338,99 +378,304 @@ void RamSaver::savePage(int64_t blockOffset,
             }
         });
 
-        // Calculate all hashes and if applicable, compare with previous
-        // snapshot, computing all changed nonzero pages
-        mIncStats.measure(StatTime::Hashing, [&] {
+        mIncStats.countMultiple(StatAction::SamePage, samePage);
+        mIncStats.countMultiple(StatAction::NotLoadedPage, notLoadedPage);
+
+        if (nonzero(mFlags & Flags::CopyOnWrite) &&
+            protectBlock(mLastBlockIndex)) {
+            // The guest can't change what gets saved anymore, so the rest
+            // can wait until it's running again; see complete().
+            return;
+        }
+        saveBlock(mLastBlockIndex);
+    }
+}
+
+void RamSaver::saveBlock(int blockIndex) {
+    auto& block = mIndex.blocks[size_t(blockIndex)];
+    const auto numPages = int32_t(block.pages.size());
+
+    // Stats counting vars (for speed, avoid atomic ops)
+    int totalZero = 0;
+    int changedTotal = 0;
+    int stillZero = 0;
+    int sameHash = 0;
+
+    // Check for all-zero pages and hash the rest in a single pass, while
+    // each page is still in the cache; going over multiple GBs of RAM
+    // twice costs more than either of the two. Pages that weren't even
+    // loaded are known to be the same, so they aren't read at all.
+    mIncStats.measure(StatTime::Hashing, [&] {
+
+        // Hint that we will access sequentially.
+        android::base::memoryHint(
+            block.ramBlock.hostPtr,
+            numPages * block.ramBlock.pageSize,
+            MemoryHint::Sequential);
+
+        {
+
+            // RAM decommit: when checking for zero pages or hashing, we need to make sure
+            // that the memory does not become resident, or useful memory might
+            // get paged out and the save itself will have to compete with
+            // paging out, which can slow things down.
+            //
+            // Track continguous 16mb ranges to decommit.  This is so that zero
+            // check causes extra RAM to be resident only up to 16 mb, while
+            // avoiding issuing frequent system calls.
+
+            // Zero pages can actually be zeroed out and MADV_FREE'ed.
+            ContiguousRangeMapper zeroPageDeleter([](uintptr_t start, uintptr_t size) {
+                android::base::memoryHint((void*)start, size, MemoryHint::DontNeed);
+            }, kDecommitChunkSize);
 
 #if SNAPSHOT_PROFILE > 1
-            ScopedMemoryProfiler mem("hashing");
+            ScopedMemoryProfiler mem("zeroCheck and hashing");
 #endif
 
-            uint8_t* hashPtr = block.ramBlock.hostPtr;
-            for (int32_t i = 0; i < numPages; ++i,
-                 hashPtr += (uintptr_t)block.ramBlock.pageSize) {
+            // The guest is running during a copy-on-write save, so
+            // its pages can't be freed from under it.
+            const bool deleteZeroPages = !block.pageCopies;
+
+            for (int32_t i = 0; i < numPages; ++i) {
                 auto& page = block.pages[size_t(i)];
-                if (page.sizeOnDisk && !page.hashFilled) {
-                    calcHash(page, block, hashPtr);
+                if (page.same) {
+                    continue;
                 }
-            }
 
+                const auto pagePtr = acquirePage(block, i);
+                bool isZero = isBufferZeroed(pagePtr,
+                                             block.ramBlock.pageSize);
 
-            // Comparison with previous snapshot
-            if (mLoader) {
-                mIncStats.measure(StatTime::Hashing, [&] {
-
-                for (int32_t i = 0; i < numPages; ++i) {
-                    auto& page = block.pages[size_t(i)];
-                    auto loaderPage = page.loaderPage;
-                    if (loaderPage && loaderPage->zeroed() && !page.sizeOnDisk) {
-                        ++stillZero;
-                        page.same = true;
-                        page.sizeOnDisk = 0;
-                    } else if (page.hash == loaderPage->hash) {
-                        ++sameHash;
-                        page.same = true;
-                        page.filePos = loaderPage->filePos;
-                        page.sizeOnDisk = loaderPage->sizeOnDisk;
+                // Don't branch for the isZero decision
+                page.sizeOnDisk = kDefaultPageSize * !isZero;
+                totalZero += isZero;
+
+                // Decommit or free in chunks of 16 mb.
+                if (page.sizeOnDisk == 0) {
+                    if (deleteZeroPages) {
+                        zeroPageDeleter.add((uintptr_t)pagePtr,
+                                            block.ramBlock.pageSize);
                     }
+                } else {
+                    calcHash(page, block, pagePtr);
                 }
+                releasePage(block, i, pagePtr);
+            }
+        }
 
-                // Don't count stillZero pages in the total changed pages set.
-                changedTotal -= stillZero;
+        changedTotal = totalZero;
+    });
 
-                });
-            }
+    // If applicable, compare with previous snapshot, computing all
+    // changed nonzero pages
+    mIncStats.measure(StatTime::Hashing, [&] {
+        // Comparison with previous snapshot
+        if (mLoader) {
+            mIncStats.measure(StatTime::Hashing, [&] {
 
-            // These are the pages that will actually be written to disk;
-            // the nonzero and changed pages.
             for (int32_t i = 0; i < numPages; ++i) {
                 auto& page = block.pages[size_t(i)];
-                if (!page.same && page.sizeOnDisk) {
-                    block.nonzeroChangedPages.push_back(i);
+                auto loaderPage = page.loaderPage;
+                if (loaderPage && loaderPage->zeroed() && !page.sizeOnDisk) {
+                    ++stillZero;
+                    page.same = true;
+                    page.sizeOnDisk = 0;
+                } else if (page.hash == loaderPage->hash) {
+                    ++sameHash;
+                    page.same = true;
+                    page.filePos = loaderPage->filePos;
+                    page.sizeOnDisk = loaderPage->sizeOnDisk;
                 }
             }
 
-            changedTotal += block.nonzeroChangedPages.size();
+            // Don't count stillZero pages in the total changed pages set.
+            changedTotal -= stillZero;
 
-        });
+            });
+        }
 
-        // Pass them to the save handler in chunks of kCompressBufferBatchSize.
-        int32_t start = 0;
-        int32_t end = 0;
-        for (int32_t i = 0; i < block.nonzeroChangedPages.size(); ++i) {
-            if (i == block.nonzeroChangedPages.size() - 1 ||
-                (i - start + 1) == kCompressBufferBatchSize) {
-                end = i + 1;
-                passToSaveHandler({mLastBlockIndex, start, end});
-                start = end;
+        // These are the pages that will actually be written to disk;
+        // the nonzero and changed pages.
+        for (int32_t i = 0; i < numPages; ++i) {
+            auto& page = block.pages[size_t(i)];
+            if (!page.same && page.sizeOnDisk) {
+                block.nonzeroChangedPages.push_back(i);
+            } else if (!page.same && page.loaderPage &&
+                       !page.loaderPage->zeroed() && !deduped()) {
+                // The page got zeroed, its old place is free now.
+                mGaps->add(page.loaderPage->filePos,
+                           page.loaderPage->sizeOnDisk);
             }
         }
 
-        // Record most stats right here.
-        mIncStats.countMultiple(StatAction::SamePage, samePage);
-        mIncStats.countMultiple(StatAction::NotLoadedPage, notLoadedPage);
-        mIncStats.countMultiple(StatAction::ChangedPage, changedTotal);
-        mIncStats.countMultiple(StatAction::StillZeroPage, stillZero);
-        mIncStats.countMultiple(StatAction::NewZeroPage, totalZero - stillZero);
-        mIncStats.countMultiple(StatAction::SameHashPage, sameHash);
-        mIncStats.countMultiple(StatAction::SamePage, sameHash + stillZero);
+        changedTotal += block.nonzeroChangedPages.size();
+
+    });
+
+    // Pass them to the save handler in chunks of kCompressBufferBatchSize.
+    int32_t start = 0;
+    int32_t end = 0;
+    for (int32_t i = 0; i < block.nonzeroChangedPages.size(); ++i) {
+        if (i == block.nonzeroChangedPages.size() - 1 ||
+            (i - start + 1) == kCompressBufferBatchSize) {
+            end = i + 1;
+            passToSaveHandler({blockIndex, start, end});
+            start = end;
+        }
     }
-}
 
-void RamSaver::complete() {
-    mWorkers->done();
+    // Record most stats right here.
+    mIncStats.countMultiple(StatAction::ChangedPage, changedTotal);
+    mIncStats.countMultiple(StatAction::StillZeroPage, stillZero);
+    mIncStats.countMultiple(StatAction::NewZeroPage, totalZero - stillZero);
+    mIncStats.countMultiple(StatAction::SameHashPage, sameHash);
+    mIncStats.countMultiple(StatAction::SamePage, sameHash + stillZero);
 }
 
 static constexpr int kStopMarkerIndex = -1;
 
+void RamSaver::complete() {
+    if (mProtectedBlocks.empty()) {
+        join();
+        return;
+    }
+    if (!mCopyOnWriteSaver) {
+        mCopyOnWriteSaver.emplace([this] { saveProtectedBlocks(); });
+        mCopyOnWriteSaver->start();
+    }
+}
+
 void RamSaver::join() {
     if (mJoined) {
         return;
     }
-    passToSaveHandler({kStopMarkerIndex, 0});
+    if (mProtectedBlocks.empty()) {
+        passToSaveHandler({kStopMarkerIndex, 0});
+    } else {
+        complete();
+        mCopyOnWriteSaver->wait();
+    }
     mJoined = true;
 }
 
+bool RamSaver::protectBlock(int blockIndex) {
+    if (!mWriteWatch) {
+        mWriteWatch.emplace([this](void* ptr) { copyPageBeforeWrite(ptr); });
+    }
+    if (!mWriteWatch->valid()) {
+        return false;
+    }
+
+    // The page fault thread may need these as soon as the block is
+    // protected.
+    auto& block = mIndex.blocks[size_t(blockIndex)];
+    const auto numPages = block.pages.size();
+    block.pageCopies.reset(new std::atomic<uint8_t*>[numPages]());
+    block.pageReaders.reset(new std::atomic<uint8_t>[numPages]());
+
+    // This fails e.g. for the blocks that are still being loaded on demand.
+    if (!mWriteWatch->protectRange(block.ramBlock.hostPtr,
+                                   size_t(block.ramBlock.totalSize))) {
+        VERBOSE_PRINT(snapshot,
+                      "Can't write-protect RAM block '%s', saving it with "
+                      "the VM stopped",
+                      block.ramBlock.id);
+        block.pageCopies.reset();
+        block.pageReaders.reset();
+        return false;
+    }
+    mProtectedBlocks.push_back(blockIndex);
+    return true;
+}
+
+void RamSaver::saveProtectedBlocks() {
+    for (int blockIndex : mProtectedBlocks) {
+        if (mCanceled.load(std::memory_order_acquire)) {
+            break;
+        }
+        saveBlock(blockIndex);
+    }
+    passToSaveHandler({kStopMarkerIndex, 0});
+
+    // Everything is on disk now, let the guest write wherever it wants.
+    mWriteWatch.clear();
+    for (int blockIndex : mProtectedBlocks) {
+        auto& block = mIndex.blocks[size_t(blockIndex)];
+        for (size_t i = 0; i < block.pages.size(); ++i) {
+            if (auto copy = block.pageCopies[i].load(std::memory_order_relaxed)) {
+                aligned_buf_free(copy);
+            }
+        }
+        block.pageCopies.reset();
+        block.pageReaders.reset();
+    }
+    VERBOSE_PRINT(snapshot, "Copied %lld RAM pages written during the save",
+                  (long long)mCopiedPages.load(std::memory_order_relaxed));
+}
+
+void RamSaver::copyPageBeforeWrite(void* ptr) {
+    const auto pagePtr = static_cast<uint8_t*>(ptr);
+    for (auto& block : mIndex.blocks) {
+        const auto start = block.ramBlock.hostPtr;
+        if (!block.pageCopies || pagePtr < start ||
+            pagePtr >= start + block.ramBlock.totalSize) {
+            continue;
+        }
+        const auto pageIndex = (pagePtr - start) / block.ramBlock.pageSize;
+        auto copy = static_cast<uint8_t*>(aligned_buf_alloc(
+                kDefaultPageSize, size_t(block.ramBlock.pageSize)));
+        memcpy(copy, start + pageIndex * block.ramBlock.pageSize,
+               size_t(block.ramBlock.pageSize));
+        block.pageCopies[pageIndex].store(copy, std::memory_order_seq_cst);
+        mCopiedPages.fetch_add(1, std::memory_order_relaxed);
+
+        // Whoever started reading the page before the copy was there has
+        // to be done with it before the guest changes it.
+        while (block.pageReaders[pageIndex].load(std::memory_order_seq_cst)) {
+            base::Thread::yield();
+        }
+        return;
+    }
+}
+
+const uint8_t* RamSaver::acquirePage(FileIndex::Block& block,
+                                     int32_t pageIndex) {
+    const uint8_t* ptr =
+            block.ramBlock.hostPtr + int64_t(pageIndex) * block.ramBlock.pageSize;
+    if (!block.pageCopies) {
+        return ptr;
+    }
+    // Pairs with copyPageBeforeWrite(): either it sees this reader, or the
+    // reader sees its copy.
+    block.pageReaders[pageIndex].fetch_add(1, std::memory_order_seq_cst);
+    if (auto copy = block.pageCopies[pageIndex].load(std::memory_order_seq_cst)) {
+        block.pageReaders[pageIndex].fetch_sub(1, std::memory_order_release);
+        return copy;
+    }
+    return ptr;
+}
+
+uint8_t* RamSaver::uncompressedWritePtr(FileIndex::Block& block,
+                                        int32_t pageIndex) {
+    // The guest may write to the page before it gets to the writer, so a
+    // copy-on-write save leaves the pointer null until then.
+    return block.pageCopies ? nullptr
+                            : block.ramBlock.hostPtr +
+                                      int64_t(pageIndex) *
+                                              block.ramBlock.pageSize;
+}
+
+void RamSaver::releasePage(FileIndex::Block& block,
+                           int32_t pageIndex,
+                           const uint8_t* ptr) {
+    if (block.pageCopies &&
+        ptr == block.ramBlock.hostPtr +
+                        int64_t(pageIndex) * block.ramBlock.pageSize) {
+        block.pageReaders[pageIndex].fetch_sub(1, std::memory_order_release);
+    }
+}
+
 void RamSaver::cancel() {
     mCanceled.store(true, std::memory_order_release);
     join();
@@ -443,6 +688,45 @@ void RamSaver::calcHash(FileIndex::Block::Page& page,
     page.hashFilled = true;
 }
 
+void RamSaver::trainDictionary() {
+    mIncStats.measure(StatTime::Compressing, [&] {
+        // All blocks are registered by now: sample their nonzero pages
+        // evenly, so the dictionary isn't biased towards the first one.
+        int64_t totalPages = 0;
+        for (const auto& block : mIndex.blocks) {
+            if (!block.ramBlock.readonly &&
+                !(block.ramBlock.flags & SNAPSHOT_RAM_USER_BACKED)) {
+                totalPages += block.ramBlock.totalSize / kDefaultPageSize;
+            }
+        }
+        const int64_t step =
+                std::max<int64_t>(1, totalPages / kDictionarySamplePages);
+
+        std::vector<const uint8_t*> samples;
+        samples.reserve(kDictionarySamplePages);
+        for (const auto& block : mIndex.blocks) {
+            if (block.ramBlock.readonly ||
+                (block.ramBlock.flags & SNAPSHOT_RAM_USER_BACKED)) {
+                continue;
+            }
+            for (int64_t offset = 0; offset < block.ramBlock.totalSize;
+                 offset += step * kDefaultPageSize) {
+                const auto ptr = block.ramBlock.hostPtr + offset;
+                if (!isBufferZeroed(ptr, kDefaultPageSize)) {
+                    samples.push_back(ptr);
+                }
+            }
+        }
+        mCodec = Codec::trainDictionary(samples, kDefaultPageSize);
+    });
+    if (!mCodec) {
+        VERBOSE_PRINT(snapshot,
+                      "Couldn't train a RAM dictionary, using plain zstd");
+        mCodec = Codec::get(CodecType::Zstd);
+    }
+    mCodecType = mCodec->type();
+}
+
 void RamSaver::passToSaveHandler(QueuedPageInfo&& pi) {
     if (pi.blockIndex != kStopMarkerIndex &&
         !mCanceled.load(std::memory_order_acquire)) {
@@ -456,8 +740,12 @@ void RamSaver::passToSaveHandler(QueuedPageInfo&& pi) {
         if (mWriter) {
             mWriter->enqueue({-1});
             mWriter.clear();
-            mIndex.startPosInFile = mCurrentStreamPos;
-            writeIndex();
+            // A failed compaction may have moved part of the pages, so
+            // neither the old nor the new positions can be trusted.
+            if (compact()) {
+                mIndex.startPosInFile = mCurrentStreamPos;
+                writeIndex();
+            }
         }
 
         mEndTime = System::get()->getHighResTimeUs();
@@ -495,23 +783,23 @@ bool RamSaver::handlePageSave(QueuedPageInfo&& pi) {
 
                 int32_t pageIndex = block.nonzeroChangedPages[size_t(nzcIndex)];
                 auto& page = block.pages[size_t(pageIndex)];
-                auto ptr = block.ramBlock.hostPtr +
-                    int64_t(pageIndex) * block.ramBlock.pageSize;
+                auto ptr = acquirePage(block, pageIndex);
 
-                auto compressedSize =
-                    compress::compress(
-                            ptr, block.ramBlock.pageSize,
-                            compressBufferData + compressBufferOffset,
-                            compress::maxCompressedSize(kDefaultPageSize));
+                auto compressedSize = mCodec->compress(
+                        ptr, block.ramBlock.pageSize,
+                        compressBufferData + compressBufferOffset,
+                        mCodec->maxCompressedSize(block.ramBlock.pageSize));
+                releasePage(block, pageIndex, ptr);
 
                 assert(compressedSize > 0);
 
                 // Invariant: The page is compressed iff
                 // its sizeOnDisk is strictly less than the page size.
-                if (compressedSize >= block.ramBlock.pageSize) {
+                if (compressedSize <= 0 ||
+                    compressedSize >= block.ramBlock.pageSize) {
                     // Screw this, the page is better off uncompressed.
                     page.sizeOnDisk = block.ramBlock.pageSize;
-                    page.writePtr = ptr;
+                    page.writePtr = uncompressedWritePtr(block, pageIndex);
                 } else {
                     page.sizeOnDisk = compressedSize;
                     page.writePtr = compressBufferData + compressBufferOffset;
@@ -524,10 +812,8 @@ bool RamSaver::handlePageSave(QueuedPageInfo&& pi) {
         for (int32_t nzcIndex = pi.nonzeroChangedIndexStart; nzcIndex < pi.nonzeroChangedIndexEnd; ++nzcIndex) {
             int32_t pageIndex = block.nonzeroChangedPages[size_t(nzcIndex)];
             auto& page = block.pages[size_t(pageIndex)];
-            auto ptr = block.ramBlock.hostPtr +
-                int64_t(pageIndex) * block.ramBlock.pageSize;
             page.sizeOnDisk = block.ramBlock.pageSize;
-            page.writePtr = ptr;
+            page.writePtr = uncompressedWritePtr(block, pageIndex);
         }
     }
 
@@ -536,14 +822,111 @@ bool RamSaver::handlePageSave(QueuedPageInfo&& pi) {
     return true;
 }
 
+bool RamSaver::compact() {
+    if (!incremental() || !nonzero(mFlags & Flags::Compact) ||
+        mCanceled.load(std::memory_order_acquire) || mHasError) {
+        return true;
+    }
+
+    const auto start = mSystem->getHighResTimeUs();
+    std::vector<FileIndex::Block::Page*> pages;
+    pages.reserve(size_t(mIndex.totalPages));
+    int64_t usedSpace = 0;
+    for (FileIndex::Block& b : mIndex.blocks) {
+        // Same as in writeIndex(): these blocks have no pages in the file.
+        if (b.ramBlock.readonly ||
+            (b.ramBlock.flags & SNAPSHOT_RAM_USER_BACKED) ||
+            ((b.ramBlock.flags & SNAPSHOT_RAM_MAPPED_SHARED) &&
+             nonzero(mFlags & Flags::Async))) {
+            continue;
+        }
+        for (FileIndex::Block::Page& page : b.pages) {
+            if (!page.zeroed()) {
+                pages.push_back(&page);
+                usedSpace += page.sizeOnDisk;
+            }
+        }
+    }
+    // Don't trust the gap tracker here: older saves didn't track the places
+    // of the pages that got zeroed.
+    const auto wastedSpace = mCurrentStreamPos - 8 - usedSpace;
+    if (wastedSpace <= (mCurrentStreamPos - 8) * kCompactionWastedSpaceRatio) {
+        return true;
+    }
+
+    std::sort(pages.begin(), pages.end(),
+              [](const FileIndex::Block::Page* l,
+                 const FileIndex::Block::Page* r) {
+                  return l->filePos < r->filePos;
+              });
+
+    // Go from the start of the file, moving each run of adjacent pages down
+    // to the end of the previous one. Runs only ever move to lower offsets,
+    // so copying them front to back never overwrites anything unread.
+    std::vector<char> buffer(kCompactionBufferSize);
+    int64_t movedBytes = 0;
+    int64_t pos = 8;
+    for (size_t i = 0; i < pages.size();) {
+        const size_t runFirst = i;
+        const int64_t runStart = pages[i]->filePos;
+        int64_t runEnd = runStart;
+        for (; i < pages.size() && pages[i]->filePos == runEnd; ++i) {
+            runEnd += pages[i]->sizeOnDisk;
+        }
+        assert(runStart >= pos);
+        for (int64_t offset = 0;
+             runStart != pos && offset < runEnd - runStart;
+             offset += kCompactionBufferSize) {
+            const auto size = size_t(std::min(kCompactionBufferSize,
+                                              runEnd - runStart - offset));
+            if (base::pread(mStreamFd, buffer.data(), size,
+                            runStart + offset) != ssize_t(size) ||
+                base::pwrite(mStreamFd, buffer.data(), size, pos + offset) !=
+                        ssize_t(size)) {
+                derror("Failed to compact snapshot RAM");
+                mHasError = true;
+                return false;
+            }
+            movedBytes += size;
+        }
+        for (size_t j = runFirst; j < i; ++j) {
+            pages[j]->filePos = pos + (pages[j]->filePos - runStart);
+        }
+        pos += runEnd - runStart;
+    }
+
+    VERBOSE_PRINT(snapshot,
+                  "Compacted snapshot RAM: %lld wasted bytes freed, "
+                  "%lld bytes moved in %.03f ms",
+                  (long long)wastedSpace, (long long)movedBytes,
+                  (mSystem->getHighResTimeUs() - start) / 1000.0);
+    mCurrentStreamPos = pos;
+    mGaps.reset(new NullGapTracker());
+    return true;
+}
+
 void RamSaver::writeIndex() {
     auto start = mIndex.startPosInFile;
 
     MemStream stream(512 + 16 * mIndex.totalPages);
     bool compressed = (mIndex.flags & int(IndexFlags::CompressedPages)) != 0;
+    // Pages in the store may come from snapshots with other compression
+    // settings, so their exact sizes always go into the index.
+    const bool exactSizes = compressed || deduped();
+    // Only compressed or stored pages depend on the codec, keep the older
+    // format for the rest.
+    const auto codec = (compressed || deduped()) && mCodec ? mCodec->type()
+                                                            : CodecType::Lz4;
+    mIndex.flags = (mIndex.flags & ~int32_t(IndexFlags::CodecMask)) |
+                   codecToIndexFlags(codec);
     stream.putBe32(uint32_t(mIndex.version));
     stream.putBe32(uint32_t(mIndex.flags));
     stream.putBe32(uint32_t(mIndex.totalPages));
+    if (codec == CodecType::ZstdDict) {
+        const auto& dictionary = mCodec->dictionary();
+        stream.putBe32(uint32_t(dictionary.size()));
+        stream.write(dictionary.data(), dictionary.size());
+    }
     int64_t prevFilePos = 8;
     int32_t prevPageSizeOnDisk = 0;
 
@@ -578,12 +961,12 @@ void RamSaver::writeIndex() {
 
             for (const FileIndex::Block::Page& page : b.pages) {
                 stream.putPackedNum(uint64_t(
-                        compressed ? page.sizeOnDisk
+                        exactSizes ? page.sizeOnDisk
                                    : (page.sizeOnDisk / b.ramBlock.pageSize)));
 
                 if (!page.zeroed()) {
                     auto deltaPos = page.filePos - prevFilePos;
-                    if (compressed) {
+                    if (exactSizes) {
                         deltaPos -= prevPageSizeOnDisk;
                     } else {
                         assert(deltaPos % b.ramBlock.pageSize == 0);
@@ -609,6 +992,9 @@ void RamSaver::writeIndex() {
     mIncStats.measure(StatTime::GapTrackingWriter, [&] {
         incremental() ? mGaps->save(stream) : OneSizeGapTracker().save(stream);
     });
+    if (incremental()) {
+        mGaps->setHolePunchFd(-1);
+    }
 
     auto end = mIncStats.measure(StatTime::DiskIndexWrite, [&] {
         auto end = mIndex.startPosInFile + stream.writtenSize();
@@ -619,11 +1005,18 @@ void RamSaver::writeIndex() {
         setFileSize(mStreamFd, int64_t(mDiskSize));
         HANDLE_EINTR(fseeko64(mStream.get(), 0, SEEK_SET));
         mStream.putBe64(uint64_t(mIndex.startPosInFile));
-        mHasError = ferror(mStream.get()) != 0;
+        mHasError |= ferror(mStream.get()) != 0;
         mStream.close();
         return end;
     });
 
+    if (mPageStore) {
+        updatePageStoreRefs();
+    } else if (!incremental()) {
+        // In case the snapshot we've overwritten used the page store.
+        releasePageStoreRefs(mSnapshotDir);
+    }
+
     auto bytesWasted = incremental() ? mGaps->wastedSpace() : 0;
     mIncStats.print(
             "RAM: index %d, total %lld bytes, wasted %d (compressed: %s)\n",
@@ -737,7 +1130,13 @@ void RamSaver::writePage(WriteInfo&& wi) {
                 contigBytes = sz;
             }
 
-            memcpy(writeCombinePtr, page.writePtr, sz);
+            if (page.writePtr) {
+                memcpy(writeCombinePtr, page.writePtr, sz);
+            } else {
+                const auto ptr = acquirePage(block, pageIndex);
+                memcpy(writeCombinePtr, ptr, sz);
+                releasePage(block, pageIndex, ptr);
+            }
             writeCombinePtr += sz;
         }
 
@@ -757,5 +1156,79 @@ void RamSaver::writePage(WriteInfo&& wi) {
     mIncStats.countMultiple(StatAction::AppendedPos, appendedPos);
 }
 
+void RamSaver::writePageToStore(WriteInfo&& wi) {
+    FileIndex::Block& block = mIndex.blocks[size_t(wi.blockIndex)];
+
+    // Here "reused" pages are the ones some snapshot already had in the
+    // store, and "appended" are the ones written anew.
+    int64_t reusedPos = 0;
+    int64_t appendedPos = 0;
+
+    mIncStats.measure(StatTime::DiskWriteCombine, [&] {
+        for (int32_t nzcIndex = wi.nonzeroChangedIndexStart;
+             nzcIndex < wi.nonzeroChangedIndexEnd; ++nzcIndex) {
+            int32_t pageIndex = block.nonzeroChangedPages[size_t(nzcIndex)];
+            auto& page = block.pages[size_t(pageIndex)];
+            assert(page.hashFilled);
+
+            bool inserted = false;
+            const auto ptr = page.writePtr ? page.writePtr
+                                           : acquirePage(block, pageIndex);
+            const auto entry = mPageStore->put(page.hash, ptr,
+                                               page.sizeOnDisk, &inserted);
+            if (!page.writePtr) {
+                releasePage(block, pageIndex, ptr);
+            }
+            if (!entry) {
+                derror("Failed to write a page to the snapshot page store");
+                mHasError = true;
+                continue;
+            }
+            page.filePos = entry->filePos;
+            page.sizeOnDisk = entry->sizeOnDisk;
+            ++(inserted ? appendedPos : reusedPos);
+        }
+
+        if (wi.toRelease) {
+            mCompressBuffers->release(wi.toRelease);
+        }
+    });
+
+    mIncStats.countMultiple(StatAction::ReusedPos, reusedPos);
+    mIncStats.countMultiple(StatAction::AppendedPos, appendedPos);
+}
+
+void RamSaver::updatePageStoreRefs() {
+    if (mCanceled.load(std::memory_order_acquire)) {
+        // Just drop whatever we've managed to put into the store.
+        mPageStore->flush();
+        return;
+    }
+
+    PageStore::Hashes refs;
+    refs.reserve(size_t(mIndex.totalPages));
+    for (const FileIndex::Block& b : mIndex.blocks) {
+        for (const FileIndex::Block::Page& page : b.pages) {
+            if (!page.zeroed() && page.hashFilled) {
+                refs.push_back(page.hash);
+            }
+        }
+    }
+    std::sort(refs.begin(), refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+
+    // Add the new references before releasing the old ones, so pages shared
+    // by both versions of the snapshot never drop to zero.
+    const auto refsFileName = PathUtils::join(mSnapshotDir, kRamRefsFileName);
+    PageStore::Hashes oldRefs;
+    PageStore::readRefs(refsFileName, &oldRefs);
+    mPageStore->addRefs(refs);
+    mPageStore->releaseRefs(oldRefs);
+
+    if (!PageStore::writeRefs(refsFileName, refs) || !mPageStore->flush()) {
+        mHasError = true;
+    }
+}
+
 }  // namespace snapshot
 }  // namespace android
@@ -19,11 +19,15 @@
 #include "android/base/synchronization/MessageChannel.h"
 #include "android/base/system/System.h"
 #include "android/base/threads/FunctorThread.h"
-#include "android/base/threads/ThreadPool.h"
+#include "android/base/threads/WorkStealingThreadPool.h"
+#include "android/base/threads/WorkerThread.h"
+#include "android/snapshot/Codec.h"
 #include "android/snapshot/Compressor.h"
 #include "android/snapshot/FastReleasePool.h"
 #include "android/snapshot/GapTracker.h"
 #include "android/snapshot/IncrementalStats.h"
+#include "android/snapshot/MemoryWatch.h"
+#include "android/snapshot/PageStore.h"
 #include "android/snapshot/RamLoader.h"
 #include "android/snapshot/common.h"
 
@@ -47,18 +51,35 @@ public:
     enum class Flags : uint8_t {
         None = 0,
         Async = 0x1,
-        // TODO: add "CopyOnWrite = 0x3  // implies |Async|"
+        // Only write-protect the guest RAM in savePage(), and save it after
+        // the VM resumes, copying out the pages the guest writes to first.
+        CopyOnWrite = 0x2,
         Compress = 0x4,
+        // Write pages into the AVD-wide content-addressed PageStore,
+        // leaving only the index in |fileName|.
+        Dedup = 0x8,
+        // Incremental saves only: once the gaps left in the file by the
+        // previous saves get too big, move the pages down to close them
+        // instead of writing the whole RAM anew.
+        Compact = 0x10,
     };
 
+    // |codec| is used for |Flags::Compress|; incremental saves keep the
+    // loaded snapshot's one, and deduplicating saves the page store's one.
+    // |pageStore| overrides the AVD's PageStore::get() for |Flags::Dedup|.
     RamSaver(const std::string& fileName,
              Flags preferredFlags,
              RamLoader* loader,
-             bool isOnExit);
+             bool isOnExit,
+             CodecType codec = CodecType::Lz4,
+             PageStore* pageStore = nullptr);
     ~RamSaver();
 
     void registerBlock(const RamBlock& block);
     void savePage(int64_t blockOffset, int64_t pageOffset, int32_t pageSize);
+    // Called once all pages have been passed to savePage(): it's the same
+    // as join(), unless it's a copy-on-write save, which then goes on in the
+    // background until join().
     void complete();
     void join();
     void cancel();
@@ -66,8 +87,15 @@ public:
     bool compressed() const {
         return mIndex.flags & int32_t(IndexFlags::CompressedPages);
     }
+    bool deduped() const {
+        return mIndex.flags & int32_t(IndexFlags::PageStore);
+    }
+    CodecType codec() const {
+        return mCodec ? mCodec->type() : mCodecType;
+    }
     uint64_t diskSize() const { return mDiskSize; }
     bool incremental() const { return mLoader != nullptr; }
+    bool savingInBackground() const { return bool(mCopyOnWriteSaver); }
 
     // getDuration():
     // Returns true if there was save with measurable time
@@ -118,6 +146,12 @@ private:
             };
             std::vector<Page> pages;
             std::vector<int32_t> nonzeroChangedPages;
+
+            // Copy-on-write saves only: the pages the guest wrote to after
+            // savePage() protected them, as they were before the write, and
+            // the number of threads reading each page from the guest RAM.
+            std::unique_ptr<std::atomic<uint8_t*>[]> pageCopies;
+            std::unique_ptr<std::atomic<uint8_t>[]> pageReaders;
         };
 
         using Flags = IndexFlags;
@@ -147,10 +181,26 @@ private:
                   const FileIndex::Block& block,
                   const void* ptr);
 
+    void trainDictionary();
+    void saveBlock(int blockIndex);
+    bool protectBlock(int blockIndex);
+    void saveProtectedBlocks();
+    void copyPageBeforeWrite(void* ptr);
+    // Returns the page to save: the guest RAM, or the page's copy if the
+    // guest has written to it. Guest RAM stays unchanged until releasePage().
+    const uint8_t* acquirePage(FileIndex::Block& block, int32_t pageIndex);
+    void releasePage(FileIndex::Block& block,
+                     int32_t pageIndex,
+                     const uint8_t* ptr);
+    uint8_t* uncompressedWritePtr(FileIndex::Block& block, int32_t pageIndex);
     void passToSaveHandler(QueuedPageInfo&& pi);
     bool handlePageSave(QueuedPageInfo&& pi);
+    // Returns false if the pages couldn't all be moved.
+    bool compact();
     void writeIndex();
     void writePage(WriteInfo&& wi);
+    void writePageToStore(WriteInfo&& wi);
+    void updatePageStoreRefs();
 
     RamLoader* mLoader = nullptr;
     base::StdioStream mStream;
@@ -164,11 +214,19 @@ private:
 
     std::atomic<bool> mCanceled{false};
     std::atomic<bool> mStopping{false};
-    base::Optional<base::ThreadPool<QueuedPageInfo>> mWorkers;
+    base::Optional<base::WorkStealingThreadPool<QueuedPageInfo>> mWorkers;
     base::Optional<base::WorkerThread<WriteInfo>> mWriter;
 
     GapTracker::Ptr mGaps;
 
+    PageStore* mPageStore = nullptr;
+    std::string mSnapshotDir;
+
+    // |mCodec| stays null for CodecType::ZstdDict until the dictionary is
+    // trained on the first savePage() call.
+    CodecType mCodecType = CodecType::Lz4;
+    Codec::Ptr mCodec;
+
     FileIndex mIndex;
     uint64_t mDiskSize = 0;
 
@@ -177,6 +235,11 @@ private:
             mCompressBuffers;
     std::vector<char> mWriteCombineBuffer;
 
+    std::vector<int> mProtectedBlocks;
+    base::Optional<MemoryWriteWatch> mWriteWatch;
+    base::Optional<base::FunctorThread> mCopyOnWriteSaver;
+    std::atomic<int64_t> mCopiedPages{0};
+
     base::System* mSystem = base::System::get();
 
     base::System::Duration mStartTime = base::System::get()->getHighResTimeUs();
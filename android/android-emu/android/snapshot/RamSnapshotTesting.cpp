@@ -61,8 +61,10 @@ RamBlock makeRam(android::base::StringView name,
 
 void saveRamSingleBlock(const RamSaver::Flags flags,
                         const RamBlock& block,
-                        android::base::StringView filename) {
-    RamSaver s(filename, flags, nullptr, true);
+                        android::base::StringView filename,
+                        PageStore* pageStore,
+                        CodecType codec) {
+    RamSaver s(filename, flags, nullptr, true, codec, pageStore);
 
     s.registerBlock(block);
 
@@ -71,8 +73,23 @@ void saveRamSingleBlock(const RamSaver::Flags flags,
     s.join();
 }
 
+void copyOnWriteSaveSingleBlock(const RamBlock& block,
+                                android::base::StringView filename,
+                                std::function<void()> writeRam) {
+    RamSaver s(filename, RamSaver::Flags::CopyOnWrite, nullptr, false);
+
+    s.registerBlock(block);
+
+    mockQemuPageSave(s, block);
+
+    s.complete();
+    writeRam();
+    s.join();
+}
+
 void loadRamSingleBlock(const RamBlock& block,
-                        android::base::StringView filename) {
+                        android::base::StringView filename,
+                        PageStore* pageStore) {
     auto ram = android_fopen(c_str(filename), "rb");
 
     RamLoader::RamBlockStructure emptyRamBlockStructure = {};
@@ -81,6 +98,7 @@ void loadRamSingleBlock(const RamBlock& block,
     RamLoader ramLoader(StdioStream(ram, StdioStream::kOwner),
                         RamLoader::Flags::None, emptyRamBlockStructure);
 
+    ramLoader.setPageStore(pageStore);
     ramLoader.registerBlock(block);
 
     ramLoader.start(false);
@@ -90,7 +108,8 @@ void loadRamSingleBlock(const RamBlock& block,
 void incrementalSaveSingleBlock(const RamSaver::Flags flags,
                                 const RamBlock& blockToLoad,
                                 const RamBlock& blockToSave,
-                                android::base::StringView filename) {
+                                android::base::StringView filename,
+                                PageStore* pageStore) {
     auto ram = android_fopen(c_str(filename), "rb");
 
     RamLoader::RamBlockStructure emptyRamBlockStructure = {};
@@ -99,11 +118,12 @@ void incrementalSaveSingleBlock(const RamSaver::Flags flags,
     RamLoader ramLoader(StdioStream(ram, StdioStream::kOwner),
                         RamLoader::Flags::None, emptyRamBlockStructure);
 
+    ramLoader.setPageStore(pageStore);
     ramLoader.registerBlock(blockToLoad);
 
     ramLoader.start(false);
 
-    RamSaver s(filename, flags, &ramLoader, true);
+    RamSaver s(filename, flags, &ramLoader, true, CodecType::Lz4, pageStore);
 
     s.registerBlock(blockToSave);
 
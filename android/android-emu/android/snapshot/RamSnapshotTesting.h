@@ -16,6 +16,7 @@
 #include "android/snapshot/RamLoader.h"
 #include "android/snapshot/RamSaver.h"
 
+#include <functional>
 #include <vector>
 
 namespace android {
@@ -29,17 +30,29 @@ RamBlock makeRam(android::base::StringView name,
                  uint8_t* hostPtr,
                  int64_t size);
 
+// |pageStore| is only used for snapshots saved with RamSaver::Flags::Dedup,
+// |codec| for ones saved with RamSaver::Flags::Compress.
 void saveRamSingleBlock(const RamSaver::Flags flags,
                         const RamBlock& block,
-                        android::base::StringView filename);
+                        android::base::StringView filename,
+                        PageStore* pageStore = nullptr,
+                        CodecType codec = CodecType::Lz4);
+
+// Saves |block| with RamSaver::Flags::CopyOnWrite, calling |writeRam| after
+// all of its pages went through savePage(), like a resumed guest would.
+void copyOnWriteSaveSingleBlock(const RamBlock& block,
+                                android::base::StringView filename,
+                                std::function<void()> writeRam);
 
 void loadRamSingleBlock(const RamBlock& block,
-                        android::base::StringView filename);
+                        android::base::StringView filename,
+                        PageStore* pageStore = nullptr);
 
 void incrementalSaveSingleBlock(const RamSaver::Flags flags,
                                 const RamBlock& blockToLoad,
                                 const RamBlock& blockToSave,
-                                android::base::StringView filename);
+                                android::base::StringView filename,
+                                PageStore* pageStore = nullptr);
 
 TestRamBuffer generateRandomRam(size_t numPages, float zeroPageChance, int seed = 0);
 
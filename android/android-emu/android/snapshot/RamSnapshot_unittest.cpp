@@ -13,12 +13,14 @@
 #include "android/base/StringView.h"
 #include "android/base/misc/FileUtils.h"
 #include "android/base/testing/TestTempDir.h"
+#include "android/snapshot/PageStore.h"
 #include "android/snapshot/RamSnapshotTesting.h"
 
 #include <gtest/gtest.h>
 
 #include <memory>
 #include <random>
+#include <stdio.h>
 #include <vector>
 
 using android::AlignedBuf;
@@ -181,5 +183,279 @@ TEST_F(RamSnapshotTest, IncrementalSaveRandomMultiStep) {
     }
 }
 
+TEST_F(RamSnapshotTest, CompactingIncrementalSaveRandomMultiStep) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+    std::string compactedRamPath = mTempDir->makeSubPath("compacted_ram.bin");
+
+    const int numPages = 100;
+    const int steps = 5;
+    const float noChangeChance = 0.5;
+    // Zero out more pages than there are new ones, for their places to stay
+    // unused.
+    const float zeroPageChance = 0.1;
+    const float mutateZeroPageChance = 0.8;
+
+    auto ramToLoad = generateRandomRam(numPages, zeroPageChance);
+    auto ramToSave = ramToLoad;
+    const RamBlock blockToLoad = makeRam("testRam", ramToLoad.data(),
+                                         (int64_t)ramToLoad.size());
+    const RamBlock blockToSave = makeRam("testRam", ramToSave.data(),
+                                         (int64_t)ramToSave.size());
+
+    saveRamSingleBlock(RamSaver::Flags::Compress, blockToSave, ramPath);
+    saveRamSingleBlock(RamSaver::Flags::Compress, blockToSave,
+                       compactedRamPath);
+
+    bool compactedSmaller = false;
+    for (int i = 0; i < steps; i++) {
+        randomMutateRam(ramToSave, noChangeChance, mutateZeroPageChance, i);
+
+        incrementalSaveSingleBlock(RamSaver::Flags::Compress, blockToLoad,
+                                   blockToSave, ramPath);
+        incrementalSaveSingleBlock(
+                RamSaver::Flags::Compress | RamSaver::Flags::Compact,
+                blockToLoad, blockToSave, compactedRamPath);
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+        loadRamSingleBlock(makeRam("testRam", testRamOut.data(),
+                                   (int64_t)testRamOut.size()),
+                           compactedRamPath);
+        EXPECT_EQ(ramToSave, testRamOut);
+
+        const auto size = System::get()->pathFileSize(ramPath);
+        const auto compactedSize =
+                System::get()->pathFileSize(compactedRamPath);
+        ASSERT_TRUE(size && compactedSize);
+        // Equal after the incremental save gives up and writes it all anew.
+        EXPECT_LE(*compactedSize, *size);
+        compactedSmaller |= *compactedSize < *size;
+    }
+    EXPECT_TRUE(compactedSmaller);
+}
+
+TEST_F(RamSnapshotTest, CodecsRandom) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+
+    const int numPages = 1000;
+    const float zeroPageChance = 0.5;
+
+    for (auto codec : {CodecType::Lz4, CodecType::Lz4Hc, CodecType::Zstd,
+                       CodecType::ZstdDict}) {
+        auto testRam = generateRandomRam(numPages, zeroPageChance, int(codec));
+
+        auto blockForTest =
+            makeRam("testRam", testRam.data(), (int64_t)testRam.size());
+
+        saveRamSingleBlock(RamSaver::Flags::Compress, blockForTest, ramPath,
+                           nullptr, codec);
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+
+        auto blockForTestOutput =
+            makeRam("testRam", testRamOut.data(), (int64_t)testRamOut.size());
+
+        loadRamSingleBlock(blockForTestOutput, ramPath);
+
+        EXPECT_EQ(testRam, testRamOut) << Codec::toString(codec);
+    }
+}
+
+TEST_F(RamSnapshotTest, IncrementalSaveRandomZstdDict) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+
+    const int numPages = 1000;
+    const int steps = 3;
+    const float noChangeChance = 0.75;
+    const float zeroPageChance = 0.5;
+
+    auto ramToLoad = generateRandomRam(numPages, zeroPageChance);
+    auto ramToSave = ramToLoad;
+
+    saveRamSingleBlock(RamSaver::Flags::Compress,
+                       makeRam("testRam", ramToLoad.data(),
+                               (int64_t)ramToLoad.size()),
+                       ramPath, nullptr, CodecType::ZstdDict);
+
+    // Incremental saves keep the dictionary from the first one.
+    for (int j = 0; j < steps; j++) {
+        randomMutateRam(ramToSave, noChangeChance, zeroPageChance, j);
+
+        incrementalSaveSingleBlock(
+                RamSaver::Flags::Compress,
+                makeRam("testRam", ramToLoad.data(), (int64_t)ramToLoad.size()),
+                makeRam("testRam", ramToSave.data(), (int64_t)ramToSave.size()),
+                ramPath);
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+        auto blockForTestOutput =
+            makeRam("testRam", testRamOut.data(), (int64_t)testRamOut.size());
+
+        loadRamSingleBlock(blockForTestOutput, ramPath);
+
+        EXPECT_EQ(ramToSave, testRamOut);
+
+        ramToLoad = ramToSave;
+    }
+}
+
+TEST_F(RamSnapshotTest, DedupAcrossSnapshots) {
+    PageStore store(mTempDir->makeSubPath("pagestore.bin"));
+    ASSERT_TRUE(store.valid());
+
+    const int numPages = 100;
+    const float zeroPageChance = 0.25;
+    const auto flags = RamSaver::Flags::Compress | RamSaver::Flags::Dedup;
+
+    // generateRandomRam() fills each page with one of 256 byte patterns, so
+    // no matter how many snapshots we take there are at most 256 unique
+    // nonzero pages to store.
+    for (int i = 0; i < 4; i++) {
+        const std::string dir = "snap" + std::to_string(i);
+        ASSERT_TRUE(mTempDir->makeSubDir(dir.c_str()));
+        const auto ramPath =
+                PathUtils::join(mTempDir->makeSubPath(dir.c_str()), "ram.bin");
+
+        auto testRam = generateRandomRam(numPages, zeroPageChance, i);
+        saveRamSingleBlock(
+                flags,
+                makeRam("testRam", testRam.data(), (int64_t)testRam.size()),
+                ramPath, &store);
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+        loadRamSingleBlock(makeRam("testRam", testRamOut.data(),
+                                   (int64_t)testRamOut.size()),
+                           ramPath, &store);
+        EXPECT_EQ(testRam, testRamOut);
+        // Can't be exported, the pages aren't in its directory.
+        EXPECT_TRUE(usesPageStore(mTempDir->makeSubPath(dir.c_str())));
+    }
+
+    EXPECT_FALSE(usesPageStore(mTempDir->path()));
+    EXPECT_GT(store.entryCount(), 0);
+    EXPECT_LE(store.entryCount(), 256);
+}
+
+// A store that can't be read may still have the pages of other snapshots,
+// so it's left alone rather than recreated.
+TEST_F(RamSnapshotTest, UnreadablePageStoreIsKept) {
+    const auto path = mTempDir->makeSubPath("pagestore.bin");
+    const std::string contents(100, '\xff');
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_TRUE(file);
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+
+    PageStore store(path);
+    EXPECT_FALSE(store.valid());
+    EXPECT_EQ(contents.size(), *System::get()->pathFileSize(path));
+}
+
+// The index on disk still has the pages released since the last flush(),
+// so their space is only reused after the next one.
+TEST_F(RamSnapshotTest, PageStoreReusesReleasedPagesAfterFlush) {
+    PageStore store(mTempDir->makeSubPath("pagestore.bin"));
+    ASSERT_TRUE(store.valid());
+    auto hash = [](char c) {
+        PageStore::Hash hash;
+        hash.fill(c);
+        return hash;
+    };
+    const std::vector<uint8_t> page(100, 'p');
+
+    const auto first = store.put(hash('a'), page.data(), int32_t(page.size()));
+    ASSERT_TRUE(first);
+    store.addRefs({hash('a')});
+    ASSERT_TRUE(store.flush());
+    store.releaseRefs({hash('a')});
+
+    const auto second = store.put(hash('b'), page.data(), int32_t(page.size()));
+    ASSERT_TRUE(second);
+    EXPECT_NE(first->filePos, second->filePos);
+    store.addRefs({hash('b')});
+    ASSERT_TRUE(store.flush());
+
+    const auto third = store.put(hash('c'), page.data(), int32_t(page.size()));
+    ASSERT_TRUE(third);
+    EXPECT_EQ(first->filePos, third->filePos);
+}
+
+TEST_F(RamSnapshotTest, DedupIncrementalSaveRandomMultiStep) {
+    PageStore store(mTempDir->makeSubPath("pagestore.bin"));
+    ASSERT_TRUE(store.valid());
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+    std::string refsPath = mTempDir->makeSubPath(kRamRefsFileName);
+
+    const int numPages = 50;
+    const int steps = 5;
+    const float noChangeChance = 0.75;
+    const float zeroPageChance = 0.5;
+    const auto flags = RamSaver::Flags::Dedup;
+
+    auto ramToLoad = generateRandomRam(numPages, zeroPageChance);
+    auto ramToSave = ramToLoad;
+
+    saveRamSingleBlock(
+            flags,
+            makeRam("testRam", ramToLoad.data(), (int64_t)ramToLoad.size()),
+            ramPath, &store);
+
+    for (int j = 0; j < steps; j++) {
+        randomMutateRam(ramToSave, noChangeChance, zeroPageChance, j);
+
+        incrementalSaveSingleBlock(
+                flags,
+                makeRam("testRam", ramToLoad.data(),
+                        (int64_t)ramToLoad.size()),
+                makeRam("testRam", ramToSave.data(),
+                        (int64_t)ramToSave.size()),
+                ramPath, &store);
+
+        TestRamBuffer testRamOut(numPages * kTestingPageSize);
+        loadRamSingleBlock(makeRam("testRam", testRamOut.data(),
+                                   (int64_t)testRamOut.size()),
+                           ramPath, &store);
+        EXPECT_EQ(ramToSave, testRamOut);
+
+        // Only the pages of the latest version stay referenced.
+        PageStore::Hashes refs;
+        EXPECT_TRUE(PageStore::readRefs(refsPath, &refs));
+        EXPECT_EQ(int64_t(refs.size()), store.entryCount());
+    }
+
+    // Deleting the snapshot empties the store.
+    PageStore::Hashes refs;
+    EXPECT_TRUE(PageStore::readRefs(refsPath, &refs));
+    store.releaseRefs(refs);
+    EXPECT_TRUE(store.flush());
+    EXPECT_EQ(0, store.entryCount());
+}
+
+TEST_F(RamSnapshotTest, CopyOnWriteRandom) {
+    std::string ramPath = mTempDir->makeSubPath("ram.bin");
+
+    const int numPages = 1000;
+    const float noChangeChance = 0.5;
+    const float zeroPageChance = 0.5;
+
+    // Hosts that can't write-protect RAM save it before |writeRam| runs, so
+    // the result has to be the same either way.
+    auto testRam = generateRandomRam(numPages, zeroPageChance);
+    const auto ramBeforeWrites = testRam;
+
+    copyOnWriteSaveSingleBlock(
+            makeRam("testRam", testRam.data(), (int64_t)testRam.size()),
+            ramPath,
+            [&testRam, noChangeChance, zeroPageChance] {
+                randomMutateRam(testRam, noChangeChance, zeroPageChance);
+            });
+
+    TestRamBuffer testRamOut(numPages * kTestingPageSize);
+    loadRamSingleBlock(
+            makeRam("testRam", testRamOut.data(), (int64_t)testRamOut.size()),
+            ramPath);
+    EXPECT_EQ(ramBeforeWrites, testRamOut);
+    EXPECT_FALSE(testRam == testRamOut);
+}
+
 }  // namespace snapshot
 }  // namespace android
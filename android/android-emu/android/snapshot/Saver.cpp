@@ -14,6 +14,8 @@
 #include "android/base/files/FileShareOpen.h"
 #include "android/base/files/PathUtils.h"
 #include "android/base/files/StdioStream.h"
+#include "android/snapshot/Codec.h"
+#include "android/snapshot/PageStore.h"
 #include "android/snapshot/RamLoader.h"
 #include "android/snapshot/TextureSaver.h"
 #include "android/snapshot/common.h"
@@ -96,13 +98,75 @@ Saver::Saver(const Snapshot& snapshot, RamLoader* loader, bool isOnExit,
             }
         }
 
+        // The codec applies to textures as well, which are always
+        // compressed; for RAM, picking a codec implies compression unless
+        // it's disabled explicitly.
+        auto codec = CodecType::Lz4;
+        const auto codecEnvVar =
+                System::get()->envGet("ANDROID_SNAPSHOT_CODEC");
+        if (!codecEnvVar.empty()) {
+            if (const auto parsed = Codec::fromString(codecEnvVar)) {
+                codec = *parsed;
+                VERBOSE_PRINT(snapshot,
+                              "autoconfig: using snapshot codec from "
+                              "environment [ANDROID_SNAPSHOT_CODEC=%s]",
+                              codecEnvVar.c_str());
+                if (compressEnvVar != "0" && compressEnvVar != "no" &&
+                    compressEnvVar != "false") {
+                    flags |= RamSaver::Flags::Compress;
+                }
+            } else {
+                dwarning("Unknown snapshot codec '%s' in "
+                         "ANDROID_SNAPSHOT_CODEC, using '%s'",
+                         codecEnvVar.c_str(), Codec::toString(codec));
+            }
+        }
+
+        // Deduplicated snapshots depend on the AVD's page store and can't
+        // be exported (see PageStore.h).
+        const auto dedupEnvVar =
+                System::get()->envGet("ANDROID_SNAPSHOT_DEDUP");
+        if (dedupEnvVar == "1" || dedupEnvVar == "yes" ||
+            dedupEnvVar == "true") {
+            VERBOSE_PRINT(snapshot,
+                          "autoconfig: enabled snapshot RAM deduplication "
+                          "from environment [ANDROID_SNAPSHOT_DEDUP=%s]",
+                          dedupEnvVar.c_str());
+            flags |= RamSaver::Flags::Dedup;
+        }
+
+        // Saving on exit doesn't resume the VM, so there's nothing to win.
+        const auto copyOnWriteEnvVar =
+                System::get()->envGet("ANDROID_SNAPSHOT_COPY_ON_WRITE");
+        if (!isOnExit &&
+            (copyOnWriteEnvVar == "1" || copyOnWriteEnvVar == "yes" ||
+             copyOnWriteEnvVar == "true")) {
+            VERBOSE_PRINT(snapshot,
+                          "autoconfig: enabled copy-on-write snapshot saving "
+                          "from environment "
+                          "[ANDROID_SNAPSHOT_COPY_ON_WRITE=%s]",
+                          copyOnWriteEnvVar.c_str());
+            flags |= RamSaver::Flags::CopyOnWrite;
+        }
+
+        const auto compactEnvVar =
+                System::get()->envGet("ANDROID_SNAPSHOT_COMPACT_RAM");
+        if (compactEnvVar == "1" || compactEnvVar == "yes" ||
+            compactEnvVar == "true") {
+            VERBOSE_PRINT(snapshot,
+                          "autoconfig: enabled snapshot RAM compaction "
+                          "from environment [ANDROID_SNAPSHOT_COMPACT_RAM=%s]",
+                          compactEnvVar.c_str());
+            flags |= RamSaver::Flags::Compact;
+        }
+
         const bool tryIncremental =
             loader && !loader->hasError() && loader->hasGaps();
 
         mIncrementallySaved = tryIncremental;
 
         mRamSaver.emplace(ramFile, flags, tryIncremental ? loader : nullptr,
-                          isOnExit);
+                          isOnExit, codec);
         if (mRamSaver->hasError()) {
             mRamSaver.clear();
             return;
@@ -118,18 +182,21 @@ Saver::Saver(const Snapshot& snapshot, RamLoader* loader, bool isOnExit,
             return;
         }
         mTextureSaver = std::make_shared<TextureSaver>(
-                StdioStream(textures, StdioStream::kOwner));
+                StdioStream(textures, StdioStream::kOwner),
+                mRamSaver->codec());
     }
 
     mStatus = OperationStatus::NotStarted;
 }
 
 Saver::~Saver() {
+    join();
     const bool deleteDirectory =
             mStatus != OperationStatus::Ok && (mRamSaver || mTextureSaver);
     mRamSaver.clear();
     mTextureSaver.reset();
     if (deleteDirectory) {
+        releasePageStoreRefs(mSnapshot.dataDir());
         path_delete_dir(c_str(mSnapshot.dataDir()));
     }
 }
@@ -144,6 +211,23 @@ void Saver::prepare() {
 }
 
 void Saver::complete(bool succeeded) {
+    if (succeeded && mRamSaver && mRamSaver->savingInBackground()) {
+        // The VM resumes as soon as this returns, while the RAM is still
+        // being written out: finish the snapshot once it's all there.
+        mFinishThread.emplace([this] { finish(true); });
+        mFinishThread->start();
+        return;
+    }
+    finish(succeeded);
+}
+
+void Saver::join() {
+    if (mFinishThread) {
+        mFinishThread->wait();
+    }
+}
+
+void Saver::finish(bool succeeded) {
     mStatus = OperationStatus::Error;
     if (!succeeded) {
         return;
@@ -178,6 +262,11 @@ void Saver::complete(bool succeeded) {
 }
 
 void Saver::cancel() {
+    if (mFinishThread) {
+        // Don't let the background part overwrite the status.
+        mRamSaver->cancel();
+        join();
+    }
     mStatus = OperationStatus::Canceled;
 
     if (mRamSaver) {
@@ -185,6 +274,7 @@ void Saver::cancel() {
     }
 
     // TODO next: texture save cancel
+    releasePageStoreRefs(mSnapshot.dataDir());
     path_delete_dir(c_str(mSnapshot.dataDir()));
 
     mSnapshot.saveFailure(FailureReason::Canceled);
@@ -15,10 +15,13 @@
 #include "android/base/Optional.h"
 #include "android/base/StringView.h"
 #include "android/base/system/System.h"
+#include "android/base/threads/FunctorThread.h"
 #include "android/snapshot/common.h"
 #include "android/snapshot/RamSaver.h"
 #include "android/snapshot/Snapshot.h"
 
+#include <atomic>
+
 namespace android {
 namespace snapshot {
 
@@ -43,6 +46,9 @@ public:
 
     void prepare();
     void complete(bool succeeded);
+    // Waits for a copy-on-write save that complete() left to finish in the
+    // background; status() stays NotStarted until it does.
+    void join();
 
     bool incrementallySaved() const { return mIncrementallySaved; }
 
@@ -55,13 +61,16 @@ public:
                                     base::System::DiskKind::Hdd; }
 
 private:
-    OperationStatus mStatus;
+    void finish(bool succeeded);
+
+    std::atomic<OperationStatus> mStatus;
     Snapshot mSnapshot;
     base::Optional<RamSaver> mRamSaver;
     std::shared_ptr<TextureSaver> mTextureSaver;
     bool mIncrementallySaved = false;
     base::System::MemUsage mMemUsage;
     base::Optional<base::System::DiskKind> mDiskKind = {};
+    base::Optional<base::FunctorThread> mFinishThread;
 };
 
 }  // namespace snapshot
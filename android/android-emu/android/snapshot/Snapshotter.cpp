@@ -44,10 +44,6 @@
 #include <cassert>
 #include <utility>
 
-extern "C" {
-#include <emmintrin.h>
-}
-
 using android::base::LazyInstance;
 using android::base::PathUtils;
 using android::base::Stopwatch;
@@ -57,64 +53,19 @@ using android::crashreport::CrashReporter;
 using android::metrics::MetricsReporter;
 namespace pb = android_studio;
 
-// Inspired by QEMU's bufferzero.c implementation, but simplified for the case
-// when checking the whole aligned memory page.
-static bool buffer_zero_sse2(const void* buf, int len) {
-    buf = __builtin_assume_aligned(buf, 1024);
-    __m128i t = _mm_load_si128(static_cast<const __m128i*>(buf));
-    auto p = reinterpret_cast<__m128i*>(
-            (reinterpret_cast<intptr_t>(buf) + 5 * 16));
-    auto e =
-            reinterpret_cast<__m128i*>((reinterpret_cast<intptr_t>(buf) + len));
-    const __m128i zero = _mm_setzero_si128();
-
-    /* Loop over 16-byte aligned blocks of 64.  */
-    do {
-        __builtin_prefetch(p);
-        t = _mm_cmpeq_epi32(t, zero);
-        if (_mm_movemask_epi8(t) != 0xFFFF) {
-            return false;
-        }
-#ifdef _MSC_VER
-        t = _mm_or_si128(_mm_or_si128(p[-4], p[-3]), _mm_or_si128(p[-2], p[-1]));
-#else
-        t = p[-4] | p[-3] | p[-2] | p[-1];
-#endif
-        p += 4;
-    } while (p <= e);
-
-    /* Finish the aligned tail.  */
-#ifdef _WIN32
-    t = _mm_or_si128(t, e[-3]);
-    t = _mm_or_si128(t, e[-2]);
-    t = _mm_or_si128(t, e[-1]);
-#else
-    t |= e[-3];
-    t |= e[-2];
-    t |= e[-1];
-#endif
-    return _mm_movemask_epi8(_mm_cmpeq_epi32(t, zero)) == 0xFFFF;
-}
-
 namespace android {
 namespace snapshot {
 
 static const System::Duration kSnapshotCrashThresholdMs = 120000; // 2 minutes
 
-// TODO: implement an optimized SSE4 version and dynamically select it if host
-// supports SSE4.
-bool isBufferZeroed(const void* ptr, int32_t size) {
-    assert((uintptr_t(ptr) & (1024 - 1)) == 0);  // page-aligned
-    assert(size >= 1024);  // at least one small page in |size|
-    return buffer_zero_sse2(ptr, size);
-}
-
 Snapshotter::Snapshotter() = default;
 
 Snapshotter::~Snapshotter() {
     if (mVmOperations.setSnapshotCallbacks) {
         mVmOperations.setSnapshotCallbacks(nullptr, nullptr);
     }
+    // Before |mLoader|, see finishSaving().
+    mSaver.reset();
 }
 
 static LazyInstance<Snapshotter> sInstance = {};
@@ -216,7 +167,7 @@ void Snapshotter::initialize(const QAndroidVmOperations& vmOperations,
              // savingComplete
              [](void* opaque) {
                  auto snapshot = static_cast<Snapshotter*>(opaque);
-                 snapshot->mSaver->ramSaver().join();
+                 snapshot->mSaver->ramSaver().complete();
                  return snapshot->mSaver->ramSaver().hasError() ? -1 : 0;
              },
              // loadRam
@@ -274,6 +225,7 @@ static void appendFailedLoad(pb::EmulatorSnapshotLoadState state,
 #endif
 
 OperationStatus Snapshotter::prepareForLoading(const char* name) {
+    finishSaving();
     if (mSaver && mSaver->snapshot().name() == name) {
         mSaver.reset();
     }
@@ -314,6 +266,21 @@ void Snapshotter::finishLoading() {
     }
 }
 
+void Snapshotter::finishSaving() {
+    // Incremental copy-on-write saves keep using |mLoader| too.
+    if (mSaver) {
+        mSaver->join();
+    }
+}
+
+OperationStatus Snapshotter::finishSaving(const char* name) {
+    finishSaving();
+    if (!mSaver || mSaver->snapshot().name() != name) {
+        return OperationStatus::Error;
+    }
+    return mSaver->status();
+}
+
 void Snapshotter::prepareLoaderForSaving(const char* name) {
     if (!mLoader) {
         return;
@@ -686,6 +653,7 @@ void Snapshotter::handleGenericLoad(const char* name,
 }
 
 OperationStatus Snapshotter::prepareForSaving(const char* name) {
+    finishSaving();
     prepareLoaderForSaving(name);
     mVmOperations.vmStop();
     mSaver.reset(new Saver(
@@ -712,6 +680,8 @@ OperationStatus Snapshotter::save(bool isOnExit, const char* name) {
         mVmOperations.setExiting();
     }
     mVmOperations.snapshotSave(name, this, nullptr);
+    // The VM is running again, but the save itself may not be done yet.
+    finishSaving();
     mLastSaveDuration.emplace(sw.elapsedUs() / 1000);
     // In unit tests, we don't have a saver, so trivially succeed.
     return mSaver ? mSaver->status() : OperationStatus::Ok;
@@ -801,6 +771,7 @@ void Snapshotter::invalidateSnapshot(const char* name) {
     mVmOperations.snapshotDelete(name, this, nullptr);
 
     // then delete kRamFileName / kTexturesFileName / kMappedRamFileName
+    releasePageStoreRefs(getSnapshotDir(nameValidated));
     path_delete_file(
             PathUtils::join(getSnapshotDir(nameValidated), kRamFileName)
                     .c_str());
@@ -810,6 +781,9 @@ void Snapshotter::invalidateSnapshot(const char* name) {
     path_delete_file(
             PathUtils::join(getSnapshotDir(nameValidated), kMappedRamFileName)
                     .c_str());
+    path_delete_file(
+            PathUtils::join(getSnapshotDir(nameValidated), kRamAccessFileName)
+                    .c_str());
 
     tombstone.saveFailure(FailureReason::Tombstone);
 }
@@ -840,6 +814,7 @@ bool Snapshotter::onStartSaving(const char* name) {
     CrashReporter::get()->hangDetector().pause(true);
 #endif
     callCallbacks(Operation::Save, Stage::Start);
+    finishSaving();
     prepareLoaderForSaving(name);
     if (!mSaver || isComplete(*mSaver)) {
         mSaver.reset(new Saver(
@@ -969,6 +944,7 @@ bool Snapshotter::onDeletingComplete(const char* name, int res) {
             mLoader.reset();
         }
         if (!mIsInvalidating) {
+            releasePageStoreRefs(Snapshot::dataDir(name));
             path_delete_dir(base::c_str(Snapshot::dataDir(name)));
         }
     }
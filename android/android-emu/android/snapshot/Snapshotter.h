@@ -75,6 +75,13 @@ public:
     OperationStatus load(bool isQuickboot, const char* name);
     OperationStatus prepareForSaving(const char* name);
     OperationStatus save(bool isOnExit, const char* name);
+    // Waits until the last save is done: a copy-on-write one keeps writing
+    // RAM out after the VM resumes. save() does it already.
+    void finishSaving();
+    // Same, returning how the save of |name| went, or Error if another
+    // operation replaced it since. Must run on the main loop, like the
+    // operations that replace the saver.
+    OperationStatus finishSaving(const char* name);
 
     void setRamFile(const char* path, bool shared);
     void setRamFileShared(bool shared);
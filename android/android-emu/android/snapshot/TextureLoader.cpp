@@ -13,10 +13,23 @@
 
 #include "android/base/EintrWrapper.h"
 #include "android/base/files/DecompressingStream.h"
+#include "android/base/files/InplaceStream.h"
+#include "android/base/files/MemStream.h"
 
+#include <algorithm>
 #include <assert.h>
+#include <limits>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 using android::base::DecompressingStream;
+using android::base::InplaceStream;
+using android::base::MemStream;
 
 namespace android {
 namespace snapshot {
@@ -24,6 +37,10 @@ namespace snapshot {
 TextureLoader::TextureLoader(android::base::StdioStream&& stream)
     : mStream(std::move(stream)) {}
 
+TextureLoader::~TextureLoader() {
+    unmap();
+}
+
 bool TextureLoader::start() {
     if (mStarted) {
         return !mHasError;
@@ -35,13 +52,24 @@ bool TextureLoader::start() {
         mHasError = true;
         return false;
     }
+    // Version 2 has no sizes, its textures are decompressed straight from
+    // the file stream.
+    if (mVersion != 2) {
+        map();
+    }
     return true;
 }
 
 void TextureLoader::loadTexture(uint32_t texId, const loader_t& loader) {
-    android::base::AutoLock scopedLock(mLock);
     assert(mIndex.count(texId));
-    HANDLE_EINTR(fseeko64(mStream.get(), mIndex[texId], SEEK_SET));
+    const int64_t offset = mIndex.find(texId)->second;
+    if (mMapped) {
+        loadMappedTexture(offset, loader);
+        return;
+    }
+
+    android::base::AutoLock scopedLock(mLock);
+    HANDLE_EINTR(fseeko64(mStream.get(), offset, SEEK_SET));
     switch (mVersion) {
         case 1:
             loader(&mStream);
@@ -49,6 +77,27 @@ void TextureLoader::loadTexture(uint32_t texId, const loader_t& loader) {
         case 2: {
             DecompressingStream stream(mStream);
             loader(&stream);
+            break;
+        }
+        case 3: {
+            const auto rawSize = int32_t(mStream.getBe32());
+            const auto sizeOnDisk = int32_t(mStream.getBe32());
+            MemStream::Buffer raw(static_cast<size_t>(rawSize));
+            if (sizeOnDisk == rawSize) {
+                mStream.read(raw.data(), raw.size());
+            } else {
+                std::vector<uint8_t> compressed(
+                        static_cast<size_t>(sizeOnDisk));
+                mStream.read(compressed.data(), compressed.size());
+                if (!mCodec->decompress(compressed.data(), sizeOnDisk,
+                                        (uint8_t*)raw.data(), rawSize)) {
+                    mHasError = true;
+                    return;
+                }
+            }
+            MemStream stream(std::move(raw));
+            loader(&stream);
+            break;
         }
     }
     if (ferror(mStream.get())) {
@@ -56,6 +105,94 @@ void TextureLoader::loadTexture(uint32_t texId, const loader_t& loader) {
     }
 }
 
+void TextureLoader::loadMappedTexture(int64_t offset,
+                                      const loader_t& loader) {
+    if (offset < 0 || uint64_t(offset) >= mMappedSize) {
+        mHasError = true;
+        return;
+    }
+    char* data = const_cast<char*>(mMapped) + offset;
+    const uint64_t available = mMappedSize - offset;
+    if (mVersion == 1) {
+        // Unknown size, the loader reads as much as it needs.
+        InplaceStream stream(
+                data, uint32_t(std::min<uint64_t>(
+                              available, std::numeric_limits<int>::max())));
+        loader(&stream);
+        return;
+    }
+
+    if (available < 8) {
+        mHasError = true;
+        return;
+    }
+    InplaceStream header(data, 8);
+    const auto rawSize = int32_t(header.getBe32());
+    const auto sizeOnDisk = int32_t(header.getBe32());
+    if (rawSize < 0 || sizeOnDisk < 0 ||
+        uint64_t(sizeOnDisk) > available - 8) {
+        mHasError = true;
+        return;
+    }
+    if (sizeOnDisk == rawSize) {
+        InplaceStream stream(data + 8, uint32_t(rawSize));
+        loader(&stream);
+        return;
+    }
+    MemStream::Buffer raw(static_cast<size_t>(rawSize));
+    if (!mCodec->decompress(reinterpret_cast<const uint8_t*>(data + 8),
+                            sizeOnDisk, (uint8_t*)raw.data(), rawSize)) {
+        mHasError = true;
+        return;
+    }
+    MemStream stream(std::move(raw));
+    loader(&stream);
+}
+
+void TextureLoader::map() {
+    if (!mDiskSize || mDiskSize > std::numeric_limits<size_t>::max()) {
+        return;
+    }
+#ifdef _WIN32
+    const auto file = reinterpret_cast<HANDLE>(
+            _get_osfhandle(fileno(mStream.get())));
+    mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping) {
+        return;
+    }
+    mMapped = static_cast<const char*>(
+            MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mMapped) {
+        CloseHandle(mMapping);
+        mMapping = nullptr;
+        return;
+    }
+#else
+    void* addr = mmap(nullptr, size_t(mDiskSize), PROT_READ, MAP_SHARED,
+                      fileno(mStream.get()), 0);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+    mMapped = static_cast<const char*>(addr);
+#endif
+    mMappedSize = mDiskSize;
+}
+
+void TextureLoader::unmap() {
+    if (!mMapped) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mMapped);
+    CloseHandle(mMapping);
+    mMapping = nullptr;
+#else
+    munmap(const_cast<char*>(mMapped), size_t(mMappedSize));
+#endif
+    mMapped = nullptr;
+    mMappedSize = 0;
+}
+
 bool TextureLoader::readIndex() {
 #if SNAPSHOT_PROFILE > 1
     auto start = android::base::System::get()->getHighResTimeUs();
@@ -68,9 +205,15 @@ bool TextureLoader::readIndex() {
     auto indexPos = mStream.getBe64();
     HANDLE_EINTR(fseeko64(mStream.get(), static_cast<int64_t>(indexPos), SEEK_SET));
     mVersion = mStream.getBe32();
-    if (mVersion < 1 || mVersion > 2) {
+    if (mVersion < 1 || mVersion > 3) {
         return false;
     }
+    if (mVersion > 2) {
+        mCodec = Codec::get(CodecType(mStream.getByte()));
+        if (!mCodec) {
+            return false;
+        }
+    }
     uint32_t texCount = mStream.getBe32();
     mIndex.reserve(texCount);
     for (uint32_t i = 0; i < texCount; i++) {
@@ -16,8 +16,10 @@
 #include "android/base/synchronization/Lock.h"
 #include "android/base/system/System.h"
 #include "android/base/threads/Thread.h"
+#include "android/snapshot/Codec.h"
 #include "android/snapshot/common.h"
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <unordered_map>
@@ -48,9 +50,14 @@ public:
     virtual void interrupt() = 0;
 };
 
+// TextureLoader memory-maps the texture file when it can, so a texture's data
+// stays in the file until it's restored, and loads of different textures
+// (the background loader and the render threads touching a texture first)
+// don't wait for each other.
 class TextureLoader final : public ITextureLoader {
 public:
     TextureLoader(android::base::StdioStream&& stream);
+    ~TextureLoader();
 
     bool start() override;
     void loadTexture(uint32_t texId, const loader_t& loader) override;
@@ -67,6 +74,7 @@ public:
             mLoaderThread->wait();
             mLoaderThread.reset();
         }
+        unmap();
         mStream.close();
         mEndTime = base::System::get()->getHighResTimeUs();
     }
@@ -77,6 +85,7 @@ public:
             mLoaderThread->wait();
             mLoaderThread.reset();
         }
+        unmap();
         mStream.close();
         mEndTime = base::System::get()->getHighResTimeUs();
     }
@@ -98,13 +107,23 @@ public:
 
 private:
     bool readIndex();
+    void map();
+    void unmap();
+    void loadMappedTexture(int64_t offset, const loader_t& loader);
 
     android::base::StdioStream mStream;
     std::unordered_map<uint32_t, int64_t> mIndex;
     android::base::Lock mLock;
     bool mStarted = false;
-    bool mHasError = false;
+    std::atomic<bool> mHasError{false};
+    // The whole file, or null if it couldn't be mapped.
+    const char* mMapped = nullptr;
+    uint64_t mMappedSize = 0;
+#ifdef _WIN32
+    void* mMapping = nullptr;
+#endif
     int mVersion = 0;
+    Codec::Ptr mCodec;  // Version 3 only.
     uint64_t mDiskSize = 0;
     LoaderThreadPtr mLoaderThread;
 
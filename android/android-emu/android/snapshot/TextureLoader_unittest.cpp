@@ -0,0 +1,93 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/TextureLoader.h"
+
+#include "android/base/files/StdioStream.h"
+#include "android/base/testing/TestTempDir.h"
+#include "android/snapshot/TextureSaver.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdio.h>
+#include <vector>
+
+using android::base::StdioStream;
+using android::base::Stream;
+using android::base::TestTempDir;
+
+namespace android {
+namespace snapshot {
+
+static constexpr uint32_t kTextureCount = 20;
+
+// Texture |id| is its id followed by id KB of mostly repeated bytes, with
+// every third texture all zeroes.
+static char textureByte(uint32_t id) {
+    return id % 3 ? static_cast<char>(id) : 0;
+}
+
+static void saveTextures(const std::string& path, CodecType codec) {
+    TextureSaver saver(StdioStream(fopen(path.c_str(), "wb"),
+                                   StdioStream::kOwner),
+                       codec);
+    for (uint32_t id = 1; id <= kTextureCount; id++) {
+        saver.saveTexture(id, [id](Stream* stream, TextureSaver::Buffer*) {
+            const std::vector<char> data(id * 1024, textureByte(id));
+            stream->putBe32(id);
+            stream->putBe32(data.size());
+            stream->write(data.data(), data.size());
+        });
+    }
+    saver.done();
+    EXPECT_FALSE(saver.hasError());
+}
+
+// Loads the textures in the reverse order of saving, as they'd come when
+// restored on demand.
+static void loadTextures(const std::string& path) {
+    auto loader = std::make_shared<TextureLoader>(
+            StdioStream(fopen(path.c_str(), "rb"), StdioStream::kOwner));
+    ASSERT_TRUE(loader->start());
+    for (uint32_t id = kTextureCount; id >= 1; id--) {
+        loader->loadTexture(id, [id](Stream* stream) {
+            EXPECT_EQ(id, stream->getBe32());
+            const uint32_t size = stream->getBe32();
+            ASSERT_EQ(id * 1024, size);
+            std::vector<char> data(size);
+            EXPECT_EQ(static_cast<ssize_t>(size),
+                      stream->read(data.data(), size));
+            for (char c : data) {
+                ASSERT_EQ(textureByte(id), c);
+            }
+        });
+    }
+    EXPECT_FALSE(loader->hasError());
+    loader->join();
+}
+
+TEST(TextureLoader, RoundTripStreaming) {
+    TestTempDir dir("textureloadertest");
+    const std::string path = dir.makeSubPath("textures.bin");
+    saveTextures(path, CodecType::Lz4);
+    loadTextures(path);
+}
+
+TEST(TextureLoader, RoundTripMapped) {
+    TestTempDir dir("textureloadertest");
+    const std::string path = dir.makeSubPath("textures.bin");
+    saveTextures(path, CodecType::Zstd);
+    loadTextures(path);
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -12,6 +12,7 @@
 #include "android/snapshot/TextureSaver.h"
 
 #include "android/base/files/CompressingStream.h"
+#include "android/base/files/MemStream.h"
 #include "android/base/system/System.h"
 
 #include <algorithm>
@@ -20,13 +21,22 @@
 #include <utility>
 
 using android::base::CompressingStream;
+using android::base::MemStream;
 using android::base::System;
 
 namespace android {
 namespace snapshot {
 
-TextureSaver::TextureSaver(android::base::StdioStream&& stream)
+TextureSaver::TextureSaver(android::base::StdioStream&& stream,
+                           CodecType codec)
     : mStream(std::move(stream)) {
+    if (codec == CodecType::ZstdDict) {
+        codec = CodecType::Zstd;
+    }
+    if (codec != CodecType::Lz4) {
+        mCodec = Codec::get(codec);
+        mIndex.version = 3;
+    }
     // Put a placeholder for the index offset right now.
     mStream.putBe64(0);
 }
@@ -48,8 +58,32 @@ void TextureSaver::saveTexture(uint32_t texId, const saver_t& saver) {
                         }));
     mIndex.textures.push_back({texId, ftello64(mStream.get())});
 
-    CompressingStream stream(mStream);
+    if (!mCodec) {
+        CompressingStream stream(mStream);
+        saver(&stream, &mBuffer);
+        return;
+    }
+
+    // Block format: raw size, size on disk, then the data; the data is
+    // stored as is if it doesn't compress.
+    MemStream stream;
     saver(&stream, &mBuffer);
+    const auto& raw = stream.buffer();
+    const auto rawSize = int32_t(raw.size());
+    std::vector<uint8_t> compressed(size_t(mCodec->maxCompressedSize(rawSize)));
+    auto compressedSize = rawSize ? mCodec->compress(
+                                            (const uint8_t*)raw.data(),
+                                            rawSize, compressed.data(),
+                                            int32_t(compressed.size()))
+                                  : 0;
+    mStream.putBe32(uint32_t(rawSize));
+    if (compressedSize <= 0 || compressedSize >= rawSize) {
+        mStream.putBe32(uint32_t(rawSize));
+        mStream.write(raw.data(), raw.size());
+    } else {
+        mStream.putBe32(uint32_t(compressedSize));
+        mStream.write(compressed.data(), size_t(compressedSize));
+    }
 }
 
 void TextureSaver::done() {
@@ -74,6 +108,9 @@ void TextureSaver::writeIndex() {
 #endif
 
     mStream.putBe32(static_cast<uint32_t>(mIndex.version));
+    if (mIndex.version > 2) {
+        mStream.putByte(static_cast<uint8_t>(mCodec->type()));
+    }
     mStream.putBe32(static_cast<uint32_t>(mIndex.textures.size()));
     for (const FileIndex::Texture& b : mIndex.textures) {
         mStream.putBe32(b.texId);
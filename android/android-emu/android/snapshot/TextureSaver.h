@@ -14,6 +14,7 @@
 #include "android/base/containers/SmallVector.h"
 #include "android/base/files/StdioStream.h"
 #include "android/base/system/System.h"
+#include "android/snapshot/Codec.h"
 #include "android/snapshot/common.h"
 
 #include <functional>
@@ -46,7 +47,11 @@ class TextureSaver final : public ITextureSaver {
     DISALLOW_COPY_AND_ASSIGN(TextureSaver);
 
 public:
-    TextureSaver(android::base::StdioStream&& stream);
+    // LZ4 keeps the version 2 streaming format; other codecs compress each
+    // texture as a single block (version 3). CodecType::ZstdDict has no
+    // place for a dictionary here and falls back to CodecType::Zstd.
+    TextureSaver(android::base::StdioStream&& stream,
+                 CodecType codec = CodecType::Lz4);
     ~TextureSaver();
     void saveTexture(uint32_t texId, const saver_t& saver) override;
     void done();
@@ -85,6 +90,7 @@ private:
     void writeIndex();
 
     android::base::StdioStream mStream;
+    Codec::Ptr mCodec;
     // A buffer for fetching data from GPU memory to RAM.
     android::base::SmallFixedVector<unsigned char, 128> mBuffer;
 
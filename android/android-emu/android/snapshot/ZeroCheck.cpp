@@ -0,0 +1,141 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/ZeroCheck.h"
+
+#include "android/snapshot/common.h"
+#include "android/utils/x86_cpuid.h"
+
+#include <cassert>
+
+extern "C" {
+#include <emmintrin.h>
+#include <immintrin.h>
+}
+
+// Inspired by QEMU's bufferzero.c implementation, but simplified for the case
+// when checking the whole aligned memory page.
+static bool buffer_zero_sse2(const void* buf, int len) {
+    buf = __builtin_assume_aligned(buf, 1024);
+    __m128i t = _mm_load_si128(static_cast<const __m128i*>(buf));
+    auto p = reinterpret_cast<__m128i*>(
+            (reinterpret_cast<intptr_t>(buf) + 5 * 16));
+    auto e =
+            reinterpret_cast<__m128i*>((reinterpret_cast<intptr_t>(buf) + len));
+    const __m128i zero = _mm_setzero_si128();
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    do {
+        __builtin_prefetch(p);
+        t = _mm_cmpeq_epi32(t, zero);
+        if (_mm_movemask_epi8(t) != 0xFFFF) {
+            return false;
+        }
+#ifdef _MSC_VER
+        t = _mm_or_si128(_mm_or_si128(p[-4], p[-3]), _mm_or_si128(p[-2], p[-1]));
+#else
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+#endif
+        p += 4;
+    } while (p <= e);
+
+    /* Finish the aligned tail.  */
+#ifdef _WIN32
+    t = _mm_or_si128(t, e[-3]);
+    t = _mm_or_si128(t, e[-2]);
+    t = _mm_or_si128(t, e[-1]);
+#else
+    t |= e[-3];
+    t |= e[-2];
+    t |= e[-1];
+#endif
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(t, zero)) == 0xFFFF;
+}
+
+// Twice the width of the SSE2 version, with VPTEST instead of the compare +
+// move mask pair. Nonzero pages usually have something in the first cache
+// line, so that one gets a quick look on its own before the loop goes over
+// the whole page two lines at a time.
+__attribute__((target("avx2"))) static bool buffer_zero_avx2(const void* buf,
+                                                             int len) {
+    buf = __builtin_assume_aligned(buf, 1024);
+    auto p = static_cast<const __m256i*>(buf);
+    const auto e = p + len / 32;
+    __m256i t = _mm256_or_si256(p[0], p[1]);
+    if (!_mm256_testz_si256(t, t)) {
+        return false;
+    }
+    for (; p < e; p += 4) {
+        t = _mm256_or_si256(_mm256_or_si256(p[0], p[1]),
+                            _mm256_or_si256(p[2], p[3]));
+        if (!_mm256_testz_si256(t, t)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool buffer_zero_sse2_checked(const void* buf, int32_t len) {
+    return buffer_zero_sse2(buf, len);
+}
+
+// The AVX2 loop goes 128 bytes at a time.
+static bool buffer_zero_avx2_checked(const void* buf, int32_t len) {
+    return len % 128 ? buffer_zero_sse2(buf, len) : buffer_zero_avx2(buf, len);
+}
+
+static bool hostHasAvx2() {
+    if (android_get_x86_cpuid_function_max() < 7) {
+        return false;
+    }
+    // AVX2 also needs the OS to save the YMM registers.
+    uint32_t ecx = 0;
+    android_get_x86_cpuid(1, 0, nullptr, nullptr, &ecx, nullptr);
+    static constexpr uint32_t kOsXsave = 1 << 27;
+    if (!(ecx & kOsXsave)) {
+        return false;
+    }
+    uint32_t xcr0 = 0;
+#if defined(_MSC_VER) && !defined(__clang__)
+    xcr0 = uint32_t(_xgetbv(0));
+#else
+    __asm__("xgetbv" : "=a"(xcr0) : "c"(0) : "%edx");
+#endif
+    static constexpr uint32_t kXmmYmmState = 0x6;
+    if ((xcr0 & kXmmYmmState) != kXmmYmmState) {
+        return false;
+    }
+    uint32_t ebx = 0;
+    android_get_x86_cpuid(7, 0, nullptr, &ebx, nullptr, nullptr);
+    static constexpr uint32_t kAvx2 = 1 << 5;
+    return (ebx & kAvx2) != 0;
+}
+
+namespace android {
+namespace snapshot {
+
+std::vector<ZeroCheck> supportedZeroChecks() {
+    std::vector<ZeroCheck> res = {{"sse2", &buffer_zero_sse2_checked}};
+    if (hostHasAvx2()) {
+        res.push_back({"avx2", &buffer_zero_avx2_checked});
+    }
+    return res;
+}
+
+bool isBufferZeroed(const void* ptr, int32_t size) {
+    assert((uintptr_t(ptr) & (1024 - 1)) == 0);  // page-aligned
+    assert(size >= 1024);  // at least one small page in |size|
+    static const ZeroCheckFunc check = supportedZeroChecks().back().func;
+    return check(ptr, size);
+}
+
+}  // namespace snapshot
+}  // namespace android
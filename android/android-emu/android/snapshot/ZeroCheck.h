@@ -0,0 +1,42 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+// The zero page checks behind isBufferZeroed() (see common.h).
+//
+// Every snapshot save runs one over all of the guest RAM, so there's a
+// version for each vector extension that makes a difference; the first
+// isBufferZeroed() call picks the best one the host CPU supports. (SSE4.1's
+// PTEST doesn't: the SSE2 loop is already limited by memory bandwidth.)
+//
+// All of them have the same requirements as isBufferZeroed(): |ptr| is
+// 1024-byte aligned, and |size| is at least 1024 and a multiple of 16.
+
+using ZeroCheckFunc = bool (*)(const void* ptr, int32_t size);
+
+struct ZeroCheck {
+    const char* name;
+    ZeroCheckFunc func;
+};
+
+// The checks the host CPU can run, from the slowest to the one
+// isBufferZeroed() uses.
+std::vector<ZeroCheck> supportedZeroChecks();
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,146 @@
+// Copyright 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Measures the part of a RAM save that goes over all of the guest memory:
+// each zero page check on its own, and the zero check + hashing of the
+// nonzero pages, as two passes over RAM and as a single one.
+//
+// The guest RAM is 2GB of generated pages, half of them zero; set
+// ANDROID_SNAPSHOT_BENCHMARK_RAM_MB for a different size.
+
+#include "android/base/AlignedBuf.h"
+#include "android/base/system/System.h"
+#include "android/snapshot/ZeroCheck.h"
+#include "android/snapshot/common.h"
+
+#include "MurmurHash3.h"
+#include "benchmark/benchmark_api.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using android::AlignedBuf;
+using android::base::System;
+using android::snapshot::isBufferZeroed;
+using android::snapshot::kDefaultPageSize;
+using android::snapshot::supportedZeroChecks;
+
+using Hash = std::array<char, 16>;
+
+static AlignedBuf<uint8_t, 4096>& guestRam() {
+    static AlignedBuf<uint8_t, 4096>* const ram = [] {
+        int64_t sizeMb = 2048;
+        const auto env =
+                System::get()->envGet("ANDROID_SNAPSHOT_BENCHMARK_RAM_MB");
+        if (!env.empty()) {
+            sizeMb = std::max(1, atoi(env.c_str()));
+        }
+        const auto size = sizeMb * 1024 * 1024;
+        auto ram = new AlignedBuf<uint8_t, 4096>(size);
+        memset(ram->data(), 0, size);
+
+        std::default_random_engine generator;
+        generator.seed(0);
+        std::uniform_int_distribution<int> distribution(0, 255);
+        for (int64_t pos = 0; pos < size; pos += kDefaultPageSize) {
+            auto page = ram->data() + pos;
+            switch (distribution(generator) % 8) {
+                case 0:
+                    // Nonzero only at the end: the whole page gets checked.
+                    page[kDefaultPageSize - 1] = 1;
+                    break;
+                case 1:
+                case 2:
+                case 3:
+                    for (int i = 0; i < kDefaultPageSize; i += 8) {
+                        page[i] = uint8_t(distribution(generator));
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return ram;
+    }();
+    return *ram;
+}
+
+static void BM_ZeroCheck(benchmark::State& state) {
+    const auto checks = supportedZeroChecks();
+    if (state.range_x() >= int(checks.size())) {
+        state.SetLabel("not supported");
+        while (state.KeepRunning()) {
+        }
+        return;
+    }
+    const auto& check = checks[state.range_x()];
+    auto& ram = guestRam();
+    int64_t zeroPages = 0;
+    while (state.KeepRunning()) {
+        for (size_t pos = 0; pos < ram.size(); pos += kDefaultPageSize) {
+            zeroPages += check.func(ram.data() + pos, kDefaultPageSize);
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+    char label[64];
+    snprintf(label, sizeof(label), "%s, %.1f%% zero", check.name,
+             100.0 * zeroPages / state.iterations() /
+                     (ram.size() / kDefaultPageSize));
+    state.SetLabel(label);
+}
+
+BENCHMARK(BM_ZeroCheck)->Arg(0)->Arg(1);
+
+// The way RamSaver used to do it: find the zero pages, then go over the RAM
+// again to hash the rest.
+static void BM_ZeroCheckThenHash(benchmark::State& state) {
+    auto& ram = guestRam();
+    const size_t pageCount = ram.size() / kDefaultPageSize;
+    std::vector<bool> zero(pageCount);
+    std::vector<Hash> hashes(pageCount);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < pageCount; ++i) {
+            zero[i] = isBufferZeroed(ram.data() + i * kDefaultPageSize,
+                                     kDefaultPageSize);
+        }
+        for (size_t i = 0; i < pageCount; ++i) {
+            if (!zero[i]) {
+                MurmurHash3_x64_128(ram.data() + i * kDefaultPageSize,
+                                    kDefaultPageSize, 0, hashes[i].data());
+            }
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+BENCHMARK(BM_ZeroCheckThenHash);
+
+static void BM_ZeroCheckAndHash(benchmark::State& state) {
+    auto& ram = guestRam();
+    const size_t pageCount = ram.size() / kDefaultPageSize;
+    std::vector<Hash> hashes(pageCount);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < pageCount; ++i) {
+            const auto page = ram.data() + i * kDefaultPageSize;
+            if (!isBufferZeroed(page, kDefaultPageSize)) {
+                MurmurHash3_x64_128(page, kDefaultPageSize, 0,
+                                    hashes[i].data());
+            }
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * ram.size());
+}
+
+BENCHMARK(BM_ZeroCheckAndHash);
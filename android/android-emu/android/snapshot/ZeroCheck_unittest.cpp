@@ -0,0 +1,59 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// This software is licensed under the terms of the GNU General Public
+// License version 2, as published by the Free Software Foundation, and
+// may be copied, distributed, and modified under those terms.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+#include "android/snapshot/ZeroCheck.h"
+
+#include "android/base/AlignedBuf.h"
+#include "android/snapshot/common.h"
+
+#include <gtest/gtest.h>
+
+using android::AlignedBuf;
+
+namespace android {
+namespace snapshot {
+
+TEST(ZeroCheck, SupportedChecks) {
+    const auto checks = supportedZeroChecks();
+    ASSERT_FALSE(checks.empty());
+    EXPECT_STREQ("sse2", checks.front().name);
+}
+
+TEST(ZeroCheck, AllChecksAgree) {
+    for (const int32_t size : {1024, 1040, 1088, 4096, 64 * 1024}) {
+        AlignedBuf<uint8_t, 1024> buf(size);
+        memset(buf.data(), 0, size);
+        for (const auto& check : supportedZeroChecks()) {
+            SCOPED_TRACE(testing::Message()
+                         << check.name << ", size " << size);
+            EXPECT_TRUE(check.func(buf.data(), size));
+            for (int32_t i = 0; i < size; i += 7) {
+                buf[i] = 0x80;
+                EXPECT_FALSE(check.func(buf.data(), size)) << "at " << i;
+                buf[i] = 0;
+            }
+            buf[size - 1] = 1;
+            EXPECT_FALSE(check.func(buf.data(), size));
+            buf[size - 1] = 0;
+        }
+    }
+}
+
+TEST(ZeroCheck, IsBufferZeroed) {
+    AlignedBuf<uint8_t, 4096> page(kDefaultPageSize);
+    memset(page.data(), 0, kDefaultPageSize);
+    EXPECT_TRUE(isBufferZeroed(page.data(), kDefaultPageSize));
+    page[kDefaultPageSize / 2] = 1;
+    EXPECT_FALSE(isBufferZeroed(page.data(), kDefaultPageSize));
+}
+
+}  // namespace snapshot
+}  // namespace android
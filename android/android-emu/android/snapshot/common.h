@@ -54,6 +54,10 @@ enum class IndexFlags {
     Empty = 0,
     CompressedPages = 0x01,
     SeparateBackingStore = 0x02,
+    // Page positions point into the AVD's PageStore instead of ram.bin.
+    PageStore = 0x04,
+    // CodecType of the compressed pages, see Codec.h.
+    CodecMask = 0xf0,
 };
 
 enum class OperationStatus {
@@ -120,6 +124,10 @@ constexpr const char* kRamFileName = "ram.bin";
 constexpr const char* kTexturesFileName = "textures.bin";
 constexpr const char* kMappedRamFileName = "ram.img";
 constexpr const char* kMappedRamFileDirtyName = "ram.img.dirty";
+constexpr const char* kRamRefsFileName = "ram.refs";
+constexpr const char* kRamAccessFileName = "ram.access";
+// In the snapshot base directory, shared by all snapshots of the AVD.
+constexpr const char* kPageStoreFileName = "pagestore.bin";
 
 void resetSnapshotLiveness();
 bool isSnapshotAlive();
@@ -13,6 +13,7 @@
   X(EGLBoolean, eglSaveAllImages, (EGLDisplay display, EGLStream stream, const void* textureSaver)) \
   X(EGLBoolean, eglPreSaveContext, (EGLDisplay display, EGLContext contex, EGLStream stream)) \
   X(EGLBoolean, eglPostLoadAllImages, (EGLDisplay display, EGLStream stream)) \
+  X(EGLBoolean, eglPrioritizeImageRestore, (EGLDisplay display, EGLImageKHR image)) \
   X(EGLBoolean, eglPostSaveContext, (EGLDisplay display, EGLConfig config, EGLStream stream)) \
   X(void, eglUseOsEglApi, (EGLBoolean enable)) \
   X(void, eglSetMaxGLESVersion, (EGLint glesVersion)) \
@@ -59,6 +59,9 @@ public:
     virtual void setLogger(emugl_logger_struct logger) = 0;
     virtual void setGLObjectCounter(
             android::base::GLObjectCounter* counter) = 0;
+    // Tell emugl where to keep the on-disk shader cache; must be called
+    // before initRenderer(). An empty directory disables the cache.
+    virtual void setShaderCacheDir(const char* dir) = 0;
     virtual void setCrashReporter(emugl_crash_reporter_t reporter) = 0;
     virtual void setFeatureController(emugl_feature_is_enabled_t featureController) = 0;
     virtual void setSyncDevice(emugl_sync_create_timeline_t,
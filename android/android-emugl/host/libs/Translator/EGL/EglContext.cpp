@@ -136,6 +136,9 @@ EglContext::~EglContext()
         m_mngr->deleteShareGroup(m_native.get());
     }
     m_shareGroup.reset();
+    // Also the objects deleted through other contexts whose deletion is
+    // still batched, so that none are left once the last context is gone.
+    m_dpy->getGlobalNameSpace()->flushDeletedNames();
 
     //
     // call the client-api to remove the GLES context
@@ -708,3 +708,21 @@ void EglDisplay::onLoadAllImages(android::base::Stream* stream,
 void EglDisplay::postLoadAllImages(android::base::Stream* stream) {
     m_globalNameSpace.postLoad(stream);
 }
+
+bool EglDisplay::prioritizeImageRestore(EGLImageKHR img) {
+    SaveableTexturePtr saveableTexture;
+    {
+        emugl::Mutex::AutoLock mutex(m_lock);
+        unsigned int hndl = SafeUIntFromPointer(img);
+        ImagesHndlMap::const_iterator i(m_eglImages.find(hndl));
+        if (i == m_eglImages.end()) {
+            return false;
+        }
+        if (!i->second->needRestore) {
+            return true;
+        }
+        saveableTexture = i->second->saveableTexture;
+    }
+    m_globalNameSpace.prioritizeRestore(saveableTexture);
+    return true;
+}
@@ -111,6 +111,8 @@ public:
                          const android::snapshot::ITextureLoaderPtr& textureLoader,
                          SaveableTexture::creator_t creator);
     void postLoadAllImages(android::base::Stream* stream);
+    // Has the texture of |img| restored ahead of the others after a load.
+    bool prioritizeImageRestore(EGLImageKHR img);
 
 private:
     static void addConfig(void* opaque, const EglOS::ConfigInfo* configInfo);
@@ -164,6 +164,7 @@ EGLAPI EGLBoolean EGLAPIENTRY eglLoadAllImages(EGLDisplay display,
                                                EGLStream stream,
                                                const void* textureLoader);
 EGLAPI EGLBoolean EGLAPIENTRY eglPostLoadAllImages(EGLDisplay display, EGLStream stream);
+EGLAPI EGLBoolean EGLAPIENTRY eglPrioritizeImageRestore(EGLDisplay display, EGLImageKHR image);
 EGLAPI void EGLAPIENTRY eglUseOsEglApi(EGLBoolean enable);
 EGLAPI void EGLAPIENTRY eglSetMaxGLESVersion(EGLint version);
 EGLAPI void EGLAPIENTRY eglFillUsages(void* usages);
@@ -1761,6 +1762,11 @@ EGLAPI EGLBoolean EGLAPIENTRY eglPostLoadAllImages(EGLDisplay display, EGLStream
     return true;
 }
 
+EGLAPI EGLBoolean EGLAPIENTRY eglPrioritizeImageRestore(EGLDisplay display, EGLImageKHR image) {
+    VALIDATE_DISPLAY(display);
+    return dpy->prioritizeImageRestore(image) ? EGL_TRUE : EGL_FALSE;
+}
+
 EGLAPI void EGLAPIENTRY eglUseOsEglApi(EGLBoolean enable) {
     MEM_TRACE("EMUGL");
     EglGlobalInfo::setEgl2Egl(enable);
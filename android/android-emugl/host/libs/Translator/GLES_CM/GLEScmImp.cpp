@@ -733,11 +733,15 @@ GL_API void GL_APIENTRY  glDeleteBuffers( GLsizei n, const GLuint *buffers) {
     GLES_CM_TRACE()
     SET_ERROR_IF(n<0,GL_INVALID_VALUE);
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i < n; i++){
             ctx->shareGroup()->deleteName(NamedObjectType::VERTEXBUFFER,
                                           buffers[i]);
-            ctx->unbindBuffer(buffers[i]);
+            bound |= ctx->unbindBuffer(buffers[i]);
         }
+        // The host unbinds deleted objects from this context only when it
+        // deletes them, so don't batch those.
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
@@ -746,9 +750,11 @@ GL_API void GL_APIENTRY  glDeleteTextures( GLsizei n, const GLuint *textures) {
     GLES_CM_TRACE()
     SET_ERROR_IF(n<0,GL_INVALID_VALUE);
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i < n; i++){
             if(textures[i] != 0)
             {
+                bound |= ctx->isTextureBound(textures[i]);
                 if(ctx->getBindedTexture(GL_TEXTURE_2D) == textures[i])
                     ctx->setBindedTexture(GL_TEXTURE_2D,0);
                 if (ctx->getBindedTexture(GL_TEXTURE_CUBE_MAP) == textures[i])
@@ -757,6 +763,8 @@ GL_API void GL_APIENTRY  glDeleteTextures( GLsizei n, const GLuint *textures) {
                                               textures[i]);
             }
         }
+        // See glDeleteBuffers().
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
@@ -843,12 +851,14 @@ GL_API void GL_APIENTRY  glEnableClientState( GLenum array) {
 GL_API void GL_APIENTRY  glFinish( void) {
     GET_CTX()
     GLES_CM_TRACE()
+    ctx->flushDeletedNames();
     ctx->dispatcher().glFinish();
 }
 
 GL_API void GL_APIENTRY  glFlush( void) {
     GET_CTX()
     GLES_CM_TRACE()
+    ctx->flushDeletedNames();
     ctx->dispatcher().glFlush();
 }
 
@@ -2299,10 +2309,18 @@ GL_API void GLAPIENTRY glDeleteRenderbuffersOES(GLsizei n, const GLuint *renderb
     GET_CTX()
     GLES_CM_TRACE()
     SET_ERROR_IF(!ctx->getCaps()->GL_EXT_FRAMEBUFFER_OBJECT,GL_INVALID_OPERATION);
+    bool bound = false;
     for (int i=0;i<n;++i) {
+        if (renderbuffers[i] &&
+            ctx->getRenderbufferBinding() == renderbuffers[i]) {
+            ctx->setRenderbufferBinding(0);
+            bound = true;
+        }
         ctx->shareGroup()->deleteName(NamedObjectType::RENDERBUFFER,
                                       renderbuffers[i]);
     }
+    // See glDeleteBuffers().
+    if (bound) ctx->flushDeletedNames();
 }
 
 GL_API void GLAPIENTRY glGenRenderbuffersOES(GLsizei n, GLuint *renderbuffers) {
@@ -11,6 +11,9 @@
 
 #include "ANGLEShaderParser.h"
 
+#include "GLcommon/ShaderCache.h"
+#include "android/base/files/MemStream.h"
+#include "android/base/files/StreamSerializing.h"
 #include "android/base/synchronization/Lock.h"
 
 #include <map>
@@ -19,6 +22,9 @@
 #define SH_GLES31_SPEC ((ShShaderSpec)0x8B88)
 #define GL_COMPUTE_SHADER 0x91B9
 
+using android::base::MemStream;
+using android::base::Stream;
+
 namespace ANGLEShaderParser {
 
 ShBuiltInResources kResources;
@@ -209,6 +215,192 @@ static int detectShaderESSLVersion(const char* const* strings) {
     return wantedESSLVersion;
 }
 
+// Translations are cached with the variables ANGLE found, so that a cache
+// hit gives back the whole ShaderLinkInfo. Bump this when what's saved
+// changes.
+static constexpr uint32_t kTranslationCacheVersion = 1;
+
+static void saveShaderVariable(Stream* stream, const sh::ShaderVariable& var) {
+    stream->putBe32(var.type);
+    stream->putBe32(var.precision);
+    stream->putString(var.name);
+    stream->putString(var.mappedName);
+    stream->putBe32(var.arraySize);
+    stream->putByte(var.staticUse);
+    stream->putString(var.structName);
+    android::base::saveBuffer(stream, var.fields, saveShaderVariable);
+}
+
+static void loadShaderVariable(Stream* stream, sh::ShaderVariable* var) {
+    var->type = stream->getBe32();
+    var->precision = stream->getBe32();
+    var->name = stream->getString();
+    var->mappedName = stream->getString();
+    var->arraySize = stream->getBe32();
+    var->staticUse = stream->getByte();
+    var->structName = stream->getString();
+    android::base::loadBuffer(stream, &var->fields, [](Stream* stream) {
+        sh::ShaderVariable field;
+        loadShaderVariable(stream, &field);
+        return field;
+    });
+}
+
+template <class Var>
+static Var loadPlainVariable(Stream* stream) {
+    Var var;
+    loadShaderVariable(stream, &var);
+    return var;
+}
+
+static void saveVarying(Stream* stream, const sh::Varying& var) {
+    saveShaderVariable(stream, var);
+    stream->putBe32(var.interpolation);
+    stream->putByte(var.isInvariant);
+}
+
+static sh::Varying loadVarying(Stream* stream) {
+    sh::Varying var;
+    loadShaderVariable(stream, &var);
+    var.interpolation = static_cast<sh::InterpolationType>(stream->getBe32());
+    var.isInvariant = stream->getByte();
+    return var;
+}
+
+// Attributes and output variables.
+template <class Var>
+static void saveVariableWithLocation(Stream* stream, const Var& var) {
+    saveShaderVariable(stream, var);
+    stream->putBe32(var.location);
+}
+
+template <class Var>
+static Var loadVariableWithLocation(Stream* stream) {
+    Var var;
+    loadShaderVariable(stream, &var);
+    var.location = stream->getBe32();
+    return var;
+}
+
+static void saveInterfaceBlock(Stream* stream,
+                               const sh::InterfaceBlock& block) {
+    stream->putString(block.name);
+    stream->putString(block.mappedName);
+    stream->putString(block.instanceName);
+    stream->putBe32(block.arraySize);
+    stream->putBe32(block.layout);
+    stream->putByte(block.isRowMajorLayout);
+    stream->putByte(block.staticUse);
+    android::base::saveBuffer(
+            stream, block.fields,
+            [](Stream* stream, const sh::InterfaceBlockField& field) {
+                saveShaderVariable(stream, field);
+                stream->putByte(field.isRowMajorLayout);
+            });
+}
+
+static sh::InterfaceBlock loadInterfaceBlock(Stream* stream) {
+    sh::InterfaceBlock block;
+    block.name = stream->getString();
+    block.mappedName = stream->getString();
+    block.instanceName = stream->getString();
+    block.arraySize = stream->getBe32();
+    block.layout = static_cast<sh::BlockLayoutType>(stream->getBe32());
+    block.isRowMajorLayout = stream->getByte();
+    block.staticUse = stream->getByte();
+    android::base::loadBuffer(stream, &block.fields, [](Stream* stream) {
+        sh::InterfaceBlockField field;
+        loadShaderVariable(stream, &field);
+        field.isRowMajorLayout = stream->getByte();
+        return field;
+    });
+    return block;
+}
+
+// Everything the translation depends on: the source and the translator
+// settings, which include the host GL limits.
+static std::string translationCacheKey(bool hostUsesCoreProfile,
+                                       const char* src,
+                                       GLenum shaderType,
+                                       int esslVersion) {
+    // The hash function is a pointer, which changes from run to run.
+    ShBuiltInResources resources = kResources;
+    resources.HashFunction = nullptr;
+
+    MemStream stream;
+    stream.putString("angle-translate");
+    stream.putBe32(kTranslationCacheVersion);
+    stream.putBe32(ANGLE_SH_VERSION);
+    stream.putByte(hostUsesCoreProfile);
+    stream.putBe32(shaderType);
+    stream.putBe32(esslVersion);
+    stream.write(&resources, sizeof(resources));
+    stream.putString(src);
+    return std::string(stream.buffer().begin(), stream.buffer().end());
+}
+
+static std::string saveTranslation(bool res,
+                                   const std::string& infolog,
+                                   const std::string& objCode,
+                                   const ShaderLinkInfo& linkInfo) {
+    MemStream stream;
+    stream.putByte(res);
+    stream.putString(infolog);
+    stream.putString(objCode);
+    stream.putBe32(linkInfo.esslVersion);
+    android::base::saveBuffer(&stream, linkInfo.uniforms, saveShaderVariable);
+    android::base::saveBuffer(&stream, linkInfo.varyings, saveVarying);
+    android::base::saveBuffer(&stream, linkInfo.attributes,
+                              saveVariableWithLocation<sh::Attribute>);
+    android::base::saveBuffer(&stream, linkInfo.outputVars,
+                              saveVariableWithLocation<sh::OutputVariable>);
+    android::base::saveBuffer(&stream, linkInfo.interfaceBlocks,
+                              saveInterfaceBlock);
+    android::base::saveCollection(
+            &stream, linkInfo.nameMap,
+            [](Stream* stream,
+               const std::pair<const std::string, std::string>& name) {
+                stream->putString(name.first);
+                stream->putString(name.second);
+            });
+    return std::string(stream.buffer().begin(), stream.buffer().end());
+}
+
+static bool loadTranslation(const std::string& data,
+                            std::string* outInfolog,
+                            std::string* outObjCode,
+                            ShaderLinkInfo* outShaderLinkInfo) {
+    MemStream stream(MemStream::Buffer(data.begin(), data.end()));
+    const bool res = stream.getByte();
+    *outInfolog = stream.getString();
+    *outObjCode = stream.getString();
+    if (!outShaderLinkInfo) {
+        return res;
+    }
+    outShaderLinkInfo->esslVersion = stream.getBe32();
+    android::base::loadBuffer(&stream, &outShaderLinkInfo->uniforms,
+                              loadPlainVariable<sh::Uniform>);
+    android::base::loadBuffer(&stream, &outShaderLinkInfo->varyings,
+                              loadVarying);
+    android::base::loadBuffer(&stream, &outShaderLinkInfo->attributes,
+                              loadVariableWithLocation<sh::Attribute>);
+    android::base::loadBuffer(&stream, &outShaderLinkInfo->outputVars,
+                              loadVariableWithLocation<sh::OutputVariable>);
+    android::base::loadBuffer(&stream, &outShaderLinkInfo->interfaceBlocks,
+                              loadInterfaceBlock);
+    outShaderLinkInfo->nameMap.clear();
+    outShaderLinkInfo->nameMapReverse.clear();
+    android::base::loadCollection(
+            &stream, &outShaderLinkInfo->nameMap, [](Stream* stream) {
+                std::string name = stream->getString();
+                return std::make_pair(std::move(name), stream->getString());
+            });
+    for (const auto& elt : outShaderLinkInfo->nameMap) {
+        outShaderLinkInfo->nameMapReverse[elt.second] = elt.first;
+    }
+    return res;
+}
+
 bool translate(bool hostUsesCoreProfile,
                const char* src,
                GLenum shaderType,
@@ -241,6 +433,20 @@ bool translate(bool hostUsesCoreProfile,
         return false;
     }
 
+    // Apps compile the same shaders each time they start, and instances of
+    // the same AVD run the same apps: look for an earlier translation first.
+    ShaderCache* cache = ShaderCache::get();
+    std::string cacheKey;
+    if (cache) {
+        cacheKey = translationCacheKey(hostUsesCoreProfile, src, shaderType,
+                                       esslVersion);
+        std::string cached;
+        if (cache->lookup(cacheKey, &cached)) {
+            return loadTranslation(cached, outInfolog, outObjCode,
+                                   outShaderLinkInfo);
+        }
+    }
+
     // ANGLE may crash if multiple RenderThreads attempt to compile shaders
     // at the same time.
     android::base::AutoLock autolock(kCompilerLock);
@@ -268,9 +474,20 @@ bool translate(bool hostUsesCoreProfile,
     *outInfolog = std::string(ShGetInfoLog(compilerHandle));
     *outObjCode = std::string(ShGetObjectCode(compilerHandle));
 
+    ShaderLinkInfo linkInfo;
+    if (!outShaderLinkInfo && cache) {
+        // The cache entry is for all callers, whether they want it or not.
+        outShaderLinkInfo = &linkInfo;
+    }
     if (outShaderLinkInfo) getShaderLinkInfo(esslVersion, compilerHandle, outShaderLinkInfo);
 
     ShClearResults(compilerHandle);
+    autolock.unlock();
+
+    if (cache) {
+        cache->store(cacheKey, saveTranslation(res, *outInfolog, *outObjCode,
+                                               *outShaderLinkInfo));
+    }
 
     return res;
 }
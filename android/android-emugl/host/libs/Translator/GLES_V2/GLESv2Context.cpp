@@ -674,6 +674,18 @@ void GLESv2Context::setBindSampler(GLuint unit, GLuint sampler) {
     m_bindSampler[unit] = sampler;
 }
 
+bool GLESv2Context::unbindSampler(GLuint sampler) {
+    if (!sampler) return false;
+    bool found = false;
+    for (auto& bindSampler : m_bindSampler) {
+        if (bindSampler.second == sampler) {
+            bindSampler.second = 0;
+            found = true;
+        }
+    }
+    return found;
+}
+
 bool GLESv2Context::needConvert(GLESConversionArrays& cArrs,GLint first,GLsizei count,GLenum type,const GLvoid* indices,bool direct,GLESpointer* p,GLenum array_id) {
 
     bool usingVBO = p->getAttribType() == GLESpointer::BUFFER;
@@ -851,9 +863,9 @@ void GLESv2Context::bindIndexedBuffer(GLenum target,
     GLEScontext::bindIndexedBuffer(target, index, buffer);
 }
 
-void GLESv2Context::unbindBuffer(GLuint buffer) {
+bool GLESv2Context::unbindBuffer(GLuint buffer) {
     if (m_glesMajorVersion >= 3) {
         boundTransformFeedback()->unbindBuffer(buffer);
     }
-    GLEScontext::unbindBuffer(buffer);
+    return GLEScontext::unbindBuffer(buffer);
 }
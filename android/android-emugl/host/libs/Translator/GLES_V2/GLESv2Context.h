@@ -63,6 +63,9 @@ public:
     void setVertexAttribBindingIndex(GLuint attribindex, GLuint bindingindex);
     void setVertexAttribFormat(GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint reloffset, bool isInt = false);
     void setBindSampler(GLuint unit, GLuint sampler);
+    // Clears the bindings of a deleted |sampler|, returns whether it was
+    // bound.
+    bool unbindSampler(GLuint sampler);
     int  getMaxCombinedTexUnits() override;
     int  getMaxTexUnits() override;
 
@@ -110,7 +113,7 @@ public:
                            GLintptr stride = 0,
                            bool isBindBase = false) override;
     void bindIndexedBuffer(GLenum target, GLuint index, GLuint buffer) override;
-    void unbindBuffer(GLuint buffer) override;
+    bool unbindBuffer(GLuint buffer) override;
 
     static void setMaxGlesVersion(GLESVersion version);
 
@@ -34,6 +34,7 @@
 #include "GLcommon/FramebufferData.h"
 #include "GLcommon/GLutils.h"
 #include "GLcommon/SaveableTexture.h"
+#include "GLcommon/ShaderCache.h"
 #include "GLcommon/TextureData.h"
 #include "GLcommon/TextureUtils.h"
 #include "GLcommon/TranslatorIfaces.h"
@@ -45,6 +46,7 @@
 
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/metrics.h"
+#include "emugl/common/misc.h"
 
 #include "ANGLEShaderParser.h"
 
@@ -1068,6 +1070,8 @@ GL_APICALL GLuint GL_APIENTRY glCreateShader(GLenum type){
                 minProgramTexelOffset,
                 maxProgramTexelOffset,
                 maxDualSourceDrawBuffers);
+
+        ShaderCache::initialize(emugl::getShaderCacheDir());
     }
     RET_AND_SET_ERROR_IF(!GLESv2Validate::shaderType(ctx, type), GL_INVALID_ENUM, 0);
     if(ctx->shareGroup().get()) {
@@ -1106,11 +1110,15 @@ GL_APICALL void  GL_APIENTRY glDeleteBuffers(GLsizei n, const GLuint* buffers){
     GET_CTX();
     SET_ERROR_IF(n<0,GL_INVALID_VALUE);
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i < n; i++){
             ctx->shareGroup()->deleteName(NamedObjectType::VERTEXBUFFER,
                                           buffers[i]);
-            ctx->unbindBuffer(buffers[i]);
+            bound |= ctx->unbindBuffer(buffers[i]);
         }
+        // The host unbinds deleted objects from this context only when it
+        // deletes them, so don't batch those.
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
@@ -1178,7 +1186,13 @@ GL_APICALL void  GL_APIENTRY glDeleteRenderbuffers(GLsizei n, const GLuint* rend
     GET_CTX();
     SET_ERROR_IF(n<0,GL_INVALID_VALUE);
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i < n; i++){
+            if (renderbuffers[i] &&
+                ctx->getRenderbufferBinding() == renderbuffers[i]) {
+                ctx->setRenderbufferBinding(0);
+                bound = true;
+            }
             ctx->shareGroup()->deleteName(NamedObjectType::RENDERBUFFER,
                                           renderbuffers[i]);
             s_detachFromFramebuffer(NamedObjectType::RENDERBUFFER,
@@ -1186,6 +1200,8 @@ GL_APICALL void  GL_APIENTRY glDeleteRenderbuffers(GLsizei n, const GLuint* rend
             s_detachFromFramebuffer(NamedObjectType::RENDERBUFFER,
                                     renderbuffers[i], GL_READ_FRAMEBUFFER);
         }
+        // See glDeleteBuffers().
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
@@ -1193,8 +1209,10 @@ GL_APICALL void  GL_APIENTRY glDeleteTextures(GLsizei n, const GLuint* textures)
     GET_CTX();
     SET_ERROR_IF(n<0,GL_INVALID_VALUE);
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i < n; i++){
             if (textures[i]!=0) {
+                bound |= ctx->isTextureBound(textures[i]);
                 if (ctx->getBindedTexture(GL_TEXTURE_2D) == textures[i])
                     ctx->setBindedTexture(GL_TEXTURE_2D,0);
                 if (ctx->getBindedTexture(GL_TEXTURE_CUBE_MAP) == textures[i])
@@ -1211,6 +1229,8 @@ GL_APICALL void  GL_APIENTRY glDeleteTextures(GLsizei n, const GLuint* textures)
                                               textures[i]);
             }
         }
+        // See glDeleteBuffers(); this covers the other texture units too.
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
@@ -1470,10 +1490,12 @@ GL_APICALL void  GL_APIENTRY glEnableVertexAttribArray(GLuint index){
 
 GL_APICALL void  GL_APIENTRY glFinish(void){
     GET_CTX();
+    ctx->flushDeletedNames();
     ctx->dispatcher().glFinish();
 }
 GL_APICALL void  GL_APIENTRY glFlush(void){
     GET_CTX();
+    ctx->flushDeletedNames();
     ctx->dispatcher().glFlush();
 }
 
@@ -2989,7 +3011,7 @@ GL_APICALL void  GL_APIENTRY glLinkProgram(GLuint program){
                 ShaderParser* vertSp = (ShaderParser*)vertObjData;
 
                 if(fragSp->getCompileStatus() && vertSp->getCompileStatus()) {
-                    ctx->dispatcher().glLinkProgram(globalProgramName);
+                    programData->linkHostProgram(globalProgramName);
                     ctx->dispatcher().glGetProgramiv(globalProgramName,GL_LINK_STATUS,&linkStatus);
                     programData->setHostLinkStatus(linkStatus);
                     if (!programData->validateLink(fragSp, vertSp)) {
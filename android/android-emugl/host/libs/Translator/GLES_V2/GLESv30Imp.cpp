@@ -840,6 +840,10 @@ extern "C" GL_APICALL void GL_APIENTRY glTransformFeedbackVaryings(GLuint progra
     if (ctx->shareGroup().get()) {
         const GLuint globalProgramName = ctx->shareGroup()->getGlobalName(NamedObjectType::SHADER_OR_PROGRAM, program);
         ctx->dispatcher().glTransformFeedbackVaryings(globalProgramName, count, varyings, bufferMode);
+        auto objData = ctx->shareGroup()->getObjectData(NamedObjectType::SHADER_OR_PROGRAM, program);
+        if (objData && objData->getDataType() == PROGRAM_DATA) {
+            ((ProgramData*)objData)->setUsesTransformFeedbackVaryings();
+        }
     }
 }
 
@@ -870,9 +874,13 @@ GL_APICALL void GL_APIENTRY glDeleteSamplers(GLsizei n, const GLuint * samplers)
     SET_ERROR_IF(n < 0,GL_INVALID_VALUE);
 
     if(ctx->shareGroup().get()) {
+        bool bound = false;
         for(int i=0; i<n ;i++) {
             ctx->shareGroup()->deleteName(NamedObjectType::SAMPLER, samplers[i]);
+            bound |= ctx->unbindSampler(samplers[i]);
         }
+        // The host unbinds deleted samplers only when it deletes them.
+        if (bound) ctx->flushDeletedNames();
     }
 }
 
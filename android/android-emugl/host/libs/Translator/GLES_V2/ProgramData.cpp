@@ -18,17 +18,21 @@
 #include "OpenglCodecCommon/glUtils.h"
 
 #include "android/base/containers/Lookup.h"
+#include "android/base/files/MemStream.h"
 #include "android/base/files/StreamSerializing.h"
 #include "ANGLEShaderParser.h"
 #include "GLcommon/GLutils.h"
 #include "GLcommon/GLESmacros.h"
+#include "GLcommon/ShaderCache.h"
 #include "GLcommon/ShareGroup.h"
 
 #include <GLES3/gl31.h>
+#include <map>
 #include <string.h>
 #include <unordered_set>
 
 using android::base::c_str;
+using android::base::MemStream;
 using android::base::StringView;
 
 GLUniformDesc::GLUniformDesc(const char* name, GLint location, GLsizei count, GLboolean transpose,
@@ -730,6 +734,101 @@ void ProgramData::linkedAttribLocation(const std::string& var, GLuint loc) {
     linkedAttribLocs[var] = loc;
 }
 
+// Bump when what the program binary cache keys on changes.
+static constexpr uint32_t kProgramBinaryCacheVersion = 1;
+
+static bool sHostSupportsProgramBinaries() {
+    static const bool supported = [] {
+        GLDispatch& dispatcher = GLEScontext::dispatcher();
+        if (!dispatcher.glProgramBinary || !dispatcher.glGetProgramBinary ||
+            !dispatcher.glProgramParameteri) {
+            return false;
+        }
+        GLint formats = 0;
+        dispatcher.glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        // Clear GL errors if the underlying GL doesn't have the enum.
+        dispatcher.glGetError();
+        return formats > 0;
+    }();
+    return supported;
+}
+
+// Everything the host link depends on: the host GL, the sources the host
+// compiled the shaders from, and the attribute bindings.
+std::string ProgramData::hostProgramCacheKey() const {
+    GLDispatch& dispatcher = GLEScontext::dispatcher();
+    MemStream stream;
+    stream.putString("host-program");
+    stream.putBe32(kProgramBinaryCacheVersion);
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const GLubyte* str = dispatcher.glGetString(name);
+        stream.putString(str ? (const char*)str : "");
+    }
+    for (const auto& s : attachedShaders) {
+        stream.putString(s.shader ? s.shader->getCompiledSrc() : "");
+    }
+    const std::map<std::string, GLuint> attribLocs(boundAttribLocs.begin(),
+                                                   boundAttribLocs.end());
+    saveCollection(&stream, attribLocs,
+                   [](android::base::Stream* stream,
+                      const std::pair<const std::string, GLuint>& attribLoc) {
+                       stream->putString(attribLoc.first);
+                       stream->putBe32(attribLoc.second);
+                   });
+    return std::string(stream.buffer().begin(), stream.buffer().end());
+}
+
+void ProgramData::linkHostProgram(GLuint globalName) {
+    GLDispatch& dispatcher = GLEScontext::dispatcher();
+    ShaderCache* cache = ShaderCache::get();
+    if (!cache || mUsesTransformFeedbackVaryings ||
+        !sHostSupportsProgramBinaries()) {
+        dispatcher.glLinkProgram(globalName);
+        return;
+    }
+
+    // Entries are the binary format followed by the binary.
+    const std::string key = hostProgramCacheKey();
+    std::string entry;
+    GLenum format = 0;
+    if (cache->lookup(key, &entry) && entry.size() > sizeof(format)) {
+        memcpy(&format, entry.data(), sizeof(format));
+        dispatcher.glProgramBinary(globalName, format,
+                                   entry.data() + sizeof(format),
+                                   entry.size() - sizeof(format));
+        GLint linkStatus = GL_FALSE;
+        dispatcher.glGetProgramiv(globalName, GL_LINK_STATUS, &linkStatus);
+        if (linkStatus) {
+            return;
+        }
+        // The driver can reject any binary, e.g. after it was updated
+        // without its version string changing; link as usual then.
+    }
+
+    dispatcher.glProgramParameteri(globalName,
+                                   GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    dispatcher.glLinkProgram(globalName);
+    GLint linkStatus = GL_FALSE;
+    dispatcher.glGetProgramiv(globalName, GL_LINK_STATUS, &linkStatus);
+    GLint length = 0;
+    if (linkStatus) {
+        dispatcher.glGetProgramiv(globalName, GL_PROGRAM_BINARY_LENGTH,
+                                  &length);
+    }
+    if (length <= 0) {
+        return;
+    }
+    entry.assign(sizeof(format) + length, '\0');
+    dispatcher.glGetProgramBinary(globalName, length, &length, &format,
+                                  &entry[sizeof(format)]);
+    if (length <= 0) {
+        return;
+    }
+    memcpy(&entry[0], &format, sizeof(format));
+    entry.resize(sizeof(format) + length);
+    cache->store(key, entry);
+}
+
 // Link-time validation
 void ProgramData::appendValidationErrMsg(std::ostringstream& ss) {
     validationInfoLog += "Error: " + ss.str() + "\n";
@@ -82,6 +82,15 @@ public:
     void bindAttribLocation(const std::string& var, GLuint loc);
     void linkedAttribLocation(const std::string& var, GLuint loc);
 
+    // Links |globalName| on the host, from the shader cache's program
+    // binary when there is one for the attached shaders and bindings.
+    void linkHostProgram(GLuint globalName);
+    // The varyings aren't part of the program binary cache key, so programs
+    // that set them are always linked.
+    void setUsesTransformFeedbackVaryings() {
+        mUsesTransformFeedbackVaryings = true;
+    }
+
     void appendValidationErrMsg(std::ostringstream& ss);
     bool validateLink(ShaderParser* frag, ShaderParser* vert);
 
@@ -140,10 +149,12 @@ private:
     std::unordered_map<GLuint, GLuint> mUniformBlockBinding;
     std::vector<std::string> mTransformFeedbacks;
     GLenum mTransformFeedbackBufferMode = 0;
+    bool mUsesTransformFeedbackVaryings = false;
 
     int mGlesMajorVersion = 2;
     int mGlesMinorVersion = 0;
     std::unordered_map<GLuint, GLUniformDesc> collectUniformInfo() const;
+    std::string hostProgramCacheKey() const;
     void getUniformValue(const GLchar *name, GLenum type,
             std::unordered_map<GLuint, GLUniformDesc> &uniformsOnSave) const;
 
@@ -0,0 +1,145 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Decodes square RGB8 / RGBA8 textures of range_x() pixels on a side, tiled
+// with the blocks of Etc2_unittest: etc2_decode_image() on the calling
+// thread, then EtcDecoder with its workers, then EtcDecoder hitting its
+// cache. Times are wall clock, as the workers' CPU time isn't counted.
+
+#include <GLcommon/EtcDecoder.h>
+
+#include "benchmark/benchmark_api.h"
+
+#include <vector>
+
+namespace {
+
+// One block of each of the RGB modes, from Etc2_unittest.
+const etc1_byte kRgbBlocks[][8] = {
+        {140, 74, 38, 40, 90, 60, 195, 150},      // individual
+        {132, 82, 161, 123, 240, 15, 51, 204},    // differential
+        {21, 101, 186, 135, 166, 238, 74, 106},   // T
+        {110, 13, 228, 186, 119, 119, 255, 117},  // H
+        {89, 138, 250, 79, 120, 181, 146, 29},    // planar
+};
+
+const etc1_byte kAlphaBlock[8] = {101, 65, 229, 178, 147, 5, 32, 2};
+
+struct Texture {
+    ETC2ImageFormat format;
+    etc1_uint32 size;
+    etc1_uint32 stride;
+    std::vector<etc1_byte> encoded;
+    std::vector<etc1_byte> decoded;
+
+    Texture(ETC2ImageFormat format, etc1_uint32 size)
+        : format(format),
+          size(size),
+          stride(size * etc_get_decoded_pixel_size(format)),
+          decoded(stride * size) {
+        const etc1_uint32 blocks = (size / 4) * (size / 4);
+        for (etc1_uint32 i = 0; i < blocks; i++) {
+            if (format == EtcRGBA8) {
+                encoded.insert(encoded.end(), kAlphaBlock, kAlphaBlock + 8);
+            }
+            const auto& block = kRgbBlocks[i % 5];
+            encoded.insert(encoded.end(), block, block + 8);
+        }
+    }
+
+    void setBytesProcessed(benchmark::State& state) const {
+        state.SetBytesProcessed(int64_t(state.iterations()) * decoded.size());
+    }
+};
+
+void decodeSerially(benchmark::State& state, ETC2ImageFormat format) {
+    Texture texture(format, state.range_x());
+    while (state.KeepRunning()) {
+        etc2_decode_image(texture.encoded.data(), format,
+                          texture.decoded.data(), texture.size, texture.size,
+                          texture.stride);
+    }
+    texture.setBytesProcessed(state);
+}
+
+void decodeWithDecoder(benchmark::State& state,
+                       ETC2ImageFormat format,
+                       size_t cacheBytes) {
+    Texture texture(format, state.range_x());
+    EtcDecoder decoder(cacheBytes, 0);
+    while (state.KeepRunning()) {
+        decoder.decode(texture.encoded.data(), format, texture.decoded.data(),
+                       texture.size, texture.size, texture.stride);
+    }
+    texture.setBytesProcessed(state);
+}
+
+}  // namespace
+
+static void BM_DecodeRgb8_Serial(benchmark::State& state) {
+    decodeSerially(state, EtcRGB8);
+}
+
+static void BM_DecodeRgb8_Parallel(benchmark::State& state) {
+    decodeWithDecoder(state, EtcRGB8, 0);
+}
+
+static void BM_DecodeRgb8_Cached(benchmark::State& state) {
+    decodeWithDecoder(state, EtcRGB8, 256 * 1024 * 1024);
+}
+
+static void BM_DecodeRgba8_Serial(benchmark::State& state) {
+    decodeSerially(state, EtcRGBA8);
+}
+
+static void BM_DecodeRgba8_Parallel(benchmark::State& state) {
+    decodeWithDecoder(state, EtcRGBA8, 0);
+}
+
+static void BM_DecodeRgba8_Cached(benchmark::State& state) {
+    decodeWithDecoder(state, EtcRGBA8, 256 * 1024 * 1024);
+}
+
+BENCHMARK(BM_DecodeRgb8_Serial)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+BENCHMARK(BM_DecodeRgb8_Parallel)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+BENCHMARK(BM_DecodeRgb8_Cached)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+BENCHMARK(BM_DecodeRgba8_Serial)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+BENCHMARK(BM_DecodeRgba8_Parallel)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+BENCHMARK(BM_DecodeRgba8_Cached)
+        ->Arg(256)
+        ->Arg(1024)
+        ->Arg(2048)
+        ->UseRealTime();
+
+BENCHMARK_MAIN()
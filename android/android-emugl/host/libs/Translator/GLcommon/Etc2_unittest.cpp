@@ -84,6 +84,37 @@ TEST_F(Etc2Test, ETC2P) {
     decodeRgbTest((const etc1_byte*)encoded, (const etc1_byte*)expectedDecoded);
 }
 
+// The individual and differential modes, which ETC2 keeps from ETC1.
+TEST_F(Etc2Test, ETC1Individual) {
+    const unsigned char encoded[cRgbEncodedSize] = {140, 74, 38, 40, 90, 60, 195, 150};
+    const unsigned char expectedDecoded[cRgbPatchSize] = {
+        141, 73, 39,   119, 51, 17,   233, 199, 131,  195, 161, 93,
+        153, 85, 51,   131, 63, 29,   175, 141, 73,   213, 179, 111,
+        119, 51, 17,   141, 73, 39,   213, 179, 111,  175, 141, 73,
+        131, 63, 29,   153, 85, 51,   195, 161, 93,   233, 199, 131};
+    decodeRgbTest((const etc1_byte*)encoded, (const etc1_byte*)expectedDecoded);
+}
+
+TEST_F(Etc2Test, ETC1DifferentialFlipped) {
+    const unsigned char encoded[cRgbEncodedSize] = {132, 82, 161, 123, 240, 15, 51, 204};
+    const unsigned char expectedDecoded[cRgbPatchSize] = {
+        119, 69, 152,  145, 95, 178,  174, 124, 207,  90, 40, 123,
+        119, 69, 152,  145, 95, 178,  174, 124, 207,  90, 40, 123,
+        0, 0, 67,      205, 205, 255, 132, 132, 206,  66, 66, 140,
+        0, 0, 67,      205, 205, 255, 132, 132, 206,  66, 66, 140};
+    decodeRgbTest((const etc1_byte*)encoded, (const etc1_byte*)expectedDecoded);
+}
+
+TEST_F(Etc2Test, ETC1IndividualFlippedClamped) {
+    const unsigned char encoded[cRgbEncodedSize] = {241, 226, 15, 253, 18, 52, 86, 120};
+    const unsigned char expectedDecoded[cRgbPatchSize] = {
+        255, 255, 47,  72, 55, 0,     255, 255, 47,   72, 55, 0,
+        255, 255, 47,  72, 55, 0,     72, 55, 0,      255, 255, 47,
+        0, 0, 208,     200, 217, 255, 200, 217, 255,  200, 217, 255,
+        200, 217, 255, 64, 81, 255,   64, 81, 255,    64, 81, 255};
+    decodeRgbTest((const etc1_byte*)encoded, (const etc1_byte*)expectedDecoded);
+}
+
 // EAC alpha decoder tests.
 TEST_F(Etc2Test, EAC_Alpha) {
     const unsigned char encoded[cAlphaEncodedSize]
@@ -0,0 +1,254 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/EtcDecoder.h"
+
+#include "android/base/Optional.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/synchronization/ConditionVariable.h"
+#include "android/base/synchronization/Lock.h"
+#include "android/base/system/System.h"
+#include "android/base/threads/ThreadPool.h"
+
+#include "MurmurHash3.h"
+
+#include <algorithm>
+#include <array>
+#include <list>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+using android::base::AutoLock;
+using android::base::ConditionVariable;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::Optional;
+using android::base::System;
+using android::base::ThreadPool;
+
+namespace {
+
+// Smaller images decode faster than the workers would wake up.
+constexpr etc1_uint32 kMinParallelBlocks = 64 * 64;
+constexpr etc1_uint32 kMinBandBlockRows = 16;
+
+constexpr size_t kDefaultCacheBytes = 64 * 1024 * 1024;
+constexpr int kMaxDefaultThreads = 8;
+
+struct Key {
+    std::array<uint64_t, 2> hash;
+    ETC2ImageFormat format;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 stride;
+
+    bool operator==(const Key& other) const {
+        return hash == other.hash && format == other.format &&
+               width == other.width && height == other.height &&
+               stride == other.stride;
+    }
+};
+
+struct KeyHash {
+    size_t operator()(const Key& key) const { return key.hash[0]; }
+};
+
+// The bands of one decode() call, and how many are still running.
+struct Batch {
+    Lock lock;
+    ConditionVariable cv;
+    int pending = 0;
+    int result = 0;
+};
+
+struct Band {
+    const etc1_byte* pIn;
+    ETC2ImageFormat format;
+    etc1_byte* pOut;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 stride;
+    Batch* batch;
+};
+
+}  // namespace
+
+class EtcDecoder::Impl {
+public:
+    Impl(size_t cacheBytes, int threads) : mCacheBytes(cacheBytes) {
+        if (threads < 1) {
+            threads = std::min(System::get()->getCpuCoreCount(),
+                               kMaxDefaultThreads);
+        }
+        mWorkers.emplace(threads, [](Band&& band) {
+            const int result =
+                    etc2_decode_image(band.pIn, band.format, band.pOut,
+                                      band.width, band.height, band.stride);
+            AutoLock lock(band.batch->lock);
+            if (result) {
+                band.batch->result = result;
+            }
+            // Signal with the lock held: the batch is gone as soon as
+            // decodeImage() sees it done.
+            if (--band.batch->pending == 0) {
+                band.batch->cv.signal();
+            }
+        });
+        if (!mWorkers->start()) {
+            mWorkers.clear();
+        }
+    }
+
+    int decode(const etc1_byte* pIn,
+               ETC2ImageFormat format,
+               etc1_byte* pOut,
+               etc1_uint32 width,
+               etc1_uint32 height,
+               etc1_uint32 stride) {
+        const size_t decodedSize = size_t(stride) * height;
+        if (!mCacheBytes || decodedSize > mCacheBytes / 4) {
+            return decodeImage(pIn, format, pOut, width, height, stride);
+        }
+
+        Key key = {{}, format, width, height, stride};
+        MurmurHash3_x64_128(pIn, etc_get_encoded_data_size(format, width, height),
+                            0, key.hash.data());
+        {
+            AutoLock lock(mLock);
+            auto it = mEntries.find(key);
+            if (it != mEntries.end()) {
+                ++mStats.hits;
+                mLru.splice(mLru.begin(), mLru, it->second);
+                // Copy under the lock, so the entry can't be evicted
+                // meanwhile.
+                memcpy(pOut, it->second->data.data(), decodedSize);
+                return 0;
+            }
+            ++mStats.misses;
+        }
+
+        const int result =
+                decodeImage(pIn, format, pOut, width, height, stride);
+        if (result) {
+            return result;
+        }
+
+        AutoLock lock(mLock);
+        if (mEntries.count(key)) {
+            // Another thread decoded the same image meanwhile.
+            return 0;
+        }
+        while (mCachedBytes + decodedSize > mCacheBytes) {
+            mCachedBytes -= mLru.back().data.size();
+            mEntries.erase(mLru.back().key);
+            mLru.pop_back();
+        }
+        mLru.push_front({key, std::vector<etc1_byte>(pOut, pOut + decodedSize)});
+        mEntries.emplace(key, mLru.begin());
+        mCachedBytes += decodedSize;
+        return 0;
+    }
+
+    Stats stats() const {
+        AutoLock lock(mLock);
+        return mStats;
+    }
+
+private:
+    struct Entry {
+        Key key;
+        std::vector<etc1_byte> data;
+    };
+
+    int decodeImage(const etc1_byte* pIn,
+                    ETC2ImageFormat format,
+                    etc1_byte* pOut,
+                    etc1_uint32 width,
+                    etc1_uint32 height,
+                    etc1_uint32 stride) {
+        const etc1_uint32 blockRows = (height + 3) / 4;
+        const etc1_uint32 blocks = blockRows * ((width + 3) / 4);
+        if (!mWorkers || blocks < kMinParallelBlocks) {
+            return etc2_decode_image(pIn, format, pOut, width, height, stride);
+        }
+
+        // One band for each worker and one for this thread.
+        const etc1_uint32 bandBlockRows = std::max(
+                kMinBandBlockRows,
+                (blockRows + mWorkers->numWorkers()) /
+                        (mWorkers->numWorkers() + 1));
+        const size_t blockRowSize = etc_get_encoded_data_size(format, width, 4);
+
+        Batch batch;
+        etc1_uint32 row = 0;
+        {
+            AutoLock lock(batch.lock);
+            for (; row + bandBlockRows < blockRows; row += bandBlockRows) {
+                ++batch.pending;
+                mWorkers->enqueue({pIn + row * blockRowSize, format,
+                                   pOut + size_t(row) * 4 * stride, width,
+                                   bandBlockRows * 4, stride, &batch});
+            }
+        }
+        int result = etc2_decode_image(pIn + row * blockRowSize, format,
+                                       pOut + size_t(row) * 4 * stride, width,
+                                       height - row * 4, stride);
+
+        AutoLock lock(batch.lock);
+        batch.cv.wait(&lock, [&batch] { return batch.pending == 0; });
+        return result ? result : batch.result;
+    }
+
+    const size_t mCacheBytes;
+    Optional<ThreadPool<Band>> mWorkers;
+
+    mutable Lock mLock;
+    std::list<Entry> mLru;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> mEntries;
+    size_t mCachedBytes = 0;
+    Stats mStats;
+};
+
+EtcDecoder::EtcDecoder(size_t cacheBytes, int threads)
+    : mImpl(new Impl(cacheBytes, threads)) {}
+
+EtcDecoder::~EtcDecoder() = default;
+
+namespace {
+
+struct GlobalEtcDecoder {
+    EtcDecoder decoder{kDefaultCacheBytes, 0};
+};
+
+LazyInstance<GlobalEtcDecoder> sGlobalEtcDecoder = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+EtcDecoder* EtcDecoder::get() {
+    return &sGlobalEtcDecoder->decoder;
+}
+
+int EtcDecoder::decode(const etc1_byte* pIn,
+                       ETC2ImageFormat format,
+                       etc1_byte* pOut,
+                       etc1_uint32 width,
+                       etc1_uint32 height,
+                       etc1_uint32 stride) {
+    return mImpl->decode(pIn, format, pOut, width, height, stride);
+}
+
+EtcDecoder::Stats EtcDecoder::stats() const {
+    return mImpl->stats();
+}
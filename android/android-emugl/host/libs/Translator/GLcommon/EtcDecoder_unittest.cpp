@@ -0,0 +1,144 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/EtcDecoder.h>
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+struct Image {
+    ETC2ImageFormat format;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 stride;
+    std::vector<etc1_byte> encoded;
+
+    Image(ETC2ImageFormat format,
+          etc1_uint32 width,
+          etc1_uint32 height,
+          uint32_t seed)
+        : format(format),
+          width(width),
+          height(height),
+          stride((width * etc_get_decoded_pixel_size(format) + 3) & ~3),
+          encoded(etc_get_encoded_data_size(format, width, height)) {
+        // Random blocks go through all of the ETC2 modes.
+        std::mt19937 random(seed);
+        for (auto& byte : encoded) {
+            byte = random();
+        }
+    }
+
+    std::vector<etc1_byte> decode(EtcDecoder* decoder) const {
+        std::vector<etc1_byte> decoded(stride * height);
+        EXPECT_EQ(0, decoder->decode(encoded.data(), format, decoded.data(),
+                                     width, height, stride));
+        return decoded;
+    }
+
+    std::vector<etc1_byte> decodeSerially() const {
+        std::vector<etc1_byte> decoded(stride * height);
+        EXPECT_EQ(0, etc2_decode_image(encoded.data(), format, decoded.data(),
+                                       width, height, stride));
+        return decoded;
+    }
+
+    // The row padding isn't written by either decoder.
+    void expectSame(const std::vector<etc1_byte>& expected,
+                    const std::vector<etc1_byte>& actual) const {
+        const size_t rowSize = width * etc_get_decoded_pixel_size(format);
+        for (etc1_uint32 y = 0; y < height; y++) {
+            EXPECT_EQ(0, memcmp(&expected[y * stride], &actual[y * stride],
+                                rowSize))
+                    << "format " << format << ", row " << y;
+        }
+    }
+};
+
+const ETC2ImageFormat kFormats[] = {
+        EtcRGB8,        EtcRGBA8, EtcR11,   EtcSignedR11,
+        EtcRG11,        EtcSignedRG11,      EtcRGB8A1,
+};
+
+}  // namespace
+
+// Large enough to be split between the workers, and not a multiple of the
+// block size so that the last band is a partial one.
+TEST(EtcDecoder, ParallelMatchesSerial) {
+    EtcDecoder decoder(0, 4);
+    for (auto format : kFormats) {
+        const Image image(format, 517, 301, format);
+        image.expectSame(image.decodeSerially(), image.decode(&decoder));
+    }
+    EXPECT_EQ(0u, decoder.stats().hits);
+    EXPECT_EQ(0u, decoder.stats().misses);
+}
+
+TEST(EtcDecoder, SmallImage) {
+    EtcDecoder decoder(0, 4);
+    for (auto format : kFormats) {
+        const Image image(format, 7, 3, format);
+        image.expectSame(image.decodeSerially(), image.decode(&decoder));
+    }
+}
+
+TEST(EtcDecoder, CacheHit) {
+    EtcDecoder decoder(16 * 1024 * 1024, 2);
+    const Image image(EtcRGBA8, 300, 200, 1);
+    const auto first = image.decode(&decoder);
+    const auto second = image.decode(&decoder);
+    image.expectSame(image.decodeSerially(), first);
+    image.expectSame(first, second);
+    EXPECT_EQ(1u, decoder.stats().hits);
+    EXPECT_EQ(1u, decoder.stats().misses);
+
+    // Same size, different data.
+    const Image other(EtcRGBA8, 300, 200, 2);
+    other.expectSame(other.decodeSerially(), other.decode(&decoder));
+    EXPECT_EQ(1u, decoder.stats().hits);
+    EXPECT_EQ(2u, decoder.stats().misses);
+
+    // Same data, different format.
+    Image reinterpreted = image;
+    reinterpreted.format = EtcRG11;
+    reinterpreted.stride = reinterpreted.width * 8;
+    reinterpreted.expectSame(reinterpreted.decodeSerially(),
+                             reinterpreted.decode(&decoder));
+    EXPECT_EQ(1u, decoder.stats().hits);
+    EXPECT_EQ(3u, decoder.stats().misses);
+}
+
+TEST(EtcDecoder, CacheEviction) {
+    // Room for 4 of the 32x32 RGBA images.
+    EtcDecoder decoder(16 * 1024, 1);
+    std::vector<Image> images;
+    for (uint32_t i = 0; i < 5; i++) {
+        images.emplace_back(EtcRGBA8, 32, 32, i);
+        images.back().decode(&decoder);
+    }
+    EXPECT_EQ(5u, decoder.stats().misses);
+
+    // The first one went out to make room for the last one.
+    images[4].decode(&decoder);
+    images[1].decode(&decoder);
+    EXPECT_EQ(2u, decoder.stats().hits);
+    images[0].expectSame(images[0].decodeSerially(),
+                         images[0].decode(&decoder));
+    EXPECT_EQ(6u, decoder.stats().misses);
+}
@@ -46,7 +46,7 @@ intptr_t GLBackgroundLoader::main() {
     }
 
     for (const auto& it : m_textureMap) {
-        if (m_interrupted.load(std::memory_order_relaxed)) break;
+        if (!restorePrioritized()) break;
 
         // Acquire the texture loader for each load; bail
         // in case something else happened to interrupt loading.
@@ -65,6 +65,7 @@ intptr_t GLBackgroundLoader::main() {
         }
     }
 
+    restorePrioritized();
     m_textureMap.clear();
 
     m_eglIface.unbindAuxiliaryContext();
@@ -78,6 +79,33 @@ intptr_t GLBackgroundLoader::main() {
     return 0;
 }
 
+bool GLBackgroundLoader::restorePrioritized() {
+    for (;;) {
+        if (m_interrupted.load(std::memory_order_relaxed)) return false;
+
+        SaveableTexturePtr saveable;
+        {
+            android::base::AutoLock lock(m_priorityLock);
+            if (m_priorityQueue.empty()) return true;
+            saveable = std::move(m_priorityQueue.front());
+            m_priorityQueue.pop_front();
+        }
+
+        auto ptr = m_textureLoaderWPtr.lock();
+        if (!ptr) return false;
+
+        // No delay here: these are waited for by the user. Restoring one
+        // that was restored already is a no-op.
+        m_glesIface.restoreTexture(saveable.get());
+    }
+}
+
+void GLBackgroundLoader::prioritize(const SaveableTexturePtr& texture) {
+    if (!texture) return;
+    android::base::AutoLock lock(m_priorityLock);
+    m_priorityQueue.push_back(texture);
+}
+
 bool GLBackgroundLoader::wait(intptr_t* exitStatus) {
     m_loadDelayMs.store(0, std::memory_order_relaxed);
     return Thread::wait();
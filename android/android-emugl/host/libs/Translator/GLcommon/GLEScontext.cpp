@@ -441,7 +441,8 @@ void GLEScontext::setActiveTexture(GLenum tex) {
 GLEScontext::GLEScontext() {}
 
 GLEScontext::GLEScontext(GlobalNameSpace* globalNameSpace,
-        android::base::Stream* stream, GlLibrary* glLib) {
+        android::base::Stream* stream, GlLibrary* glLib) :
+        m_globalNameSpace(globalNameSpace) {
     if (stream) {
         m_initialized = stream->getByte();
         m_glesMajorVersion = stream->getBe32();
@@ -1263,7 +1264,8 @@ void GLEScontext::bindIndexedBuffer(GLenum target, GLuint index, GLuint buffer)
     bindIndexedBuffer(target, index, buffer, 0, sz, 0, true);
 }
 
-static void sClearIndexedBufferBinding(GLuint id, std::vector<BufferBinding>& bindings) {
+static bool sClearIndexedBufferBinding(GLuint id, std::vector<BufferBinding>& bindings) {
+    bool found = false;
     for (size_t i = 0; i < bindings.size(); i++) {
         if (bindings[i].buffer == id) {
             bindings[i].offset = 0;
@@ -1271,35 +1273,33 @@ static void sClearIndexedBufferBinding(GLuint id, std::vector<BufferBinding>& bi
             bindings[i].stride = 0;
             bindings[i].buffer = 0;
             bindings[i].isBindBase = false;
+            found = true;
         }
     }
+    return found;
 }
 
-void GLEScontext::unbindBuffer(GLuint buffer) {
-    if (m_arrayBuffer == buffer)
-        m_arrayBuffer = 0;
-    if (m_currVaoState.iboId() == buffer)
-        m_currVaoState.iboId() = 0;
-    if (m_copyReadBuffer == buffer)
-        m_copyReadBuffer = 0;
-    if (m_copyWriteBuffer == buffer)
-        m_copyWriteBuffer = 0;
-    if (m_pixelPackBuffer == buffer)
-        m_pixelPackBuffer = 0;
-    if (m_pixelUnpackBuffer == buffer)
-        m_pixelUnpackBuffer = 0;
-    if (m_transformFeedbackBuffer == buffer)
-        m_transformFeedbackBuffer = 0;
-    if (m_uniformBuffer == buffer)
-        m_uniformBuffer = 0;
-    if (m_atomicCounterBuffer == buffer)
-        m_atomicCounterBuffer = 0;
-    if (m_dispatchIndirectBuffer == buffer)
-        m_dispatchIndirectBuffer = 0;
-    if (m_drawIndirectBuffer == buffer)
-        m_drawIndirectBuffer = 0;
-    if (m_shaderStorageBuffer == buffer)
-        m_shaderStorageBuffer = 0;
+static bool sClearBufferBinding(GLuint id, GLuint& binding) {
+    if (binding != id) return false;
+    binding = 0;
+    return true;
+}
+
+bool GLEScontext::unbindBuffer(GLuint buffer) {
+    if (!buffer) return false;
+    bool found = false;
+    found |= sClearBufferBinding(buffer, m_arrayBuffer);
+    found |= sClearBufferBinding(buffer, m_currVaoState.iboId());
+    found |= sClearBufferBinding(buffer, m_copyReadBuffer);
+    found |= sClearBufferBinding(buffer, m_copyWriteBuffer);
+    found |= sClearBufferBinding(buffer, m_pixelPackBuffer);
+    found |= sClearBufferBinding(buffer, m_pixelUnpackBuffer);
+    found |= sClearBufferBinding(buffer, m_transformFeedbackBuffer);
+    found |= sClearBufferBinding(buffer, m_uniformBuffer);
+    found |= sClearBufferBinding(buffer, m_atomicCounterBuffer);
+    found |= sClearBufferBinding(buffer, m_dispatchIndirectBuffer);
+    found |= sClearBufferBinding(buffer, m_drawIndirectBuffer);
+    found |= sClearBufferBinding(buffer, m_shaderStorageBuffer);
 
     // One might think that indexed buffer bindings for transform feedbacks
     // must be cleared as well, but transform feedbacks are
@@ -1308,10 +1308,11 @@ void GLEScontext::unbindBuffer(GLuint buffer) {
     // glGetIntegeri_v must still return the deleted name [1].
     // sClearIndexedBufferBinding(buffer, m_indexedTransformFeedbackBuffers);
     // [1] OpenGL ES 3.0.5 spec Appendix D.1.3
-    sClearIndexedBufferBinding(buffer, m_indexedUniformBuffers);
-    sClearIndexedBufferBinding(buffer, m_indexedAtomicCounterBuffers);
-    sClearIndexedBufferBinding(buffer, m_indexedShaderStorageBuffers);
-    sClearIndexedBufferBinding(buffer, m_currVaoState.bufferBindings());
+    found |= sClearIndexedBufferBinding(buffer, m_indexedUniformBuffers);
+    found |= sClearIndexedBufferBinding(buffer, m_indexedAtomicCounterBuffers);
+    found |= sClearIndexedBufferBinding(buffer, m_indexedShaderStorageBuffers);
+    found |= sClearIndexedBufferBinding(buffer, m_currVaoState.bufferBindings());
+    return found;
 }
 
 //checks if any buffer is binded to target
@@ -1963,6 +1964,16 @@ void GLEScontext::setBindedTexture(GLenum target, unsigned int tex) {
     m_texState[m_activeTexture][pos].texture = tex;
 }
 
+bool GLEScontext::isTextureBound(unsigned int tex) const {
+    if (!tex || !m_texState) return false;
+    for (int i = 0; i < m_maxTexUnits; ++i) {
+        for (int j = 0; j < NUM_TEXTURE_TARGETS; ++j) {
+            if (m_texState[i][j].texture == tex) return true;
+        }
+    }
+    return false;
+}
+
 void GLEScontext::setTextureEnabled(GLenum target, GLenum enable) {
     TextureTarget pos = GLTextureTargetToLocal(target);
     m_texState[m_activeTexture][pos].enabled = enable;
@@ -2190,6 +2201,12 @@ void GLEScontext::prepareCoreProfileEmulatedTexture(TextureData* texData, bool i
     if (internalformat_out) *internalformat_out = emulatedInternalFormat;
 }
 
+void GLEScontext::flushDeletedNames() {
+    if (m_globalNameSpace) {
+        m_globalNameSpace->flushDeletedNames();
+    }
+}
+
 bool GLEScontext::isFBO(ObjectLocalName p_localName) {
     return m_fboNameSpace->isObject(p_localName);
 }
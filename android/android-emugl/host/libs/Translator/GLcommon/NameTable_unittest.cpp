@@ -0,0 +1,62 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/NameTable.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+TEST(NameTable, EmplaceFindErase) {
+    NameTable<int, 16> table;
+    EXPECT_TRUE(table.empty());
+    EXPECT_EQ(nullptr, table.find(1));
+
+    // Dense and sparse names.
+    for (uint64_t name : {1ull, 5ull, 15ull, 16ull, 1ull << 40}) {
+        const int value = name % 1000;
+        EXPECT_EQ(value, table.emplace(name, value));
+    }
+    EXPECT_EQ(5u, table.size());
+    for (uint64_t name : {1ull, 5ull, 15ull, 16ull, 1ull << 40}) {
+        ASSERT_TRUE(table.find(name));
+        EXPECT_EQ(static_cast<int>(name % 1000), *table.find(name));
+    }
+    EXPECT_FALSE(table.contains(2));
+    EXPECT_FALSE(table.contains(17));
+
+    // emplace() doesn't replace, set() does.
+    EXPECT_EQ(5, table.emplace(5, 42));
+    table.set(5, 42);
+    EXPECT_EQ(42, *table.find(5));
+    table.set(2, 3);
+    EXPECT_EQ(3, *table.find(2));
+    EXPECT_EQ(6u, table.size());
+
+    EXPECT_TRUE(table.erase(5));
+    EXPECT_FALSE(table.erase(5));
+    EXPECT_TRUE(table.erase(1ull << 40));
+    EXPECT_FALSE(table.erase(1000));
+    EXPECT_FALSE(table.contains(5));
+    EXPECT_EQ(4u, table.size());
+}
+
+TEST(NameTable, EraseDropsValue) {
+    NameTable<std::shared_ptr<int>> table;
+    auto value = std::make_shared<int>(1);
+    table.emplace(3, value);
+    EXPECT_EQ(2, value.use_count());
+    table.erase(3);
+    EXPECT_EQ(1, value.use_count());
+}
@@ -90,44 +90,81 @@ NamedObject::NamedObject(GenNameInfo genNameInfo,
     }
 }
 
+// Objects of these types are shared by all the contexts, so they can be
+// deleted from whichever context is current when the batch is flushed.
+// Framebuffers, vertex arrays, queries and transform feedbacks belong to
+// the context that made them, and are deleted right away.
+static bool isSharedType(NamedObjectType type) {
+    switch (type) {
+        case NamedObjectType::VERTEXBUFFER:
+        case NamedObjectType::TEXTURE:
+        case NamedObjectType::RENDERBUFFER:
+        case NamedObjectType::SHADER_OR_PROGRAM:
+        case NamedObjectType::SAMPLER:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// How many deleted objects are batched before they're deleted on the GPU
+// anyway, without waiting for GlobalNameSpace::flushDeletedNames().
+static constexpr size_t kDeleteBatchSize = 256;
+
 NamedObject::~NamedObject() {
     emugl::Mutex::AutoLock _lock(m_globalNameSpace->m_lock);
     assert(GLEScontext::dispatcher().isInitialized());
-    switch (m_type) {
+    if (m_globalName && isSharedType(m_type)) {
+        m_globalNameSpace->m_deletedNames[toIndex(m_type)].push_back(
+                m_globalName);
+        if (++m_globalNameSpace->m_deletedNameCount >= kDeleteBatchSize) {
+            m_globalNameSpace->flushDeletedNamesLocked();
+        }
+    } else {
+        deleteGlobalNames(m_type, 1, &m_globalName);
+    }
+    emugl::getGLObjectCounter()->decCount(toIndex(m_type));
+}
+
+void NamedObject::deleteGlobalNames(NamedObjectType type,
+                                    GLsizei count,
+                                    const GLuint* names) {
+    auto& gl = GLEScontext::dispatcher();
+    switch (type) {
     case NamedObjectType::VERTEXBUFFER:
-        GLEScontext::dispatcher().glDeleteBuffers(1, &m_globalName);
+        gl.glDeleteBuffers(count, names);
         break;
     case NamedObjectType::TEXTURE:
-        GLEScontext::dispatcher().glDeleteTextures(1, &m_globalName);
+        gl.glDeleteTextures(count, names);
         break;
     case NamedObjectType::RENDERBUFFER:
-        GLEScontext::dispatcher().glDeleteRenderbuffers(1, &m_globalName);
+        gl.glDeleteRenderbuffers(count, names);
         break;
     case NamedObjectType::FRAMEBUFFER:
-        GLEScontext::dispatcher().glDeleteFramebuffers(1, &m_globalName);
+        gl.glDeleteFramebuffers(count, names);
         break;
     case NamedObjectType::SHADER_OR_PROGRAM:
-        if (GLEScontext::dispatcher().glIsProgram(m_globalName)) {
-            GLEScontext::dispatcher().glDeleteProgram(m_globalName);
-        } else {
-            GLEScontext::dispatcher().glDeleteShader(m_globalName);
+        for (GLsizei i = 0; i < count; i++) {
+            if (gl.glIsProgram(names[i])) {
+                gl.glDeleteProgram(names[i]);
+            } else {
+                gl.glDeleteShader(names[i]);
+            }
         }
         break;
     case NamedObjectType::SAMPLER:
-        GLEScontext::dispatcher().glDeleteSamplers(1, &m_globalName);
+        gl.glDeleteSamplers(count, names);
         break;
     case NamedObjectType::QUERY:
-        GLEScontext::dispatcher().glDeleteQueries(1, &m_globalName);
+        gl.glDeleteQueries(count, names);
         break;
     case NamedObjectType::VERTEX_ARRAY_OBJECT:
-        GLEScontext::dispatcher().glDeleteVertexArrays(1, &m_globalName);
+        gl.glDeleteVertexArrays(count, names);
         break;
     case NamedObjectType::TRANSFORM_FEEDBACK:
-        GLEScontext::dispatcher().glDeleteTransformFeedbacks(1, &m_globalName);
+        gl.glDeleteTransformFeedbacks(count, names);
         break;
     default:
         break;
     }
-    emugl::getGLObjectCounter()->decCount(toIndex(m_type));
 }
-
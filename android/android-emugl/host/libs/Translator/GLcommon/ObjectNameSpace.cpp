@@ -171,19 +171,28 @@ NameSpace::genName(GenNameInfo genNameInfo, ObjectLocalName p_localName, bool ge
     assert(m_type == genNameInfo.m_type);
     ObjectLocalName localName = p_localName;
     if (genLocal) {
-        do {
+        // Deleted names aren't reused right away, so a stale name the app
+        // still holds doesn't turn into a new object at once.
+        static constexpr size_t kMinFreeNames = 1024;
+        localName = 0;
+        while (m_freeNames.size() > kMinFreeNames) {
+            const ObjectLocalName freeName = m_freeNames.front();
+            m_freeNames.pop_front();
+            if (!m_localToGlobalMap.contains(freeName)) {
+                localName = freeName;
+                break;
+            }
+        }
+        while (localName == 0 || m_localToGlobalMap.contains(localName)) {
             localName = ++m_nextName;
-        } while(localName == 0 ||
-                m_localToGlobalMap.find(localName) !=
-                        m_localToGlobalMap.end() );
+        }
     }
 
-    auto it = m_localToGlobalMap.emplace(localName,
-                                         NamedObjectPtr(
-                                            new NamedObject(genNameInfo,
-                                                    m_globalNameSpace))).first;
-    unsigned int globalName = it->second->getGlobalName();
-    m_globalToLocalMap[globalName] = localName;
+    const NamedObjectPtr& namedObject = m_localToGlobalMap.emplace(
+            localName,
+            std::make_shared<NamedObject>(genNameInfo, m_globalNameSpace));
+    unsigned int globalName = namedObject->getGlobalName();
+    m_globalToLocalMap.set(globalName, localName);
 
     return localName;
 }
@@ -192,10 +201,9 @@ NameSpace::genName(GenNameInfo genNameInfo, ObjectLocalName p_localName, bool ge
 unsigned int
 NameSpace::getGlobalName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
+    if (const NamedObjectPtr* n = m_localToGlobalMap.find(p_localName)) {
         // object found - return its global name map
-        return (*n).second->getGlobalName();
+        return (*n)->getGlobalName();
     }
 
     // object does not exist;
@@ -205,18 +213,17 @@ NameSpace::getGlobalName(ObjectLocalName p_localName)
 ObjectLocalName
 NameSpace::getLocalName(unsigned int p_globalName)
 {
-    const auto it = m_globalToLocalMap.find(p_globalName);
-    if (it != m_globalToLocalMap.end()) {
-        return it->second;
+    if (const ObjectLocalName* localName =
+                m_globalToLocalMap.find(p_globalName)) {
+        return *localName;
     }
 
     return 0;
 }
 
 NamedObjectPtr NameSpace::getNamedObject(ObjectLocalName p_localName) {
-    auto it = m_localToGlobalMap.find(p_localName);
-    if (it != m_localToGlobalMap.end()) {
-        return it->second;
+    if (const NamedObjectPtr* n = m_localToGlobalMap.find(p_localName)) {
+        return *n;
     }
 
     return nullptr;
@@ -225,10 +232,10 @@ NamedObjectPtr NameSpace::getNamedObject(ObjectLocalName p_localName) {
 void
 NameSpace::deleteName(ObjectLocalName p_localName)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalToLocalMap.erase(n->second->getGlobalName());
-        m_localToGlobalMap.erase(n);
+    if (const NamedObjectPtr* n = m_localToGlobalMap.find(p_localName)) {
+        m_globalToLocalMap.erase((*n)->getGlobalName());
+        m_localToGlobalMap.erase(p_localName);
+        m_freeNames.push_back(p_localName);
     }
     m_objectDataMap.erase(p_localName);
 }
@@ -236,16 +243,15 @@ NameSpace::deleteName(ObjectLocalName p_localName)
 bool
 NameSpace::isObject(ObjectLocalName p_localName)
 {
-    return (m_localToGlobalMap.find(p_localName) != m_localToGlobalMap.end() );
+    return m_localToGlobalMap.contains(p_localName);
 }
 
 void
 NameSpace::setGlobalObject(ObjectLocalName p_localName,
                                NamedObjectPtr p_namedObject) {
-    NamesMap::iterator n(m_localToGlobalMap.find(p_localName));
-    if (n != m_localToGlobalMap.end()) {
-        m_globalToLocalMap.erase(n->second->getGlobalName());
-        (*n).second = p_namedObject;
+    if (NamedObjectPtr* n = m_localToGlobalMap.find(p_localName)) {
+        m_globalToLocalMap.erase((*n)->getGlobalName());
+        *n = p_namedObject;
     } else {
         m_localToGlobalMap.emplace(p_localName, p_namedObject);
     }
@@ -256,10 +262,9 @@ void
 NameSpace::replaceGlobalObject(ObjectLocalName p_localName,
                                NamedObjectPtr p_namedObject)
 {
-    NamesMap::iterator n( m_localToGlobalMap.find(p_localName) );
-    if (n != m_localToGlobalMap.end()) {
-        m_globalToLocalMap.erase(n->second->getGlobalName());
-        (*n).second = p_namedObject;
+    if (NamedObjectPtr* n = m_localToGlobalMap.find(p_localName)) {
+        m_globalToLocalMap.erase((*n)->getGlobalName());
+        *n = p_namedObject;
         m_globalToLocalMap.emplace(p_namedObject->getGlobalName(), p_localName);
     }
 }
@@ -416,15 +421,44 @@ void GlobalNameSpace::onLoad(android::base::Stream* stream,
     textureLoader->acquireLoaderThread(m_backgroundLoader);
 }
 
+void GlobalNameSpace::flushDeletedNames() {
+    emugl::Mutex::AutoLock lock(m_lock);
+    flushDeletedNamesLocked();
+}
+
+void GlobalNameSpace::flushDeletedNamesLocked() {
+    if (!m_deletedNameCount) {
+        return;
+    }
+    for (int i = 0; i < static_cast<int>(NamedObjectType::NUM_OBJECT_TYPES);
+         i++) {
+        auto& names = m_deletedNames[i];
+        if (names.empty()) {
+            continue;
+        }
+        NamedObject::deleteGlobalNames(static_cast<NamedObjectType>(i),
+                                       names.size(), names.data());
+        names.clear();
+    }
+    m_deletedNameCount = 0;
+}
+
 void GlobalNameSpace::clearTextureMap() {
     decltype(m_textureMap)().swap(m_textureMap);
 }
 
 void GlobalNameSpace::postLoad(android::base::Stream* stream) {
     m_backgroundLoader->start();
+    m_startedBackgroundLoader = m_backgroundLoader;
     m_backgroundLoader.reset(); // leave it to TextureLoader
 }
 
+void GlobalNameSpace::prioritizeRestore(const SaveableTexturePtr& texture) {
+    if (auto loader = m_startedBackgroundLoader.lock()) {
+        loader->prioritize(texture);
+    }
+}
+
 const SaveableTexturePtr& GlobalNameSpace::getSaveableTextureFromLoad(
         unsigned int oldGlobalName) {
     assert(m_textureMap.count(oldGlobalName));
@@ -0,0 +1,251 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "GLcommon/ShaderCache.h"
+
+#include "android/base/files/PathUtils.h"
+#include "android/base/files/ScopedStdioFile.h"
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/system/System.h"
+#include "android/utils/path.h"
+
+#include "MurmurHash3.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+using android::base::AutoLock;
+using android::base::LazyInstance;
+using android::base::Lock;
+using android::base::PathUtils;
+using android::base::ScopedStdioFile;
+using android::base::StringView;
+using android::base::System;
+
+static constexpr uint32_t kEntryMagic = 0x43485345;  // 'ESHC'
+// Bump when the entry layout changes; older entries are then ignored.
+static constexpr uint32_t kEntryVersion = 1;
+static constexpr char kEntrySuffix[] = ".shader";
+
+static constexpr uint64_t kDefaultMaxBytes = 64 * 1024 * 1024;
+
+namespace {
+
+// Entry layout: magic, version, key size, value size, hash of the value,
+// then the key and the value.
+struct EntryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t valueHash;
+};
+
+uint32_t valueHash(StringView value) {
+    uint32_t hash = 0;
+    MurmurHash3_x86_32(value.data(), static_cast<int>(value.size()), 0,
+                       &hash);
+    return hash;
+}
+
+bool endsWith(const std::string& str, StringView suffix) {
+    return str.size() >= suffix.size() &&
+           !str.compare(str.size() - suffix.size(), suffix.size(),
+                        suffix.data(), suffix.size());
+}
+
+}  // namespace
+
+ShaderCache::ShaderCache(StringView dir, uint64_t maxBytes)
+    : mDir(dir), mMaxBytes(maxBytes) {
+    path_mkdir_if_needed(mDir.c_str(), 0755);
+    trim(0);
+}
+
+void ShaderCache::trim(uint64_t reserve) {
+    std::vector<std::pair<System::Duration, std::string>> entries;
+    std::vector<uint64_t> sizes;
+    uint64_t total = 0;
+    for (auto& path : System::get()->scanDirEntries(mDir, true)) {
+        if (!endsWith(path, kEntrySuffix)) {
+            continue;
+        }
+        const auto size = System::get()->pathFileSize(path);
+        if (!size) {
+            continue;
+        }
+        total += *size;
+        entries.emplace_back(
+                System::get()->pathModificationTime(path).valueOr(0),
+                std::move(path));
+        sizes.push_back(*size);
+    }
+
+    if (total + reserve > mMaxBytes) {
+        // Oldest first, down to 3/4 of the budget so that this doesn't
+        // happen again on every start or store.
+        std::vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+            return entries[a].first < entries[b].first;
+        });
+        for (size_t i : order) {
+            if (total <= mMaxBytes / 4 * 3) {
+                break;
+            }
+            if (System::get()->deleteFile(entries[i].second)) {
+                total -= sizes[i];
+            }
+        }
+    }
+
+    // Stores that finished during the scan may be counted twice or not at
+    // all; the next trim corrects that.
+    AutoLock lock(mLock);
+    mBytes = total;
+    mTrimming = false;
+}
+
+std::string ShaderCache::entryPath(StringView key) const {
+    uint64_t hash[2];
+    MurmurHash3_x64_128(key.data(), static_cast<int>(key.size()), 0, hash);
+    char name[48];
+    snprintf(name, sizeof(name), "%016llx%016llx%s",
+             static_cast<unsigned long long>(hash[0]),
+             static_cast<unsigned long long>(hash[1]), kEntrySuffix);
+    return PathUtils::join(mDir, name);
+}
+
+bool ShaderCache::lookup(StringView key, std::string* value) {
+    const std::string path = entryPath(key);
+    bool found = false;
+    ScopedStdioFile file(fopen(path.c_str(), "rb"));
+    EntryHeader header;
+    if (file && fread(&header, sizeof(header), 1, file.get()) == 1 &&
+        header.magic == kEntryMagic && header.version == kEntryVersion &&
+        header.keySize == key.size() && header.valueSize <= mMaxBytes) {
+        std::string storedKey(header.keySize, '\0');
+        std::string storedValue(header.valueSize, '\0');
+        if (fread(&storedKey[0], 1, storedKey.size(), file.get()) ==
+                    storedKey.size() &&
+            fread(&storedValue[0], 1, storedValue.size(), file.get()) ==
+                    storedValue.size() &&
+            StringView(storedKey) == key &&
+            valueHash(storedValue) == header.valueHash) {
+            *value = std::move(storedValue);
+            found = true;
+        }
+    }
+
+    AutoLock lock(mLock);
+    if (found) {
+        ++mStats.hits;
+    } else {
+        ++mStats.misses;
+    }
+    return found;
+}
+
+void ShaderCache::store(StringView key, StringView value) {
+    const uint64_t entryBytes =
+            sizeof(EntryHeader) + key.size() + value.size();
+    if (entryBytes > mMaxBytes - mMaxBytes / 4 * 3) {
+        return;
+    }
+    {
+        AutoLock lock(mLock);
+        if (mBytes + entryBytes > mMaxBytes) {
+            if (mTrimming) {
+                // Another thread is making room; not worth waiting for.
+                return;
+            }
+            mTrimming = true;
+            lock.unlock();
+            trim(entryBytes);
+        }
+    }
+
+    static std::atomic<uint32_t> sTempIndex{0};
+    const std::string path = entryPath(key);
+    char tempSuffix[32];
+    snprintf(tempSuffix, sizeof(tempSuffix), ".%d.%u.tmp",
+             static_cast<int>(System::get()->getCurrentProcessId()),
+             sTempIndex++);
+    const std::string tempPath = path + tempSuffix;
+
+    ScopedStdioFile file(fopen(tempPath.c_str(), "wb"));
+    if (!file) {
+        return;
+    }
+    const EntryHeader header = {kEntryMagic, kEntryVersion,
+                                static_cast<uint32_t>(key.size()),
+                                static_cast<uint32_t>(value.size()),
+                                valueHash(value)};
+    const bool written =
+            fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+            fwrite(key.data(), 1, key.size(), file.get()) == key.size() &&
+            fwrite(value.data(), 1, value.size(), file.get()) == value.size();
+    file.reset();
+    // On Windows, rename() fails if another instance stored the same entry
+    // meanwhile, which is just as good.
+    if (!written || rename(tempPath.c_str(), path.c_str()) != 0) {
+        System::get()->deleteFile(tempPath);
+        return;
+    }
+
+    AutoLock lock(mLock);
+    mBytes += entryBytes;
+    ++mStats.stores;
+}
+
+ShaderCache::Stats ShaderCache::stats() const {
+    AutoLock lock(mLock);
+    return mStats;
+}
+
+namespace {
+
+struct GlobalShaderCache {
+    Lock lock;
+    bool initialized = false;
+    std::unique_ptr<ShaderCache> cache;
+};
+
+LazyInstance<GlobalShaderCache> sGlobalShaderCache = LAZY_INSTANCE_INIT;
+
+}  // namespace
+
+void ShaderCache::initialize(StringView dir) {
+    AutoLock lock(sGlobalShaderCache->lock);
+    if (sGlobalShaderCache->initialized) {
+        return;
+    }
+    sGlobalShaderCache->initialized = true;
+    if (!dir.empty()) {
+        sGlobalShaderCache->cache.reset(
+                new ShaderCache(dir, kDefaultMaxBytes));
+    }
+}
+
+ShaderCache* ShaderCache::get() {
+    AutoLock lock(sGlobalShaderCache->lock);
+    return sGlobalShaderCache->cache.get();
+}
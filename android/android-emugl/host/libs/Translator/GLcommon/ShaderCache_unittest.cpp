@@ -0,0 +1,99 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <GLcommon/ShaderCache.h>
+
+#include "android/base/system/System.h"
+#include "android/base/testing/TestTempDir.h"
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <string>
+
+using android::base::System;
+using android::base::TestTempDir;
+
+TEST(ShaderCache, StoreLookup) {
+    TestTempDir dir("shadercachetest");
+    ShaderCache cache(dir.path(), 1024 * 1024);
+
+    std::string value;
+    EXPECT_FALSE(cache.lookup("key", &value));
+    cache.store("key", "value");
+    cache.store(std::string("binary\0key", 10), std::string("\0\1\2", 3));
+    ASSERT_TRUE(cache.lookup("key", &value));
+    EXPECT_EQ("value", value);
+    ASSERT_TRUE(cache.lookup(std::string("binary\0key", 10), &value));
+    EXPECT_EQ(std::string("\0\1\2", 3), value);
+    EXPECT_FALSE(cache.lookup("binary", &value));
+
+    const ShaderCache::Stats stats = cache.stats();
+    EXPECT_EQ(2u, stats.hits);
+    EXPECT_EQ(2u, stats.misses);
+    EXPECT_EQ(2u, stats.stores);
+}
+
+// A second cache on the same directory, as another emulator instance of
+// the same AVD would open, sees the entries of the first.
+TEST(ShaderCache, SharedDirectory) {
+    TestTempDir dir("shadercachetest");
+    ShaderCache first(dir.path(), 1024 * 1024);
+    first.store("key", "value");
+
+    ShaderCache second(dir.path(), 1024 * 1024);
+    std::string value;
+    ASSERT_TRUE(second.lookup("key", &value));
+    EXPECT_EQ("value", value);
+}
+
+TEST(ShaderCache, CorruptEntryIsMiss) {
+    TestTempDir dir("shadercachetest");
+    ShaderCache cache(dir.path(), 1024 * 1024);
+    cache.store("key", "value");
+
+    for (const auto& path : System::get()->scanDirEntries(dir.path(), true)) {
+        FILE* file = fopen(path.c_str(), "r+b");
+        ASSERT_TRUE(file);
+        fseek(file, -1, SEEK_END);
+        fputc('X', file);
+        fclose(file);
+    }
+    std::string value;
+    EXPECT_FALSE(cache.lookup("key", &value));
+}
+
+TEST(ShaderCache, SizeLimit) {
+    TestTempDir dir("shadercachetest");
+    const std::string value(1000, 'v');
+    {
+        ShaderCache cache(dir.path(), 4096);
+        for (int i = 0; i < 10; i++) {
+            cache.store(std::to_string(i), value);
+        }
+        // A full cache makes room for new entries.
+        EXPECT_EQ(10u, cache.stats().stores);
+        std::string stored;
+        EXPECT_TRUE(cache.lookup("9", &stored));
+
+        // Too big to fit after a trim.
+        cache.store("big", std::string(1100, 'v'));
+        EXPECT_EQ(10u, cache.stats().stores);
+    }
+    EXPECT_EQ(4u, System::get()->scanDirEntries(dir.path()).size());
+
+    // Opening with a smaller limit deletes entries down to 3/4 of it.
+    ShaderCache cache(dir.path(), 2048);
+    EXPECT_EQ(1u, System::get()->scanDirEntries(dir.path()).size());
+}
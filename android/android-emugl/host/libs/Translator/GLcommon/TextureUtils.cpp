@@ -14,6 +14,7 @@
 * limitations under the License.
 */
 #include <GLcommon/TextureUtils.h>
+#include <GLcommon/EtcDecoder.h>
 #include <GLcommon/GLESmacros.h>
 #include <GLcommon/GLDispatch.h>
 #include <GLcommon/GLESvalidate.h>
@@ -399,7 +400,7 @@ void doCompressedTexImage2D(GLEScontext* ctx, GLenum target, GLint level,
         std::unique_ptr<etc1_byte[]> pOut(new etc1_byte[size]);
 
         int res =
-            etc2_decode_image(
+            EtcDecoder::get()->decode(
                     (const etc1_byte*)data, etcFormat, pOut.get(),
                     width, height, bpr);
         SET_ERROR_IF(res!=0, GL_INVALID_VALUE);
@@ -20,6 +20,10 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 typedef uint16_t etc1_uint16;
 
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
@@ -263,6 +267,78 @@ void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
     }
 }
 
+#if defined(__SSE2__)
+
+// mask ? a : b, for each 16-bit lane.
+static inline __m128i select_epi16(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Same as the two decode_subblock() calls for a block without alpha, on all
+// 16 pixels at once: each pixel's modifier is picked from its subblock's
+// table with lane masks, and the clamping is the saturation of the final
+// pack to bytes. The first 8 pixels of a row-major 4x4 block go in the lo
+// vectors, the last 8 in the hi ones.
+static void decode_subblocks_sse2(etc1_byte* pOut, int r1, int g1, int b1,
+        int r2, int g2, int b2, const int* tableA, const int* tableB,
+        etc1_uint32 low, bool flipped) {
+    // The bit of each pixel's index: they are stored column by column.
+    const __m128i bitLo = _mm_setr_epi16(1 << 0, 1 << 4, 1 << 8, 1 << 12,
+                                         1 << 1, 1 << 5, 1 << 9, 1 << 13);
+    const __m128i bitHi = _mm_setr_epi16(1 << 2, 1 << 6, 1 << 10, 1 << 14,
+                                         1 << 3, 1 << 7, 1 << 11,
+                                         (short)(1 << 15));
+    const __m128i lsbs = _mm_set1_epi16((short)(low & 0xffff));
+    const __m128i msbs = _mm_set1_epi16((short)(low >> 16));
+    const __m128i lsbLo = _mm_cmpeq_epi16(_mm_and_si128(lsbs, bitLo), bitLo);
+    const __m128i lsbHi = _mm_cmpeq_epi16(_mm_and_si128(lsbs, bitHi), bitHi);
+    const __m128i msbLo = _mm_cmpeq_epi16(_mm_and_si128(msbs, bitLo), bitLo);
+    const __m128i msbHi = _mm_cmpeq_epi16(_mm_and_si128(msbs, bitHi), bitHi);
+
+    // The second subblock is the right half, or the bottom one if flipped.
+    const __m128i rightHalf = _mm_setr_epi16(0, 0, -1, -1, 0, 0, -1, -1);
+    const __m128i secondLo = flipped ? _mm_setzero_si128() : rightHalf;
+    const __m128i secondHi = flipped ? _mm_set1_epi16(-1) : rightHalf;
+
+    __m128i modifiers[4][2];
+    for (int i = 0; i < 4; i++) {
+        const __m128i a = _mm_set1_epi16(tableA[i]);
+        const __m128i b = _mm_set1_epi16(tableB[i]);
+        modifiers[i][0] = select_epi16(secondLo, b, a);
+        modifiers[i][1] = select_epi16(secondHi, b, a);
+    }
+    const __m128i deltaLo =
+            select_epi16(msbLo,
+                         select_epi16(lsbLo, modifiers[3][0], modifiers[2][0]),
+                         select_epi16(lsbLo, modifiers[1][0], modifiers[0][0]));
+    const __m128i deltaHi =
+            select_epi16(msbHi,
+                         select_epi16(lsbHi, modifiers[3][1], modifiers[2][1]),
+                         select_epi16(lsbHi, modifiers[1][1], modifiers[0][1]));
+
+    const int bases[3][2] = {{r1, r2}, {g1, g2}, {b1, b2}};
+    union {
+        __m128i v;
+        etc1_byte b[16];
+    } channels[3];
+    for (int c = 0; c < 3; c++) {
+        const __m128i first = _mm_set1_epi16(bases[c][0]);
+        const __m128i second = _mm_set1_epi16(bases[c][1]);
+        const __m128i lo =
+                _mm_add_epi16(select_epi16(secondLo, second, first), deltaLo);
+        const __m128i hi =
+                _mm_add_epi16(select_epi16(secondHi, second, first), deltaHi);
+        channels[c].v = _mm_packus_epi16(lo, hi);
+    }
+    for (int i = 0; i < 16; i++) {
+        *pOut++ = channels[0].b[i];
+        *pOut++ = channels[1].b[i];
+        *pOut++ = channels[2].b[i];
+    }
+}
+
+#endif  // __SSE2__
+
 static void etc2_T_H_index(const int* clrTable, etc1_uint32 low,
                            bool isPunchthroughAlpha, bool opaque,
                            etc1_byte* pOut) {
@@ -431,6 +507,13 @@ void etc2_decode_rgb_block(const etc1_byte* pIn, bool isPunchthroughAlpha,
     const int* tableA = rgbModifierTable + tableIndexA * 4;
     const int* tableB = rgbModifierTable + tableIndexB * 4;
     bool flipped = (high & 1) != 0;
+#if defined(__SSE2__)
+    if (!isPunchthroughAlpha) {
+        decode_subblocks_sse2(pOut, r1, g1, b1, r2, g2, b2, tableA, tableB,
+                              low, flipped);
+        return;
+    }
+#endif
     decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped,
                     isPunchthroughAlpha, opaque);
     decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped,
@@ -0,0 +1,60 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "GLcommon/etc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Decodes whole ETC1/ETC2/EAC images the same way etc2_decode_image() does,
+// for the compressed texture uploads that have to be decompressed before
+// they go to the host GL.
+//
+// Large images are split into bands of block rows, decoded on a pool of
+// worker threads while the calling thread decodes the last band. The most
+// recently decoded images are also kept by a hash of their compressed data,
+// so an upload of the same texture (an app restarting, or the same atlas
+// uploaded to several contexts) copies the earlier result instead.
+class EtcDecoder {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    // |cacheBytes| bounds the decoded data kept around, 0 disables the
+    // cache. |threads| is the number of workers, 0 for one per CPU core.
+    EtcDecoder(size_t cacheBytes, int threads);
+    ~EtcDecoder();
+
+    // The decoder the GLES translators share.
+    static EtcDecoder* get();
+
+    // Same parameters and return value as etc2_decode_image(); |pIn| has
+    // etc_get_encoded_data_size(format, width, height) bytes.
+    int decode(const etc1_byte* pIn,
+               ETC2ImageFormat format,
+               etc1_byte* pOut,
+               etc1_uint32 width,
+               etc1_uint32 height,
+               etc1_uint32 stride);
+
+    Stats stats() const;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> mImpl;
+};
@@ -15,6 +15,7 @@
 */
 #pragma once
 
+#include "android/base/synchronization/Lock.h"
 #include "android/snapshot/TextureLoader.h"
 #include "emugl/common/thread.h"
 #include "GLcommon/TranslatorIfaces.h"
@@ -22,6 +23,7 @@
 #include <EGL/egl.h>
 
 #include <atomic>
+#include <deque>
 #include <memory>
 
 class GLBackgroundLoader : public emugl::InterruptibleThread {
@@ -43,7 +45,15 @@ public:
     bool wait(intptr_t* exitStatus) override;
     void interrupt() override;
 
+    // Restores |texture| before the ones left in the texture map, e.g.
+    // because it's on screen. Can be called from any thread.
+    void prioritize(const SaveableTexturePtr& texture);
+
 private:
+    // Restores the prioritized textures; returns false if interrupted.
+    bool restorePrioritized();
+
+
     std::atomic<int> m_loadDelayMs { 10 };
     std::atomic<bool> m_interrupted { false };
 
@@ -52,4 +62,7 @@ private:
     const GLESiface& m_glesIface;
 
     SaveableTextureMap& m_textureMap;
+
+    android::base::Lock m_priorityLock;
+    std::deque<SaveableTexturePtr> m_priorityQueue;
 };
@@ -224,6 +224,8 @@ public:
     unsigned int getBindedTexture(GLenum target);
     unsigned int getBindedTexture(GLenum unit,GLenum target);
     void setBindedTexture(GLenum target,unsigned int tex);
+    // Whether |tex| is bound to any target of any texture unit.
+    bool isTextureBound(unsigned int tex) const;
     bool isTextureUnitEnabled(GLenum unit);
     void setTextureEnabled(GLenum target, GLenum enable);
     ObjectLocalName getDefaultTextureName(GLenum target);
@@ -258,7 +260,8 @@ public:
                                    GLintptr stride = 0,
                                    bool isBindBase = false);
     virtual void bindIndexedBuffer(GLenum target, GLuint index, GLuint buffer);
-    virtual void unbindBuffer(GLuint buffer);
+    // Clears the bindings of a deleted |buffer|, returns whether it was bound.
+    virtual bool unbindBuffer(GLuint buffer);
     bool isBuffer(GLuint buffer);
     bool isBindedBuffer(GLenum target);
     GLvoid* getBindedBuffer(GLenum target);
@@ -400,6 +403,10 @@ public:
     int getMajorVersion() const { return m_glesMajorVersion; }
     int getMinorVersion() const { return m_glesMinorVersion; }
 
+    // Deletes the objects whose deletion was batched; called at the points
+    // where the app flushes anyway (glFlush(), glFinish()).
+    void flushDeletedNames();
+
     // FBO
     void initFBONameSpace(GlobalNameSpace* globalNameSpace,
             android::base::Stream* stream);
@@ -639,6 +646,7 @@ private:
     static std::string    s_glRenderer;
     static std::string    s_glVersion;
 
+    GlobalNameSpace* m_globalNameSpace = nullptr;
     NameSpace* m_fboNameSpace = nullptr;
     // m_vaoNameSpace is an empty shell that holds the names but not the data
     // TODO(yahan): consider moving the data into it?
@@ -0,0 +1,110 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// NameTable maps GL object names to values, for the name translations that
+// run on every GL call that takes an object. GL names are small integers
+// handed out from 1 up, so the names below |DenseLimit| index a vector of
+// slots directly; the others (names the app chose itself) go to a hash map.
+//
+// The dense part only grows up to the largest name used, which stays close
+// to the number of live objects as long as deleted names are reused.
+template <class V, size_t DenseLimit = 64 * 1024>
+class NameTable {
+public:
+    using Name = uint64_t;
+
+    const V* find(Name name) const {
+        if (name < DenseLimit) {
+            return name < mSlots.size() && mSlots[name].used
+                           ? &mSlots[name].value
+                           : nullptr;
+        }
+        const auto it = mSparse.find(name);
+        return it != mSparse.end() ? &it->second : nullptr;
+    }
+
+    V* find(Name name) {
+        return const_cast<V*>(static_cast<const NameTable*>(this)->find(name));
+    }
+
+    bool contains(Name name) const { return find(name) != nullptr; }
+
+    // Like std::unordered_map::emplace(), does nothing if |name| is there
+    // already. Returns the value |name| maps to.
+    V& emplace(Name name, V value) {
+        if (name >= DenseLimit) {
+            auto result = mSparse.emplace(name, std::move(value));
+            if (result.second) {
+                ++mSize;
+            }
+            return result.first->second;
+        }
+        if (name >= mSlots.size()) {
+            mSlots.resize(std::min<size_t>(
+                    DenseLimit, std::max<size_t>(name + 1, mSlots.size() * 2)));
+        }
+        Slot& slot = mSlots[name];
+        if (!slot.used) {
+            slot.value = std::move(value);
+            slot.used = true;
+            ++mSize;
+        }
+        return slot.value;
+    }
+
+    void set(Name name, V value) {
+        if (V* existing = find(name)) {
+            *existing = std::move(value);
+        } else {
+            emplace(name, std::move(value));
+        }
+    }
+
+    bool erase(Name name) {
+        if (name >= DenseLimit) {
+            if (!mSparse.erase(name)) {
+                return false;
+            }
+        } else {
+            if (name >= mSlots.size() || !mSlots[name].used) {
+                return false;
+            }
+            // Drops the reference now, as the map would.
+            mSlots[name] = Slot();
+        }
+        --mSize;
+        return true;
+    }
+
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+private:
+    struct Slot {
+        V value = V();
+        bool used = false;
+    };
+
+    std::vector<Slot> mSlots;
+    std::unordered_map<Name, V> mSparse;
+    size_t mSize = 0;
+};
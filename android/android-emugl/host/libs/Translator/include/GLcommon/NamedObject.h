@@ -106,6 +106,12 @@ public:
                 GlobalNameSpace *globalNameSpace);
     ~NamedObject();
     unsigned int getGlobalName() const {return m_globalName;}
+
+    // Deletes the GPU objects of |count| global names of |type| at once.
+    // Called with the GlobalNameSpace lock held.
+    static void deleteGlobalNames(NamedObjectType type,
+                                  GLsizei count,
+                                  const GLuint* names);
 private:
     // m_globalName is the name generated by GPU
     unsigned int m_globalName = 0;
@@ -19,18 +19,21 @@
 #include "android/snapshot/common.h"
 #include "emugl/common/mutex.h"
 #include "GLcommon/GLBackgroundLoader.h"
+#include "GLcommon/NameTable.h"
 #include "GLcommon/NamedObject.h"
 #include "GLcommon/ObjectData.h"
 #include "GLcommon/SaveableTexture.h"
 #include "GLcommon/TranslatorIfaces.h"
 
 #include <GLES/gl.h>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
-typedef std::unordered_map<ObjectLocalName, NamedObjectPtr> NamesMap;
+typedef NameTable<NamedObjectPtr> NamesMap;
 typedef std::unordered_map<ObjectLocalName, ObjectDataPtr> ObjectDataMap;
-typedef std::unordered_map<unsigned int, ObjectLocalName> GlobalToLocalNamesMap;
+typedef NameTable<ObjectLocalName> GlobalToLocalNamesMap;
 
 class GlobalNameSpace;
 
@@ -111,6 +114,10 @@ public:
     ObjectDataMap::const_iterator objDataMapEnd() const;
 private:
     ObjectLocalName m_nextName = 0;
+    // Deleted local names, reused by genName() oldest first once there are
+    // enough of them; this keeps the names, and so m_localToGlobalMap, dense
+    // for apps that create and delete objects all the time.
+    std::deque<ObjectLocalName> m_freeNames;
     NamesMap m_localToGlobalMap;
     ObjectDataMap m_objectDataMap;
     GlobalToLocalNamesMap m_globalToLocalMap;
@@ -142,6 +149,13 @@ public:
                 const android::snapshot::ITextureLoaderWPtr& textureLoaderWPtr,
                 SaveableTexture::creator_t creator);
     void postLoad(android::base::Stream* stream);
+    // Deletes the GPU objects of the deleted NamedObjects; see
+    // NamedObject::~NamedObject(). Needs a current context; there is none
+    // when the display goes away, so every EglContext flushes on destruction.
+    void flushDeletedNames();
+    // Asks the background loader to restore |texture| next, if it's still
+    // running.
+    void prioritizeRestore(const SaveableTexturePtr& texture);
     const SaveableTexturePtr& getSaveableTextureFromLoad(unsigned int oldGlobalName);
     SaveableTextureMap* getSaveableTextureMap() { return &m_textureMap; }
 
@@ -154,13 +168,21 @@ public:
     }
 
 private:
+    void flushDeletedNamesLocked();
 
     emugl::Mutex m_lock;
+    // The global names of the deleted objects that are shared between
+    // contexts, by type, not deleted on the GPU yet.
+    std::vector<GLuint> m_deletedNames[static_cast<int>(
+            NamedObjectType::NUM_OBJECT_TYPES)];
+    size_t m_deletedNameCount = 0;
     // m_textureMap is only used when saving / loading a snapshot
     // It is empty in all other situations
     SaveableTextureMap m_textureMap;
 
     std::shared_ptr<GLBackgroundLoader>     m_backgroundLoader;
+    // The TextureLoader owns the background loader once it's started.
+    std::weak_ptr<GLBackgroundLoader>       m_startedBackgroundLoader;
 
     const EGLiface* m_eglIface = nullptr;
     const GLESiface* m_glesIface = nullptr;
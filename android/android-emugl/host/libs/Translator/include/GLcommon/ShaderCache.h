@@ -0,0 +1,71 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "android/base/StringView.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <cstdint>
+#include <string>
+
+// ShaderCache is a persistent, content-addressed store for the work the
+// GLES translator redoes each time an app starts: translating the guest
+// shaders with ANGLE, and linking the programs on the host GL.
+//
+// Each entry is a file named after a hash of its key, and holds the whole
+// key so that a hash collision is a miss rather than a wrong result. Files
+// are written under a temporary name and renamed into place, so emulator
+// instances of the same AVD can share the directory: a reader only ever
+// sees complete entries, and two writers of the same entry write the same
+// contents.
+class ShaderCache {
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t stores = 0;
+    };
+
+    // Entries are kept in |dir|, which is created if needed. When the
+    // entries there take more than |maxBytes|, on open or because a new one
+    // doesn't fit, the least recently written ones are deleted down to 3/4
+    // of it. Entries bigger than the remaining 1/4 aren't stored.
+    ShaderCache(android::base::StringView dir, uint64_t maxBytes);
+
+    // Sets up the cache the GLES translator uses, in |dir|. Only the first
+    // call does something.
+    static void initialize(android::base::StringView dir);
+    // The cache set up by initialize(), or null if there isn't any.
+    static ShaderCache* get();
+
+    // Returns true and sets |value| if there's an entry for |key|.
+    bool lookup(android::base::StringView key, std::string* value);
+    void store(android::base::StringView key, android::base::StringView value);
+
+    Stats stats() const;
+
+private:
+    std::string entryPath(android::base::StringView key) const;
+    // Scans |mDir| and deletes the oldest entries down to 3/4 of
+    // |mMaxBytes| if it can't take |reserve| more bytes.
+    void trim(uint64_t reserve);
+
+    const std::string mDir;
+    const uint64_t mMaxBytes;
+
+    mutable android::base::Lock mLock;
+    uint64_t mBytes = 0;
+    bool mTrimming = false;
+    Stats mStats;
+};
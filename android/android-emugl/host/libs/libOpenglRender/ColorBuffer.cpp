@@ -414,6 +414,8 @@ void ColorBuffer::readPixelsYUVCached(int x,
 }
 
 void ColorBuffer::reformat(GLint internalformat, GLenum type) {
+    touch();
+
     GLenum texFormat = internalformat;
     GLenum pixelType = GL_UNSIGNED_BYTE;
     GLint sizedInternalFormat = GL_RGBA8;
@@ -475,6 +477,7 @@ void ColorBuffer::reformat(GLint internalformat, GLenum type) {
 }
 
 void ColorBuffer::swapYUVTextures(uint32_t type, uint32_t* textures) {
+    touch();
     if (type == FRAMEWORK_FORMAT_NV12) {
         m_yuv_converter->swapTextures(type, textures);
     } else {
@@ -843,9 +846,17 @@ void ColorBuffer::readback(unsigned char* img, bool readbackBgra) {
     }
 }
 
-void ColorBuffer::readbackAsync(GLuint buffer, bool readbackBgra) {
+void ColorBuffer::readbackAsync(GLuint buffer,
+                                bool readbackBgra,
+                                GLsync* fence) {
     RecursiveScopedHelperContext context(m_helper);
     if (!context.isOk()) {
+        // Don't leave the fence of an earlier readback to |buffer| behind,
+        // or it would be waited on as if it covered this one.
+        if (fence && *fence) {
+            s_gles2.glDeleteSync(*fence);
+            *fence = nullptr;
+        }
         return;
     }
     touch();
@@ -859,6 +870,15 @@ void ColorBuffer::readbackAsync(GLuint buffer, bool readbackBgra) {
         s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
         unbindFbo();
     }
+
+    if (fence) {
+        if (*fence) {
+            s_gles2.glDeleteSync(*fence);
+        }
+        *fence = s_gles2.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // The fence is waited on from another context.
+        s_gles2.glFlush();
+    }
 }
 
 HandleType ColorBuffer::getHndl() const {
@@ -932,18 +952,28 @@ void ColorBuffer::restore() {
 }
 
 
+void ColorBuffer::prioritizeRestore() {
+    if (!needRestore() || !s_egl.eglPrioritizeImageRestore) {
+        return;
+    }
+    s_egl.eglPrioritizeImageRestore(m_display, m_eglImage);
+    s_egl.eglPrioritizeImageRestore(m_display, m_blitEGLImage);
+}
+
 GLuint ColorBuffer::getTexture() {
     touch();
     return m_tex;
 }
 
 void ColorBuffer::postLayer(ComposeLayer* l, int frameWidth, int frameHeight) {
+    touch();
     if (m_inUse) fprintf(stderr, "%s: cb in use\n", __func__);
     waitSync();
     m_helper->getTextureDraw()->drawLayer(l, frameWidth, frameHeight, m_width, m_height, m_tex);
 }
 
 void ColorBuffer::postLayerMask(ComposeLayer* l, int frameWidth, int frameHeight) {
+    touch();
     if (m_inUse) fprintf(stderr, "%s: cb in use\n", __func__);
     waitSync();
     m_helper->getTextureDraw()->drawLayerMask(l, frameWidth, frameHeight, m_width, m_height, m_tex);
@@ -960,6 +990,7 @@ bool ColorBuffer::importMemory(
         bool linearTiling,
         bool vulkanOnly) {
     RecursiveScopedHelperContext context(m_helper);
+    touch();
     s_gles2.glCreateMemoryObjectsEXT(1, &m_memoryObject);
     if (dedicated) {
         static const GLint DEDICATED_FLAG = GL_TRUE;
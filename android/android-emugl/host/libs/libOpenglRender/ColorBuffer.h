@@ -28,6 +28,7 @@
 #include "Hwc2.h"
 #include "RenderContext.h"
 
+#include <atomic>
 #include <memory>
 
 class TextureDraw;
@@ -236,7 +237,12 @@ public:
     // |img| must be a buffer large enough (i.e. width * height * 4).
     void readback(unsigned char* img, bool readbackBgra = false);
     // readback() but async (to the specified |buffer|)
-    void readbackAsync(GLuint buffer, bool readbackBgra = false);
+    // If |fence| is not null, the fence it holds (if any) is deleted and
+    // replaced with one that signals once the read is done, or with null if
+    // nothing could be read.
+    void readbackAsync(GLuint buffer,
+                       bool readbackBgra = false,
+                       GLsync* fence = nullptr);
 
     void onSave(android::base::Stream* stream);
     static ColorBuffer* onLoad(android::base::Stream* stream,
@@ -271,6 +277,9 @@ public:
 
 public:
     void restore();
+    // After a snapshot load, has the textures of this ColorBuffer restored
+    // in the background ahead of the others, as it's about to be shown.
+    void prioritizeRestore();
 
 private:
     ColorBuffer(EGLDisplay display, HandleType hndl, Helper* helper);
@@ -316,7 +325,8 @@ private:
 
     bool m_importedMemory = false;
     GLuint m_memoryObject = 0;
-    bool m_inUse = false;
+    // Set by FrameBuffer without its lock held.
+    std::atomic<bool> m_inUse{false};
     bool m_isBuffer = false;
     GLuint m_buf = 0;
     uint32_t m_displayId = 0;
@@ -0,0 +1,102 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "android/base/Compiler.h"
+#include "android/base/containers/Lookup.h"
+#include "android/base/synchronization/Lock.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+// ConcurrentHandleMap maps handles to reference-counted objects, for tables
+// that many render threads look up at once while only a few calls add or
+// remove entries. The handles are spread over |Shards| maps that each have
+// their own lock, and a lookup only takes its shard's lock for reading.
+//
+// get() returns a reference of its own, so the object stays alive for the
+// caller even if it's removed from the map right after.
+template <class T, size_t Shards = 16>
+class ConcurrentHandleMap {
+    DISALLOW_COPY_AND_ASSIGN(ConcurrentHandleMap);
+
+public:
+    using Handle = uint32_t;
+    using Ptr = std::shared_ptr<T>;
+
+    ConcurrentHandleMap() = default;
+
+    Ptr get(Handle handle) const {
+        const Shard& shard = shardOf(handle);
+        android::base::AutoReadLock lock(shard.lock);
+        return android::base::findOrDefault(shard.map, handle);
+    }
+
+    void set(Handle handle, Ptr ptr) {
+        Shard& shard = shardOf(handle);
+        android::base::AutoWriteLock lock(shard.lock);
+        shard.map[handle] = std::move(ptr);
+    }
+
+    // Returns the removed object, if any, so that the caller decides where
+    // the reference is dropped.
+    Ptr remove(Handle handle) {
+        Ptr removed;
+        Shard& shard = shardOf(handle);
+        android::base::AutoWriteLock lock(shard.lock);
+        auto it = shard.map.find(handle);
+        if (it != shard.map.end()) {
+            removed = std::move(it->second);
+            shard.map.erase(it);
+        }
+        return removed;
+    }
+
+    void clear() {
+        for (auto& shard : mShards) {
+            // Destroyed once the shard is unlocked.
+            std::unordered_map<Handle, Ptr> removed;
+            android::base::AutoWriteLock lock(shard.lock);
+            removed.swap(shard.map);
+        }
+    }
+
+    size_t size() const {
+        size_t size = 0;
+        for (const auto& shard : mShards) {
+            android::base::AutoReadLock lock(shard.lock);
+            size += shard.map.size();
+        }
+        return size;
+    }
+
+private:
+    // A cache line each, so that threads looking up different shards don't
+    // bounce the same line between them.
+    struct alignas(64) Shard {
+        mutable android::base::ReadWriteLock lock;
+        std::unordered_map<Handle, Ptr> map;
+    };
+
+    // Handles are handed out sequentially, which keeps the shards even.
+    Shard& shardOf(Handle handle) { return mShards[handle % Shards]; }
+    const Shard& shardOf(Handle handle) const {
+        return mShards[handle % Shards];
+    }
+
+    std::array<Shard, Shards> mShards;
+};
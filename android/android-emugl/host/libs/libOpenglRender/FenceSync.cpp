@@ -42,7 +42,10 @@ using android::base::StaticMap;
 // delete. After at least that many timeline increments have
 // happened, we sweep away the remaining native fences.
 // The function that performs the deleting,
-// incrementTimelineAndDeleteOldFences(), happens on the SyncThread.
+// incrementTimelineAndDeleteOldFences(), happens on the SyncThread workers.
+// As these run in parallel, SyncThread::triggerWait() takes its own
+// reference on a fence, so that a sweep elsewhere can't delete it while it
+// is waited on.
 
 class Timeline {
 public:
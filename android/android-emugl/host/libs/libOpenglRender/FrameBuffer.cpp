@@ -36,6 +36,7 @@
 #include "android/base/memory/MemoryTracker.h"
 #include "android/base/memory/ScopedPtr.h"
 #include "android/base/system/System.h"
+#include "android/base/threads/Thread.h"
 
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/feature_control.h"
@@ -43,6 +44,7 @@
 #include "emugl/common/misc.h"
 #include "emugl/common/vm_operations.h"
 
+#include <algorithm>
 #include <stdio.h>
 #include <string.h>
 
@@ -243,6 +245,8 @@ void FrameBuffer::finalize() {
     sweepColorBuffersLocked();
 
     m_colorbuffers.clear();
+    m_colorBufferTable.clear();
+    m_retiredColorBuffers.clear();
     m_colorBufferDelayedCloseList.clear();
     if (m_useSubWindow) {
         removeSubWindow_locked();
@@ -591,7 +595,7 @@ bool FrameBuffer::initialize(int width, int height, bool useSubWindow,
         goldfish_vk::setUseCreateResourcesWithRequirements(emu, useCreateResourcesWithRequirements);
     }
 
-    // Start up the single sync thread if GLAsyncSwap enabled
+    // Start up the sync threads if GLAsyncSwap enabled
     if (emugl::emugl_feature_is_enabled(android::featurecontrol::GLAsyncSwap)) {
         SyncThread::get();
     }
@@ -631,16 +635,14 @@ void FrameBuffer::setColorBufferInUse(
     bool inUse) {
 	PD("");
 
-    AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c(m_colorbuffers.find(colorBufferHandle));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb = m_colorBufferTable.get(colorBufferHandle);
+    if (!cb) {
         // bad colorbuffer handle
         ERR("FB: setColorBufferInUse cb handle %#x not found\n", colorBufferHandle);
         return;
     }
 
-    (*c).second.cb->setInUse(inUse);
+    cb->setInUse(inUse);
 }
 
 void FrameBuffer::disableFastBlit() {
@@ -721,7 +723,8 @@ FrameBuffer::sendReadbackWorkerCmd(const Readback& readback) {
         m_readbackWorker->initGL();
         return WorkerProcessingResult::Continue;
     case ReadbackCmd::GetPixels:
-        m_readbackWorker->getPixels(readback.pixelsOut, readback.bytes);
+        m_readbackWorker->getPixels(readback.pixelsOut, readback.bytes,
+                                    readback.consumer);
         return WorkerProcessingResult::Continue;
     case ReadbackCmd::Exit:
         m_readbackWorker.reset();
@@ -1114,6 +1117,7 @@ HandleType FrameBuffer::createColorBufferWithHandleLocked(
                 m_colorbuffers[handle] = {std::move(cb), 0, false, 0};
             }
         }
+        m_colorBufferTable.set(handle, m_colorbuffers[handle].cb);
     } else {
         handle = 0;
         DBG("Create color buffer failed.\n");
@@ -1388,6 +1392,7 @@ void FrameBuffer::closeColorBufferLocked(HandleType p_colorbuffer,
     if (--c->second.refcount == 0) {
         if (forced) {
             eraseDelayedCloseColorBufferLocked(c->first, c->second.closedTs);
+            removeFromColorBufferTableLocked(p_colorbuffer);
             m_colorbuffers.erase(c);
         } else {
             c->second.closedTs = System::get()->getUnixTime();
@@ -1414,6 +1419,7 @@ void FrameBuffer::performDelayedColorBufferCloseLocked(bool forced) {
         if (it->cbHandle != 0) {
             const auto& cb = m_colorbuffers.find(it->cbHandle);
             if (cb != m_colorbuffers.end()) {
+                removeFromColorBufferTableLocked(it->cbHandle);
                 m_colorbuffers.erase(cb);
             }
         }
@@ -1421,6 +1427,27 @@ void FrameBuffer::performDelayedColorBufferCloseLocked(bool forced) {
     }
     m_colorBufferDelayedCloseList.erase(
                 m_colorBufferDelayedCloseList.begin(), it);
+    sweepRetiredColorBuffersLocked();
+}
+
+void FrameBuffer::removeFromColorBufferTableLocked(HandleType p_colorbuffer) {
+    ColorBufferPtr cb = m_colorBufferTable.remove(p_colorbuffer);
+    // |cb| and m_colorbuffers hold the other two references.
+    if (cb && cb.use_count() > 2) {
+        m_retiredColorBuffers.push_back(std::move(cb));
+    }
+}
+
+void FrameBuffer::sweepRetiredColorBuffersLocked() {
+    // Nothing can find a retired color buffer anymore, so one that's down
+    // to this last reference stays unused.
+    m_retiredColorBuffers.erase(
+            std::remove_if(m_retiredColorBuffers.begin(),
+                           m_retiredColorBuffers.end(),
+                           [](const ColorBufferPtr& cb) {
+                               return cb.use_count() == 1;
+                           }),
+            m_retiredColorBuffers.end());
 }
 
 void FrameBuffer::eraseDelayedCloseColorBufferLocked(
@@ -1786,16 +1813,12 @@ bool FrameBuffer::getColorBufferInfo(
     HandleType p_colorbuffer, int* width, int* height, GLint* internalformat) {
 
 	PD("");
-    AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb = m_colorBufferTable.get(p_colorbuffer);
+    if (!cb) {
         // bad colorbuffer handle
         return false;
     }
 
-    auto cb = (*c).second.cb;
-
     *width = cb->getWidth();
     *height = cb->getHeight();
     *internalformat = cb->getInternalFormat();
@@ -1803,41 +1826,41 @@ bool FrameBuffer::getColorBufferInfo(
     return true;
 }
 
+// The lookup doesn't need m_lock, but the bind does: reformat() and
+// importMemory() replace the color buffer's EGLImage under it, and restoring
+// a color buffer loaded from a snapshot uses the helper context.
 bool FrameBuffer::bindColorBufferToTexture(HandleType p_colorbuffer) {
-    AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb = m_colorBufferTable.get(p_colorbuffer);
+    if (!cb) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToTexture();
+    AutoLock mutex(m_lock);
+    return cb->bindToTexture();
 }
 
 bool FrameBuffer::bindColorBufferToTexture2(HandleType p_colorbuffer) {
-    AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb = m_colorBufferTable.get(p_colorbuffer);
+    if (!cb) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToTexture2();
+    AutoLock mutex(m_lock);
+    return cb->bindToTexture2();
 }
 
 bool FrameBuffer::bindColorBufferToRenderbuffer(HandleType p_colorbuffer) {
 	PD("p_colorbuffer 0x%x",p_colorbuffer);
-    AutoLock mutex(m_lock);
-
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
+    ColorBufferPtr cb = m_colorBufferTable.get(p_colorbuffer);
+    if (!cb) {
         // bad colorbuffer handle
         return false;
     }
 
-    return (*c).second.cb->bindToRenderbuffer();
+    AutoLock mutex(m_lock);
+    return cb->bindToRenderbuffer();
 }
 
 bool FrameBuffer::bindContext(HandleType p_context,
@@ -2231,6 +2254,9 @@ bool FrameBuffer::postImpl(HandleType p_colorbuffer,
                 printf("Resident memory: %f mb %s \n%s\n",
                     (float)usage.resident / 1048576.0f, lastStats.c_str(),
                     memoryStats.c_str());
+                if (m_readbackWorker) {
+                    printReadbackStats();
+                }
             }
         }
     }
@@ -2243,14 +2269,27 @@ bool FrameBuffer::postImpl(HandleType p_colorbuffer,
             auto cb = (*c).second.cb;
             if (!m_readbackWorker) {
                 if (!m_readbackThread.isStarted()) {
-                    m_readbackWorker.reset(new ReadbackWorker(cb->getWidth(), cb->getHeight()));
+                    // ANDROID_EMUGL_READBACK_BUFFERS sets the depth of the
+                    // readback ring; more buffers let slower consumers
+                    // copy out a frame over several posts.
+                    uint32_t readbackBuffers =
+                            ReadbackWorker::kDefaultBufferCount;
+                    const std::string buffersEnv = System::get()->envGet(
+                            "ANDROID_EMUGL_READBACK_BUFFERS");
+                    if (!buffersEnv.empty()) {
+                        readbackBuffers = std::max(
+                                2, std::min(16, atoi(buffersEnv.c_str())));
+                    }
+                    m_readbackWorker.reset(new ReadbackWorker(
+                            cb->getWidth(), cb->getHeight(), readbackBuffers));
                     m_readbackThread.start();
                     m_readbackThread.enqueue({ReadbackCmd::Init});
                     m_readbackThread.waitQueuedItems();
                 }
             }
 
-            m_readbackWorker->doNextReadback(cb.get(), m_fbImage, repaint, m_postCallbackReadBgra);
+            m_readbackWorker->doNextReadback(cb.get(), m_fbImage,
+                                             m_postCallbackReadBgra);
         } else {
             (*c).second.cb->readback(m_fbImage, m_postCallbackReadBgra);
             doPostCallback(m_fbImage);
@@ -2264,13 +2303,29 @@ EXIT:
     return ret;
 }
 
+void FrameBuffer::printReadbackStats() {
+    for (const auto& it : m_readbackWorker->consumerStats()) {
+        const auto& stats = it.second;
+        const uint64_t spanUs = stats.lastFrameUs - stats.firstFrameUs;
+        printf("Readback consumer %lu: %llu frames (%llu repeated), "
+               "%.2f fps, %.2f MB/s, latency avg %.2f ms max %.2f ms\n",
+               it.first, (unsigned long long)stats.frames,
+               (unsigned long long)stats.repeatedFrames,
+               spanUs ? (stats.frames - 1) * 1000000.0 / spanUs : 0.0,
+               spanUs ? stats.bytes / (double)spanUs : 0.0,
+               stats.totalLatencyUs / 1000.0 / stats.frames,
+               stats.maxLatencyUs / 1000.0);
+    }
+}
+
 void FrameBuffer::doPostCallback(void* pixels) {
     m_onPost(m_onPostContext, m_framebufferWidth, m_framebufferHeight, -1, GL_RGBA, GL_UNSIGNED_BYTE,
              (unsigned char*)pixels);
 }
 
 void FrameBuffer::getPixels(void* pixels, uint32_t bytes) {
-    m_readbackThread.enqueue({ ReadbackCmd::GetPixels, 0, pixels, bytes });
+    m_readbackThread.enqueue({ReadbackCmd::GetPixels, 0, pixels, bytes,
+                              android::base::getCurrentThreadId()});
     m_readbackThread.waitQueuedItems();
 }
 
@@ -2402,6 +2457,7 @@ bool FrameBuffer::decColorBufferRefCountLocked(HandleType p_colorbuffer) {
     if (it != m_colorbuffers.end()) {
         it->second.refcount -= 1;
         if (it->second.refcount == 0) {
+            removeFromColorBufferTableLocked(p_colorbuffer);
             m_colorbuffers.erase(p_colorbuffer);
             return true;
         }
@@ -2575,6 +2631,7 @@ bool FrameBuffer::onLoad(Stream* stream,
             m_contexts.clear();
             m_windows.clear();
             m_colorbuffers.clear();
+            m_colorBufferTable.clear();
         } else {
             std::vector<HandleType> colorBuffersToCleanup;
 
@@ -2635,6 +2692,7 @@ bool FrameBuffer::onLoad(Stream* stream,
         if (!m_colorbuffers.empty()) {
             fprintf(stderr, "%s: warning: on load, stale colorbuffers: %zu\n", __func__, m_colorbuffers.size());
             m_colorbuffers.clear();
+            m_colorBufferTable.clear();
         }
         assert(m_colorbuffers.empty());
 #ifdef SNAPSHOT_PROFILE
@@ -2683,6 +2741,9 @@ bool FrameBuffer::onLoad(Stream* stream,
         }
         return { handle, { std::move(cb), refCount, opened, closedTs } };
     });
+    for (const auto& it : m_colorbuffers) {
+        m_colorBufferTable.set(it.first, it.second.cb);
+    }
     m_lastPostedColorBuffer = static_cast<HandleType>(stream->getBe32());
     GL_LOG("Got lasted posted color buffer from snapshot");
 
@@ -2718,14 +2779,29 @@ bool FrameBuffer::onLoad(Stream* stream,
 
     registerTriggerWait();
 
+    // Only the color buffers on screen are restored right away, so that
+    // the first frame after the load doesn't wait for the others. Those
+    // that windows render to come next from the background loader, and the
+    // rest restore on first use (every ColorBuffer entry point touch()es).
     {
         ScopedBind scopedBind(m_colorBufferHelper);
-        for (auto& it : m_colorbuffers) {
-            if (it.second.cb) {
-                it.second.cb->touch();
+        std::vector<HandleType> onScreen = {m_lastPostedColorBuffer};
+        for (const auto& it : displays_onLoad) {
+            onScreen.push_back(it.second.cb);
+        }
+        for (HandleType handle : onScreen) {
+            const auto it = m_colorbuffers.find(handle);
+            if (it != m_colorbuffers.end() && it->second.cb) {
+                it->second.cb->touch();
             }
         }
     }
+    for (const auto& it : m_windows) {
+        const auto cb = m_colorbuffers.find(it.second.second);
+        if (cb != m_colorbuffers.end() && cb->second.cb) {
+            cb->second.cb->prioritizeRestore();
+        }
+    }
 
     // Restore Vulkan state
     if (emugl::emugl_feature_is_enabled(android::featurecontrol::VulkanSnapshots) &&
@@ -2789,13 +2865,7 @@ void FrameBuffer::unlock() {
 }
 
 ColorBufferPtr FrameBuffer::findColorBuffer(HandleType p_colorbuffer) {
-    ColorBufferMap::iterator c(m_colorbuffers.find(p_colorbuffer));
-    if (c == m_colorbuffers.end()) {
-        return nullptr;
-    }
-    else {
-        return c->second.cb;
-    }
+    return m_colorBufferTable.get(p_colorbuffer);
 }
 
 void FrameBuffer::registerProcessCleanupCallback(void* key, std::function<void()> cb) {
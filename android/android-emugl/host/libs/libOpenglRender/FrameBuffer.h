@@ -22,6 +22,7 @@
 #include "android/snapshot/common.h"
 
 #include "ColorBuffer.h"
+#include "ConcurrentHandleMap.h"
 #include "emugl/common/mutex.h"
 #include "FbConfig.h"
 #include "GLESVersionDetector.h"
@@ -588,6 +589,11 @@ private:
     void performDelayedColorBufferCloseLocked(bool forced = false);
     void eraseDelayedCloseColorBufferLocked(
             HandleType cb, android::base::System::Duration ts);
+    // Removes |p_colorbuffer| from m_colorBufferTable, before it's erased
+    // from m_colorbuffers.
+    void removeFromColorBufferTableLocked(HandleType p_colorbuffer);
+    // Destroys the retired color buffers no other thread uses anymore.
+    void sweepRetiredColorBuffersLocked();
 
     bool postImpl(HandleType p_colorbuffer, bool needLockAndBind = true, bool repaint = false);
     void setGuestPostedAFrame() { m_guestPostedAFrame = true; }
@@ -635,6 +641,14 @@ private:
     RenderContextMap m_contexts;
     WindowSurfaceMap m_windows;
     ColorBufferMap m_colorbuffers;
+    // The color buffers of m_colorbuffers, for the lookups that don't take
+    // m_lock (findColorBuffer(), getColorBufferInfo()...).
+    // Only changed with m_lock held, together with m_colorbuffers.
+    ConcurrentHandleMap<ColorBuffer> m_colorBufferTable;
+    // Color buffers removed while such a lookup still had them: they're kept
+    // here until it's done, as destroying a color buffer needs m_lock for
+    // the helper context.
+    std::vector<ColorBufferPtr> m_retiredColorBuffers;
     std::unordered_map<HandleType, HandleType> m_windowSurfaceToColorBuffer;
 
     // A collection of color buffers that were closed without any usages
@@ -713,10 +727,14 @@ private:
         GLuint bufferId;
         void* pixelsOut;
         uint32_t bytes;
+        // Thread id of the getPixels() caller.
+        unsigned long consumer;
     };
     std::unique_ptr<ReadbackWorker> m_readbackWorker = {};
     android::base::WorkerThread<Readback> m_readbackThread;
     android::base::WorkerProcessingResult sendReadbackWorkerCmd(const Readback& readback);
+    // Prints the latency and throughput of each readback consumer.
+    void printReadbackStats();
 
     bool m_asyncReadbackSupported = true;
     bool m_guestPostedAFrame = false;
@@ -1,4 +1,3 @@
-
 #include "ReadbackWorker.h"
 
 #include "ColorBuffer.h"
@@ -8,18 +7,28 @@
 #include "OpenGLESDispatch/EGLDispatch.h"
 #include "OpenGLESDispatch/GLESv2Dispatch.h"
 
+#include "android/base/system/System.h"
+
+#include <algorithm>
+
+using android::base::System;
+
+// How long getPixels() waits for a readback to be done, in ns.
+static constexpr GLuint64 kReadbackTimeoutNs = 1000000000ULL;
 
-ReadbackWorker::ReadbackWorker(uint32_t width, uint32_t height) :
+ReadbackWorker::ReadbackWorker(uint32_t width,
+                               uint32_t height,
+                               uint32_t bufferCount) :
     mFb(FrameBuffer::getFB()),
-    mBufferSize(4 * width * height /* RGBA8 (4 bpp) */),
-    mBuffers(3 /* mailbox */, 0) {
+    mSlots(std::max(bufferCount, 2u)),
+    mBufferSize(4 * width * height /* RGBA8 (4 bpp) */) {
 }
 
 void ReadbackWorker::initGL() {
     mFb->createAndBindTrivialSharedContext(&mContext, &mSurf);
-    s_gles2.glGenBuffers(mBuffers.size(), &mBuffers[0]);
-    for (auto buffer : mBuffers) {
-        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+    for (auto& slot : mSlots) {
+        s_gles2.glGenBuffers(1, &slot.buffer);
+        s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
         s_gles2.glBufferData(GL_PIXEL_PACK_BUFFER, mBufferSize,
                              0 /* init, with no data */,
                              GL_STREAM_READ);
@@ -30,105 +39,111 @@ void ReadbackWorker::initGL() {
 ReadbackWorker::~ReadbackWorker() {
     s_gles2.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     s_gles2.glBindBuffer(GL_COPY_READ_BUFFER, 0);
-    s_gles2.glDeleteBuffers(mBuffers.size(), &mBuffers[0]);
+    for (auto& slot : mSlots) {
+        if (slot.fence) {
+            s_gles2.glDeleteSync(slot.fence);
+        }
+        s_gles2.glDeleteBuffers(1, &slot.buffer);
+    }
     mFb->unbindAndDestroyTrivialSharedContext(mContext, mSurf);
 }
 
 void ReadbackWorker::doNextReadback(ColorBuffer* cb, void* fbImage,
-                                    bool repaint, bool readbackBgra) {
-
-    // if |repaint|, make sure that the current frame is immediately sent down
-    // the pipeline and made available to the consumer by priming async
-    // readback; doing 4 consecutive reads in a row, which should be enough to
-    // fill the 3 buffers in the triple buffering setup and on the 4th, trigger
-    // a post callback.
-    int numIter = repaint ? 4 : 1;
-
-    // Mailbox-style triple buffering setup:
-    // We want to avoid glReadPixels while in the middle of doing
-    // memcpy to the consumer, but also want to avoid latency while
-    // that is going on.
-    //
-    // There are 3 buffer ids, A, B, and C.
-    // If we are not in the middle of copying out a frame,
-    // set glReadPixels to write to buffer A and copy from buffer B in
-    // alternation, so the consumer always gets the latest frame
-    // +1 frame of lag in order to not cause blocking on
-    // glReadPixels / glMapBufferRange.
-    // If we are in the middle of copying out a frame, reset A and B to
-    // not be the buffer being copied out, and continue glReadPixels to
-    // buffer A and B as before.
-    //
-    // The resulting invariants are:
-    // - glReadPixels is called on a different buffer every time
-    //   so we avoid introducing sync points there.
-    // - At no time are we mapping/copying a buffer and also doing
-    //   glReadPixels on it (avoid simultaneous map + glReadPixels)
-    // - glReadPixels and then immediately map/copy the same buffer
-    //   doesn't happen either (avoid sync point in glMapBufferRange)
-    for (int i = 0; i < numIter; i++) {
-        android::base::AutoLock lock(mLock);
-        if (mIsCopying) {
-            switch (mMapCopyIndex) {
-                // To keep double buffering effect on
-                // glReadPixels, need to keep even/oddness of
-                // mReadPixelsIndexEven and mReadPixelsIndexOdd.
-                case 0:
-                    mReadPixelsIndexEven = 2;
-                    mReadPixelsIndexOdd = 1;
-                    break;
-                case 1:
-                    mReadPixelsIndexEven = 0;
-                    mReadPixelsIndexOdd = 2;
-                    break;
-                case 2:
-                    mReadPixelsIndexEven = 0;
-                    mReadPixelsIndexOdd = 1;
-                    break;
-            }
-        } else {
-            mReadPixelsIndexEven = 0;
-            mReadPixelsIndexOdd = 1;
-            mMapCopyIndex = mPrevReadPixelsIndex;
-        }
+                                    bool readbackBgra) {
+    // Each readback goes to the next buffer of the ring, skipping the one
+    // getPixels() may be copying out: glReadPixels is never called on a
+    // buffer that's mapped, and the earlier frames stay available while
+    // this one is read. The fence of each buffer tells getPixels() whether
+    // its readback is done, so the consumer never maps a buffer that is
+    // still being written to, and this thread never waits for the consumer.
+    android::base::AutoLock lock(mLock);
+    uint32_t readAt = mNextSlot;
+    if (static_cast<int>(readAt) == mCopySlot) {
+        readAt = (readAt + 1) % mSlots.size();
+    }
+    mNextSlot = (readAt + 1) % mSlots.size();
+    Slot& slot = mSlots[readAt];
+    slot.seq = 0;
+    lock.unlock();
 
-        // Double buffering on buffer A / B part
-        uint32_t readAt;
-        if (m_readbackCount % 2 == 0) {
-            readAt = mReadPixelsIndexEven;
-        } else {
-            readAt = mReadPixelsIndexOdd;
-        }
-        lock.unlock();
+    const uint64_t readbackUs = System::get()->getHighResTimeUs();
+    cb->readbackAsync(slot.buffer, readbackBgra, &slot.fence);
 
-        cb->readbackAsync(mBuffers[readAt], readbackBgra);
+    lock.lock();
+    slot.seq = ++mSeq;
+    slot.readbackUs = readbackUs;
+    lock.unlock();
 
-        // It's possible to post callback before any of the async readbacks
-        // have written any data yet, which results in a black frame.  Safer
-        // option to avoid this glitch is to wait until all 3 potential
-        // buffers in our triple buffering setup have had chances to readback.
-        if (m_readbackCount > 2) {
-            mFb->doPostCallback(fbImage);
-        }
-        m_readbackCount++;
+    mFb->doPostCallback(fbImage);
+}
 
-        mPrevReadPixelsIndex = readAt;
+int ReadbackWorker::pickSlotToCopyLocked() {
+    int latest = -1;
+    int latestDone = -1;
+    for (int i = 0; i < static_cast<int>(mSlots.size()); i++) {
+        const Slot& slot = mSlots[i];
+        if (!slot.seq) {
+            continue;
+        }
+        if (latest < 0 || slot.seq > mSlots[latest].seq) {
+            latest = i;
+        }
+        if ((latestDone < 0 || slot.seq > mSlots[latestDone].seq) &&
+            (!slot.fence || s_gles2.glClientWaitSync(slot.fence, 0, 0) !=
+                                    GL_TIMEOUT_EXPIRED)) {
+            latestDone = i;
+        }
     }
+    return latestDone >= 0 ? latestDone : latest;
 }
 
-void ReadbackWorker::getPixels(void* buf, uint32_t bytes) {
+void ReadbackWorker::getPixels(void* buf, uint32_t bytes,
+                               unsigned long consumer) {
     android::base::AutoLock lock(mLock);
-    mIsCopying = true;
+    mCopySlot = pickSlotToCopyLocked();
+    if (mCopySlot < 0) {
+        // Nothing was posted yet.
+        return;
+    }
+    const Slot slot = mSlots[mCopySlot];
     lock.unlock();
 
-    GLuint buffer = mBuffers[mMapCopyIndex];
-    s_gles2.glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    // Only waits if none of the readbacks are done yet.
+    if (slot.fence) {
+        s_gles2.glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 kReadbackTimeoutNs);
+    }
+
+    s_gles2.glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
     void* pixels = s_gles2.glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes,
                                             GL_MAP_READ_BIT);
-    memcpy(buf, pixels, bytes);
+    if (pixels) {
+        memcpy(buf, pixels, bytes);
+    }
     s_gles2.glUnmapBuffer(GL_COPY_READ_BUFFER);
 
+    const uint64_t nowUs = System::get()->getHighResTimeUs();
     lock.lock();
-    mIsCopying = false;
-    lock.unlock();
+    mCopySlot = -1;
+
+    ConsumerStats& stats = mConsumerStats[consumer];
+    if (slot.seq == stats.lastFrameSeq) {
+        ++stats.repeatedFrames;
+    }
+    if (!stats.frames) {
+        stats.firstFrameUs = nowUs;
+    }
+    ++stats.frames;
+    stats.bytes += bytes;
+    const uint64_t latencyUs = nowUs - slot.readbackUs;
+    stats.totalLatencyUs += latencyUs;
+    stats.maxLatencyUs = std::max(stats.maxLatencyUs, latencyUs);
+    stats.lastFrameUs = nowUs;
+    stats.lastFrameSeq = slot.seq;
+}
+
+std::unordered_map<unsigned long, ReadbackWorker::ConsumerStats>
+ReadbackWorker::consumerStats() const {
+    android::base::AutoLock lock(mLock);
+    return mConsumerStats;
 }
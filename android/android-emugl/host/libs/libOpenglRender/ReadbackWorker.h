@@ -6,6 +6,7 @@
 #include <EGL/egl.h>
 #include <GLES3/gl3.h>
 
+#include <unordered_map>
 #include <vector>
 
 class ColorBuffer;
@@ -17,7 +18,28 @@ struct RenderThreadInfo;
 // and a separate GL thread, with two main points of interaction:
 class ReadbackWorker {
 public:
-    ReadbackWorker(uint32_t width, uint32_t height);
+    // Readback statistics of one consumer of getPixels().
+    struct ConsumerStats {
+        // Frames copied out, and how many of them had been copied out to
+        // this consumer already (it asked faster than frames were posted).
+        uint64_t frames = 0;
+        uint64_t repeatedFrames = 0;
+        uint64_t bytes = 0;
+        // From doNextReadback() to the end of the copy, over all the frames.
+        uint64_t totalLatencyUs = 0;
+        uint64_t maxLatencyUs = 0;
+        // When the first and last frames were copied out.
+        uint64_t firstFrameUs = 0;
+        uint64_t lastFrameUs = 0;
+        uint64_t lastFrameSeq = 0;
+    };
+
+    static constexpr uint32_t kDefaultBufferCount = 3;
+
+    // |bufferCount| is the depth of the readback ring, at least 2.
+    ReadbackWorker(uint32_t width,
+                   uint32_t height,
+                   uint32_t bufferCount = kDefaultBufferCount);
     ~ReadbackWorker();
 
     // GL initialization (must be on the thread that
@@ -29,35 +51,53 @@ public:
     // This will trigger an async glReadPixels of the current framebuffer.
     // The post callback of Framebuffer will also be triggered, but
     // in async mode it should do minimal work that involves |fbImage|.
-    // |repaint|: flag to prime async readback with multiple iterations
-    // so that the consumer of readback doesn't lag behind.
     // |readbackBgra|: Whether to force the readback format as GL_BGRA_EXT,
     // so that we get (depending on driver quality, heh) a gpu conversion of the
     // readback image that is suitable for webrtc, which expects formats like that.
-    void doNextReadback(ColorBuffer* cb, void* fbImage, bool repaint, bool readbackBgra);
+    void doNextReadback(ColorBuffer* cb, void* fbImage, bool readbackBgra);
 
     // getPixels(): Run this on a separate GL thread. This retrieves the
     // latest framebuffer that has been posted and read with doNextReadback.
     // This is meant for apps like video encoding to use as input; they will
     // need to do synchronized communication with the thread ReadbackWorker
     // is running on.
-    void getPixels(void* out, uint32_t bytes);
+    // |consumer| identifies the caller in consumerStats().
+    void getPixels(void* out, uint32_t bytes, unsigned long consumer = 0);
+
+    std::unordered_map<unsigned long, ConsumerStats> consumerStats() const;
+
 private:
+    // A pixel pack buffer of the ring. Readbacks go around the ring, so the
+    // previous frames stay available while the next one is read.
+    struct Slot {
+        GLuint buffer = 0;
+        // Signals when the readback into |buffer| is done.
+        GLsync fence = nullptr;
+        // 0 while there's no complete frame to copy out.
+        uint64_t seq = 0;
+        uint64_t readbackUs = 0;
+    };
+
+    // Returns the slot getPixels() should copy out, -1 if there's none yet.
+    // Takes the most recent readback that's done if there's one, the most
+    // recent one otherwise.
+    int pickSlotToCopyLocked();
+
     EGLContext mContext;
     EGLSurface mSurf;
     RenderThreadInfo* mTLS;
     FrameBuffer* mFb;
 
-    android::base::Lock mLock;
-    uint32_t mReadPixelsIndexEven = 0;
-    uint32_t mReadPixelsIndexOdd = 1;
-    uint32_t mPrevReadPixelsIndex = 1;
-    uint32_t mMapCopyIndex = 0;
-    bool mIsCopying = false;
+    mutable android::base::Lock mLock;
+    std::vector<Slot> mSlots;
+    // Where doNextReadback() reads to next and getPixels() copies from,
+    // -1 when it isn't copying.
+    uint32_t mNextSlot = 0;
+    int mCopySlot = -1;
+    uint64_t mSeq = 0;
 
     uint32_t mBufferSize = 0;
-    std::vector<GLuint> mBuffers = {};
-    uint32_t m_readbackCount = 0;
+    std::unordered_map<unsigned long, ConsumerStats> mConsumerStats;
 
     DISALLOW_COPY_AND_ASSIGN(ReadbackWorker);
 };
@@ -52,6 +52,10 @@ void RenderLibImpl::setGLObjectCounter(
     emugl::setGLObjectCounter(counter);
 }
 
+void RenderLibImpl::setShaderCacheDir(const char* dir) {
+    emugl::setShaderCacheDir(dir);
+}
+
 void RenderLibImpl::setCrashReporter(emugl_crash_reporter_t reporter) {
     set_emugl_crash_reporter(reporter);
 }
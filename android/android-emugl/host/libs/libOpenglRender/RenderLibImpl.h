@@ -33,6 +33,7 @@ public:
     virtual void setLogger(emugl_logger_struct logger) override;
     virtual void setGLObjectCounter(
             android::base::GLObjectCounter* counter) override;
+    virtual void setShaderCacheDir(const char* dir) override;
     virtual void setCrashReporter(emugl_crash_reporter_t reporter) override;
     virtual void setFeatureController(emugl_feature_is_enabled_t featureController) override;
     virtual void setSyncDevice(emugl_sync_create_timeline_t,
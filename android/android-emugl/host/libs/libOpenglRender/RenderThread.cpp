@@ -68,6 +68,12 @@ static uint64_t currTimeUs(bool enable) {
     }
 }
 
+// Base opcodes of the decoders: each one owns the opcodes from its base up
+// to the next one. GLESv1 opcodes start at 1024.
+static constexpr uint32_t kGles2BaseOpcode = 2048;
+static constexpr uint32_t kRenderControlBaseOpcode = 10000;
+static constexpr uint32_t kVulkanBaseOpcode = 20000;
+
 // Start with a smaller buffer to not waste memory on a low-used render threads.
 static constexpr int kStreamBufferSize = 128 * 1024;
 
@@ -390,84 +396,80 @@ intptr_t RenderThread::main() {
         }
 
         auto progressStart = currTimeUs(benchmarkEnabled);
-        bool progress;
-        do {
-            progress = false;
-
-            // try to process some of the command buffer using the GLESv1
-            // decoder
-            //
-            // DRIVER WORKAROUND:
-            // On Linux with NVIDIA GPU's at least, we need to avoid performing
-            // GLES ops while someone else holds the FrameBuffer write lock.
-            //
-            // To be more specific, on Linux with NVIDIA Quadro K2200 v361.xx,
-            // we get a segfault in the NVIDIA driver when glTexSubImage2D
-            // is called at the same time as glXMake(Context)Current.
-            //
-            // To fix, this driver workaround avoids calling
-            // any sort of GLES call when we are creating/destroying EGL
-            // contexts.
-            {
-                AEMU_SCOPED_THRESHOLD_TRACE("lockContextStructureRead");
-                FrameBuffer::getFB()->lockContextStructureRead();
-            }
-            size_t last;
-
-            {
-                AEMU_SCOPED_THRESHOLD_TRACE("glDec.decode");
-                last = tInfo.m_glDec.decode(
-                        readBuf.buf(), readBuf.validData(), ioStream, &checksumCalc);
-                if (last > 0) {
-                    progress = true;
-                    readBuf.consume(last);
+
+        //
+        // hand the command buffer to the decoder that owns the next opcode;
+        // each decoder goes on through all of the following packets it owns,
+        // and stops early on a packet that isn't complete yet.
+        //
+        while (readBuf.validData() >= 8) {
+            uint32_t opcode = *(const uint32_t*)readBuf.buf();
+            size_t last = 0;
+
+            if (opcode < kRenderControlBaseOpcode) {
+                // DRIVER WORKAROUND:
+                // On Linux with NVIDIA GPU's at least, we need to avoid
+                // performing GLES ops while someone else holds the FrameBuffer
+                // write lock.
+                //
+                // To be more specific, on Linux with NVIDIA Quadro K2200
+                // v361.xx, we get a segfault in the NVIDIA driver when
+                // glTexSubImage2D is called at the same time as
+                // glXMake(Context)Current.
+                //
+                // To fix, this driver workaround avoids calling
+                // any sort of GLES call when we are creating/destroying EGL
+                // contexts.
+                {
+                    AEMU_SCOPED_THRESHOLD_TRACE("lockContextStructureRead");
+                    FrameBuffer::getFB()->lockContextStructureRead();
                 }
-            }
 
-            //
-            // try to process some of the command buffer using the GLESv2
-            // decoder
-            //
-            {
-                AEMU_SCOPED_THRESHOLD_TRACE("gl2Dec.decode");
-                last = tInfo.m_gl2Dec.decode(readBuf.buf(), readBuf.validData(),
-                                             ioStream, &checksumCalc);
-
-                if (last > 0) {
-                    progress = true;
+                // Interleaved GLESv1 and GLESv2 packets all go under the
+                // same lock.
+                do {
+                    if (opcode < kGles2BaseOpcode) {
+                        AEMU_SCOPED_THRESHOLD_TRACE("glDec.decode");
+                        last = tInfo.m_glDec.decode(readBuf.buf(),
+                                                    readBuf.validData(),
+                                                    ioStream, &checksumCalc);
+                    } else {
+                        AEMU_SCOPED_THRESHOLD_TRACE("gl2Dec.decode");
+                        last = tInfo.m_gl2Dec.decode(readBuf.buf(),
+                                                     readBuf.validData(),
+                                                     ioStream, &checksumCalc);
+                    }
+                    if (!last) {
+                        break;
+                    }
                     readBuf.consume(last);
+                    if (readBuf.validData() < 8) {
+                        break;
+                    }
+                    opcode = *(const uint32_t*)readBuf.buf();
+                } while (opcode < kRenderControlBaseOpcode);
+
+                FrameBuffer::getFB()->unlockContextStructureRead();
+                if (!last) {
+                    break;
                 }
+                continue;
             }
 
-            FrameBuffer::getFB()->unlockContextStructureRead();
-            //
-            // try to process some of the command buffer using the
-            // renderControl decoder
-            //
-            {
+            if (opcode < kVulkanBaseOpcode) {
                 AEMU_SCOPED_THRESHOLD_TRACE("rcDec.decode");
                 last = tInfo.m_rcDec.decode(readBuf.buf(), readBuf.validData(),
                                             ioStream, &checksumCalc);
-                if (last > 0) {
-                    readBuf.consume(last);
-                    progress = true;
-                }
-            }
-
-            //
-            // try to process some of the command buffer using the
-            // Vulkan decoder
-            //
-            {
+            } else {
                 AEMU_SCOPED_THRESHOLD_TRACE("vkDec.decode");
                 last = tInfo.m_vkDec.decode(readBuf.buf(), readBuf.validData(),
                                             ioStream);
-                if (last > 0) {
-                    readBuf.consume(last);
-                    progress = true;
-                }
             }
-        } while (progress);
+            if (!last) {
+                break;
+            }
+            readBuf.consume(last);
+        }
     }
 
     if (dumpFP) {
@@ -98,9 +98,6 @@ const unsigned char* RingStream::readRaw(void* buf, size_t* inout_len) {
     uint32_t ringAvailable = 0;
     uint32_t ringLargeXferAvailable = 0;
 
-    const uint32_t maxSpins = 30;
-    uint32_t spins = 0;
-
     while (count < wanted) {
 
         if (mReadBufferLeft) {
@@ -158,16 +155,8 @@ const unsigned char* RingStream::readRaw(void* buf, size_t* inout_len) {
             type3Read(ringLargeXferAvailable,
                       &count, &current, ptrEnd);
         } else {
-            if (++spins < maxSpins) {
-                ring_buffer_yield();
-                continue;
-            } else {
-                spins = 0;
-            }
-
-            if (mShouldExit) {
-                return nullptr;
-            }
+            // The callback spins for as long as the guest usually takes to
+            // send more, then parks until it does.
             if (-1 == mCallbacks.onUnavailableRead()) {
                 mShouldExit = true;
             }
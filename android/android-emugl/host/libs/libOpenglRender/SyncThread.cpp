@@ -17,6 +17,7 @@
 #include "SyncThread.h"
 
 #include "android/base/memory/LazyInstance.h"
+#include "android/base/system/System.h"
 #include "android/utils/debug.h"
 #include "emugl/common/crash_reporter.h"
 #include "emugl/common/OpenGLDispatchLoader.h"
@@ -25,6 +26,7 @@
 #ifndef _MSC_VER
 #include <sys/time.h>
 #endif
+#include <algorithm>
 #include <memory>
 
 #define DEBUG 0
@@ -48,7 +50,9 @@ static uint64_t curr_ms() {
 
 #endif
 
+using android::base::AutoLock;
 using android::base::LazyInstance;
+using android::base::System;
 
 // The single global sync thread instance.
 class GlobalSyncThread {
@@ -66,10 +70,24 @@ static LazyInstance<GlobalSyncThread> sGlobalSyncThread = LAZY_INSTANCE_INIT;
 static const uint32_t kTimelineInterval = 1;
 static const uint64_t kDefaultTimeoutNsecs = 5ULL * 1000ULL * 1000ULL * 1000ULL;
 
-SyncThread::SyncThread() :
-    emugl::Thread(android::base::ThreadFlags::MaskSignals, 512 * 1024) {
-    this->start();
-    initSyncContext();
+// Each worker keeps an EGL context and a pbuffer surface, so don't go
+// overboard; guests rarely have more than a handful of busy timelines.
+static const int kMaxSyncWorkers = 4;
+
+SyncThread::SyncThread(int numWorkers) {
+    if (numWorkers < 1) {
+        numWorkers = std::max(
+                1, std::min(kMaxSyncWorkers,
+                            System::get()->getCpuCoreCount() / 2));
+    }
+    mWorkers.reserve(numWorkers);
+    for (int i = 0; i < numWorkers; ++i) {
+        mWorkers.emplace_back(new Worker(this));
+        mWorkers.back()->start();
+    }
+    for (auto& worker : mWorkers) {
+        worker->initSyncContext();
+    }
 }
 
 SyncThread::~SyncThread() {
@@ -80,26 +98,74 @@ void SyncThread::triggerWait(FenceSync* fenceSync,
                              uint64_t timeline) {
     DPRINT("fenceSyncInfo=0x%llx timeline=0x%lx ...",
             fenceSync, timeline);
+    // Hold a reference until the worker is done with the fence: waits on
+    // other timelines sweep old fences on other workers, and may drop the
+    // timeline's references while this one is still queued or waiting.
+    FenceSync* fence =
+        FenceSync::getFromHandle((uint64_t)(uintptr_t)fenceSync);
+    if (fence) {
+        fence->incRef();
+    }
     SyncThreadCmd to_send;
     to_send.opCode = SYNC_THREAD_WAIT;
-    to_send.fenceSync = fenceSync;
+    to_send.fenceSync = fence;
     to_send.timeline = timeline;
+    to_send.queuedUs = System::get()->getHighResTimeUs();
     DPRINT("opcode=%u", to_send.opCode);
-    sendAsync(to_send);
+    onWaitQueued();
+    workerForTimeline(timeline)->sendAsync(to_send);
     DPRINT("exit");
 }
 
 void SyncThread::cleanup() {
     DPRINT("enter");
-    SyncThreadCmd to_send;
-    to_send.opCode = SYNC_THREAD_EXIT;
-    sendAndWaitForResult(to_send);
+    if (mExited) {
+        return;
+    }
+    mExited = true;
+    for (auto& worker : mWorkers) {
+        SyncThreadCmd to_send;
+        to_send.opCode = SYNC_THREAD_EXIT;
+        worker->sendAndWaitForResult(to_send);
+        worker->wait();
+    }
     DPRINT("exit");
 }
 
+SyncThread::Stats SyncThread::stats() const {
+    AutoLock lock(mStatsLock);
+    return mStats;
+}
+
+SyncThread::Worker* SyncThread::workerForTimeline(uint64_t timeline) {
+    // Timelines are guest kernel pointers, so mix the bits before picking
+    // a worker; their low bits are all the same.
+    const uint64_t hash = (timeline * 0x9E3779B97F4A7C15ULL) >> 32;
+    return mWorkers[hash % mWorkers.size()].get();
+}
+
+void SyncThread::onWaitQueued() {
+    AutoLock lock(mStatsLock);
+    ++mStats.queueDepth;
+    mStats.maxQueueDepth = std::max(mStats.maxQueueDepth, mStats.queueDepth);
+}
+
+void SyncThread::onWaitDone(uint64_t queuedUs) {
+    const uint64_t waitUs = System::get()->getHighResTimeUs() - queuedUs;
+    AutoLock lock(mStatsLock);
+    --mStats.queueDepth;
+    ++mStats.waits;
+    mStats.totalWaitUs += waitUs;
+    mStats.maxWaitUs = std::max(mStats.maxWaitUs, waitUs);
+}
+
 // Private methods below////////////////////////////////////////////////////////
 
-void SyncThread::initSyncContext() {
+SyncThread::Worker::Worker(SyncThread* parent) :
+    emugl::Thread(android::base::ThreadFlags::MaskSignals, 512 * 1024),
+    mParent(parent) {}
+
+void SyncThread::Worker::initSyncContext() {
     DPRINT("enter");
     SyncThreadCmd to_send;
     to_send.opCode = SYNC_THREAD_INIT;
@@ -107,7 +173,7 @@ void SyncThread::initSyncContext() {
     DPRINT("exit");
 }
 
-intptr_t SyncThread::main() {
+intptr_t SyncThread::Worker::main() {
     DPRINT("in sync thread");
 
     bool exiting = false;
@@ -138,7 +204,7 @@ intptr_t SyncThread::main() {
     return 0;
 }
 
-int SyncThread::sendAndWaitForResult(SyncThreadCmd& cmd) {
+int SyncThread::Worker::sendAndWaitForResult(SyncThreadCmd& cmd) {
     DPRINT("send with opcode=%d", cmd.opCode);
     cmd.needReply = true;
     mInput.send(cmd);
@@ -148,14 +214,14 @@ int SyncThread::sendAndWaitForResult(SyncThreadCmd& cmd) {
     return result;
 }
 
-void SyncThread::sendAsync(SyncThreadCmd& cmd) {
+void SyncThread::Worker::sendAsync(SyncThreadCmd& cmd) {
     DPRINT("send with opcode=%u fenceSyncInfo=0x%llx",
            cmd.opCode, cmd.fenceSync);
     cmd.needReply = false;
     mInput.send(cmd);
 }
 
-void SyncThread::doSyncContextInit() {
+void SyncThread::Worker::doSyncContextInit() {
     const EGLDispatch* egl = emugl::LazyLoadedEGLDispatch::get();
 
     mDisplay = egl->eglGetDisplay(EGL_DEFAULT_DISPLAY);
@@ -191,21 +257,21 @@ void SyncThread::doSyncContextInit() {
     egl->eglMakeCurrent(mDisplay, mSurface, mSurface, mContext);
 }
 
-void SyncThread::doSyncWait(SyncThreadCmd* cmd) {
+void SyncThread::Worker::doSyncWait(SyncThreadCmd* cmd) {
     DPRINT("enter");
 
-    FenceSync* fenceSync =
-        FenceSync::getFromHandle((uint64_t)(uintptr_t)cmd->fenceSync);
+    FenceSync* fenceSync = cmd->fenceSync;
 
     if (!fenceSync) {
         emugl::emugl_sync_timeline_inc(cmd->timeline, kTimelineInterval);
+        mParent->onWaitDone(cmd->queuedUs);
         return;
     }
 
     EGLint wait_result = 0x0;
 
     DPRINT("wait on sync obj: %p", cmd->fenceSync);
-    wait_result = cmd->fenceSync->wait(kDefaultTimeoutNsecs);
+    wait_result = fenceSync->wait(kDefaultTimeoutNsecs);
 
     DPRINT("done waiting, with wait result=0x%x. "
            "increment timeline (and signal fence)",
@@ -244,13 +310,16 @@ void SyncThread::doSyncWait(SyncThreadCmd* cmd) {
 
     emugl::emugl_sync_timeline_inc(cmd->timeline, kTimelineInterval);
     FenceSync::incrementTimelineAndDeleteOldFences();
+    // Taken in triggerWait(); this may be the last one.
+    fenceSync->decRef();
+    mParent->onWaitDone(cmd->queuedUs);
 
     DPRINT("done timeline increment");
 
     DPRINT("exit");
 }
 
-void SyncThread::doExit() {
+void SyncThread::Worker::doExit() {
 
     if (mContext == EGL_NO_CONTEXT) return;
 
@@ -263,7 +332,7 @@ void SyncThread::doExit() {
     mSurface = EGL_NO_SURFACE;
 }
 
-int SyncThread::doSyncThreadCmd(SyncThreadCmd* cmd) {
+int SyncThread::Worker::doSyncThreadCmd(SyncThreadCmd* cmd) {
     int result = 0;
     switch (cmd->opCode) {
     case SYNC_THREAD_INIT:
@@ -27,9 +27,14 @@
 
 #include "emugl/common/thread.h"
 
+#include <memory>
+#include <vector>
+
 // SyncThread///////////////////////////////////////////////////////////////////
 // The purpose of SyncThread is to track sync device timelines and give out +
 // signal FD's that correspond to the completion of host-side GL fence commands.
+// Despite the name, it is a small pool of sync worker threads, so a slow
+// fence on one guest timeline doesn't hold up signaling all the others.
 
 // We communicate with the sync thread in 3 ways:
 enum SyncThreadOpCode {
@@ -49,15 +54,28 @@ struct SyncThreadCmd {
     bool needReply = false;
     FenceSync* fenceSync = nullptr;
     uint64_t timeline = 0;
+    // When the command was queued, for the wait time counters.
+    uint64_t queuedUs = 0;
 };
 
 struct RenderThreadInfo;
-class SyncThread : public emugl::Thread {
+class SyncThread {
 public:
-    // - constructor: start up the sync thread for a given context.
-    // The initialization of the sync thread is nonblocking.
+    // Counters for the fence waits, cumulative since the start.
+    struct Stats {
+        uint64_t waits = 0;         // completed SYNC_THREAD_WAIT commands
+        uint32_t queueDepth = 0;    // waits queued or in progress right now
+        uint32_t maxQueueDepth = 0;
+        uint64_t totalWaitUs = 0;   // from triggerWait() to the timeline
+        uint64_t maxWaitUs = 0;     // increment
+    };
+
+    // - constructor: start up |numWorkers| sync worker threads, or a
+    // default number of them if it's 0.
+    // The initialization of the sync threads is nonblocking.
     // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_INIT|
-    SyncThread();
+    // on every worker.
+    explicit SyncThread(int numWorkers = 0);
     ~SyncThread();
 
     // |triggerWait|: async wait with a given FenceSync object.
@@ -66,15 +84,23 @@ public:
     // which should signal the guest-side fence FD.
     // This method is how the goldfish sync virtual device
     // knows when to increment timelines / signal native fence FD's.
+    // All waits for the same |timeline| go to the same worker, so its
+    // increments happen in the order of the triggerWait() calls; waits on
+    // different timelines may complete in parallel. A reference to
+    // |fenceSync| is held until its timeline has been incremented.
     void triggerWait(FenceSync* fenceSync,
                      uint64_t timeline);
     // |cleanup|: for use with destructors and other cleanup functions.
-    // it destroys the sync context and exits the sync thread.
+    // it destroys the sync contexts and exits the sync threads, after
+    // they process everything queued before.
     // This is blocking; after this function returns, we're sure
-    // the sync thread is gone.
+    // the sync threads are gone.
     // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_EXIT|
     void cleanup();
 
+    int numWorkers() const { return static_cast<int>(mWorkers.size()); }
+    Stats stats() const;
+
     // Obtains the global sync thread.
     static SyncThread* get();
 
@@ -83,43 +109,64 @@ public:
     static void recreate();
 
 private:
-    // |initSyncContext| creates an EGL context expressly for calling
-    // eglClientWaitSyncKHR in the processing caused by |triggerWait|.
-    // This is used by the constructor only. It is non-blocking.
-    // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_INIT|
-    void initSyncContext();
-
-    // Thread function executing all sync commands.
-    // It listens for |SyncThreadCmd| objects off the message channel
-    // |mInput|, and runs them serially.
-    virtual intptr_t main() override final;
-    static const size_t kSyncThreadChannelCapacity = 256;
-    android::base::MessageChannel<SyncThreadCmd, kSyncThreadChannelCapacity> mInput;
-
-    // |mOutput| holds result of cmds in case of blocking commands
-    // that require return results.
-    android::base::MessageChannel<GLint, kSyncThreadChannelCapacity> mOutput;
-
-    // These two functions are used to communicate with the sync thread
-    // from another thread:
-    // - |sendAndWaitForResult| issues |cmd| to the sync thread,
-    //   and blocks until it receives the result of the command.
-    // - |sendAsync| issues |cmd| to the sync thread and does not
-    //   wait for the result, returning immediately after.
-    GLint sendAndWaitForResult(SyncThreadCmd& cmd);
-    void sendAsync(SyncThreadCmd& cmd);
-
-    // |doSyncThreadCmd| and related functions below
-    // execute the actual commands. These run on the sync thread.
-    GLint doSyncThreadCmd(SyncThreadCmd* cmd);
-    void doSyncContextInit();
-    void doSyncWait(SyncThreadCmd* cmd);
-    void doExit();
-
-    // EGL objects / object handles specific to
-    // a sync thread.
-    EGLDisplay mDisplay = EGL_NO_DISPLAY;
-    EGLContext mContext = EGL_NO_CONTEXT;
-    EGLSurface mSurface = EGL_NO_SURFACE;
+    // A single thread with its own EGL context, which processes the
+    // commands for the timelines mapped to it one by one.
+    class Worker : public emugl::Thread {
+    public:
+        explicit Worker(SyncThread* parent);
+
+        // |initSyncContext| creates an EGL context expressly for calling
+        // eglClientWaitSyncKHR in the processing caused by |triggerWait|.
+        // This is used by the constructor only. It is non-blocking.
+        // - Triggers a |SyncThreadCmd| with op code |SYNC_THREAD_INIT|
+        void initSyncContext();
+
+        // These two functions are used to communicate with the sync thread
+        // from another thread:
+        // - |sendAndWaitForResult| issues |cmd| to the sync thread,
+        //   and blocks until it receives the result of the command.
+        // - |sendAsync| issues |cmd| to the sync thread and does not
+        //   wait for the result, returning immediately after.
+        GLint sendAndWaitForResult(SyncThreadCmd& cmd);
+        void sendAsync(SyncThreadCmd& cmd);
+
+    private:
+        // Thread function executing all sync commands.
+        // It listens for |SyncThreadCmd| objects off the message channel
+        // |mInput|, and runs them serially.
+        virtual intptr_t main() override final;
+        static const size_t kSyncThreadChannelCapacity = 256;
+        android::base::MessageChannel<SyncThreadCmd,
+                                      kSyncThreadChannelCapacity> mInput;
+
+        // |mOutput| holds result of cmds in case of blocking commands
+        // that require return results.
+        android::base::MessageChannel<GLint, kSyncThreadChannelCapacity>
+                mOutput;
+
+        // |doSyncThreadCmd| and related functions below
+        // execute the actual commands. These run on the sync thread.
+        GLint doSyncThreadCmd(SyncThreadCmd* cmd);
+        void doSyncContextInit();
+        void doSyncWait(SyncThreadCmd* cmd);
+        void doExit();
+
+        SyncThread* const mParent;
+
+        // EGL objects / object handles specific to
+        // a sync thread.
+        EGLDisplay mDisplay = EGL_NO_DISPLAY;
+        EGLContext mContext = EGL_NO_CONTEXT;
+        EGLSurface mSurface = EGL_NO_SURFACE;
+    };
+
+    Worker* workerForTimeline(uint64_t timeline);
+    void onWaitQueued();
+    void onWaitDone(uint64_t queuedUs);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    bool mExited = false;
+
+    mutable android::base::Lock mStatsLock;
+    Stats mStats;
 };
-
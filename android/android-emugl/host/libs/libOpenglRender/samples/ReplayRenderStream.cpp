@@ -0,0 +1,342 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replays the guest command streams that render threads dump to
+// RENDERER_DUMP_DIR/stream_<thread> through the host decoders, on a
+// FrameBuffer without a window, and prints how long the decoding took:
+//
+//   ReplayRenderStream [-size <width>x<height>] <stream file>...
+//
+// Each stream gets its own render thread state and is replayed packet by
+// packet, in the order of the command line. The report has the bytes/s of
+// the whole stream, the time between frames (window color buffer flushes,
+// composes and Vulkan image releases) and the decode time of each opcode.
+// GL opcodes are printed as offsets into their .in file (gles1.in,
+// gles2.in, renderControl.in); Vulkan ones by name.
+//
+// Rendering uses SwiftShader unless ANDROID_EMU_TEST_WITH_HOST_GPU=1.
+// The handles the host returned to the guest aren't in the dumps, so the
+// replay depends on the host handing out the same ones again: replay all of
+// the streams a guest session dumped, starting from the first one.
+
+#include "Standalone.h"
+
+#include "ChecksumCalculatorThreadInfo.h"
+#include "OpenGLESDispatch/GLESv1Dispatch.h"
+#include "OpenGLESDispatch/GLESv2Dispatch.h"
+#include "RenderControl.h"
+#include "VulkanDispatch.h"
+#include "common/goldfish_vk_marshaling.h"
+#include "renderControl_opcodes.h"
+
+#include "android/base/GLObjectCounter.h"
+#include "android/base/system/System.h"
+#include "android/utils/file_io.h"
+#include "emugl/common/feature_control.h"
+#include "emugl/common/vm_operations.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using android::base::System;
+
+namespace emugl {
+
+namespace {
+
+constexpr uint32_t kGles1BaseOpcode = 1024;
+constexpr uint32_t kGles2BaseOpcode = 2048;
+constexpr uint32_t kRenderControlBaseOpcode = 10000;
+constexpr uint32_t kVulkanBaseOpcode = 20000;
+
+using Clock = std::chrono::steady_clock;
+
+// Takes the decoders' replies and throws them away.
+class DiscardStream : public IOStream {
+public:
+    DiscardStream() : IOStream(4096) {}
+
+    void* allocBuffer(size_t minSize) override {
+        mBuffer.resize(std::max(minSize, mBuffer.size()));
+        return mBuffer.data();
+    }
+    int commitBuffer(size_t size) override { return size; }
+    int writeFully(const void* buf, size_t len) override { return 0; }
+    const unsigned char* readFully(void* buf, size_t len) override {
+        return nullptr;
+    }
+    void* getDmaForReading(uint64_t guest_paddr) override { return nullptr; }
+    void unlockDma(uint64_t guest_paddr) override {}
+
+protected:
+    const unsigned char* readRaw(void* buf, size_t* inout_len) override {
+        return nullptr;
+    }
+    void onSave(android::base::Stream* stream) override {}
+    unsigned char* onLoad(android::base::Stream* stream) override {
+        return nullptr;
+    }
+
+private:
+    std::vector<unsigned char> mBuffer;
+};
+
+struct OpcodeStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    Clock::duration time = {};
+};
+
+std::string opcodeName(uint32_t opcode) {
+    char name[64];
+    if (opcode >= kVulkanBaseOpcode) {
+        return goldfish_vk::api_opcode_to_string(opcode);
+    } else if (opcode >= kRenderControlBaseOpcode) {
+        snprintf(name, sizeof(name), "renderControl #%u",
+                 opcode - kRenderControlBaseOpcode);
+    } else if (opcode >= kGles2BaseOpcode) {
+        snprintf(name, sizeof(name), "gles2 #%u", opcode - kGles2BaseOpcode);
+    } else if (opcode >= kGles1BaseOpcode) {
+        snprintf(name, sizeof(name), "gles1 #%u", opcode - kGles1BaseOpcode);
+    } else {
+        snprintf(name, sizeof(name), "unknown %u", opcode);
+    }
+    return name;
+}
+
+bool isEndOfFrame(uint32_t opcode) {
+    switch (opcode) {
+        case OP_rcFlushWindowColorBuffer:
+        case OP_rcFlushWindowColorBufferAsync:
+        case OP_rcCompose:
+        case OP_vkQueueSignalReleaseImageANDROID:
+            return true;
+        default:
+            return false;
+    }
+}
+
+double toMs(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+bool readFile(const char* path, std::vector<unsigned char>* data) {
+    FILE* file = android_fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    data->resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    const bool ok = fread(data->data(), 1, data->size(), file) == data->size();
+    fclose(file);
+    return ok;
+}
+
+void printReport(const char* path,
+                 uint64_t bytes,
+                 uint64_t packets,
+                 Clock::duration total,
+                 std::vector<Clock::duration> frames,
+                 const std::map<uint32_t, OpcodeStats>& opcodes) {
+    printf("%s: %llu bytes in %llu packets, %.3f ms, %.2f MB/s\n", path,
+           (unsigned long long)bytes, (unsigned long long)packets, toMs(total),
+           bytes / std::max(toMs(total), 0.001) * 1000.0 / (1024 * 1024));
+
+    if (!frames.empty()) {
+        auto sum = Clock::duration{};
+        for (auto frame : frames) {
+            sum += frame;
+        }
+        std::sort(frames.begin(), frames.end());
+        const auto percentile = [&frames](int p) {
+            return toMs(frames[(frames.size() - 1) * p / 100]);
+        };
+        printf("%zu frames: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, "
+               "p99 %.3f ms, max %.3f ms\n",
+               frames.size(), toMs(sum) / frames.size(), percentile(50),
+               percentile(90), percentile(99), toMs(frames.back()));
+    }
+
+    std::vector<std::pair<uint32_t, OpcodeStats>> sorted(opcodes.begin(),
+                                                         opcodes.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.time > b.second.time;
+    });
+    printf("%-48s %10s %12s %10s %12s\n", "opcode", "count", "total ms",
+           "mean us", "bytes");
+    for (const auto& item : sorted) {
+        const auto& stats = item.second;
+        printf("%-48s %10llu %12.3f %10.3f %12llu\n",
+               opcodeName(item.first).c_str(),
+               (unsigned long long)stats.count, toMs(stats.time),
+               toMs(stats.time) * 1000.0 / stats.count,
+               (unsigned long long)stats.bytes);
+    }
+    printf("\n");
+}
+
+}  // namespace
+
+// Decodes the stream the same way RenderThread::main() does, except that
+// each decoder gets one packet at a time so it can be timed on its own.
+void replay(const char* path) {
+    std::vector<unsigned char> data;
+    if (!readFile(path, &data)) {
+        fprintf(stderr, "Could not read %s\n", path);
+        return;
+    }
+
+    RenderThreadInfo tInfo;
+    ChecksumCalculatorThreadInfo tChecksumInfo;
+    ChecksumCalculator& checksumCalc = tChecksumInfo.get();
+    tInfo.m_glDec.initGL(gles1_dispatch_get_proc_func, nullptr);
+    tInfo.m_gl2Dec.initGL(gles2_dispatch_get_proc_func, nullptr);
+    initRenderControlContext(&tInfo.m_rcDec);
+    DiscardStream stream;
+
+    std::map<uint32_t, OpcodeStats> opcodes;
+    std::vector<Clock::duration> frames;
+    uint64_t packets = 0;
+    const auto start = Clock::now();
+    auto frameStart = start;
+
+    size_t pos = 0;
+    while (data.size() - pos >= 8) {
+        unsigned char* packet = data.data() + pos;
+        const uint32_t opcode = *(const uint32_t*)packet;
+        const uint32_t size = *(const uint32_t*)(packet + 4);
+        if (size < 8 || size > data.size() - pos) {
+            fprintf(stderr, "%s: bad packet at %zu (opcode %u, size %u)\n",
+                    path, pos, opcode, size);
+            break;
+        }
+
+        const auto packetStart = Clock::now();
+        size_t last = 0;
+        FrameBuffer::getFB()->lockContextStructureRead();
+        if (opcode < kGles2BaseOpcode) {
+            last = tInfo.m_glDec.decode(packet, size, &stream, &checksumCalc);
+        } else if (opcode < kRenderControlBaseOpcode) {
+            last = tInfo.m_gl2Dec.decode(packet, size, &stream, &checksumCalc);
+        }
+        FrameBuffer::getFB()->unlockContextStructureRead();
+        if (opcode >= kVulkanBaseOpcode) {
+            last = tInfo.m_vkDec.decode(packet, size, &stream);
+        } else if (opcode >= kRenderControlBaseOpcode) {
+            last = tInfo.m_rcDec.decode(packet, size, &stream, &checksumCalc);
+        }
+        stream.flush();
+        const auto packetEnd = Clock::now();
+
+        if (!last) {
+            fprintf(stderr, "%s: no decoder took packet at %zu (opcode %u)\n",
+                    path, pos, opcode);
+            break;
+        }
+
+        auto& stats = opcodes[opcode];
+        ++stats.count;
+        stats.bytes += size;
+        stats.time += packetEnd - packetStart;
+        ++packets;
+        pos += size;
+
+        if (isEndOfFrame(opcode)) {
+            frames.push_back(packetEnd - frameStart);
+            frameStart = packetEnd;
+        }
+    }
+
+    printReport(path, pos, packets, Clock::now() - start, std::move(frames),
+                opcodes);
+
+    FrameBuffer::getFB()->bindContext(0, 0, 0);
+    FrameBuffer::getFB()->drainWindowSurface();
+    FrameBuffer::getFB()->drainRenderContext();
+}
+
+namespace {
+
+bool isFeatureEnabled(android::featurecontrol::Feature feature) {
+    switch (feature) {
+        case android::featurecontrol::GLAsyncSwap:
+        case android::featurecontrol::GLESDynamicVersion:
+        case android::featurecontrol::Vulkan:
+            return true;
+        default:
+            return false;
+    }
+}
+
+}  // namespace
+
+bool initialize(int width, int height) {
+    setupStandaloneLibrarySearchPaths();
+    setGLObjectCounter(android::base::GLObjectCounter::get());
+    set_emugl_feature_is_enabled(&isFeatureEnabled);
+    QAndroidVmOperations vmOps = {};
+    vmOps.setSkipSnapshotSave = [](bool) {};
+    set_emugl_vm_operations(vmOps);
+    if (System::get()->envGet("ANDROID_EMU_VK_ICD").empty()) {
+        System::get()->envSet("ANDROID_EMU_VK_ICD", "swiftshader");
+    }
+
+    LazyLoadedEGLDispatch::get();
+    LazyLoadedGLESv1Dispatch::get();
+    LazyLoadedGLESv2Dispatch::get();
+
+    const bool useHostGpu = shouldUseHostGpu();
+    return FrameBuffer::initialize(width, height, false /* useSubWindow */,
+                                   !useHostGpu /* egl2egl */);
+}
+
+}  // namespace emugl
+
+int main(int argc, char** argv) {
+    int width = 1080;
+    int height = 1920;
+    int first = 1;
+    if (argc > 2 && !strcmp(argv[1], "-size")) {
+        if (sscanf(argv[2], "%dx%d", &width, &height) != 2) {
+            fprintf(stderr, "Bad size %s\n", argv[2]);
+            return 1;
+        }
+        first = 3;
+    }
+    if (first >= argc) {
+        fprintf(stderr,
+                "Usage: %s [-size <width>x<height>] <stream file>...\n",
+                argv[0]);
+        return 1;
+    }
+
+    if (!emugl::initialize(width, height)) {
+        fprintf(stderr, "Could not initialize the FrameBuffer\n");
+        return 1;
+    }
+
+    for (int i = first; i < argc; ++i) {
+        emugl::replay(argv[i]);
+    }
+
+    FrameBuffer::getFB()->finalize();
+    return 0;
+}
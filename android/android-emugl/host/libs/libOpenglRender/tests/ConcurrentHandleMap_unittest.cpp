@@ -0,0 +1,109 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ConcurrentHandleMap.h"
+
+#include "android/base/threads/FunctorThread.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+using android::base::FunctorThread;
+
+TEST(ConcurrentHandleMap, SetGetRemove) {
+    ConcurrentHandleMap<int> map;
+    EXPECT_EQ(nullptr, map.get(1));
+    EXPECT_EQ(0u, map.size());
+
+    map.set(1, std::make_shared<int>(10));
+    map.set(17, std::make_shared<int>(170));
+    ASSERT_NE(nullptr, map.get(1));
+    EXPECT_EQ(10, *map.get(1));
+    EXPECT_EQ(170, *map.get(17));
+    EXPECT_EQ(2u, map.size());
+
+    map.set(1, std::make_shared<int>(11));
+    EXPECT_EQ(11, *map.get(1));
+    EXPECT_EQ(2u, map.size());
+
+    auto removed = map.remove(1);
+    ASSERT_NE(nullptr, removed);
+    EXPECT_EQ(11, *removed);
+    EXPECT_EQ(nullptr, map.get(1));
+    EXPECT_EQ(nullptr, map.remove(1));
+    EXPECT_EQ(1u, map.size());
+
+    map.clear();
+    EXPECT_EQ(nullptr, map.get(17));
+    EXPECT_EQ(0u, map.size());
+}
+
+// A lookup keeps its object alive after it's removed from the map.
+TEST(ConcurrentHandleMap, GetKeepsReference) {
+    ConcurrentHandleMap<int> map;
+    map.set(5, std::make_shared<int>(5));
+    auto ptr = map.get(5);
+    map.clear();
+    ASSERT_NE(nullptr, ptr);
+    EXPECT_EQ(5, *ptr);
+    EXPECT_TRUE(ptr.unique());
+}
+
+TEST(ConcurrentHandleMap, ConcurrentLookups) {
+    constexpr int kThreads = 4;
+    constexpr uint32_t kHandles = 256;
+    constexpr int kRounds = 200;
+
+    ConcurrentHandleMap<uint32_t> map;
+    for (uint32_t i = 0; i < kHandles; i += 2) {
+        map.set(i, std::make_shared<uint32_t>(i));
+    }
+
+    // Readers only ever see the even handles and the right values, while a
+    // writer keeps adding and removing the odd ones.
+    std::atomic<bool> done{false};
+    std::atomic<int> errors{0};
+    std::vector<std::unique_ptr<FunctorThread>> readers;
+    for (int t = 0; t < kThreads; t++) {
+        readers.emplace_back(new FunctorThread([&map, &done, &errors] {
+            while (!done) {
+                for (uint32_t i = 0; i < kHandles; i++) {
+                    auto ptr = map.get(i);
+                    if ((i % 2 == 0 && !ptr) || (ptr && *ptr != i)) {
+                        ++errors;
+                    }
+                }
+            }
+        }));
+        readers.back()->start();
+    }
+    for (int round = 0; round < kRounds; round++) {
+        for (uint32_t i = 1; i < kHandles; i += 2) {
+            map.set(i, std::make_shared<uint32_t>(i));
+        }
+        for (uint32_t i = 1; i < kHandles; i += 2) {
+            map.remove(i);
+        }
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader->wait();
+    }
+
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ(size_t(kHandles / 2), map.size());
+}
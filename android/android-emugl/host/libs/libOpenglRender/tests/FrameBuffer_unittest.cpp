@@ -16,18 +16,27 @@
 #include "android/base/files/StdioStream.h"
 #include "android/base/GLObjectCounter.h"
 #include "android/base/perflogger/BenchmarkLibrary.h"
+#include "android/base/synchronization/Lock.h"
 #include "android/base/system/System.h"
 #include "android/base/testing/TestSystem.h"
+#include "android/base/threads/FunctorThread.h"
 #include "android/emulation/control/window_agent.h"
 #include "android/snapshot/TextureLoader.h"
 #include "android/snapshot/TextureSaver.h"
 
 #include "GLSnapshotTesting.h"
+#include "FenceSync.h"
 #include "GLTestUtils.h"
 #include "Standalone.h"
+#include "SyncThread.h"
+#include "emugl/common/sync_device.h"
 
 #include <gtest/gtest.h>
+#include <atomic>
+#include <map>
 #include <memory>
+#include <set>
+#include <vector>
 
 
 #ifdef _MSC_VER
@@ -807,4 +816,162 @@ TEST_F(FrameBufferTest, ComposeMultiDisplay) {
     mFb->destroyDisplay(ids[2]);
     mFb->DestroyWindowSurface(surface);
 }
+
+// Measures how color buffer lookups scale with the number of render threads
+// doing them at once, as they don't take the FrameBuffer lock.
+TEST_F(FrameBufferTest, ColorBufferLookupScaling) {
+    constexpr int kColorBuffers = 64;
+    constexpr int kLookupsPerThread = 200000;
+
+    std::vector<HandleType> handles;
+    for (int i = 0; i < kColorBuffers; i++) {
+        handles.push_back(mFb->createColorBuffer(
+                16, 16, GL_RGBA, FRAMEWORK_FORMAT_GL_COMPATIBLE));
+        EXPECT_NE(0, handles.back());
+    }
+
+    for (int threads : {1, 2, 4, 8}) {
+        std::atomic<int> failures{0};
+        std::vector<std::unique_ptr<android::base::FunctorThread>> workers;
+        const auto startUs = System::get()->getHighResTimeUs();
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back(new android::base::FunctorThread(
+                    [this, &handles, &failures, t] {
+                        for (int i = 0; i < kLookupsPerThread; i++) {
+                            const HandleType handle =
+                                    handles[(i + t) % kColorBuffers];
+                            int width, height;
+                            GLint internalFormat;
+                            if (!mFb->getColorBufferInfo(handle, &width,
+                                                         &height,
+                                                         &internalFormat) ||
+                                !mFb->findColorBuffer(handle)) {
+                                ++failures;
+                            }
+                        }
+                    }));
+            workers.back()->start();
+        }
+        for (auto& worker : workers) {
+            worker->wait();
+        }
+        const auto durationUs = System::get()->getHighResTimeUs() - startUs;
+
+        EXPECT_EQ(0, failures);
+        const double lookups = 2.0 * kLookupsPerThread * threads;
+        printf("%d thread(s): %.0f lookups in %.2f ms, %.2f M lookups/s\n",
+               threads, lookups, durationUs / 1000.0, lookups / durationUs);
+    }
+
+    for (auto handle : handles) {
+        mFb->closeColorBuffer(handle);
+    }
+}
+
+// Records which threads incremented which timelines.
+static android::base::Lock sTimelineIncLock;
+static std::map<uint64_t, std::set<unsigned long>> sTimelineThreads;
+static std::map<uint64_t, uint32_t> sTimelineValues;
+
+static void recordTimelineInc(uint64_t timeline, uint32_t howMuch) {
+    android::base::AutoLock lock(sTimelineIncLock);
+    sTimelineThreads[timeline].insert(android::base::getCurrentThreadId());
+    sTimelineValues[timeline] += howMuch;
+}
+
+TEST_F(FrameBufferTest, SyncThreadTimelinesStayOnOneWorker) {
+    const auto oldTimelineInc = emugl_sync_timeline_inc;
+    set_emugl_sync_timeline_inc(recordTimelineInc);
+    sTimelineThreads.clear();
+    sTimelineValues.clear();
+
+    const int kTimelines = 16;
+    const int kWaitsPerTimeline = 32;
+    {
+        SyncThread syncThread(4);
+        EXPECT_EQ(4, syncThread.numWorkers());
+        for (int i = 0; i < kWaitsPerTimeline; ++i) {
+            for (int t = 0; t < kTimelines; ++t) {
+                // Kernel pointer-like handles: equal low bits.
+                syncThread.triggerWait(nullptr, 0xffff800000000000ULL +
+                                                        t * 0x1000ULL);
+            }
+        }
+        syncThread.cleanup();
+
+        const auto stats = syncThread.stats();
+        EXPECT_EQ(uint64_t(kTimelines * kWaitsPerTimeline), stats.waits);
+        EXPECT_EQ(0u, stats.queueDepth);
+        EXPECT_GE(stats.maxQueueDepth, 1u);
+    }
+
+    set_emugl_sync_timeline_inc(oldTimelineInc);
+
+    ASSERT_EQ(size_t(kTimelines), sTimelineValues.size());
+    std::set<unsigned long> allThreads;
+    for (const auto& timeline : sTimelineThreads) {
+        // Ordering within a timeline comes from staying on a single worker.
+        EXPECT_EQ(1u, timeline.second.size());
+        EXPECT_EQ(uint32_t(kWaitsPerTimeline),
+                  sTimelineValues[timeline.first]);
+        allThreads.insert(timeline.second.begin(), timeline.second.end());
+    }
+    // The timelines are spread over the workers.
+    EXPECT_GT(allThreads.size(), 1u);
+}
+
+// Real fences on several timelines: the sweep of old fences on one worker
+// must not delete fences that other workers still have queued or wait on.
+TEST_F(FrameBufferTest, SyncThreadNativeFencesOnManyTimelines) {
+    const auto oldTimelineInc = emugl_sync_timeline_inc;
+    set_emugl_sync_timeline_inc(recordTimelineInc);
+    sTimelineThreads.clear();
+    sTimelineValues.clear();
+
+    HandleType context = mFb->createRenderContext(0, 0, GLESApi_3_0);
+    HandleType surface = mFb->createWindowSurface(0, mWidth, mHeight);
+    EXPECT_TRUE(mFb->bindContext(context, surface, surface));
+
+    // Many more fences than FenceSync keeps around, so that sweeps happen
+    // while most of them are still queued.
+    const int kTimelines = 8;
+    const int kFencesPerTimeline = 16;
+    std::vector<uint64_t> handles;
+    {
+        SyncThread syncThread(4);
+        std::vector<FenceSync*> fences;
+        for (int i = 0; i < kTimelines * kFencesPerTimeline; ++i) {
+            // Like the guest's eglSwapBuffers() fences, released by the
+            // timeline once signaled.
+            fences.push_back(new FenceSync(true /* hasNativeFence */,
+                                           true /* destroyWhenSignaled */));
+            handles.push_back((uint64_t)(uintptr_t)fences.back());
+        }
+        LazyLoadedGLESv2Dispatch::get()->glFlush();
+        for (int i = 0; i < kFencesPerTimeline; ++i) {
+            for (int t = 0; t < kTimelines; ++t) {
+                syncThread.triggerWait(fences[i * kTimelines + t],
+                                       0xffff800000000000ULL + t * 0x1000ULL);
+            }
+        }
+        syncThread.cleanup();
+        EXPECT_EQ(uint64_t(kTimelines * kFencesPerTimeline),
+                  syncThread.stats().waits);
+    }
+
+    set_emugl_sync_timeline_inc(oldTimelineInc);
+
+    ASSERT_EQ(size_t(kTimelines), sTimelineValues.size());
+    for (const auto& timeline : sTimelineValues) {
+        EXPECT_EQ(uint32_t(kFencesPerTimeline), timeline.second);
+    }
+    // Once waited on, the timeline sweeps released all of them.
+    for (auto handle : handles) {
+        EXPECT_EQ(nullptr, FenceSync::getFromHandle(handle));
+    }
+
+    EXPECT_TRUE(mFb->bindContext(0, 0, 0));
+    mFb->DestroyWindowSurface(surface);
+}
+
 }  // namespace emugl
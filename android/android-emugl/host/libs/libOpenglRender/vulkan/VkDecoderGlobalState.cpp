@@ -47,11 +47,14 @@
 #endif
 
 using android::base::AutoLock;
+using android::base::AutoReadLock;
+using android::base::AutoWriteLock;
 using android::base::ConditionVariable;
 using android::base::LazyInstance;
 using android::base::Lock;
 using android::base::Optional;
 using android::base::pj;
+using android::base::ReadWriteLock;
 using android::base::System;
 
 #define VKDGS_DEBUG 0
@@ -220,7 +223,7 @@ public:
 
         if (res != VK_SUCCESS) return res;
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         // TODO: bug 129484301
         get_emugl_vm_operations().setSkipSnapshotSave(
@@ -272,7 +275,7 @@ public:
     }
 
     void vkDestroyInstanceImpl(VkInstance instance, const VkAllocationCallbacks* pAllocator) {
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         teardownInstanceLocked(instance);
 
@@ -321,7 +324,7 @@ public:
 
         if (res != VK_SUCCESS) return res;
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         if (physicalDeviceCount && physicalDevices) {
             // Box them up
@@ -384,7 +387,7 @@ public:
         auto physicalDevice = unbox_VkPhysicalDevice(boxed_physicalDevice);
         auto vk = dispatch_VkPhysicalDevice(boxed_physicalDevice);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto physdevInfo =
             android::base::find(mPhysdevInfo, physicalDevice);
@@ -478,7 +481,7 @@ public:
                 imageFormatInfo.format = cmpInfo.sizeCompFormat;
             }
         }
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto physdevInfo = android::base::find(mPhysdevInfo, physicalDevice);
         if (!physdevInfo) {
@@ -557,7 +560,7 @@ public:
         auto physicalDevice = unbox_VkPhysicalDevice(boxed_physicalDevice);
         auto vk = dispatch_VkPhysicalDevice(boxed_physicalDevice);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto physdevInfo = android::base::find(mPhysdevInfo, physicalDevice);
         if (!physdevInfo)
@@ -628,7 +631,7 @@ public:
         auto physicalDevice = unbox_VkPhysicalDevice(boxed_physicalDevice);
         auto vk = dispatch_VkPhysicalDevice(boxed_physicalDevice);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto physdevInfo =
             android::base::find(mPhysdevInfo, physicalDevice);
@@ -818,7 +821,7 @@ public:
 
         if (result != VK_SUCCESS) return result;
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         mDeviceToPhysicalDevice[*pDevice] = physicalDevice;
 
@@ -881,7 +884,7 @@ public:
 
         auto device = unbox_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         *pQueue = VK_NULL_HANDLE;
 
@@ -933,7 +936,7 @@ public:
 
         auto device = unbox_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         destroyDeviceLocked(device, pAllocator);
 
@@ -955,7 +958,7 @@ public:
             vk->vkCreateBuffer(device, pCreateInfo, pAllocator, pBuffer);
 
         if (result == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             auto& bufInfo = mBufferInfo[*pBuffer];
             bufInfo.device = device;
             bufInfo.size = pCreateInfo->size;
@@ -976,7 +979,7 @@ public:
 
         vk->vkDestroyBuffer(device, buffer, pAllocator);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mBufferInfo.erase(buffer);
     }
 
@@ -1004,7 +1007,7 @@ public:
             vk->vkBindBufferMemory(device, buffer, memory, memoryOffset);
 
         if (result == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             setBufferMemoryBindInfoLocked(buffer, memory, memoryOffset);
         }
         return result;
@@ -1023,7 +1026,7 @@ public:
             vk->vkBindBufferMemory2(device, bindInfoCount, pBindInfos);
 
         if (result == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             for (uint32_t i = 0; i < bindInfoCount; ++i) {
                 setBufferMemoryBindInfoLocked(
                         pBindInfos[i].buffer,
@@ -1048,7 +1051,7 @@ public:
             vk->vkBindBufferMemory2KHR(device, bindInfoCount, pBindInfos);
 
         if (result == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             for (uint32_t i = 0; i < bindInfoCount; ++i) {
                 setBufferMemoryBindInfoLocked(
                         pBindInfos[i].buffer,
@@ -1071,7 +1074,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto deviceInfoIt = mDeviceInfo.find(device);
         if (deviceInfoIt == mDeviceInfo.end()) {
@@ -1167,7 +1170,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         auto it = mImageInfo.find(image);
 
         if (it == mImageInfo.end()) return;
@@ -1218,7 +1221,7 @@ public:
         if (VK_SUCCESS != result) {
             return result;
         }
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         auto deviceInfoIt = mDeviceInfo.find(device);
         if (deviceInfoIt == mDeviceInfo.end()) {
             return VK_ERROR_OUT_OF_HOST_MEMORY;
@@ -1268,7 +1271,7 @@ public:
             return VK_ERROR_OUT_OF_HOST_MEMORY;
         }
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         auto deviceInfoIt = mDeviceInfo.find(device);
         if (deviceInfoIt == mDeviceInfo.end()) {
             return VK_ERROR_OUT_OF_HOST_MEMORY;
@@ -1335,7 +1338,7 @@ public:
         auto vk = dispatch_VkDevice(boxed_device);
 
         vk->vkDestroyImageView(device, imageView, pAllocator);
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mImageViewInfo.erase(imageView);
     }
 
@@ -1353,7 +1356,7 @@ public:
         if (result != VK_SUCCESS) {
             return result;
         }
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         auto& samplerInfo = mSamplerInfo[*pSampler];
         samplerInfo.createInfo = *pCreateInfo;
         // We emulate RGB with RGBA for some compressed textures, which does not
@@ -1384,7 +1387,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
         vk->vkDestroySampler(device, sampler, pAllocator);
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         const auto& samplerInfoIt = mSamplerInfo.find(sampler);
         if (samplerInfoIt != mSamplerInfo.end()) {
             if (samplerInfoIt->second.emulatedborderSampler != VK_NULL_HANDLE) {
@@ -1444,7 +1447,7 @@ public:
         auto vk = dispatch_VkDevice(boxed_device);
 
 #ifdef _WIN32
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto infoPtr = android::base::find(
                 mSemaphoreInfo, pImportSemaphoreFdInfo->semaphore);
@@ -1492,7 +1495,7 @@ public:
         if (result != VK_SUCCESS) {
             return result;
         }
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mSemaphoreInfo[pGetFdInfo->semaphore].externalHandle = handle;
         int nextId = genSemaphoreId();
         mExternalSemaphoresById[nextId] = pGetFdInfo->semaphore;
@@ -1503,7 +1506,7 @@ public:
             return result;
         }
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         mSemaphoreInfo[pGetFdInfo->semaphore].externalHandle = *pFd;
         // No next id; its already an fd
@@ -1521,7 +1524,7 @@ public:
         auto vk = dispatch_VkDevice(boxed_device);
 
 #ifndef _WIN32
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         const auto& ite = mSemaphoreInfo.find(semaphore);
         if (ite != mSemaphoreInfo.end() &&
                 (ite->second.externalHandle != VK_EXT_MEMORY_HANDLE_INVALID)) {
@@ -1545,7 +1548,7 @@ public:
             vk->vkCreateDescriptorSetLayout(device, pCreateInfo, pAllocator, pSetLayout);
 
         if (res == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             auto& info = mDescriptorSetLayoutInfo[*pSetLayout];
             *pSetLayout = new_boxed_non_dispatchable_VkDescriptorSetLayout(*pSetLayout);
 
@@ -1569,7 +1572,7 @@ public:
 
         vk->vkDestroyDescriptorSetLayout(device, descriptorSetLayout, pAllocator);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mDescriptorSetLayoutInfo.erase(descriptorSetLayout);
     }
 
@@ -1587,7 +1590,7 @@ public:
             vk->vkCreateDescriptorPool(device, pCreateInfo, pAllocator, pDescriptorPool);
 
         if (res == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             auto& info = mDescriptorPoolInfo[*pDescriptorPool];
             *pDescriptorPool = new_boxed_non_dispatchable_VkDescriptorPool(*pDescriptorPool);
             info.createInfo = *pCreateInfo;
@@ -1637,7 +1640,7 @@ public:
 
         vk->vkDestroyDescriptorPool(device, descriptorPool, pAllocator);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         cleanupDescriptorPoolAllocedSetsLocked(descriptorPool);
         mDescriptorPoolInfo.erase(descriptorPool);
     }
@@ -1654,7 +1657,7 @@ public:
         auto res = vk->vkResetDescriptorPool(device, descriptorPool, flags);
 
         if (res == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
             cleanupDescriptorPoolAllocedSetsLocked(descriptorPool);
         }
 
@@ -1670,7 +1673,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto allocValidationRes = validateDescriptorSetAllocLocked(pAllocateInfo);
         if (allocValidationRes != VK_SUCCESS) return allocValidationRes;
@@ -1717,7 +1720,7 @@ public:
             descriptorSetCount, pDescriptorSets);
 
         if (res == VK_SUCCESS) {
-            AutoLock lock(mLock);
+            AutoWriteLock lock(mLock);
 
             for (uint32_t i = 0; i < descriptorSetCount; ++i) {
                 auto setInfo = android::base::find(
@@ -1759,37 +1762,58 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
         bool needEmulateWriteDescriptor = false;
         // c++ seems to allow for 0-size array allocation
         std::unique_ptr<bool[]> descriptorWritesNeedDeepCopy(
                 new bool[descriptorWriteCount]);
-        for (uint32_t i = 0; i < descriptorWriteCount; i++) {
-            const VkWriteDescriptorSet& descriptorWrite = pDescriptorWrites[i];
-            descriptorWritesNeedDeepCopy[i] = false;
-            if (descriptorWrite.descriptorType !=
-                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
-                continue;
-            }
-            for (uint32_t j = 0; j < descriptorWrite.descriptorCount; j++) {
-                const VkDescriptorImageInfo& imageInfo =
-                    descriptorWrite.pImageInfo[j];
-                const auto& viewIt = mImageViewInfo.find(imageInfo.imageView);
-                if (viewIt == mImageViewInfo.end()) {
-                    continue;
-                }
-                const auto& samplerIt = mSamplerInfo.find(imageInfo.sampler);
-                if (samplerIt == mSamplerInfo.end()) {
+        // Needs mLock held, for reading at least.
+        auto findWritesNeedingEmulation = [&]() {
+            needEmulateWriteDescriptor = false;
+            for (uint32_t i = 0; i < descriptorWriteCount; i++) {
+                const VkWriteDescriptorSet& descriptorWrite =
+                    pDescriptorWrites[i];
+                descriptorWritesNeedDeepCopy[i] = false;
+                if (descriptorWrite.descriptorType !=
+                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
                     continue;
                 }
-                if (viewIt->second.needEmulatedAlpha &&
-                        samplerIt->second.needEmulatedAlpha) {
-                    needEmulateWriteDescriptor = true;
-                    descriptorWritesNeedDeepCopy[i] = true;
-                    break;
+                for (uint32_t j = 0; j < descriptorWrite.descriptorCount;
+                        j++) {
+                    const VkDescriptorImageInfo& imageInfo =
+                        descriptorWrite.pImageInfo[j];
+                    const auto& viewIt =
+                        mImageViewInfo.find(imageInfo.imageView);
+                    if (viewIt == mImageViewInfo.end()) {
+                        continue;
+                    }
+                    const auto& samplerIt =
+                        mSamplerInfo.find(imageInfo.sampler);
+                    if (samplerIt == mSamplerInfo.end()) {
+                        continue;
+                    }
+                    if (viewIt->second.needEmulatedAlpha &&
+                            samplerIt->second.needEmulatedAlpha) {
+                        needEmulateWriteDescriptor = true;
+                        descriptorWritesNeedDeepCopy[i] = true;
+                        break;
+                    }
                 }
             }
+        };
+        AutoReadLock readLock(mLock);
+        findWritesNeedingEmulation();
+        if (!needEmulateWriteDescriptor) {
+            vk->vkUpdateDescriptorSets(device, descriptorWriteCount,
+                    pDescriptorWrites, descriptorCopyCount,
+                    pDescriptorCopies);
+            return;
         }
+        // The emulated border samplers are created on first use below.
+        // The views and samplers may have changed while mLock was free, so
+        // look again.
+        readLock.unlockRead();
+        AutoWriteLock lock(mLock);
+        findWritesNeedingEmulation();
         if (!needEmulateWriteDescriptor) {
             vk->vkUpdateDescriptorSets(device, descriptorWriteCount,
                     pDescriptorWrites, descriptorCopyCount,
@@ -1870,7 +1894,7 @@ public:
         auto commandBuffer = unbox_VkCommandBuffer(boxed_commandBuffer);
         auto vk = dispatch_VkCommandBuffer(boxed_commandBuffer);
 
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
         auto srcIt = mImageInfo.find(srcImage);
         if (srcIt == mImageInfo.end()) {
             return;
@@ -1947,7 +1971,7 @@ public:
         auto commandBuffer = unbox_VkCommandBuffer(boxed_commandBuffer);
         auto vk = dispatch_VkCommandBuffer(boxed_commandBuffer);
 
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
         auto it = mImageInfo.find(srcImage);
         if (it == mImageInfo.end()) {
             return;
@@ -2003,7 +2027,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
         vk->vkGetImageMemoryRequirements(device, image, pMemoryRequirements);
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         updateImageMemorySizeLocked(device, image, pMemoryRequirements);
     }
 
@@ -2014,7 +2038,7 @@ public:
             VkMemoryRequirements2* pMemoryRequirements) {
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         auto physicalDevice = mDeviceToPhysicalDevice[device];
         auto physdevInfo = android::base::find(mPhysdevInfo, physicalDevice);
 
@@ -2067,7 +2091,7 @@ public:
         auto commandBuffer = unbox_VkCommandBuffer(boxed_commandBuffer);
         auto vk = dispatch_VkCommandBuffer(boxed_commandBuffer);
 
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
         auto it = mImageInfo.find(dstImage);
         if (it == mImageInfo.end()) return;
         auto bufferInfoIt = mBufferInfo.find(srcBuffer);
@@ -2085,9 +2109,11 @@ public:
                     dstImageLayout, regionCount, pRegions);
             return;
         }
-        auto cmdBufferInfoIt = mCmdBufferInfo.find(commandBuffer);
-        if (cmdBufferInfoIt == mCmdBufferInfo.end()) {
-            return;
+        {
+            AutoLock cmdBufferLock(mCmdBufferLock);
+            if (mCmdBufferInfo.find(commandBuffer) == mCmdBufferInfo.end()) {
+                return;
+            }
         }
         CompressedImageInfo& cmp = it->second.cmpInfo;
         for (uint32_t r = 0; r < regionCount; r++) {
@@ -2167,7 +2193,8 @@ public:
                     imageMemoryBarrierCount, pImageMemoryBarriers);
             return;
         }
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
+        AutoLock cmdBufferLock(mCmdBufferLock);
         auto cmdBufferInfoIt = mCmdBufferInfo.find(commandBuffer);
         if (cmdBufferInfoIt == mCmdBufferInfo.end()) {
             return;
@@ -2523,7 +2550,7 @@ public:
             return result;
         }
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto physdev = android::base::find(mDeviceToPhysicalDevice, device);
 
@@ -2652,7 +2679,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         freeMemoryLocked(vk, device, memory, pAllocator);
 
@@ -2668,7 +2695,7 @@ public:
             VkMemoryMapFlags flags,
             void** ppData) {
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         return on_vkMapMemoryLocked(0, memory, offset, size, flags, ppData);
     }
     VkResult on_vkMapMemoryLocked(VkDevice,
@@ -2701,7 +2728,7 @@ public:
     }
 
     uint8_t* getMappedHostPointer(VkDeviceMemory memory) {
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
 
         auto info = android::base::find(mMapInfo, memory);
 
@@ -2714,7 +2741,7 @@ public:
     }
 
     VkDeviceSize getDeviceMemorySize(VkDeviceMemory memory) {
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
 
         auto info = android::base::find(mMapInfo, memory);
 
@@ -2809,7 +2836,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto imageInfo = android::base::find(mImageInfo, image);
         if (!imageInfo) {
@@ -2826,6 +2853,21 @@ public:
 
         AndroidNativeBufferInfo* anbInfo = &imageInfo->anbInfo;
 
+        // Lock the queue setAndroidNativeImageSemaphoreSignaled() submits
+        // to: the default one the first time, then the one the image was
+        // last synced on.
+        VkQueue submitQueue = defaultQueue;
+        if ((anbInfo->everSynced || anbInfo->everAcquired) &&
+            anbInfo->lastUsedQueueFamilyIndex <
+                    anbInfo->queueStates.size()) {
+            submitQueue =
+                    anbInfo->queueStates[anbInfo->lastUsedQueueFamilyIndex]
+                            .queue;
+        }
+        auto queueInfo = android::base::find(mQueueInfo, submitQueue);
+        if (!queueInfo) return VK_ERROR_INITIALIZATION_FAILED;
+        AutoLock queueLock(*queueInfo->lock);
+
         return
             setAndroidNativeImageSemaphoreSignaled(
                     vk, device,
@@ -2844,21 +2886,24 @@ public:
         auto queue = unbox_VkQueue(boxed_queue);
         auto vk = dispatch_VkQueue(boxed_queue);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
-        auto queueFamilyIndex = queueFamilyIndexOfQueueLocked(queue);
+        auto queueInfo = android::base::find(mQueueInfo, queue);
 
-        if (!queueFamilyIndex) {
+        if (!queueInfo) {
             return VK_ERROR_INITIALIZATION_FAILED;
         }
 
+        auto queueFamilyIndex = queueInfo->queueFamilyIndex;
+        AutoLock queueLock(*queueInfo->lock);
+
         auto imageInfo = android::base::find(mImageInfo, image);
         AndroidNativeBufferInfo* anbInfo = &imageInfo->anbInfo;
 
         return
             syncImageToColorBuffer(
                     vk,
-                    *queueFamilyIndex,
+                    queueFamilyIndex,
                     queue,
                     waitSemaphoreCount, pWaitSemaphores,
                     pNativeFenceFd, anbInfo);
@@ -2878,7 +2923,7 @@ public:
                     "while GLDirectMem is not enabled!");
         }
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto info = android::base::find(mMapInfo, memory);
 
@@ -2908,7 +2953,7 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
 
         auto info = android::base::find(mMapInfo, memory);
 
@@ -2973,7 +3018,7 @@ public:
             return result;
         }
 
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; i++) {
             mCmdBufferInfo[pCommandBuffers[i]] = CommandBufferInfo();
             mCmdBufferInfo[pCommandBuffers[i]].device = device;
@@ -3001,7 +3046,7 @@ public:
         if (result != VK_SUCCESS) {
             return result;
         }
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         mCmdPoolInfo[*pCommandPool] = CommandPoolInfo();
 
         *pCommandPool = new_boxed_non_dispatchable_VkCommandPool(*pCommandPool);
@@ -3019,7 +3064,7 @@ public:
         auto vk = dispatch_VkDevice(boxed_device);
 
         vk->vkDestroyCommandPool(device, commandPool, pAllocator);
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         const auto ite = mCmdPoolInfo.find(commandPool);
         if (ite != mCmdPoolInfo.end()) {
             removeCommandBufferInfo(ite->second.cmdBuffers);
@@ -3041,7 +3086,7 @@ public:
         if (result != VK_SUCCESS) {
             return result;
         }
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         const auto ite = mCmdPoolInfo.find(commandPool);
         if (ite != mCmdPoolInfo.end()) {
             removeCommandBufferInfo(ite->second.cmdBuffers);
@@ -3060,7 +3105,7 @@ public:
 
         vk->vkCmdExecuteCommands(commandBuffer, commandBufferCount,
                 pCommandBuffers);
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         CommandBufferInfo& cmdBuffer = mCmdBufferInfo[commandBuffer];
         cmdBuffer.subCmds.insert(cmdBuffer.subCmds.end(),
                 pCommandBuffers, pCommandBuffers + commandBufferCount);
@@ -3076,14 +3121,22 @@ public:
         auto queue = unbox_VkQueue(boxed_queue);
         auto vk = dispatch_VkQueue(boxed_queue);
 
-        AutoLock lock(mLock);
+        auto queueLock = queueLockOf(queue);
+        if (!queueLock) return VK_ERROR_INITIALIZATION_FAILED;
 
-        for (uint32_t i = 0; i < submitCount; i++) {
-            const VkSubmitInfo& submit = pSubmits[i];
-            for (uint32_t c = 0; c < submit.commandBufferCount; c++) {
-                executePreprocessRecursive(0, submit.pCommandBuffers[c]);
+        {
+            AutoLock lock(mCmdBufferLock);
+            for (uint32_t i = 0; i < submitCount; i++) {
+                const VkSubmitInfo& submit = pSubmits[i];
+                for (uint32_t c = 0; c < submit.commandBufferCount; c++) {
+                    executePreprocessRecursive(0, submit.pCommandBuffers[c]);
+                }
             }
         }
+
+        // Submissions only need to be serialized per queue, not against
+        // everything else behind mLock.
+        AutoLock lock(*queueLock);
         return vk->vkQueueSubmit(queue, submitCount, pSubmits, fence);
     }
 
@@ -3108,7 +3161,7 @@ public:
 
         VkResult result = vk->vkResetCommandBuffer(commandBuffer, flags);
         if (VK_SUCCESS == result) {
-            AutoLock lock(mLock);
+            AutoLock lock(mCmdBufferLock);
             mCmdBufferInfo[commandBuffer].preprocessFuncs.clear();
             mCmdBufferInfo[commandBuffer].subCmds.clear();
             mCmdBufferInfo[commandBuffer].computePipeline = 0;
@@ -3132,7 +3185,7 @@ public:
         if (!device) return;
         vk->vkFreeCommandBuffers(device, commandPool, commandBufferCount,
                 pCommandBuffers);
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         for (uint32_t i = 0; i < commandBufferCount; i++) {
             const auto& cmdBufferInfoIt =
                 mCmdBufferInfo.find(pCommandBuffers[i]);
@@ -3290,26 +3343,31 @@ public:
         auto device = unbox_VkDevice(boxed_device);
         auto vk = dispatch_VkDevice(boxed_device);
 
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
         auto info = android::base::find(
                 mDescriptorUpdateTemplateInfo,
                 descriptorUpdateTemplate);
 
         if (!info) return;
 
-        memcpy(info->data.data() + info->imageInfoStart,
+        // Other threads can be updating with the same template, so the
+        // descriptor data goes into a per-thread copy of |info->data|.
+        static thread_local std::vector<uint8_t> data;
+        data.resize(info->data.size());
+
+        memcpy(data.data() + info->imageInfoStart,
                 pImageInfos,
                 imageInfoCount * sizeof(VkDescriptorImageInfo));
-        memcpy(info->data.data() + info->bufferInfoStart,
+        memcpy(data.data() + info->bufferInfoStart,
                 pBufferInfos,
                 bufferInfoCount * sizeof(VkDescriptorBufferInfo));
-        memcpy(info->data.data() + info->bufferViewStart,
+        memcpy(data.data() + info->bufferViewStart,
                 pBufferViews,
                 bufferViewCount * sizeof(VkBufferView));
 
         vk->vkUpdateDescriptorSetWithTemplate(
                 device, descriptorSet, descriptorUpdateTemplate,
-                info->data.data());
+                data.data());
     }
 
     void hostSyncCommandBuffer(
@@ -3326,7 +3384,7 @@ public:
 
         auto commandBuffer = unbox_VkCommandBuffer(boxed_commandBuffer);
 
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         auto& info = mCmdBufferInfo[commandBuffer];
 
         bool doWait = false;
@@ -3335,7 +3393,7 @@ public:
             while ((sequenceNumber - info.sequenceNumber) != 1) {
                 auto waitUntilUs = nextDeadline();
                 mCvWaitSequenceNumber.timedWait(
-                    &mLock, waitUntilUs);
+                    &mCmdBufferLock, waitUntilUs);
                 doWait = true;
 
                 if (timeoutDeadline < System::get()->getUnixTimeUs()) {
@@ -3416,7 +3474,7 @@ public:
             return result;
         }
         // TODO: Check VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT?
-        AutoLock lock(mLock);
+        AutoLock lock(mCmdBufferLock);
         mCmdBufferInfo[commandBuffer].preprocessFuncs.clear();
         mCmdBufferInfo[commandBuffer].subCmds.clear();
         return VK_SUCCESS;
@@ -3447,7 +3505,7 @@ public:
         auto vk = dispatch_VkCommandBuffer(boxed_commandBuffer);
         vk->vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
         if (pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
-            AutoLock lock(mLock);
+            AutoLock lock(mCmdBufferLock);
             auto cmdBufferInfoIt = mCmdBufferInfo.find(commandBuffer);
             if (cmdBufferInfoIt != mCmdBufferInfo.end()) {
                 if (pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
@@ -3473,7 +3531,7 @@ public:
                 pDescriptorSets, dynamicOffsetCount,
                 pDynamicOffsets);
         if (pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
-            AutoLock lock(mLock);
+            AutoLock lock(mCmdBufferLock);
             auto cmdBufferInfoIt = mCmdBufferInfo.find(commandBuffer);
             if (cmdBufferInfoIt != mCmdBufferInfo.end()) {
                 cmdBufferInfoIt->second.descriptorLayout = layout;
@@ -3496,7 +3554,7 @@ public:
         auto vk = dispatch_VkDevice(boxed_device);
         VkRenderPassCreateInfo createInfo;
         bool needReformat = false;
-        AutoLock lock(mLock);
+        AutoReadLock lock(mLock);
 
         auto deviceInfoIt = mDeviceInfo.find(device);
         if (deviceInfoIt == mDeviceInfo.end()) {
@@ -3641,19 +3699,19 @@ public:
         mGlobalHandleStore.remove((uint64_t)boxed); \
     } \
     type unbox_##type(type boxed) { \
-        AutoLock lock(mGlobalHandleStore.lock); \
+        AutoReadLock lock(mGlobalHandleStore.lock); \
         auto elt = mGlobalHandleStore.getLocked( \
                 (uint64_t)(uintptr_t)boxed); \
         if (!elt) return VK_NULL_HANDLE; \
         return (type)elt->underlying; \
     } \
     type unboxed_to_boxed_##type(type unboxed) { \
-        AutoLock lock(mGlobalHandleStore.lock); \
+        AutoReadLock lock(mGlobalHandleStore.lock); \
         return (type)mGlobalHandleStore.getBoxedFromUnboxedLocked( \
                 (uint64_t)(uintptr_t)unboxed); \
     } \
     VulkanDispatch* dispatch_##type(type boxed) { \
-        AutoLock lock(mGlobalHandleStore.lock); \
+        AutoReadLock lock(mGlobalHandleStore.lock); \
         auto elt = mGlobalHandleStore.getLocked( \
                 (uint64_t)(uintptr_t)boxed); \
         if (!elt) { fprintf(stderr, "%s: err not found boxed %p\n", __func__, boxed); return nullptr; } \
@@ -3671,12 +3729,12 @@ public:
         mGlobalHandleStore.remove((uint64_t)boxed); \
     } \
     type unboxed_to_boxed_non_dispatchable_##type(type unboxed) { \
-        AutoLock lock(mGlobalHandleStore.lock); \
+        AutoReadLock lock(mGlobalHandleStore.lock); \
         return (type)mGlobalHandleStore.getBoxedFromUnboxedLocked( \
                 (uint64_t)(uintptr_t)unboxed); \
     } \
     type unbox_non_dispatchable_##type(type boxed) { \
-        AutoLock lock(mGlobalHandleStore.lock); \
+        AutoReadLock lock(mGlobalHandleStore.lock); \
         auto elt = mGlobalHandleStore.getLocked( \
                 (uint64_t)(uintptr_t)boxed); \
         if (!elt) { fprintf(stderr, "%s: unbox %p failed, not found\n", __func__, boxed); return VK_NULL_HANDLE; } \
@@ -3764,11 +3822,12 @@ private:
         return &physdevInfo->memoryProperties;
     }
 
-    Optional<uint32_t> queueFamilyIndexOfQueueLocked(VkQueue queue) {
+    std::shared_ptr<Lock> queueLockOf(VkQueue queue) {
+        AutoReadLock lock(mLock);
         auto info = android::base::find(mQueueInfo, queue);
-        if (!info) return {};
+        if (!info) return nullptr;
 
-        return info->queueFamilyIndex;
+        return info->lock;
     }
 
     bool getDefaultQueueForDeviceLocked(
@@ -4985,13 +5044,13 @@ private:
     void registerDescriptorUpdateTemplate(
             VkDescriptorUpdateTemplate descriptorUpdateTemplate,
             const DescriptorUpdateTemplateInfo& info) {
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mDescriptorUpdateTemplateInfo[descriptorUpdateTemplate] = info;
     }
 
     void unregisterDescriptorUpdateTemplate(
             VkDescriptorUpdateTemplate descriptorUpdateTemplate) {
-        AutoLock lock(mLock);
+        AutoWriteLock lock(mLock);
         mDescriptorUpdateTemplateInfo.erase(descriptorUpdateTemplate);
     }
 
@@ -5033,7 +5092,14 @@ private:
     bool mLogMap = false;
     PFN_vkUseIOSurfaceMVK m_useIOSurfaceFunc = nullptr;
 
-    Lock mLock;
+    // Guards the handle info tables below, except for the command buffer
+    // and command pool ones. Calls that only look things up take it for
+    // reading, so that decoders of different guest threads don't have to
+    // wait on each other for them.
+    ReadWriteLock mLock;
+    // Guards mCmdBufferInfo and mCmdPoolInfo, which recording and host sync
+    // update on every command buffer. Taken after mLock when both are needed.
+    Lock mCmdBufferLock;
     ConditionVariable mCvWaitSequenceNumber;
 
     // We always map the whole size on host.
@@ -5130,6 +5196,9 @@ private:
         VkDevice device;
         uint32_t queueFamilyIndex;
         VkQueue boxed = nullptr;
+        // Vulkan wants host access to a queue externally synchronized.
+        // Shared so that a submit can hold it after letting go of mLock.
+        std::shared_ptr<Lock> lock = std::make_shared<Lock>();
     };
 
     struct BufferInfo {
@@ -5285,7 +5354,9 @@ private:
     public:
         using Store = android::base::EntityManager<32, 16, 16, T>;
 
-        Lock lock;
+        // Every decoded call unboxes its handles, so lookups only take this
+        // for reading.
+        ReadWriteLock lock;
         Store store;
         std::unordered_map<uint64_t, uint64_t> reverseMap;
 
@@ -5295,21 +5366,21 @@ private:
         }
 
         uint64_t add(const T& item, BoxedHandleTypeTag tag) {
-            AutoLock l(lock);
+            AutoWriteLock l(lock);
             auto res = (uint64_t)store.add(item, (size_t)tag);
             reverseMap[(uint64_t)(item.underlying)] = res;
             return res;
         }
 
         uint64_t addFixed(uint64_t handle, const T& item, BoxedHandleTypeTag tag) {
-            AutoLock l(lock);
+            AutoWriteLock l(lock);
             auto res = (uint64_t)store.addFixed(handle, item, (size_t)tag);
             reverseMap[(uint64_t)(item.underlying)] = res;
             return res;
         }
 
         void remove(uint64_t h) {
-            AutoLock l(lock);
+            AutoWriteLock l(lock);
             auto item = getLocked(h);
             if (item) {
                 reverseMap.erase((uint64_t)(item->underlying));
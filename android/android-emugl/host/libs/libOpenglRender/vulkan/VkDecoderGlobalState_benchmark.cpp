@@ -0,0 +1,299 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how well guest render threads decoding Vulkan calls at the same
+// time scale, as they all go through the VkDecoderGlobalState tables: each
+// benchmark runs with 1 to 8 threads sharing a single SwiftShader device.
+//
+// The calls get the same handles the decoder would give them: dispatchable
+// handles boxed, non-dispatchable ones unboxed.
+
+#include "VkCommonOperations.h"
+#include "VkDecoderGlobalState.h"
+#include "VulkanDispatch.h"
+
+#include "android/base/memory/LazyInstance.h"
+#include "android/base/Pool.h"
+#include "emugl/common/vm_operations.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <vector>
+
+using android::base::LazyInstance;
+using android::base::Pool;
+using goldfish_vk::VkDecoderGlobalState;
+
+namespace {
+
+constexpr uint32_t kImageSize = 64;
+
+struct SharedDevice {
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t queueFamilyIndex = 0;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+
+    SharedDevice() {
+        QAndroidVmOperations vmOps = {};
+        vmOps.setSkipSnapshotSave = [](bool) {};
+        set_emugl_vm_operations(vmOps);
+
+        // Picks the SwiftShader ICD.
+        goldfish_vk::createOrGetGlobalVkEmulation(emugl::vkDispatch(true));
+        auto state = VkDecoderGlobalState::get();
+        Pool pool;
+
+        VkApplicationInfo appInfo = {
+                VK_STRUCTURE_TYPE_APPLICATION_INFO, nullptr,
+                "VkDecoderGlobalState_benchmark", 1, "", 1,
+                VK_API_VERSION_1_0,
+        };
+        VkInstanceCreateInfo instanceInfo = {
+                VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, nullptr, 0, &appInfo,
+        };
+        if (state->on_vkCreateInstance(&pool, &instanceInfo, nullptr,
+                                       &instance) != VK_SUCCESS) {
+            return;
+        }
+
+        uint32_t count = 1;
+        state->on_vkEnumeratePhysicalDevices(&pool, instance, &count,
+                                             &physicalDevice);
+        if (!count) {
+            return;
+        }
+
+        float priority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo = {
+                VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                nullptr,
+                0,
+                queueFamilyIndex,
+                1,
+                &priority,
+        };
+        VkDeviceCreateInfo deviceInfo = {
+                VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, nullptr, 0, 1,
+                &queueInfo,
+        };
+        if (state->on_vkCreateDevice(&pool, physicalDevice, &deviceInfo,
+                                     nullptr, &device) != VK_SUCCESS) {
+            device = VK_NULL_HANDLE;
+            return;
+        }
+
+        // A buffer and an image to copy between, with memory bound to them.
+        VkBufferCreateInfo bufferInfo = {
+                VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                nullptr,
+                0,
+                kImageSize * kImageSize * 4,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_SHARING_MODE_EXCLUSIVE,
+        };
+        state->on_vkCreateBuffer(&pool, device, &bufferInfo, nullptr, &buffer);
+        buffer = state->unbox_non_dispatchable_VkBuffer(buffer);
+
+        VkImageCreateInfo imageInfo = {
+                VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                nullptr,
+                0,
+                VK_IMAGE_TYPE_2D,
+                VK_FORMAT_R8G8B8A8_UNORM,
+                {kImageSize, kImageSize, 1},
+                1,
+                1,
+                VK_SAMPLE_COUNT_1_BIT,
+                VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                VK_SHARING_MODE_EXCLUSIVE,
+        };
+        state->on_vkCreateImage(&pool, device, &imageInfo, nullptr, &image);
+        image = state->unbox_non_dispatchable_VkImage(image);
+
+        auto vk = state->dispatch_VkDevice(device);
+        auto unboxedDevice = state->unbox_VkDevice(device);
+        VkMemoryRequirements bufferReqs;
+        vk->vkGetBufferMemoryRequirements(unboxedDevice, buffer, &bufferReqs);
+        VkMemoryRequirements imageReqs;
+        state->on_vkGetImageMemoryRequirements(&pool, device, image,
+                                               &imageReqs);
+        state->on_vkBindBufferMemory(&pool, device, buffer,
+                                     allocate(bufferReqs), 0);
+        state->on_vkBindImageMemory(&pool, device, image, allocate(imageReqs),
+                                    0);
+    }
+
+    VkDeviceMemory allocate(const VkMemoryRequirements& reqs) {
+        uint32_t typeIndex = 0;
+        while (!(reqs.memoryTypeBits & (1 << typeIndex))) {
+            ++typeIndex;
+        }
+        VkMemoryAllocateInfo allocInfo = {
+                VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                nullptr,
+                reqs.size,
+                typeIndex,
+        };
+        Pool pool;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDecoderGlobalState::get()->on_vkAllocateMemory(
+                &pool, device, &allocInfo, nullptr, &memory);
+        return VkDecoderGlobalState::get()->unbox_non_dispatchable_VkDeviceMemory(
+                memory);
+    }
+};
+
+LazyInstance<SharedDevice> sDevice = LAZY_INSTANCE_INIT;
+
+// Returns false and marks the benchmark skipped if there's no SwiftShader.
+bool haveDevice(benchmark::State& state) {
+    if (sDevice->device) {
+        return true;
+    }
+    state.SetLabel("no SwiftShader device");
+    while (state.KeepRunning()) {
+    }
+    return false;
+}
+
+}  // namespace
+
+// The lookups every decoded call makes for its handles.
+static void BM_UnboxHandles(benchmark::State& state) {
+    if (!haveDevice(state)) {
+        return;
+    }
+    auto decoderState = VkDecoderGlobalState::get();
+    const VkDevice device = sDevice->device;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(decoderState->unbox_VkDevice(device));
+        benchmark::DoNotOptimize(decoderState->dispatch_VkDevice(device));
+    }
+}
+
+BENCHMARK(BM_UnboxHandles)->ThreadRange(1, 8)->UseRealTime();
+
+// What a guest render thread sends for each of its command buffers: the
+// host sync and recording calls that look up or update the handle tables.
+static void BM_RecordCommandBuffer(benchmark::State& state) {
+    if (!haveDevice(state)) {
+        return;
+    }
+    auto decoderState = VkDecoderGlobalState::get();
+    const VkDevice device = sDevice->device;
+    Pool pool;
+
+    VkCommandPoolCreateInfo poolInfo = {
+            VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            nullptr,
+            VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            sDevice->queueFamilyIndex,
+    };
+    VkCommandPool commandPool;
+    decoderState->on_vkCreateCommandPool(&pool, device, &poolInfo, nullptr,
+                                         &commandPool);
+    commandPool = decoderState->unbox_non_dispatchable_VkCommandPool(
+            commandPool);
+    VkCommandBufferAllocateInfo allocInfo = {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            nullptr,
+            commandPool,
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            1,
+    };
+    VkCommandBuffer commandBuffer;
+    decoderState->on_vkAllocateCommandBuffers(&pool, device, &allocInfo,
+                                              &commandBuffer);
+
+    VkCommandBufferBeginInfo beginInfo = {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            nullptr,
+            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkImageMemoryBarrier barrier = {
+            VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            nullptr,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            sDevice->image,
+            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+    };
+    VkBufferImageCopy region = {
+            0, 0, 0, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            {0, 0, 0}, {kImageSize, kImageSize, 1},
+    };
+
+    uint32_t sequenceNumber = 0;
+    while (state.KeepRunning()) {
+        decoderState->on_vkCommandBufferHostSyncGOOGLE(
+                &pool, commandBuffer, 0, ++sequenceNumber);
+        decoderState->on_vkBeginCommandBuffer(&pool, commandBuffer,
+                                              &beginInfo);
+        decoderState->on_vkCmdPipelineBarrier(
+                &pool, commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                &barrier);
+        decoderState->on_vkCmdCopyBufferToImage(
+                &pool, commandBuffer, sDevice->buffer, sDevice->image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        decoderState->on_vkEndCommandBufferAsyncGOOGLE(&pool, commandBuffer);
+        decoderState->on_vkResetCommandBuffer(&pool, commandBuffer, 0);
+    }
+
+    decoderState->on_vkFreeCommandBuffers(&pool, device, commandPool, 1,
+                                          &commandBuffer);
+    decoderState->on_vkDestroyCommandPool(&pool, device, commandPool,
+                                          nullptr);
+}
+
+BENCHMARK(BM_RecordCommandBuffer)->ThreadRange(1, 8)->UseRealTime();
+
+// Object creation, which still needs the tables to itself.
+static void BM_CreateDestroyBuffer(benchmark::State& state) {
+    if (!haveDevice(state)) {
+        return;
+    }
+    auto decoderState = VkDecoderGlobalState::get();
+    const VkDevice device = sDevice->device;
+    Pool pool;
+    VkBufferCreateInfo bufferInfo = {
+            VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            nullptr,
+            0,
+            4096,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_SHARING_MODE_EXCLUSIVE,
+    };
+    while (state.KeepRunning()) {
+        VkBuffer buffer;
+        decoderState->on_vkCreateBuffer(&pool, device, &bufferInfo, nullptr,
+                                        &buffer);
+        auto boxed = buffer;
+        buffer = decoderState->unbox_non_dispatchable_VkBuffer(boxed);
+        decoderState->delete_boxed_non_dispatchable_VkBuffer(boxed);
+        decoderState->on_vkDestroyBuffer(&pool, device, buffer, nullptr);
+    }
+}
+
+BENCHMARK(BM_CreateDestroyBuffer)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN()
@@ -24,13 +24,18 @@
 #include <assert.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(_MSC_VER)
+#include <nmmintrin.h>
+#define CHECKSUMHELPER_HAS_CRC32_INSN 1
+#endif
+
 // Checklist when implementing new protocol:
 // 1. update CHECKSUMHELPER_MAX_VERSION
 // 2. update checksumByteSize()
 // 3. update addBuffer, writeChecksum, resetChecksum, validate
 
 // change CHECKSUMHELPER_MAX_VERSION when you want to update the protocol version
-#define CHECKSUMHELPER_MAX_VERSION 1
+#define CHECKSUMHELPER_MAX_VERSION 2
 
 // utility macros to create checksum string at compilation time
 #define CHECKSUMHELPER_VERSION_STR_PREFIX "ANDROID_EMU_CHECKSUM_HELPER_v"
@@ -50,6 +55,103 @@ uint32_t ChecksumCalculator::getMaxVersion() {return kMaxVersion;}
 const char* ChecksumCalculator::getMaxVersionStr() {return kMaxVersionStr;}
 const char* ChecksumCalculator::getMaxVersionStrPrefix() {return kMaxVersionStrPrefix;}
 
+// CRC32C (Castagnoli) tables for slicing by 8 bytes, the software fallback
+// of the crc32 instruction.
+namespace {
+
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    Crc32cTables() {
+        static constexpr uint32_t kPolynomial = 0x82f63b78;  // reflected
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (kPolynomial & (0 - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int slice = 1; slice < 8; slice++) {
+                const uint32_t prev = table[slice - 1][i];
+                table[slice][i] = (prev >> 8) ^ table[0][prev & 0xff];
+            }
+        }
+    }
+};
+
+}  // namespace
+
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t* data, size_t len) {
+    static const Crc32cTables tables;
+    const auto& t = tables.table;
+    for (; len && (reinterpret_cast<uintptr_t>(data) & 7); --len) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    for (; len >= 8; len -= 8, data += 8) {
+        uint32_t lo;
+        uint32_t hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+              t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+              t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; len; --len) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef CHECKSUMHELPER_HAS_CRC32_INSN
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t len) {
+    for (; len && (reinterpret_cast<uintptr_t>(data) & 7); --len) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, data += 8) {
+        uint64_t value;
+        memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; len >= 4; len -= 4, data += 4) {
+        uint32_t value;
+        memcpy(&value, data, 4);
+        crc = _mm_crc32_u32(crc, value);
+    }
+    for (; len; --len) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+static bool hasCrc32Insn() {
+    static const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+    return hasSse42;
+}
+
+#endif  // CHECKSUMHELPER_HAS_CRC32_INSN
+
+uint32_t ChecksumCalculator::crc32c(uint32_t crc,
+                                    const void* buf,
+                                    size_t len,
+                                    bool allowHardware) {
+    const uint8_t* data = static_cast<const uint8_t*>(buf);
+#ifdef CHECKSUMHELPER_HAS_CRC32_INSN
+    if (allowHardware && hasCrc32Insn()) {
+        return ~crc32cHardware(~crc, data, len);
+    }
+#endif
+    return ~crc32cSoftware(~crc, data, len);
+}
+
 bool ChecksumCalculator::setVersion(uint32_t version) {
     if (version > kMaxVersion) {  // unsupported version
         LOG_CHECKSUMHELPER("%s: ChecksumCalculator Set Unsupported version Version %d\n",
@@ -74,6 +176,9 @@ void ChecksumCalculator::addBuffer(const void* buf, size_t packetLen) {
         case 1:
             m_v1BufferTotalLength += packetLen;
             break;
+        case 2:
+            m_v2Crc = crc32c(m_v2Crc, buf, packetLen);
+            break;
     }
 }
 
@@ -87,6 +192,11 @@ bool ChecksumCalculator::writeChecksum(void* outputChecksum, size_t outputChecks
             memcpy(checksumPtr+sizeof(val), &m_numWrite, sizeof(m_numWrite));
             break;
         }
+        case 2: { // protocol v2 writes the CRC32C of the data instead
+            memcpy(checksumPtr, &m_v2Crc, sizeof(m_v2Crc));
+            memcpy(checksumPtr+sizeof(m_v2Crc), &m_numWrite, sizeof(m_numWrite));
+            break;
+        }
     }
     resetChecksum();
     m_numWrite++;
@@ -98,6 +208,9 @@ void ChecksumCalculator::resetChecksum() {
         case 1:
             m_v1BufferTotalLength = 0;
             break;
+        case 2:
+            m_v2Crc = 0;
+            break;
     }
     m_isEncodingChecksum = false;
 }
@@ -112,8 +225,10 @@ bool ChecksumCalculator::validate(const void* expectedChecksum,
     }
     bool isValid;
     switch (m_version) {
-        case 1: {
-            const uint32_t val = computeV1Checksum();
+        case 1:
+        case 2: {
+            const uint32_t val =
+                    m_version == 1 ? computeV1Checksum() : m_v2Crc;
             assert(checksumSize == sizeof(val) + sizeof(m_numRead));
             isValid = 0 == memcmp(&val, expectedChecksum, sizeof(val)) &&
                       0 == memcmp(&m_numRead,
@@ -147,6 +262,9 @@ void ChecksumCalculator::save(android::base::Stream* stream) {
     case 1:
         assert(m_v1BufferTotalLength == 0);
         break;
+    case 2:
+        assert(m_v2Crc == 0);
+        break;
     }
 
     // Our checksum should never become > 255 bytes. Ever.
@@ -163,6 +281,9 @@ void ChecksumCalculator::load(android::base::Stream* stream) {
     case 1:
         assert(m_v1BufferTotalLength == 0);
         break;
+    case 2:
+        assert(m_v2Crc == 0);
+        break;
     }
 
     m_checksumSize = stream->getByte();
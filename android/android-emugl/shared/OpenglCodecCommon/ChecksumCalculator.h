@@ -46,6 +46,10 @@ namespace android { namespace base { class Stream; } }
 // no checksum (i.e., checksumByteSize returns 0, validate always returns true,
 // addBuffer and writeCheckSum does nothing).
 //
+// Version 1 only checks the length of the data. Version 2 checks the data
+// itself with a CRC32C, which uses the SSE4.2 crc32 instruction on the CPUs
+// that have it.
+//
 // Notice that to detect package lost, ChecksumCalculator also keeps track of how
 // many times it generates/validates checksums, and might use it as part of the
 // checksum.
@@ -145,6 +149,14 @@ public:
     static const char* getMaxVersionStr();
     static const char* getMaxVersionStrPrefix();
 
+    // Returns the CRC32C of the |len| bytes at |buf| appended to data whose
+    // CRC32C is |crc| (0 for no data), as used by version 2. Doesn't use
+    // the crc32 instruction if |allowHardware| is false.
+    static uint32_t crc32c(uint32_t crc,
+                           const void* buf,
+                           size_t len,
+                           bool allowHardware = true);
+
     // Size of checksum in the current version
     size_t checksumByteSize() const { return m_checksumSize; }
 
@@ -175,12 +187,16 @@ public:
 
 private:
     static constexpr size_t kVersion1ChecksumSize = 8;  // 2 x uint32_t
+    static constexpr size_t kVersion2ChecksumSize = 8;  // 2 x uint32_t
 
     static_assert(kVersion1ChecksumSize <= kMaxChecksumLength,
                   "Invalid ChecksumCalculator::kMaxChecksumLength value");
+    static_assert(kVersion2ChecksumSize <= kMaxChecksumLength,
+                  "Invalid ChecksumCalculator::kMaxChecksumLength value");
 
     static constexpr size_t checksumByteSize(uint32_t version) {
-        return version == 1 ? kVersion1ChecksumSize : 0;
+        return version == 1 ? kVersion1ChecksumSize
+                            : version == 2 ? kVersion2ChecksumSize : 0;
     }
 
     uint32_t m_version = 0;
@@ -197,4 +213,6 @@ private:
     uint32_t computeV1Checksum() const;
     // The buffer used in protocol version 1 to compute checksum.
     uint32_t m_v1BufferTotalLength = 0;
+    // The CRC32C of the buffers added so far, in protocol version 2.
+    uint32_t m_v2Crc = 0;
 };
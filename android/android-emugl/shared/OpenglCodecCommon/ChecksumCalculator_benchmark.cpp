@@ -0,0 +1,80 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The cost of checksumming the command stream, per protocol version, for
+// packets of range_x() bytes. Each iteration is what the decoder does for
+// one packet: checksum it, then check the checksum the encoder wrote.
+
+#include "ChecksumCalculator.h"
+
+#include "benchmark/benchmark_api.h"
+
+#include <vector>
+
+namespace {
+
+void checksumPackets(benchmark::State& state, uint32_t version) {
+    std::vector<unsigned char> packet(state.range_x());
+    for (size_t i = 0; i < packet.size(); i++) {
+        packet[i] = static_cast<unsigned char>(i * 31);
+    }
+
+    ChecksumCalculator encoder;
+    ChecksumCalculator decoder;
+    encoder.setVersion(version);
+    decoder.setVersion(version);
+    unsigned char checksum[ChecksumCalculator::kMaxChecksumLength];
+    const size_t checksumSize = encoder.checksumByteSize();
+
+    bool valid = true;
+    while (state.KeepRunning()) {
+        encoder.addBuffer(packet.data(), packet.size());
+        encoder.writeChecksum(checksum, checksumSize);
+        decoder.addBuffer(packet.data(), packet.size());
+        valid &= decoder.validate(checksum, checksumSize);
+    }
+    if (!valid) {
+        state.SetLabel("checksum mismatch");
+    }
+    // Two passes over the packet per iteration.
+    state.SetBytesProcessed(int64_t(state.iterations()) * packet.size() * 2);
+}
+
+}  // namespace
+
+static void BM_ChecksumV1(benchmark::State& state) {
+    checksumPackets(state, 1);
+}
+
+static void BM_ChecksumV2(benchmark::State& state) {
+    checksumPackets(state, 2);
+}
+
+// Version 2 on a CPU without the crc32 instruction.
+static void BM_Crc32cSoftware(benchmark::State& state) {
+    std::vector<unsigned char> packet(state.range_x(), 0x5a);
+    uint32_t crc = 0;
+    while (state.KeepRunning()) {
+        crc = ChecksumCalculator::crc32c(crc, packet.data(), packet.size(),
+                                         false /* allowHardware */);
+    }
+    benchmark::DoNotOptimize(crc);
+    state.SetBytesProcessed(int64_t(state.iterations()) * packet.size());
+}
+
+BENCHMARK(BM_ChecksumV1)->Arg(64)->Arg(4096)->Arg(1024 * 1024);
+BENCHMARK(BM_ChecksumV2)->Arg(64)->Arg(4096)->Arg(1024 * 1024);
+BENCHMARK(BM_Crc32cSoftware)->Arg(64)->Arg(4096)->Arg(1024 * 1024);
+
+BENCHMARK_MAIN()
@@ -0,0 +1,73 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ChecksumCalculator.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+TEST(ChecksumCalculator, Crc32cKnownValue) {
+    EXPECT_EQ(0u, ChecksumCalculator::crc32c(0, nullptr, 0));
+    EXPECT_EQ(0xe3069283u, ChecksumCalculator::crc32c(0, "123456789", 9));
+    EXPECT_EQ(0xe3069283u,
+              ChecksumCalculator::crc32c(0, "123456789", 9, false));
+}
+
+// The hardware and software paths agree for all alignments and lengths,
+// and a CRC can be computed in pieces.
+TEST(ChecksumCalculator, Crc32cHardwareMatchesSoftware) {
+    std::mt19937 random(1);
+    std::vector<unsigned char> data(4096 + 16);
+    for (auto& byte : data) {
+        byte = random();
+    }
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len : {1, 3, 8, 15, 64, 1000, 4096}) {
+            const unsigned char* buf = data.data() + offset;
+            const uint32_t crc = ChecksumCalculator::crc32c(0, buf, len);
+            EXPECT_EQ(crc, ChecksumCalculator::crc32c(0, buf, len, false))
+                    << "offset " << offset << ", len " << len;
+            const uint32_t half = ChecksumCalculator::crc32c(0, buf, len / 2);
+            EXPECT_EQ(crc, ChecksumCalculator::crc32c(half, buf + len / 2,
+                                                      len - len / 2));
+        }
+    }
+}
+
+TEST(ChecksumCalculator, Version2) {
+    ChecksumCalculator encoder;
+    ChecksumCalculator decoder;
+    ASSERT_TRUE(encoder.setVersion(2));
+    ASSERT_TRUE(decoder.setVersion(2));
+    ASSERT_EQ(8u, encoder.checksumByteSize());
+
+    std::vector<unsigned char> packet(100, 7);
+    unsigned char checksum[ChecksumCalculator::kMaxChecksumLength];
+    for (int i = 0; i < 3; i++) {
+        encoder.addBuffer(packet.data(), 40);
+        encoder.addBuffer(packet.data() + 40, 60);
+        ASSERT_TRUE(encoder.writeChecksum(checksum, sizeof(checksum)));
+        decoder.addBuffer(packet.data(), packet.size());
+        EXPECT_TRUE(decoder.validate(checksum, 8));
+    }
+
+    // Unlike version 1, a change in the data is caught.
+    encoder.addBuffer(packet.data(), packet.size());
+    ASSERT_TRUE(encoder.writeChecksum(checksum, sizeof(checksum)));
+    packet[50] ^= 1;
+    decoder.addBuffer(packet.data(), packet.size());
+    EXPECT_FALSE(decoder.validate(checksum, 8));
+}
@@ -19,6 +19,7 @@
 #include "android/base/memory/MemoryTracker.h"
 
 #include <cstring>
+#include <string>
 
 static int s_apiLevel = -1;
 static bool s_isPhone = false;
@@ -32,6 +33,8 @@ android::base::GLObjectCounter* s_gl_object_counter = nullptr;
 android::base::CpuUsage* s_cpu_usage = nullptr;
 android::base::MemoryTracker* s_mem_usage = nullptr;
 
+static std::string s_shader_cache_dir;
+
 static SelectedRenderer s_renderer =
     SELECTED_RENDERER_HOST;
 
@@ -103,3 +106,11 @@ void emugl::setMemoryTracker(android::base::MemoryTracker* usage) {
 android::base::MemoryTracker* emugl::getMemoryTracker() {
     return s_mem_usage;
 }
+
+void emugl::setShaderCacheDir(const char* dir) {
+    s_shader_cache_dir = dir ? dir : "";
+}
+
+const char* emugl::getShaderCacheDir() {
+    return s_shader_cache_dir.c_str();
+}
@@ -69,6 +69,10 @@ namespace emugl {
     EMUGL_COMMON_API void setMemoryTracker(android::base::MemoryTracker* usage);
     EMUGL_COMMON_API android::base::MemoryTracker* getMemoryTracker();
 
+    // Shader cache directory get/set. An empty directory means no cache.
+    EMUGL_COMMON_API void setShaderCacheDir(const char* dir);
+    EMUGL_COMMON_API const char* getShaderCacheDir();
+
     // Window operation agent
     EMUGL_COMMON_API void set_emugl_window_operations(const QAndroidEmulatorWindowAgent &vm_operations);
     EMUGL_COMMON_API const QAndroidEmulatorWindowAgent &get_emugl_window_operations();
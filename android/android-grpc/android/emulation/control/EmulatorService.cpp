@@ -63,8 +63,10 @@
 #include "android/emulation/control/telephony_agent.h"
 #include "android/emulation/control/user_event_agent.h"
 #include "android/emulation/control/utils/EventWaiter.h"
+#include "android/emulation/control/utils/ImageDeltaEncoder.h"
 #include "android/emulation/control/utils/ScreenshotUtils.h"
 #include "android/emulation/control/utils/ServiceUtils.h"
+#include "android/emulation/control/utils/SharedMemoryLibrary.h"
 #include "android/emulation/control/vm_operations.h"
 #include "android/emulation/control/waterfall/WaterfallService.h"
 #include "android/emulation/control/window_agent.h"
@@ -418,12 +420,21 @@ public:
         EventWaiter frameEvent(&gpu_register_shared_memory_callback,
                                &gpu_unregister_shared_memory_callback);
 
+        // Only used when the client asked for deltas.
+        ImageDeltaEncoder deltaEncoder(request->deltacompression());
+
         // Make sure we always write the first frame, this can be
         // a completely empty frame if the screen is not active.
         Image first;
-        getScreenshot(context, request, &first);
-        bool clientAvailable = writer->Write(first);
+        auto status = getScreenshot(context, request, &first);
+        if (!status.ok()) {
+            return status;
+        }
         bool lastFrameWasEmpty = first.format().width() == 0;
+        if (request->delta()) {
+            encodeDelta(request, &deltaEncoder, &first);
+        }
+        bool clientAvailable = writer->Write(first);
 
         while (clientAvailable) {
             Image reply;
@@ -437,7 +448,10 @@ public:
             auto arrived = frameEvent.next(kTimeToWaitForFrame);
             if (arrived > 0) {
                 // TODO(jansene): Add metrics around dropped frames/timing?
-                getScreenshot(context, request, &reply);
+                status = getScreenshot(context, request, &reply);
+                if (!status.ok()) {
+                    return status;
+                }
                 reply.set_seq(frameEvent.current());
 
                 // We send the first empty frame, after that we wait for frames
@@ -446,7 +460,13 @@ public:
                 // is empty frame. F is frame) [0, ... <nothing> ..., F1, F2,
                 // F3, 0, ...<nothing>... ]
                 bool emptyFrame = reply.format().width() == 0;
-                if (!lastFrameWasEmpty || !emptyFrame) {
+                bool changed = true;
+                if (request->delta()) {
+                    // No need to send a frame that is identical to the
+                    // previous one.
+                    changed = encodeDelta(request, &deltaEncoder, &reply);
+                }
+                if ((!lastFrameWasEmpty || !emptyFrame) && changed) {
                     clientAvailable = writer->Write(reply);
                 }
                 lastFrameWasEmpty = emptyFrame;
@@ -459,6 +479,12 @@ public:
     Status getScreenshot(ServerContext* context,
                          const ImageFormat* request,
                          Image* reply) override {
+        if (request->transport().channel() == ImageTransport::MMAP &&
+            !SharedMemoryLibrary::isLocalPeer(context->peer())) {
+            return Status(grpc::StatusCode::PERMISSION_DENIED,
+                          "Shared memory is only available to clients on "
+                          "this machine.");
+        }
         uint32_t width, height;
         bool enabled;
         bool multiDisplayQueryWorks =
@@ -541,8 +567,6 @@ public:
                 mAgents->display->getFrameBuffer, request->display(), newWidth,
                 newHeight);
 
-        reply->set_image(img.getPixelBuf(), img.getPixelCount());
-
         // Update format information with the retrieved width, height..
         auto format = reply->mutable_format();
         format->set_format(ScreenshotUtils::translate(img.getImageFormat()));
@@ -555,6 +579,11 @@ public:
         rotation_reply->set_zaxis(zaxis);
         rotation_reply->set_rotation(rotation);
 
+        if (request->transport().channel() == ImageTransport::MMAP) {
+            return writeToSharedMemory(request->transport(), &img);
+        }
+
+        reply->set_image(img.getPixelBuf(), img.getPixelCount());
         return Status::OK;
     }
 
@@ -677,6 +706,56 @@ public:
     }
 
 private:
+    // Turns |image| into a delta against the previous image in the stream.
+    // Returns false if the image doesn't need to be sent.
+    bool encodeDelta(const ImageFormat* request,
+                     ImageDeltaEncoder* encoder,
+                     Image* image) {
+        if (request->transport().channel() != ImageTransport::MMAP) {
+            return encoder->encode(image);
+        }
+        // getScreenshot() just wrote the pixels to the shared memory region.
+        const auto& format = image->format();
+        auto shm = mSharedMemoryLibrary.borrow(request->transport().handle(),
+                                               request->transport().size());
+        if (format.width() == 0 || !shm) {
+            return encoder->encodeRegions(image, nullptr, 0);
+        }
+        const size_t bytesPerPixel =
+                format.format() == ImageFormat::RGB888 ? 3 : 4;
+        return encoder->encodeRegions(
+                image, SharedMemoryLibrary::frame(shm.get()),
+                size_t(format.width()) * format.height() * bytesPerPixel);
+    }
+
+    // Copies the pixels of |img| to the client's shared memory region, after
+    // its header, saving the copies into and out of the protobuf and the
+    // trip through the channel.
+    Status writeToSharedMemory(const ImageTransport& transport,
+                               android::emulation::Image* img) {
+        if (img->getImageFormat() == android::emulation::ImageFormat::PNG) {
+            return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          "PNG images can't be sent through shared memory.");
+        }
+        if (SharedMemoryLibrary::kHeaderSize + img->getPixelCount() >
+            transport.size()) {
+            return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "The shared memory region is too small for a " +
+                                  std::to_string(img->getPixelCount()) +
+                                  " byte image and its header.");
+        }
+        auto shm = mSharedMemoryLibrary.borrow(transport.handle(),
+                                               transport.size());
+        if (!shm) {
+            return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          "Can't map the shared memory region '" +
+                                  transport.handle() + "'.");
+        }
+        SharedMemoryLibrary::writeFrame(shm.get(), img->getPixelBuf(),
+                                        img->getPixelCount());
+        return Status::OK;
+    }
+
     const AndroidConsoleAgents* mAgents;
     keyboard::EmulatorKeyEventSender mKeyEventSender;
     TouchEventSender mTouchEventSender;
@@ -684,6 +763,7 @@ private:
     RtcBridge* mRtcBridge;
     RingStreambuf
             mLogcatBuffer;  // A ring buffer that tracks the logcat output.
+    SharedMemoryLibrary mSharedMemoryLibrary;
 
     static constexpr uint32_t k128KB = (128 * 1024) - 1;
     static constexpr uint16_t k5SecondsWait = 5 * 1000;
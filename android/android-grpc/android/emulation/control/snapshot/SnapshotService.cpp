@@ -27,6 +27,7 @@
 #include "android/base/Log.h"
 #include "android/base/StringView.h"
 #include "android/base/Uuid.h"
+#include "android/base/async/ThreadLooper.h"
 #include "android/base/files/GzipStreambuf.h"
 #include "android/base/files/PathUtils.h"
 #include "android/emulation/control/LineConsumer.h"
@@ -36,6 +37,7 @@
 #include "android/emulation/control/snapshot/TarStream.h"
 #include "android/emulation/control/vm_operations.h"
 #include "android/snapshot/Icebox.h"
+#include "android/snapshot/PageStore.h"
 #include "android/snapshot/PathUtils.h"
 #include "android/snapshot/Snapshot.h"
 #include "android/snapshot/Snapshotter.h"
@@ -99,6 +101,18 @@ public:
             return Status::OK;
         }
 
+        // The pages of a deduplicated snapshot are in the AVD's page store,
+        // which isn't part of the snapshot directory.
+        if (snapshot::usesPageStore(snapshot->dataDir())) {
+            result.set_success(false);
+            result.set_err("Snapshot " + request->snapshot_id() +
+                           " keeps its RAM in the AVD's page store and "
+                           "can't be exported, save it again without "
+                           "ANDROID_SNAPSHOT_DEDUP");
+            writer->Write(result);
+            return Status::OK;
+        }
+
         auto tmpdir = pj(System::get()->getTempDir(), snapshot->name());
         const auto tmpdir_deleter =
                 base::makeCustomScopedPtr(&tmpdir, [](std::string* tmpdir) {
@@ -211,6 +225,14 @@ public:
             return Status::OK;
         }
 
+        // Its ram.bin would point into a page store we don't have.
+        if (snapshot::usesPageStore(tmpSnap)) {
+            reply->set_success(false);
+            reply->set_err("Snapshot RAM is in a page store, which can't be "
+                           "imported");
+            return Status::OK;
+        }
+
         reply->set_snapshot_id(id);
         std::string finalDest = snapshot::getSnapshotDir(id.c_str());
         if (System::get()->pathExists(finalDest) &&
@@ -315,6 +337,21 @@ public:
             return Status::OK;
         }
 
+        // A copy-on-write save is still writing RAM out. Wait for it where
+        // the saver gets replaced, so it can't go away while we're at it.
+        auto status = snapshot::OperationStatus::Error;
+        const std::string id = request->snapshot_id();
+        android::base::ThreadLooper::runOnMainLooperAndWaitForCompletion(
+                [&status, &id]() {
+                    status = snapshot::Snapshotter::get().finishSaving(
+                            id.c_str());
+                });
+        if (status != snapshot::OperationStatus::Ok) {
+            reply->set_success(false);
+            reply->set_err("Failed to save snapshot " + id);
+            return Status::OK;
+        }
+
         reply->set_success(true);
         return Status::OK;
     }
@@ -0,0 +1,213 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/emulation/control/utils/ImageDeltaEncoder.h"
+
+#include <zlib.h>     // for compress2, compressBound, Z_BEST_SPEED
+#include <algorithm>  // for find_if, min
+#include <cstring>    // for memcmp, memcpy
+#include <vector>     // for vector
+
+namespace android {
+namespace emulation {
+namespace control {
+
+namespace {
+
+uint32_t bytesPerPixel(ImageFormat_ImgFormat format) {
+    switch (format) {
+        case ImageFormat::RGBA8888:
+            return 4;
+        case ImageFormat::RGB888:
+            return 3;
+        default:
+            // PNG frames can't be compared pixel by pixel.
+            return 0;
+    }
+}
+
+bool sameLayout(const ImageFormat& a, const ImageFormat& b) {
+    return a.format() == b.format() && a.width() == b.width() &&
+           a.height() == b.height() &&
+           a.rotation().rotation() == b.rotation().rotation();
+}
+
+}  // namespace
+
+constexpr uint32_t ImageDeltaEncoder::kTileSize;
+
+ImageDeltaEncoder::ImageDeltaEncoder(ImageDelta_Compression compression)
+    : mCompression(compression) {}
+
+bool ImageDeltaEncoder::encode(Image* image) {
+    std::vector<Rect> rects;
+    const auto& pixels = image->image();
+    switch (image->payload_case() == Image::kImage
+                    ? diff(image->format(),
+                           reinterpret_cast<const uint8_t*>(pixels.data()),
+                           pixels.size(), &rects)
+                    : Diff::Incomparable) {
+        case Diff::Incomparable:
+            return true;
+        case Diff::Keyframe:
+            mPixels = pixels;
+            return true;
+        case Diff::Unchanged:
+            return false;
+        case Diff::Changed:
+            break;
+    }
+
+    // The new frame becomes the reference for the next one.
+    mPixels.swap(*image->mutable_image());
+    auto delta = image->mutable_delta();
+    delta->set_compression(mCompression);
+    for (const auto& r : rects) {
+        addRegion(delta, mPixels, r);
+    }
+    return true;
+}
+
+bool ImageDeltaEncoder::encodeRegions(Image* image,
+                                      const uint8_t* pixels,
+                                      size_t size) {
+    std::vector<Rect> rects;
+    switch (diff(image->format(), pixels, size, &rects)) {
+        case Diff::Incomparable:
+            return true;
+        case Diff::Keyframe:
+            mPixels.assign(reinterpret_cast<const char*>(pixels), size);
+            return true;
+        case Diff::Unchanged:
+            return false;
+        case Diff::Changed:
+            break;
+    }
+
+    mPixels.assign(reinterpret_cast<const char*>(pixels), size);
+    auto delta = image->mutable_delta();
+    for (const auto& r : rects) {
+        auto region = delta->add_regions();
+        region->set_x(r.x);
+        region->set_y(r.y);
+        region->set_width(r.width);
+        region->set_height(r.height);
+    }
+    return true;
+}
+
+ImageDeltaEncoder::Diff ImageDeltaEncoder::diff(const ImageFormat& format,
+                                                const uint8_t* pixels,
+                                                size_t size,
+                                                std::vector<Rect>* rects) {
+    const uint32_t bpp = bytesPerPixel(format.format());
+    const uint32_t width = format.width();
+    const uint32_t height = format.height();
+
+    if (!bpp || !width || size != size_t(width) * height * bpp) {
+        // Nothing to compare the next frame with either.
+        mPixels.clear();
+        mFormat.Clear();
+        return Diff::Incomparable;
+    }
+
+    if (!sameLayout(mFormat, format) || mPixels.size() != size) {
+        mFormat = format;
+        mBytesPerPixel = bpp;
+        return Diff::Keyframe;
+    }
+
+    // Find the changed tiles, merging runs of them in a tile row into a
+    // single rect, and runs with the same span in consecutive tile rows
+    // into a taller one.
+    const auto previous = reinterpret_cast<const uint8_t*>(mPixels.data());
+    const size_t stride = size_t(width) * bpp;
+    std::vector<Rect> open;  // Rects that end at the current tile row.
+    std::vector<Rect> runs;
+    for (uint32_t y = 0; y < height; y += kTileSize) {
+        const uint32_t tileHeight = std::min(kTileSize, height - y);
+        runs.clear();
+        for (uint32_t x = 0; x < width; x += kTileSize) {
+            const uint32_t tileWidth = std::min(kTileSize, width - x);
+            bool dirty = false;
+            for (uint32_t row = y; row < y + tileHeight && !dirty; ++row) {
+                const size_t offset = row * stride + size_t(x) * bpp;
+                dirty = memcmp(pixels + offset, previous + offset,
+                               size_t(tileWidth) * bpp) != 0;
+            }
+            if (!dirty) {
+                continue;
+            }
+            if (!runs.empty() && runs.back().x + runs.back().width == x) {
+                runs.back().width += tileWidth;
+            } else {
+                runs.push_back({x, y, tileWidth, tileHeight});
+            }
+        }
+
+        for (auto& run : runs) {
+            auto above = std::find_if(open.begin(), open.end(),
+                                      [&run](const Rect& r) {
+                                          return r.x == run.x &&
+                                                 r.width == run.width;
+                                      });
+            if (above != open.end()) {
+                run.y = above->y;
+                run.height += above->height;
+                open.erase(above);
+            }
+        }
+        // Whatever didn't continue into this row is complete.
+        rects->insert(rects->end(), open.begin(), open.end());
+        open.swap(runs);
+    }
+    rects->insert(rects->end(), open.begin(), open.end());
+
+    return rects->empty() ? Diff::Unchanged : Diff::Changed;
+}
+
+void ImageDeltaEncoder::addRegion(ImageDelta* delta,
+                                  const std::string& pixels,
+                                  const Rect& rect) {
+    auto region = delta->add_regions();
+    region->set_x(rect.x);
+    region->set_y(rect.y);
+    region->set_width(rect.width);
+    region->set_height(rect.height);
+
+    const size_t stride = size_t(mFormat.width()) * mBytesPerPixel;
+    const size_t rowSize = size_t(rect.width) * mBytesPerPixel;
+    mRegion.resize(rowSize * rect.height);
+    const size_t left = size_t(rect.x) * mBytesPerPixel;
+    for (uint32_t row = 0; row < rect.height; ++row) {
+        memcpy(&mRegion[row * rowSize], &pixels[(rect.y + row) * stride + left],
+               rowSize);
+    }
+
+    if (mCompression == ImageDelta::ZLIB) {
+        // A compressBound() sized buffer is always large enough.
+        uLongf size = compressBound(uLong(mRegion.size()));
+        auto out = region->mutable_pixels();
+        out->resize(size);
+        compress2(reinterpret_cast<Bytef*>(&(*out)[0]), &size,
+                  reinterpret_cast<const Bytef*>(mRegion.data()),
+                  uLong(mRegion.size()), Z_BEST_SPEED);
+        out->resize(size);
+    } else {
+        region->set_pixels(mRegion);
+    }
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
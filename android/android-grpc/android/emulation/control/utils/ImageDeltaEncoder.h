@@ -0,0 +1,101 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <cstddef>  // for size_t
+#include <cstdint>  // for uint32_t, uint8_t
+#include <string>   // for string
+#include <vector>   // for vector
+
+#include "emulator_controller.pb.h"  // for Image, ImageDelta_Compression
+
+namespace android {
+namespace emulation {
+namespace control {
+
+// An ImageDeltaEncoder turns a stream of full screenshots into the delta
+// stream described by ImageFormat.delta.
+//
+// The frames are split into kTileSize x kTileSize tiles that are compared
+// with the previous frame; changed tiles next to each other are merged into
+// a single region, so a typical update (a blinking cursor, a scrolling list)
+// becomes a handful of regions.
+//
+// Typical usage would be something like:
+//
+// ImageDeltaEncoder encoder(request->deltacompression());
+// while (...) {
+//    Image reply;
+//    getScreenshot(context, request, &reply);
+//    if (encoder.encode(&reply))
+//      writer->Write(reply);
+// }
+class ImageDeltaEncoder {
+public:
+    static constexpr uint32_t kTileSize = 64;
+
+    explicit ImageDeltaEncoder(ImageDelta_Compression compression);
+
+    // Replaces the pixels of |image|, a full frame as returned by
+    // getScreenshot, with an ImageDelta against the previous frame. Frames
+    // that can't be compared with the previous one (the first frame, or one
+    // with a different size, format or rotation, or a PNG) are left as they
+    // are.
+    //
+    // Returns false if nothing changed, i.e. there is no need to send
+    // |image| at all.
+    bool encode(Image* image);
+
+    // Like encode(), for images whose |pixels| don't travel in |image|
+    // (ImageTransport::MMAP): the ImageDelta only describes the regions that
+    // changed, and carries no pixels.
+    bool encodeRegions(Image* image, const uint8_t* pixels, size_t size);
+
+private:
+    struct Rect {
+        uint32_t x, y, width, height;
+    };
+
+    enum class Diff {
+        Incomparable,  // Not a raw image, can't be compared to anything.
+        Keyframe,      // The first one, or the layout has changed.
+        Unchanged,
+        Changed,
+    };
+
+    // Compares |pixels| to the previous frame, and stores the regions that
+    // changed in |rects|.
+    Diff diff(const ImageFormat& format,
+              const uint8_t* pixels,
+              size_t size,
+              std::vector<Rect>* rects);
+
+    void addRegion(ImageDelta* delta,
+                   const std::string& pixels,
+                   const Rect& rect);
+
+    const ImageDelta_Compression mCompression;
+
+    // The previous frame.
+    ImageFormat mFormat;
+    std::string mPixels;
+    uint32_t mBytesPerPixel = 0;
+
+    // Scratch space for a region's pixels.
+    std::string mRegion;
+};
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,226 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/emulation/control/utils/ImageDeltaEncoder.h"
+
+#include <gtest/gtest.h>  // for Test, EXPECT_EQ, ASSERT_TRUE
+#include <zlib.h>         // for uncompress
+#include <algorithm>      // for min
+#include <random>         // for default_random_engine
+#include <string>         // for string
+
+namespace android {
+namespace emulation {
+namespace control {
+
+static constexpr uint32_t kWidth = 300;
+static constexpr uint32_t kHeight = 200;
+static constexpr uint32_t kBpp = 4;
+
+static Image makeImage(const std::string& pixels,
+                       uint32_t width = kWidth,
+                       uint32_t height = kHeight) {
+    Image image;
+    auto format = image.mutable_format();
+    format->set_format(ImageFormat::RGBA8888);
+    format->set_width(width);
+    format->set_height(height);
+    image.set_image(pixels);
+    return image;
+}
+
+// An image whose pixels were sent through shared memory.
+static Image makeMmapImage() {
+    auto image = makeImage("");
+    image.clear_payload();
+    return image;
+}
+
+static void fill(std::string* pixels,
+                 uint32_t x,
+                 uint32_t y,
+                 uint32_t width,
+                 uint32_t height,
+                 char value) {
+    for (uint32_t row = y; row < y + height; ++row) {
+        for (uint32_t i = x * kBpp; i < (x + width) * kBpp; ++i) {
+            (*pixels)[row * kWidth * kBpp + i] = value;
+        }
+    }
+}
+
+// Applies |image| to |frame| the way a client would.
+static void applyImage(const Image& image, std::string* frame) {
+    if (image.payload_case() == Image::kImage) {
+        *frame = image.image();
+        return;
+    }
+    ASSERT_EQ(Image::kDelta, image.payload_case());
+    const auto stride = image.format().width() * kBpp;
+    for (const auto& region : image.delta().regions()) {
+        std::string pixels(region.width() * region.height() * kBpp, '\0');
+        if (image.delta().compression() == ImageDelta::ZLIB) {
+            uLongf size = pixels.size();
+            ASSERT_EQ(Z_OK,
+                      uncompress(reinterpret_cast<Bytef*>(&pixels[0]), &size,
+                                 reinterpret_cast<const Bytef*>(
+                                         region.pixels().data()),
+                                 region.pixels().size()));
+            ASSERT_EQ(pixels.size(), size);
+        } else {
+            pixels = region.pixels();
+        }
+        ASSERT_EQ(region.width() * region.height() * kBpp, pixels.size());
+        for (uint32_t row = 0; row < region.height(); ++row) {
+            frame->replace((region.y() + row) * stride + region.x() * kBpp,
+                           region.width() * kBpp,
+                           pixels.substr(row * region.width() * kBpp,
+                                         region.width() * kBpp));
+        }
+    }
+}
+
+TEST(ImageDeltaEncoder, FirstFrameIsFull) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    const std::string pixels(kWidth * kHeight * kBpp, 'a');
+    auto image = makeImage(pixels);
+    EXPECT_TRUE(encoder.encode(&image));
+    ASSERT_EQ(Image::kImage, image.payload_case());
+    EXPECT_EQ(pixels, image.image());
+}
+
+TEST(ImageDeltaEncoder, SameFrameIsSkipped) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    const std::string pixels(kWidth * kHeight * kBpp, 'a');
+    auto first = makeImage(pixels);
+    encoder.encode(&first);
+    auto second = makeImage(pixels);
+    EXPECT_FALSE(encoder.encode(&second));
+}
+
+TEST(ImageDeltaEncoder, SmallChangeIsOneTile) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    std::string pixels(kWidth * kHeight * kBpp, 'a');
+    auto first = makeImage(pixels);
+    encoder.encode(&first);
+
+    fill(&pixels, 70, 70, 10, 10, 'b');
+    auto second = makeImage(pixels);
+    ASSERT_TRUE(encoder.encode(&second));
+    ASSERT_EQ(Image::kDelta, second.payload_case());
+    ASSERT_EQ(1, second.delta().regions_size());
+    const auto& region = second.delta().regions(0);
+    EXPECT_EQ(64u, region.x());
+    EXPECT_EQ(64u, region.y());
+    EXPECT_EQ(64u, region.width());
+    EXPECT_EQ(64u, region.height());
+}
+
+TEST(ImageDeltaEncoder, MergesNeighbouringTiles) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    std::string pixels(kWidth * kHeight * kBpp, 'a');
+    auto first = makeImage(pixels);
+    encoder.encode(&first);
+
+    // Spans 3x2 tiles, including the partial ones at the right edge.
+    fill(&pixels, 150, 10, 150, 100, 'b');
+    auto second = makeImage(pixels);
+    ASSERT_TRUE(encoder.encode(&second));
+    ASSERT_EQ(1, second.delta().regions_size());
+    const auto& region = second.delta().regions(0);
+    EXPECT_EQ(128u, region.x());
+    EXPECT_EQ(0u, region.y());
+    EXPECT_EQ(kWidth - 128, region.width());
+    EXPECT_EQ(128u, region.height());
+}
+
+TEST(ImageDeltaEncoder, LayoutChangeIsFull) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    auto first = makeImage(std::string(kWidth * kHeight * kBpp, 'a'));
+    encoder.encode(&first);
+
+    auto rotated = makeImage(std::string(kWidth * kHeight * kBpp, 'a'),
+                             kHeight, kWidth);
+    EXPECT_TRUE(encoder.encode(&rotated));
+    EXPECT_EQ(Image::kImage, rotated.payload_case());
+}
+
+TEST(ImageDeltaEncoder, PngIsUntouched) {
+    ImageDeltaEncoder encoder(ImageDelta::NONE);
+    for (int i = 0; i < 2; ++i) {
+        auto image = makeImage("png data");
+        image.mutable_format()->set_format(ImageFormat::PNG);
+        EXPECT_TRUE(encoder.encode(&image));
+        EXPECT_EQ("png data", image.image());
+    }
+}
+
+TEST(ImageDeltaEncoder, RegionsOnly) {
+    ImageDeltaEncoder encoder(ImageDelta::ZLIB);
+    std::string pixels(kWidth * kHeight * kBpp, 'a');
+    auto first = makeMmapImage();
+    EXPECT_TRUE(encoder.encodeRegions(
+            &first, reinterpret_cast<const uint8_t*>(pixels.data()),
+            pixels.size()));
+    EXPECT_EQ(Image::PAYLOAD_NOT_SET, first.payload_case());
+
+    auto same = makeMmapImage();
+    EXPECT_FALSE(encoder.encodeRegions(
+            &same, reinterpret_cast<const uint8_t*>(pixels.data()),
+            pixels.size()));
+
+    fill(&pixels, 0, 190, 10, 10, 'b');
+    auto second = makeMmapImage();
+    ASSERT_TRUE(encoder.encodeRegions(
+            &second, reinterpret_cast<const uint8_t*>(pixels.data()),
+            pixels.size()));
+    ASSERT_EQ(Image::kDelta, second.payload_case());
+    ASSERT_EQ(1, second.delta().regions_size());
+    const auto& region = second.delta().regions(0);
+    EXPECT_EQ(0u, region.x());
+    EXPECT_EQ(128u, region.y());
+    EXPECT_EQ(64u, region.width());
+    EXPECT_EQ(kHeight - 128, region.height());
+    EXPECT_TRUE(region.pixels().empty());
+}
+
+TEST(ImageDeltaEncoder, RandomChangesRoundTrip) {
+    for (auto compression : {ImageDelta::NONE, ImageDelta::ZLIB}) {
+        ImageDeltaEncoder encoder(compression);
+        std::default_random_engine generator;
+        generator.seed(0);
+        std::uniform_int_distribution<uint32_t> xDistribution(0, kWidth - 1);
+        std::uniform_int_distribution<uint32_t> yDistribution(0, kHeight - 1);
+
+        std::string pixels(kWidth * kHeight * kBpp, 'a');
+        std::string client;
+        for (int i = 0; i < 50; ++i) {
+            for (int j = 0; j < i % 5; ++j) {
+                const auto x = xDistribution(generator);
+                const auto y = yDistribution(generator);
+                fill(&pixels, x, y, std::min(kWidth - x, 20u),
+                     std::min(kHeight - y, 30u), char('b' + i % 20));
+            }
+            auto image = makeImage(pixels);
+            if (encoder.encode(&image)) {
+                applyImage(image, &client);
+            }
+            ASSERT_EQ(pixels, client);
+        }
+    }
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,119 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "android/emulation/control/utils/SharedMemoryLibrary.h"
+
+#include <string.h>  // for memcpy
+#include <atomic>    // for atomic, atomic_thread_fence
+
+#ifndef _WIN32
+#include <sys/stat.h>  // for fstat
+#endif
+
+namespace android {
+namespace emulation {
+namespace control {
+
+using base::SharedMemory;
+
+constexpr size_t SharedMemoryLibrary::kMaxRegions;
+constexpr size_t SharedMemoryLibrary::kHeaderSize;
+
+using FrameWord = std::atomic<uint64_t>;
+static_assert(sizeof(FrameWord) == sizeof(uint64_t) &&
+                      FrameWord::is_always_lock_free,
+              "The header words are shared with other processes");
+
+// Makes sure the object behind |shm| really is |size| bytes: touching a
+// mapping beyond the end of its object raises SIGBUS on posix. The client
+// can shrink it at any time, so this is done on every borrow(). Windows
+// already refuses to map a view that's larger than the file mapping.
+static bool holds(SharedMemory* shm, size_t size) {
+#ifdef _WIN32
+    (void)shm;
+    (void)size;
+    return true;
+#else
+    struct stat sb;
+    return fstat(shm->getFd(), &sb) == 0 && size_t(sb.st_size) >= size;
+#endif
+}
+
+SharedMemoryLibrary::SharedMemoryPtr SharedMemoryLibrary::borrow(
+        const std::string& handle,
+        size_t size) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto it = mRegions.begin(); it != mRegions.end(); ++it) {
+        if (it->first != handle) {
+            continue;
+        }
+        if (it->second->size() >= size && holds(it->second.get(), size)) {
+            mRegions.splice(mRegions.begin(), mRegions, it);
+            return it->second;
+        }
+        // The client wants a larger mapping now, or resized the region;
+        // reopen it below.
+        mRegions.erase(it);
+        break;
+    }
+
+    auto shm = std::make_shared<SharedMemory>(handle, size);
+    if (shm->open(SharedMemory::AccessMode::READ_WRITE) != 0 ||
+        !holds(shm.get(), size)) {
+        return nullptr;
+    }
+
+    mRegions.emplace_front(handle, shm);
+    if (mRegions.size() > kMaxRegions) {
+        mRegions.pop_back();
+    }
+    return shm;
+}
+
+// static
+void SharedMemoryLibrary::writeFrame(SharedMemory* shm,
+                                     const void* frame,
+                                     size_t size) {
+    auto header = static_cast<uint8_t*>(shm->get());
+    auto seq = reinterpret_cast<FrameWord*>(header);
+    auto frameSize = reinterpret_cast<FrameWord*>(header + sizeof(uint64_t));
+
+    // Odd, even if a previous write never finished.
+    const uint64_t writing = seq->load(std::memory_order_relaxed) | 1;
+    seq->store(writing, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header + kHeaderSize, frame, size);
+    frameSize->store(size, std::memory_order_relaxed);
+    seq->store(writing + 1, std::memory_order_release);
+}
+
+// static
+const uint8_t* SharedMemoryLibrary::frame(const SharedMemory* shm) {
+    return static_cast<const uint8_t*>(shm->get()) + kHeaderSize;
+}
+
+// static
+bool SharedMemoryLibrary::isLocalPeer(const std::string& peer) {
+    static constexpr const char* kLocalPrefixes[] = {
+            "unix:", "ipv4:127.", "ipv6:[::1]:", "ipv6:[::ffff:127."};
+    for (const char* prefix : kLocalPrefixes) {
+        if (peer.compare(0, strlen(prefix), prefix) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,75 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint8_t
+#include <list>       // for list
+#include <memory>     // for shared_ptr
+#include <mutex>      // for mutex
+#include <string>     // for string
+#include <utility>    // for pair
+
+#include "android/base/memory/SharedMemory.h"  // for SharedMemory
+
+namespace android {
+namespace emulation {
+namespace control {
+
+// A SharedMemoryLibrary keeps the shared memory regions that clients hand
+// us (see ImageTransport) mapped, so a client that takes a screenshot every
+// few hundred milliseconds doesn't pay for an open and a mmap each time.
+//
+// Only the most recently used regions stay mapped. Borrowed regions remain
+// valid for as long as the borrower holds on to them, even if the library
+// drops them in the meantime.
+//
+// A region starts with a header of kHeaderSize bytes, followed by the last
+// frame written to it. The header holds two 64 bit words in host byte order:
+// a sequence number that is odd while a frame is being written, and the size
+// of the frame in bytes. A client copies the frame out between two reads of
+// an even sequence number, and tries again if the two differ.
+class SharedMemoryLibrary {
+public:
+    using SharedMemoryPtr = std::shared_ptr<base::SharedMemory>;
+
+    static constexpr size_t kMaxRegions = 16;
+    static constexpr size_t kHeaderSize = 16;
+
+    // Returns the region |handle|, mapped read/write, if it exists and holds
+    // at least |size| bytes. Returns null otherwise.
+    SharedMemoryPtr borrow(const std::string& handle, size_t size);
+
+    // Writes the |size| bytes of |frame| after the header of |shm|, which
+    // must hold at least kHeaderSize + |size| bytes.
+    static void writeFrame(base::SharedMemory* shm,
+                           const void* frame,
+                           size_t size);
+
+    // Returns the frame after the header of |shm|.
+    static const uint8_t* frame(const base::SharedMemory* shm);
+
+    // Returns true if |peer|, as given by grpc::ServerContext::peer(), is a
+    // client on this machine, the only ones that can share memory with us.
+    static bool isLocalPeer(const std::string& peer);
+
+private:
+    std::mutex mLock;
+    // Most recently used first.
+    std::list<std::pair<std::string, SharedMemoryPtr>> mRegions;
+};
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
@@ -0,0 +1,180 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "android/emulation/control/utils/SharedMemoryLibrary.h"
+
+#include <gtest/gtest.h>  // for Test, EXPECT_EQ, ASSERT_TRUE
+#include <string.h>       // for memcpy
+#include <algorithm>      // for all_of
+#include <atomic>         // for atomic
+#include <memory>         // for unique_ptr
+#include <string>         // for string, to_string
+#include <thread>         // for thread
+#include <vector>         // for vector
+
+#ifndef _WIN32
+#include <unistd.h>  // for ftruncate
+#endif
+
+namespace android {
+namespace emulation {
+namespace control {
+
+using base::SharedMemory;
+
+static constexpr size_t kSize = 4096;
+
+TEST(SharedMemoryLibrary, WritesAreVisibleToTheClient) {
+    SharedMemory client("tst_shm_library_1", kSize);
+    ASSERT_EQ(0, client.create(0600));
+
+    SharedMemoryLibrary library;
+    auto shm = library.borrow("tst_shm_library_1", kSize);
+    ASSERT_TRUE(shm);
+    memcpy(shm->get(), "pixels", 7);
+    EXPECT_STREQ("pixels", static_cast<const char*>(client.get()));
+
+    // The mapping is reused.
+    EXPECT_EQ(shm, library.borrow("tst_shm_library_1", kSize / 2));
+}
+
+TEST(SharedMemoryLibrary, RegionTooSmall) {
+    SharedMemory client("tst_shm_library_2", kSize);
+    ASSERT_EQ(0, client.create(0600));
+
+    SharedMemoryLibrary library;
+    EXPECT_FALSE(library.borrow("tst_shm_library_2", kSize * 2));
+    EXPECT_TRUE(library.borrow("tst_shm_library_2", kSize));
+}
+
+TEST(SharedMemoryLibrary, NoSuchRegion) {
+    SharedMemoryLibrary library;
+    EXPECT_FALSE(library.borrow("tst_shm_library_none", kSize));
+}
+
+TEST(SharedMemoryLibrary, KeepsRecentRegions) {
+    std::vector<std::unique_ptr<SharedMemory>> clients;
+    for (size_t i = 0; i <= SharedMemoryLibrary::kMaxRegions; ++i) {
+        clients.emplace_back(new SharedMemory(
+                "tst_shm_library_lru_" + std::to_string(i), kSize));
+        ASSERT_EQ(0, clients.back()->create(0600));
+    }
+
+    SharedMemoryLibrary library;
+    auto first = library.borrow("tst_shm_library_lru_0", kSize);
+    for (size_t i = 1; i <= SharedMemoryLibrary::kMaxRegions; ++i) {
+        ASSERT_TRUE(library.borrow("tst_shm_library_lru_" + std::to_string(i),
+                                   kSize));
+    }
+
+    // The first region was dropped, but is still valid for its borrower.
+    memcpy(first->get(), "still here", 11);
+    EXPECT_STREQ("still here", static_cast<const char*>(clients[0]->get()));
+    EXPECT_NE(first, library.borrow("tst_shm_library_lru_0", kSize));
+}
+
+#ifndef _WIN32
+TEST(SharedMemoryLibrary, RegionShrunkByTheClient) {
+    SharedMemory client("tst_shm_library_shrink", kSize);
+    ASSERT_EQ(0, client.create(0600));
+
+    SharedMemoryLibrary library;
+    ASSERT_TRUE(library.borrow("tst_shm_library_shrink", kSize));
+    ASSERT_EQ(0, ftruncate(client.getFd(), kSize / 2));
+    // Writing to the cached mapping would raise SIGBUS now.
+    EXPECT_FALSE(library.borrow("tst_shm_library_shrink", kSize));
+}
+#endif
+
+// Reads a frame the way a client does, returns false if it was torn.
+static bool readFrame(const SharedMemory& shm, std::vector<uint8_t>* frame) {
+    auto header = static_cast<const uint8_t*>(shm.get());
+    auto seq = reinterpret_cast<const std::atomic<uint64_t>*>(header);
+    auto size = reinterpret_cast<const std::atomic<uint64_t>*>(header + 8);
+
+    const uint64_t before = seq->load(std::memory_order_acquire);
+    if (before & 1) {
+        return false;
+    }
+    frame->resize(size->load(std::memory_order_relaxed));
+    memcpy(frame->data(), header + SharedMemoryLibrary::kHeaderSize,
+           frame->size());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return seq->load(std::memory_order_relaxed) == before;
+}
+
+TEST(SharedMemoryLibrary, WriteFrame) {
+    SharedMemory client("tst_shm_library_frame", kSize);
+    ASSERT_EQ(0, client.create(0600));
+    SharedMemoryLibrary library;
+    auto shm = library.borrow("tst_shm_library_frame", kSize);
+    ASSERT_TRUE(shm);
+
+    std::vector<uint8_t> frame;
+    ASSERT_TRUE(readFrame(client, &frame));
+    EXPECT_TRUE(frame.empty());
+
+    SharedMemoryLibrary::writeFrame(shm.get(), "pixels", 6);
+    ASSERT_TRUE(readFrame(client, &frame));
+    EXPECT_EQ("pixels", std::string(frame.begin(), frame.end()));
+    EXPECT_EQ(0, memcmp("pixels", SharedMemoryLibrary::frame(shm.get()), 6));
+}
+
+TEST(SharedMemoryLibrary, NoTornFrames) {
+    SharedMemory client("tst_shm_library_torn", kSize);
+    ASSERT_EQ(0, client.create(0600));
+    SharedMemoryLibrary library;
+    auto shm = library.borrow("tst_shm_library_torn", kSize);
+    ASSERT_TRUE(shm);
+
+    const size_t frameSize = kSize - SharedMemoryLibrary::kHeaderSize;
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        std::vector<uint8_t> frame(frameSize);
+        for (int i = 0; i < 20000; ++i) {
+            std::fill(frame.begin(), frame.end(), uint8_t(i));
+            SharedMemoryLibrary::writeFrame(shm.get(), frame.data(),
+                                            frame.size());
+        }
+        done = true;
+    });
+
+    std::vector<uint8_t> frame;
+    while (!done) {
+        if (!readFrame(client, &frame) || frame.empty()) {
+            continue;
+        }
+        ASSERT_EQ(frameSize, frame.size());
+        ASSERT_TRUE(std::all_of(frame.begin(), frame.end(),
+                                [&frame](uint8_t b) { return b == frame[0]; }));
+    }
+    writer.join();
+    ASSERT_TRUE(readFrame(client, &frame));
+    EXPECT_EQ(uint8_t(19999), frame[0]);
+}
+
+TEST(SharedMemoryLibrary, IsLocalPeer) {
+    EXPECT_TRUE(SharedMemoryLibrary::isLocalPeer("ipv4:127.0.0.1:5432"));
+    EXPECT_TRUE(SharedMemoryLibrary::isLocalPeer("ipv6:[::1]:5432"));
+    EXPECT_TRUE(
+            SharedMemoryLibrary::isLocalPeer("ipv6:[::ffff:127.0.0.1]:5432"));
+    EXPECT_TRUE(SharedMemoryLibrary::isLocalPeer("unix:/tmp/emulator.sock"));
+    EXPECT_FALSE(SharedMemoryLibrary::isLocalPeer("ipv4:192.168.1.10:5432"));
+    EXPECT_FALSE(SharedMemoryLibrary::isLocalPeer("ipv6:[::10]:5432"));
+    EXPECT_FALSE(SharedMemoryLibrary::isLocalPeer(""));
+}
+
+}  // namespace control
+}  // namespace emulation
+}  // namespace android
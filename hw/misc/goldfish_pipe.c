@@ -31,6 +31,7 @@
 #include "hw/misc/goldfish_pipe.h"
 
 #include "qemu/osdep.h"
+#include "exec/address-spaces.h"
 #include "hw/hw.h"
 #include "hw/sysbus.h"
 
@@ -319,6 +320,33 @@ typedef struct OpenCommandParams {
     uint32_t rw_params_max_count;
 } OpenCommandParams;
 
+// Most buffers a single read/write/call command can carry: the |rw_params|
+// arrays fit into the command buffer page.
+#define PIPE_MAX_RW_BUFFERS \
+    (COMMAND_BUFFER_SIZE / (sizeof(uint64_t) + sizeof(uint32_t)))
+
+// A range of guest RAM that is contiguous in the host memory as well.
+typedef struct GuestRamRange {
+    hwaddr gpa;
+    uint64_t size;
+    uint8_t* hva;
+    MemoryRegion* mr;
+    hwaddr offset_within_region;
+} GuestRamRange;
+
+// Host buffers for one direction of a read/write/call command.
+typedef struct PipeTransfer {
+    GoldfishPipeBuffer buffers[PIPE_MAX_RW_BUFFERS];
+    unsigned buffers_count;
+    // Whether the last buffer came from the RAM cache, and so may be
+    // extended with the next one.
+    bool last_cached;
+    // Buffers that had to go through map_guest_buffer().
+    GoldfishPipeBuffer mapped[PIPE_MAX_RW_BUFFERS];
+    unsigned mapped_count;
+    int is_write;
+} PipeTransfer;
+
 struct PipeDevice {
     GoldfishPipeState* ps;  // backlink to instance state
     int device_version;    // host device verion
@@ -353,6 +381,18 @@ struct PipeDevice {
     // Cache of the pipes by channel for a faster lookup.
     GHashTable* pipes_by_channel;
 
+    // Guest RAM layout, rebuilt on each memory topology change, so that
+    // transfers don't need to map and unmap their buffers. Sorted by |gpa|;
+    // not valid while a topology change is in progress.
+    MemoryListener ram_listener;
+    GArray* ram_ranges;
+    unsigned ram_last_hit;
+    bool ram_ranges_valid;
+
+    // Scratch space for the command being processed.
+    PipeTransfer send_transfer;
+    PipeTransfer recv_transfer;
+
     // i/o registers
     uint64_t address;
     uint32_t size;
@@ -594,6 +634,161 @@ static void unmap_command_buffer(void* buffer) {
                               COMMAND_BUFFER_SIZE);
 }
 
+/* Guest RAM cache.
+ * The memory API replays the whole flat view to the listener on each
+ * topology change: begin(), then region_add()/region_nop() for every
+ * section in address order, then commit(). All of it happens under the BQL,
+ * as do the pipe commands that use the cache.
+ */
+static void guest_ram_begin(MemoryListener* listener) {
+    PipeDevice* dev = container_of(listener, PipeDevice, ram_listener);
+    g_array_set_size(dev->ram_ranges, 0);
+    dev->ram_last_hit = 0;
+    dev->ram_ranges_valid = false;
+}
+
+static void guest_ram_region_add(MemoryListener* listener,
+                                 MemoryRegionSection* section) {
+    PipeDevice* dev = container_of(listener, PipeDevice, ram_listener);
+    MemoryRegion* mr = section->mr;
+    if (!memory_region_is_ram(mr) || memory_region_is_ram_device(mr) ||
+        memory_region_is_rom(mr) || section->readonly) {
+        return;
+    }
+
+    GuestRamRange range = {
+        .gpa = section->offset_within_address_space,
+        .size = int128_get64(section->size),
+        .hva = (uint8_t*)memory_region_get_ram_ptr(mr) +
+               section->offset_within_region,
+        .mr = mr,
+        .offset_within_region = section->offset_within_region,
+    };
+    if (dev->ram_ranges->len) {
+        GuestRamRange* last = &g_array_index(
+                dev->ram_ranges, GuestRamRange, dev->ram_ranges->len - 1);
+        if (last->mr == mr && last->gpa + last->size == range.gpa &&
+            last->hva + last->size == range.hva) {
+            last->size += range.size;
+            return;
+        }
+    }
+    g_array_append_val(dev->ram_ranges, range);
+}
+
+static void guest_ram_commit(MemoryListener* listener) {
+    PipeDevice* dev = container_of(listener, PipeDevice, ram_listener);
+    dev->ram_ranges_valid = true;
+}
+
+/* Returns the cached RAM range that holds all of [gpa, gpa + size), or NULL.
+ * Transfers tend to hit the same range over and over, so that one is checked
+ * before the search.
+ */
+static const GuestRamRange* guest_ram_find(PipeDevice* dev,
+                                           hwaddr gpa,
+                                           uint64_t size) {
+    if (!dev->ram_ranges_valid || !dev->ram_ranges->len) {
+        return NULL;
+    }
+    const GuestRamRange* ranges = (const GuestRamRange*)dev->ram_ranges->data;
+    const GuestRamRange* range = &ranges[dev->ram_last_hit];
+    if (gpa < range->gpa || gpa - range->gpa >= range->size) {
+        unsigned lo = 0, hi = dev->ram_ranges->len;
+        while (lo < hi) {
+            const unsigned mid = lo + (hi - lo) / 2;
+            if (gpa < ranges[mid].gpa) {
+                hi = mid;
+            } else if (gpa - ranges[mid].gpa >= ranges[mid].size) {
+                lo = mid + 1;
+            } else {
+                lo = mid;
+                break;
+            }
+        }
+        if (lo >= dev->ram_ranges->len || gpa < ranges[lo].gpa) {
+            return NULL;
+        }
+        dev->ram_last_hit = lo;
+        range = &ranges[lo];
+    }
+    if (size > range->size - (gpa - range->gpa)) {
+        return NULL;
+    }
+    return range;
+}
+
+static void pipe_transfer_init(PipeTransfer* t, int is_write) {
+    t->buffers_count = 0;
+    t->last_cached = false;
+    t->mapped_count = 0;
+    t->is_write = is_write;
+}
+
+/* Adds the guest buffer [gpa, gpa + size) to |t|, merging it into the
+ * previous one if they are next to each other in the host memory, so that
+ * the pipe service gets fewer and larger buffers. Returns false if the
+ * buffer is not in guest RAM.
+ */
+static bool pipe_transfer_add(PipeDevice* dev,
+                              PipeTransfer* t,
+                              hwaddr gpa,
+                              uint32_t size) {
+    assert(t->buffers_count < PIPE_MAX_RW_BUFFERS);
+    const GuestRamRange* range = guest_ram_find(dev, gpa, size);
+    if (range && t->is_write) {
+        // cpu_physical_memory_unmap() invalidates the translated code in
+        // pages it writes to; with TCG, take that path instead.
+        const uint8_t dirty_log_mask =
+                memory_region_get_dirty_log_mask(range->mr);
+        if (dirty_log_mask & (1 << DIRTY_MEMORY_CODE)) {
+            range = NULL;
+        } else if (dirty_log_mask) {
+            // Before the write, but still under the same BQL hold, so no
+            // dirty bitmap sync can come in between.
+            memory_region_set_dirty(
+                    range->mr,
+                    range->offset_within_region + (gpa - range->gpa), size);
+        }
+    }
+
+    if (range) {
+        uint8_t* const hva = range->hva + (gpa - range->gpa);
+        if (t->last_cached) {
+            GoldfishPipeBuffer* last = &t->buffers[t->buffers_count - 1];
+            if ((uint8_t*)last->data + last->size == hva) {
+                last->size += size;
+                return true;
+            }
+        }
+        t->buffers[t->buffers_count].data = hva;
+        t->buffers[t->buffers_count].size = size;
+        ++t->buffers_count;
+        t->last_cached = true;
+        return true;
+    }
+
+    void* const data = map_guest_buffer(gpa, size, t->is_write);
+    if (!data) {
+        return false;
+    }
+    t->buffers[t->buffers_count].data = data;
+    t->buffers[t->buffers_count].size = size;
+    ++t->buffers_count;
+    t->mapped[t->mapped_count++] = t->buffers[t->buffers_count - 1];
+    t->last_cached = false;
+    return true;
+}
+
+static void pipe_transfer_finish(PipeTransfer* t) {
+    unsigned i;
+    for (i = 0; i < t->mapped_count; ++i) {
+        cpu_physical_memory_unmap(t->mapped[i].data, t->mapped[i].size,
+                                  t->is_write, t->mapped[i].size);
+    }
+    t->mapped_count = 0;
+}
+
 static void close_all_pipes_v1(PipeDevice* dev, GoldfishPipeCloseReason reason) {
     HwPipe* pipe = dev->pipes_list;
     while (pipe) {
@@ -714,38 +909,36 @@ static void pipeDevice_doCommand_v1(PipeDevice* dev, uint32_t command) {
 
     case PIPE_CMD_READ: {
         /* Translate guest physical address into emulator memory. */
-        GoldfishPipeBuffer buffer;
-        buffer.data = map_guest_buffer(dev->address, dev->size, /*is_write*/1);
-        if (!buffer.data) {
+        PipeTransfer* const transfer = &dev->recv_transfer;
+        pipe_transfer_init(transfer, /*is_write*/1);
+        if (!pipe_transfer_add(dev, transfer, dev->address, dev->size)) {
             dev->status = GOLDFISH_PIPE_ERROR_INVAL;
             break;
         }
-        buffer.size = dev->size;
-        dev->status = service_ops->guest_recv(pipe->host_pipe, &buffer, 1);
+        dev->status = service_ops->guest_recv(pipe->host_pipe,
+                                              transfer->buffers, 1);
         DD("%s: CMD_READ channel=0x%llx address=0x%16llx size=%d > status=%d",
            __func__, (unsigned long long)dev->channel,
            (unsigned long long)dev->address,
            dev->size, dev->status);
-        cpu_physical_memory_unmap(buffer.data, dev->size,
-                                  /*is_write*/1, dev->size);
+        pipe_transfer_finish(transfer);
         break;
     }
 
     case PIPE_CMD_WRITE: {
         /* Translate guest physical address into emulator memory. */
-        GoldfishPipeBuffer  buffer;
-        buffer.data = map_guest_buffer(dev->address, dev->size, /*is_write*/0);
-        if (!buffer.data) {
+        PipeTransfer* const transfer = &dev->send_transfer;
+        pipe_transfer_init(transfer, /*is_write*/0);
+        if (!pipe_transfer_add(dev, transfer, dev->address, dev->size)) {
             dev->status = GOLDFISH_PIPE_ERROR_INVAL;
             break;
         }
-        buffer.size = dev->size;
-        dev->status = service_ops->guest_send(pipe->host_pipe, &buffer, 1);
+        dev->status = service_ops->guest_send(pipe->host_pipe,
+                                              transfer->buffers, 1);
         DD("%s: CMD_WRITE_BUFFER channel=0x%llx address=0x%16llx size=%d > "
            "status=%d", __func__, (unsigned long long)dev->channel,
            (unsigned long long)dev->address, dev->size, dev->status);
-        cpu_physical_memory_unmap(buffer.data, dev->size,
-                                  /*is_write*/0, dev->size);
+        pipe_transfer_finish(transfer);
         break;
     }
 
@@ -880,130 +1073,52 @@ static void pipeDevice_doCommand_v2(HwPipe* pipe) {
             // us with no data?
             assert(buffers_count);
 
-            // We know that the |rw_params| fit into single page as of now, so
-            // we're free to estimate the maximum size this way.
             uint64_t* const rwPtrs = hwpipe_get_command_rw_ptrs(pipe);
             uint32_t* const rwSizes = hwpipe_get_command_rw_sizes(pipe);
-            assert(buffers_count <=
-                   COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes)));
-            GoldfishPipeBuffer buffers[
-                    COMMAND_BUFFER_SIZE / (sizeof(*rwPtrs) + sizeof(*rwSizes))];
-
-#if defined(TARGET_MIPS)
-// MIPS Ranchu memory layout has device IO space hole between
-// 0x1f000000 - 0x20000000 and has two RAM regions for
-// each of them, below 0x1f000000 and after 0x20000000.
-// Tweak RAM_SPLIT_BOUNDARY accordingly to use interpolated
-// guest buffer mappings optimization on MIPS.
-#define RAM_SPLIT_BOUNDARY    0x20000000
-#elif defined(TARGET_I386)
-// If given memory around or bigger then 4G, emulator will split physical
-// memory to two parts, one is mapped below 4g, another one is mapped over
-// 4G. This is for reserving address space for PCI devices. So actually we
-// can't always map guest physical address to host virtual address with only
-// one offset. We have to use two offsets: one for memory below 4G and one
-// for memory over 4G.
-#define RAM_SPLIT_BOUNDARY    0xFFFFFFFF
-#elif defined(TARGET_ARM)
-// ARM Memory layout:
-// 0..128MB is space for a flash device bootrom code such as UEFI.
-// 128MB..256MB is used for miscellaneous device I/O.
-// 256MB..1GB is reserved for possible future PCI support (ie where the
-// PCI memory window will go if we add a PCI host controller).
-// 1GB and up is RAM (which may happily spill over into the
-// high memory region beyond 4GB).
-// For ARM this means, there will always be one single RAM region
-// (no splitting) so all buffer address interpolation will be done
-// using diffFromGuestPostSplit.
-#define RAM_SPLIT_BOUNDARY    0x40000000
-#else
-#error Unsupported architecture!
-#endif
-            // All passed buffers are allocated in the same guest process, so
-            // know they all have the same offset from the host address if they
-            // are in the same RAM region: below RAM_SPLIT_BOUNDARY or after.
-            // Use '1' as invalid value since real offsets always are aligned
-            // to page size.
-            ptrdiff_t diffFromGuestPreSplit = 1, diffFromGuestPostSplit = 1;
-            int count = 0;
-            int unmapIndex[2];
-            unsigned i;
-            for (i = 0; i < buffers_count; ++i) {
-                if ((rwPtrs[i] <= RAM_SPLIT_BOUNDARY && diffFromGuestPreSplit == 1) ||
-                    (rwPtrs[i] > RAM_SPLIT_BOUNDARY && diffFromGuestPostSplit == 1)) {
-                    buffers[i].data =
-                        map_guest_buffer(rwPtrs[i], rwSizes[i], willModifyData);
-                    if (rwPtrs[i] <= RAM_SPLIT_BOUNDARY) {
-                        diffFromGuestPreSplit =
-                            (intptr_t)buffers[i].data - (intptr_t)rwPtrs[i];
-                    } else {
-                        diffFromGuestPostSplit =
-                            (intptr_t)buffers[i].data - (intptr_t)rwPtrs[i];
-                    }
-                    unmapIndex[count++] = i;
-                } else {
-                    if (rwPtrs[i] <= RAM_SPLIT_BOUNDARY) {
-                        buffers[i].data =
-                            (void*)(intptr_t)(rwPtrs[i] + diffFromGuestPreSplit);
-                    } else {
-                        buffers[i].data =
-                            (void*)(intptr_t)(rwPtrs[i] + diffFromGuestPostSplit);
-                    }
+            assert(buffers_count <= PIPE_MAX_RW_BUFFERS);
+
+            // CALL commands perform send/recv using a single command.
+            // |read_index| is the first buffer used for receiving.
+            unsigned read_index = willModifyData ? 0 : buffers_count;
+            if (isCall) {
+                read_index = hwpipe_get_command_rw_read_index(pipe);
+                if (read_index > buffers_count) {
+                    read_index = buffers_count;
                 }
-                buffers[i].size = rwSizes[i];
-                assert(buffers[i].data != NULL);
-                assert(buffers[i].size != 0);
             }
 
-#ifndef NDEBUG
-            // Verify that our interpolated mappings are actually correct
-            for (i = 1; i < buffers_count; ++i) {
-                void* const mapping = map_guest_buffer(rwPtrs[i], rwSizes[i],
-                                                       willModifyData);
-                assert(mapping == buffers[i].data);
-                cpu_physical_memory_unmap(mapping, rwSizes[i],
-                                          willModifyData, rwSizes[i]);
+            PipeTransfer* const send = &dev->send_transfer;
+            PipeTransfer* const recv = &dev->recv_transfer;
+            pipe_transfer_init(send, /*is_write*/0);
+            pipe_transfer_init(recv, /*is_write*/1);
+            bool mapped = true;
+            unsigned i;
+            for (i = 0; i < buffers_count && mapped; ++i) {
+                assert(rwSizes[i] != 0);
+                mapped = pipe_transfer_add(dev, i < read_index ? send : recv,
+                                           rwPtrs[i], rwSizes[i]);
             }
-#endif
-
-            GoldfishPipeBuffer* send_buffers = NULL;
-            unsigned send_buffers_count = 0;
-            GoldfishPipeBuffer* recv_buffers = NULL;
-            unsigned recv_buffers_count = 0;
-
-            if (willModifyData) {
-                // CALL commands perform send/recv using a single command.
-                // |read_index| is the first buffer used for receiving.
-                if (isCall) {
-                    uint32_t read_index = hwpipe_get_command_rw_read_index(pipe);
-                    assert(read_index <= buffers_count);
-                    send_buffers = buffers;
-                    send_buffers_count = read_index;
-                    recv_buffers = &buffers[read_index];
-                    recv_buffers_count = buffers_count - read_index;
-                } else {
-                    recv_buffers = buffers;
-                    recv_buffers_count = buffers_count;
-                }
-            } else {
-                send_buffers = buffers;
-                send_buffers_count = buffers_count;
+            if (!mapped) {
+                pipe_transfer_finish(send);
+                pipe_transfer_finish(recv);
+                pipe->command_buffer->status = GOLDFISH_PIPE_ERROR_INVAL;
+                break;
             }
 
             int32_t status = 0;
             int32_t consumed_size = 0;
-            if (send_buffers_count) {
+            if (send->buffers_count) {
                 status = service_ops->guest_send(pipe->host_pipe,
-                                                 send_buffers,
-                                                 send_buffers_count);
+                                                 send->buffers,
+                                                 send->buffers_count);
                 if (status > 0) {
                     consumed_size += status;
                 }
             }
-            if (status >= 0 && recv_buffers_count) {
+            if (status >= 0 && recv->buffers_count) {
                 status = service_ops->guest_recv(pipe->host_pipe,
-                                                 recv_buffers,
-                                                 recv_buffers_count);
+                                                 recv->buffers,
+                                                 recv->buffers_count);
                 if (status > 0) {
                     consumed_size += status;
                 }
@@ -1024,11 +1139,8 @@ static void pipeDevice_doCommand_v2(HwPipe* pipe) {
                (willModifyData ? (isCall ? "CALL" : "READ") : "WRITE"),
                (int)pipe->id, (int)buffers_count, pipe->command_buffer->status);
 
-            for (i = 0; i < count; ++i) {
-                const int j = unmapIndex[i];
-                cpu_physical_memory_unmap(buffers[j].data, buffers[j].size,
-                                          willModifyData, buffers[j].size);
-            }
+            pipe_transfer_finish(send);
+            pipe_transfer_finish(recv);
             break;
         }
 
@@ -1808,6 +1920,15 @@ static void goldfish_pipe_realize(DeviceState* dev, Error** errp) {
         APANIC("%s: failed to initialize pipes hash\n", __func__);
     }
 
+    s->dev->ram_ranges = g_array_new(FALSE, FALSE, sizeof(GuestRamRange));
+    s->dev->ram_listener = (MemoryListener){
+        .begin = guest_ram_begin,
+        .region_add = guest_ram_region_add,
+        .region_nop = guest_ram_region_add,
+        .commit = guest_ram_commit,
+    };
+    memory_listener_register(&s->dev->ram_listener, &address_space_memory);
+
     memory_region_init_io(&s->iomem, OBJECT(s), &goldfish_pipe_iomem_ops, s,
                           "goldfish_pipe", 0x2000 /*TODO: ?how big?*/);
     sysbus_init_mmio(sbdev, &s->iomem);